@@ -17,9 +17,9 @@
 #include <LoRa.h>
 
 
-const String Sketch_Ver = "single_pkt_fwd_v002";
+const String Sketch_Ver = "single_pkt_fwd_v004";
 
-static float freq, txfreq;
+static uint32_t freq, txfreq;  /* Hz, as configured: a float is 64 Hz apart near 868 MHz */
 static int SF, CR, txsf;
 static long BW, preLen;
 static long old_time = millis();
@@ -33,10 +33,21 @@ void receivepacket();// receive packet
 void sendpacket(); //send join accept payload
 void emitpacket(); //send ddata down
 void writeVersion();
+void writeRecord(int size, unsigned long rxtime);
+void writeTxReport(int ok, const char *name);
 
 static char packet[256];
 static char message[256];
 
+/* binary uplink record header, see lg01-pkt-fwd/src/mcurec.h */
+#define UPREC_HDR_LEN 28
+static uint8_t uprec[UPREC_HDR_LEN];
+
+/* transmit report, see lg01-pkt-fwd/src/mcurec.h */
+#define TXREP_LEN 32
+#define TXREP_NAME_LEN 20
+static uint8_t txrep[TXREP_LEN];
+
 static int send_mode = 0; /* define mode default receive mode */
 
 //Set Debug = 1 to enable Console Output;
@@ -127,7 +138,7 @@ void getRadioConf() {
     packet[j] = p.read();
     j++;
   }
-  freq = atof(packet);
+  freq = strtoul(packet, NULL, 10);
 
   //Read txfre from uci ####################
   j = 0;
@@ -140,7 +151,7 @@ void getRadioConf() {
     packet[j] = p.read();
     j++;
   }
-  txfreq = atof(packet);
+  txfreq = strtoul(packet, NULL, 10);
 
   //Read Spread Factor ####################
   j = 0;
@@ -245,6 +256,7 @@ void receivepacket() {
     packetSize = LoRa.parsePacket();
 
     if (packetSize) {   // Received a packet
+      unsigned long rxtime = micros();
       if ( debug > 0 ) {
         Console.println();
         Console.print(F("Get Packet:"));
@@ -275,18 +287,7 @@ void receivepacket() {
 
       if ( debug > 0 ) Console.println("");
 
-      /*cfgdata file will be save rssi and packetsize*/
-      File cfgFile = FileSystem.open("/var/iot/cfgdata", FILE_WRITE);
-      cfgFile.print("rssi=");
-      cfgFile.println(LoRa.packetRssi());
-      cfgFile.print("size=");
-      cfgFile.println(packetSize);
-      cfgFile.close();
-
-      File dataFile = FileSystem.open("/var/iot/data", FILE_WRITE);
-      for (int j = 0; j < i; j++)
-        dataFile.print(message[j]);
-      dataFile.close();
+      writeRecord(i, rxtime);
 
       if ((int)message[0] == 0) {      /* Join Request */
         send_mode = 1;  /* change the mode */
@@ -331,6 +332,7 @@ void sendpacket()
 {
 
   int i = 0;
+  int ok = 0;
 
   old_time = millis();
 
@@ -393,7 +395,8 @@ void sendpacket()
 
       LoRa.beginPacket();
       LoRa.print(packet);
-      LoRa.endPacket();
+      if (LoRa.endPacket())
+        ok = 1;
 
       delay(1);
 
@@ -405,6 +408,7 @@ void sendpacket()
 
     if (debug > 0) Console.println(F("[transmit] END"));
 
+    writeTxReport(ok, "dldata");
     break;
   }
 
@@ -421,6 +425,7 @@ void sendpacket()
 void emitpacket()
 {
   int i = 0, j = 0;
+  int ok = 0;
 
   File dwFile = FileSystem.open(dwdata); /* dldata file save the downstream data */
 
@@ -452,7 +457,8 @@ void emitpacket()
   for (j = 0; j < 2; j++) {     // send data down two times every frequency
     LoRa.beginPacket();
     LoRa.write(packet, i);
-    LoRa.endPacket();
+    if (LoRa.endPacket())
+      ok = 1;
     delay(500);
 
     LoRa.setFrequency(txfreq);
@@ -461,7 +467,8 @@ void emitpacket()
 
     LoRa.beginPacket();
     LoRa.write(packet, i);
-    LoRa.endPacket();
+    if (LoRa.endPacket())
+      ok = 1;
 
     delay(200);
 
@@ -471,6 +478,8 @@ void emitpacket()
   }
 
   if (debug > 0) Console.println(F("[transmit] Data Down END"));
+
+  writeTxReport(ok, dwdata + sizeof("/var/iot/") - 1);
   
   Process rm;
   rm.begin("rm");
@@ -488,3 +497,55 @@ void writeVersion()
   fw_version.print(Sketch_Ver);
   fw_version.close();
 }
+
+static void putLe16(uint8_t *b, uint16_t v)
+{
+  b[0] = v & 0xFF;
+  b[1] = v >> 8;
+}
+
+static void putLe32(uint8_t *b, uint32_t v)
+{
+  putLe16(b, v & 0xFFFF);
+  putLe16(b + 2, v >> 16);
+}
+
+//Hand a received packet over to lg01_pkt_fwd: metadata header + payload
+void writeRecord(int size, unsigned long rxtime)
+{
+  memset(uprec, 0, sizeof(uprec));
+  uprec[0] = 'L';
+  uprec[1] = 'R';
+  uprec[2] = 1;                 /* version */
+  uprec[3] = UPREC_HDR_LEN;     /* payload offset */
+  putLe16(uprec + 4, size);
+  uprec[6] = 0x10;              /* CRC OK, the LoRa library drops bad frames */
+  uprec[7] = SF;
+  putLe32(uprec + 8, freq);
+  putLe32(uprec + 12, (uint32_t)BW);
+  uprec[16] = CR;
+  putLe16(uprec + 18, (int16_t)LoRa.packetRssi());
+  putLe16(uprec + 20, (int16_t)(LoRa.packetSnr() * 10));
+  putLe32(uprec + 24, rxtime);
+
+  File recFile = FileSystem.open("/var/iot/uprec", FILE_WRITE);
+  recFile.write(uprec, UPREC_HDR_LEN);
+  recFile.write((uint8_t *)message, size);
+  recFile.close();
+}
+
+//Tell lg01_pkt_fwd a downlink went on air, it answers the server with a TX_ACK
+void writeTxReport(int ok, const char *name)
+{
+  memset(txrep, 0, sizeof(txrep));
+  txrep[0] = 'L';
+  txrep[1] = 'T';
+  txrep[2] = 1;                 /* version */
+  txrep[3] = ok ? 0 : 1;        /* result */
+  putLe32(txrep + 8, micros());
+  strncpy((char *)txrep + 12, name, TXREP_NAME_LEN);
+
+  File repFile = FileSystem.open("/var/iot/txack", FILE_APPEND);
+  repFile.write(txrep, TXREP_LEN);
+  repFile.close();
+}
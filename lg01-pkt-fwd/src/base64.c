@@ -38,58 +38,59 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MODULE-WIDE VARIABLES ---------------------------------------- */
 
-static char code_62 = '+';	/* RFC 1421 standard character for code 62 */
-static char code_63 = '/';	/* RFC 1421 standard character for code 63 */
 static char code_pad = '=';	/* RFC 1421 padding character if padding */
 
+/* RFC 1421 alphabet, '+' for code 62 and '/' for code 63 */
+static const char code_table[64] = {
+	'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P',
+	'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f',
+	'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v',
+	'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/'
+};
+
+/* reverse of code_table, 0xFF for characters that are not base64 */
+static const uint8_t char_table[256] = {
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,  62,0xFF,0xFF,0xFF,  63,
+	  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
 /**
-@brief Convert a code in the range 0-63 to an ASCII character
+@brief Decode 2 to 4 characters into a 24-bit group, left aligned
+@return the group, or 0xFFFFFFFF if one character is not base64
 */
-char code_to_char(uint8_t x);
-
-/**
-@brief Convert an ASCII character to a code in the range 0-63
-*/
-uint8_t char_to_code(char x);
+static uint32_t decode_group(const char * in, int nb_chars);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
-char code_to_char(uint8_t x) {
-	if (x <= 25) {
-		return 'A' + x;
-	} else if ((x >= 26) && (x <= 51)) {
-		return 'a' + (x-26);
-	} else if ((x >= 52) && (x <= 61)) {
-		return '0' + (x-52);
-	} else if (x == 62) {
-		return code_62;
-	} else if (x == 63) {
-		return code_63;
-	} else {
-		DEBUG("ERROR: %i IS OUT OF RANGE 0-63 FOR BASE64 ENCODING\n", x);
-		exit(EXIT_FAILURE);
-	} //TODO: improve error management
-}
-
-uint8_t char_to_code(char x) {
-	if ((x >= 'A') && (x <= 'Z')) {
-		return (uint8_t)x - (uint8_t)'A';
-	} else if ((x >= 'a') && (x <= 'z')) {
-		return (uint8_t)x - (uint8_t)'a' + 26;
-	} else if ((x >= '0') && (x <= '9')) {
-		return (uint8_t)x - (uint8_t)'0' + 52;
-	} else if (x == code_62) {
-		return 62;
-	} else if (x == code_63) {
-		return 63;
-	} else {
-		DEBUG("ERROR: %c (0x%x) IS INVALID CHARACTER FOR BASE64 DECODING\n", x, x);
-		exit(EXIT_FAILURE);
-	} //TODO: improve error management
+static uint32_t decode_group(const char * in, int nb_chars) {
+	uint32_t b = 0;
+	uint8_t c, bad = 0;
+	int i;
+	
+	for (i = 0; i < nb_chars; ++i) {
+		c = char_table[(uint8_t)in[i]];
+		bad |= c;
+		b |= (uint32_t)(c & 0x3F) << (18 - 6*i);
+	}
+	return (bad & 0x80) ? 0xFFFFFFFF : b;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -116,19 +117,7 @@ int bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len) {
 	/* calculate the number of base64 'blocks' */
 	full_blocks = size / 3;
 	last_bytes = size % 3;
-	switch (last_bytes) {
-		case 0: /* no byte left to encode */
-			last_chars = 0;
-			break;
-		case 1: /* 1 byte left to encode -> +2 chars */
-			last_chars = 2;
-			break;
-		case 2: /* 2 bytes left to encode -> +3 chars */
-			last_chars = 3;
-			break;
-		default:
-			CRIT("switch default that should not be possible");
-	}
+	last_chars = (last_bytes == 0) ? 0 : (last_bytes + 1); /* 1 byte -> 2 chars, 2 bytes -> 3 chars */
 	
 	/* check if output buffer is big enough */
 	result_len = (4*full_blocks) + last_chars;
@@ -137,34 +126,31 @@ int bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len) {
 		return -1;
 	}
 	
-	/* process all the full blocks */
+	/* process all the full blocks, one 24-bit group per table lookup round */
 	for (i=0; i < full_blocks; ++i) {
-		b  = (0xFF & in[3*i]    ) << 16;
-		b |= (0xFF & in[3*i + 1]) << 8;
-		b |=  0xFF & in[3*i + 2];
-		out[4*i + 0] = code_to_char((b >> 18) & 0x3F);
-		out[4*i + 1] = code_to_char((b >> 12) & 0x3F);
-		out[4*i + 2] = code_to_char((b >> 6 ) & 0x3F);
-		out[4*i + 3] = code_to_char( b        & 0x3F);
+		b = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+		out[0] = code_table[ b >> 18        ];
+		out[1] = code_table[(b >> 12) & 0x3F];
+		out[2] = code_table[(b >> 6 ) & 0x3F];
+		out[3] = code_table[ b        & 0x3F];
+		in += 3;
+		out += 4;
 	}
 	
 	/* process the last 'partial' block and terminate string */
-	i = full_blocks;
-	if (last_chars == 0) {
-		out[4*i] =  0; /* null character to terminate string */
-	} else if (last_chars == 2) {
-		b  = (0xFF & in[3*i]    ) << 16;
-		out[4*i + 0] = code_to_char((b >> 18) & 0x3F);
-		out[4*i + 1] = code_to_char((b >> 12) & 0x3F);
-		out[4*i + 2] =  0; /* null character to terminate string */
-	} else if (last_chars == 3) {
-		b  = (0xFF & in[3*i]    ) << 16;
-		b |= (0xFF & in[3*i + 1]) << 8;
-		out[4*i + 0] = code_to_char((b >> 18) & 0x3F);
-		out[4*i + 1] = code_to_char((b >> 12) & 0x3F);
-		out[4*i + 2] = code_to_char((b >> 6 ) & 0x3F);
-		out[4*i + 3] = 0; /* null character to terminate string */
+	if (last_bytes == 1) {
+		b = (uint32_t)in[0] << 16;
+		out[0] = code_table[ b >> 18        ];
+		out[1] = code_table[(b >> 12) & 0x3F];
+		out += 2;
+	} else if (last_bytes == 2) {
+		b = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8);
+		out[0] = code_table[ b >> 18        ];
+		out[1] = code_table[(b >> 12) & 0x3F];
+		out[2] = code_table[(b >> 6 ) & 0x3F];
+		out += 3;
 	}
+	*out = 0; /* null character to terminate string */
 	
 	return result_len;
 }
@@ -176,7 +162,7 @@ int b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len) {
 	int last_chars; /* number of characters <4 in the last block */
 	int last_bytes; /* number of unsigned chars <3 in the last block */
 	uint32_t b;
-	;
+	uint8_t c0, c1, c2, c3;
 	
 	/* check input values */
 	if ((out == NULL) || (in == NULL)) {
@@ -190,22 +176,11 @@ int b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len) {
 	/* calculate the number of base64 'blocks' */
 	full_blocks = size / 4;
 	last_chars = size % 4;
-	switch (last_chars) {
-		case 0: /* no char left to decode */
-			last_bytes = 0;
-			break;
-		case 1: /* only 1 char left is an error */
-			DEBUG("ERROR: ONLY ONE CHAR LEFT IN B64_TO_BIN\n");
-			return -1;
-		case 2: /* 2 chars left to decode -> +1 byte */
-			last_bytes = 1;
-			break;
-		case 3: /* 3 chars left to decode -> +2 bytes */
-			last_bytes = 2;
-			break;
-		default:
-			CRIT("switch default that should not be possible");
+	if (last_chars == 1) { /* only 1 char left is an error */
+		DEBUG("ERROR: ONLY ONE CHAR LEFT IN B64_TO_BIN\n");
+		return -1;
 	}
+	last_bytes = (last_chars == 0) ? 0 : (last_chars - 1); /* 2 chars -> 1 byte, 3 chars -> 2 bytes */
 	
 	/* check if output buffer is big enough */
 	result_len = (3*full_blocks) + last_bytes;
@@ -214,33 +189,36 @@ int b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len) {
 		return -1;
 	}
 	
-	/* process all the full blocks */
+	/* process all the full blocks, invalid characters map to 0xFF and are caught on the OR */
 	for (i=0; i < full_blocks; ++i) {
-		b  = (0x3F & char_to_code(in[4*i]    )) << 18;
-		b |= (0x3F & char_to_code(in[4*i + 1])) << 12;
-		b |= (0x3F & char_to_code(in[4*i + 2])) << 6;
-		b |=  0x3F & char_to_code(in[4*i + 3]);
-		out[3*i + 0] = (b >> 16) & 0xFF;
-		out[3*i + 1] = (b >> 8 ) & 0xFF;
-		out[3*i + 2] =  b        & 0xFF;
+		c0 = char_table[(uint8_t)in[0]];
+		c1 = char_table[(uint8_t)in[1]];
+		c2 = char_table[(uint8_t)in[2]];
+		c3 = char_table[(uint8_t)in[3]];
+		if ((c0 | c1 | c2 | c3) & 0x80) {
+			DEBUG("ERROR: INVALID CHARACTER IN B64_TO_BIN\n");
+			return -1;
+		}
+		b = ((uint32_t)c0 << 18) | ((uint32_t)c1 << 12) | ((uint32_t)c2 << 6) | c3;
+		out[0] = (b >> 16) & 0xFF;
+		out[1] = (b >> 8 ) & 0xFF;
+		out[2] =  b        & 0xFF;
+		in += 4;
+		out += 3;
 	}
 	
 	/* process the last 'partial' block */
-	i = full_blocks;
-	if (last_bytes == 1) {
-		b  = (0x3F & char_to_code(in[4*i]    )) << 18;
-		b |= (0x3F & char_to_code(in[4*i + 1])) << 12;
-		out[3*i + 0] = (b >> 16) & 0xFF;
-		if (((b >> 12) & 0x0F) != 0) {
-			DEBUG("WARNING: last character contains unusable bits\n");
+	if (last_bytes > 0) {
+		b = decode_group(in, last_chars);
+		if (b == 0xFFFFFFFF) {
+			DEBUG("ERROR: INVALID CHARACTER IN B64_TO_BIN\n");
+			return -1;
 		}
-	} else if (last_bytes == 2) {
-		b  = (0x3F & char_to_code(in[4*i]    )) << 18;
-		b |= (0x3F & char_to_code(in[4*i + 1])) << 12;
-		b |= (0x3F & char_to_code(in[4*i + 2])) << 6;
-		out[3*i + 0] = (b >> 16) & 0xFF;
-		out[3*i + 1] = (b >> 8 ) & 0xFF;
-		if (((b >> 6) & 0x03) != 0) {
+		out[0] = (b >> 16) & 0xFF;
+		if (last_bytes == 2) {
+			out[1] = (b >> 8 ) & 0xFF;
+		}
+		if ((b & ((last_bytes == 1) ? 0xFFFF : 0xFF)) != 0) {
 			DEBUG("WARNING: last character contains unusable bits\n");
 		}
 	}
@@ -293,6 +271,10 @@ int b64_to_bin(const char * in, int size, uint8_t * out, int max_len) {
 	}
 	if ((size%4 == 0) && (size >= 4)) { /* potentially padded Base64 */
 		if (in[size-2] == code_pad) { /* 2 padding char to ignore */
+			if (in[size-1] != code_pad) {
+				DEBUG("ERROR: CHARACTER AFTER PADDING IN B64_TO_BIN\n");
+				return -1;
+			}
 			return b64_to_bin_nopad(in, size-2, out, max_len);
 		} else if (in[size-1] == code_pad) { /* 1 padding char to ignore */
 			return b64_to_bin_nopad(in, size-1, out, max_len);
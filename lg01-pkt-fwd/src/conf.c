@@ -0,0 +1,101 @@
+/*
+ * conf.c
+ *
+ * UCI package snapshot, see conf.h.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* snprintf */
+#include <string.h>		/* strcmp, strlen, memcpy */
+
+#include <uci.h>
+
+#include "conf.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* keep one option whole, or record it as lost */
+static void conf_add(struct conf_s *conf, const char *section, const char *name, const char *value, char list) {
+	struct conf_opt_s *opt;
+	int len = strlen(value) + 1;
+
+	if ((conf->nb_opt == CONF_OPT_MAX) || (len > CONF_TEXT_SIZE - conf->text_len) ||
+	    (strlen(section) >= sizeof opt->section) || (strlen(name) >= sizeof opt->name)) {
+		if (conf->nb_lost < CONF_LOST_MAX)
+			snprintf(conf->lost[conf->nb_lost], sizeof conf->lost[0], "%s.%s", section, name);
+		conf->nb_lost++;
+		return;
+	}
+	opt = &conf->opt[conf->nb_opt++];
+	strcpy(opt->section, section);
+	strcpy(opt->name, name);
+	opt->value = conf->text_len;
+	opt->list = list;
+	memcpy(conf->text + conf->text_len, value, len);
+	conf->text_len += len;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int conf_load(struct conf_s *conf, const char *package) {
+	struct uci_context *ctx;
+	struct uci_package *pkg = NULL;
+	struct uci_element *e, *oe, *le;
+	struct uci_section *st;
+	struct uci_option *o;
+
+	ctx = uci_alloc_context();
+	if (ctx == NULL)
+		return -1;
+	if (uci_load(ctx, package, &pkg) != UCI_OK) {
+		uci_free_context(ctx);
+		return -1;
+	}
+
+	conf->nb_opt = 0;
+	conf->text_len = 0;
+	conf->nb_lost = 0;
+	uci_foreach_element(&pkg->sections, e) {
+		st = uci_to_section(e);
+		uci_foreach_element(&st->options, oe) {
+			o = uci_to_option(oe);
+			if (o->type == UCI_TYPE_STRING) {
+				conf_add(conf, st->e.name, o->e.name, o->v.string, 0);
+			} else if (o->type == UCI_TYPE_LIST) {
+				uci_foreach_element(&o->v.list, le)
+					conf_add(conf, st->e.name, o->e.name, le->name, 1);
+			}
+		}
+	}
+
+	uci_unload(ctx, pkg);
+	uci_free_context(ctx);
+	return conf->nb_opt;
+}
+
+const char * conf_get(const struct conf_s *conf, const char *section, const char *name) {
+	int i;
+
+	for (i = 0; i < conf->nb_opt; i++) {
+		if (!conf->opt[i].list && !strcmp(conf->opt[i].name, name) && !strcmp(conf->opt[i].section, section))
+			return conf->text + conf->opt[i].value;
+	}
+	return NULL;
+}
+
+int conf_get_list(const struct conf_s *conf, const char *section, const char *name, const char **values, int max) {
+	int i, nb = 0;
+
+	for (i = 0; (i < conf->nb_opt) && (nb < max); i++) {
+		if (!strcmp(conf->opt[i].name, name) && !strcmp(conf->opt[i].section, section))
+			values[nb++] = conf->text + conf->opt[i].value;
+	}
+	return nb;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
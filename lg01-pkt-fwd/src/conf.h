@@ -0,0 +1,73 @@
+/*
+ * conf.h
+ *
+ * Snapshot of a UCI package: every option of every section, copied with a
+ * single parse of the file so that looking options up costs nothing and a
+ * snapshot that failed to load never replaces a good one. Each item of a
+ * list option is kept as an option of its own. Values are kept whole in a
+ * text area shared by all the options; an option that does not fit is left
+ * out of the snapshot and reported, never stored cut.
+ */
+
+#ifndef _CONF_H
+#define _CONF_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define CONF_OPT_MAX		160		/* options and list items kept */
+#define CONF_TEXT_SIZE		8192	/* bytes of all the values, terminators included */
+#define CONF_LOST_MAX		8		/* options left out that are reported by name */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct conf_opt_s {
+	char		section[24];
+	char		name[24];
+	uint16_t	value;		/* offset of the value in text */
+	char		list;		/* 1 for a list item */
+};
+
+struct conf_s {
+	int					nb_opt;
+	int					text_len;
+	int					nb_lost;	/* options left out: name too long, or no room left */
+	char				lost[CONF_LOST_MAX][48];	/* "section.name" of the first ones */
+	struct conf_opt_s	opt[CONF_OPT_MAX];
+	char				text[CONF_TEXT_SIZE];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Parse a UCI package into a snapshot
+@param conf snapshot to fill, left untouched on error
+@param package path of the package, e.g. /etc/config/lorawan
+@return number of options kept, -1 if the package can't be loaded; the
+options that could not be kept whole are counted in conf->nb_lost
+*/
+int conf_load(struct conf_s *conf, const char *package);
+
+/**
+@brief Look an option up
+@return value of the option, NULL if it is not set
+*/
+const char * conf_get(const struct conf_s *conf, const char *section, const char *name);
+
+/**
+@brief Look the items of a list option up, a string option counts as a list of one
+@param values filled with up to max values
+@return number of values found
+*/
+int conf_get_list(const struct conf_s *conf, const char *section, const char *name, const char **values, int max);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,96 @@
+/*
+ * dedup.c
+ *
+ * Uplink duplicate filter, see dedup.h. Linear probing over at most
+ * DEDUP_PROBE_MAX slots. A key is never cleared, it only expires: an expired
+ * entry may sit before a live one of the same probe sequence (A inserted, B
+ * inserted after it, A expires first), so a lookup goes on past expired
+ * entries and only stops at a slot that was never used, which no insertion
+ * went past. A new key takes the first expired or unused slot probed, the
+ * oldest entry if there is none.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <string.h>		/* memset */
+
+#include "dedup.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define FNV_OFFSET		2166136261U
+#define FNV_PRIME		16777619U
+#define FNV_STEP(h, b)	(((h) ^ (uint8_t)(b)) * FNV_PRIME)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static bool is_live(const struct dedup_s *dd, const struct dedup_entry_s *e, uint32_t now_ms);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool is_live(const struct dedup_s *dd, const struct dedup_entry_s *e, uint32_t now_ms) {
+	return (e->key != 0) && ((uint32_t)(now_ms - e->time_ms) < dd->window_ms);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void dedup_init(struct dedup_s *dd, uint32_t window_ms) {
+	memset(dd, 0, sizeof *dd);
+	dd->window_ms = window_ms;
+}
+
+uint32_t dedup_key(const struct lgw_pkt_rx_s *pkt) {
+	uint32_t h = FNV_OFFSET;
+	int i;
+
+	for (i = 0; i < 32; i += 8)
+		h = FNV_STEP(h, pkt->freq_hz >> i);
+	h = FNV_STEP(h, pkt->size);
+	h = FNV_STEP(h, pkt->size >> 8);
+	for (i = 0; i < pkt->size; i++)
+		h = FNV_STEP(h, pkt->payload[i]);
+	return (h != 0) ? h : 1;
+}
+
+bool dedup_check(struct dedup_s *dd, uint32_t key, uint32_t now_ms) {
+	struct dedup_entry_s *e, *victim, *spare = NULL, *oldest = NULL;
+	uint32_t i, pos;
+
+	if (dd->window_ms == 0)
+		return false;
+
+	pos = key & (DEDUP_SIZE - 1);
+	for (i = 0; i < DEDUP_PROBE_MAX; i++) {
+		e = &dd->slot[(pos + i) & (DEDUP_SIZE - 1)];
+		if (!is_live(dd, e, now_ms)) {
+			if (spare == NULL)
+				spare = e;
+			if (e->key == 0)
+				break;
+			continue;
+		}
+		if (e->key == key) {
+			dd->hit++;
+			return true;
+		}
+		if ((oldest == NULL) || ((int32_t)(e->time_ms - oldest->time_ms) < 0))
+			oldest = e;
+	}
+	victim = (spare != NULL) ? spare : oldest;
+
+	/* new packet; if the probe sequence is full its oldest entry is given up,
+	   that can only make a later duplicate go through, never drop a packet */
+	victim->key = key;
+	victim->time_ms = now_ms;
+	dd->miss++;
+	return false;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,69 @@
+/*
+ * dedup.h
+ *
+ * Uplink duplicate filter. A packet is a duplicate when a packet with the
+ * same frequency, size and payload was seen less than window_ms earlier.
+ * Keys are 32-bit hashes kept in a fixed open-addressing table, nothing is
+ * allocated; an entry expires window_ms after it was first seen, it is not
+ * refreshed by its duplicates. The filter is not thread-safe, it belongs to
+ * the uplink path.
+ */
+
+#ifndef _DEDUP_H
+#define _DEDUP_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "lgw_pkt.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define DEDUP_SIZE			256	/* table slots, power of 2, far above what one channel receives per window */
+#define DEDUP_PROBE_MAX		16	/* slots probed before the oldest one probed is reused */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct dedup_entry_s {
+	uint32_t	key;		/* 0 for a free slot */
+	uint32_t	time_ms;	/* when the key was first seen */
+};
+
+struct dedup_s {
+	uint32_t				window_ms;
+	uint32_t				hit;		/* duplicates found since start-up */
+	uint32_t				miss;		/* new packets since start-up */
+	struct dedup_entry_s	slot[DEDUP_SIZE];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Empty the filter
+@param window_ms how long a packet is remembered, 0 disables the filter
+*/
+void dedup_init(struct dedup_s *dd, uint32_t window_ms);
+
+/**
+@brief Hash of the fields identifying a packet: frequency, size and payload
+@return key, never 0
+*/
+uint32_t dedup_key(const struct lgw_pkt_rx_s *pkt);
+
+/**
+@brief Look a packet up and remember it if it is new
+@param key from dedup_key()
+@param now_ms monotonic time in milliseconds, may wrap
+@return true if the packet is a duplicate
+*/
+bool dedup_check(struct dedup_s *dd, uint32_t key, uint32_t now_ms);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,91 @@
+/*
+ * histogram.c
+ *
+ * Log-bucketed latency histograms, see histogram.h.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* snprintf */
+#include <string.h>		/* memset */
+
+#include "histogram.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static int bucket_of(uint32_t value_us);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int bucket_of(uint32_t value_us) {
+	int i;
+
+	if (value_us == 0)
+		return 0;
+	i = 31 - __builtin_clz(value_us); /* floor(log2) */
+	return (i < HIST_NB_BUCKETS) ? i : HIST_NB_BUCKETS - 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void hist_add(struct hist_s *h, uint32_t value_us) {
+	uint32_t max;
+
+	__sync_fetch_and_add(&h->bucket[bucket_of(value_us)], 1);
+	__sync_fetch_and_add(&h->count, 1);
+	max = h->max_us;
+	while ((value_us > max) && !__sync_bool_compare_and_swap(&h->max_us, max, value_us))
+		max = h->max_us;
+}
+
+void hist_snapshot(const struct hist_s *h, struct hist_s *copy) {
+	int i;
+
+	copy->max_us = h->max_us;
+	copy->count = 0;
+	for (i = 0; i < HIST_NB_BUCKETS; i++) {
+		copy->bucket[i] = ((volatile const uint32_t *)h->bucket)[i];
+		copy->count += copy->bucket[i]; /* consistent with the buckets read */
+	}
+}
+
+uint32_t hist_percentile(const struct hist_s *h, unsigned pct) {
+	uint64_t rank, seen = 0;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+	rank = ((uint64_t)h->count * pct + 99) / 100;
+	for (i = 0; i < HIST_NB_BUCKETS - 1; i++) {
+		seen += h->bucket[i];
+		if (seen >= rank)
+			return (2U << i) - 1;
+	}
+	return h->max_us;
+}
+
+int hist_to_json(const struct hist_s *h, char *out, int max_len) {
+	int i, j, index;
+
+	index = snprintf(out, max_len, "{\"count\":%u,\"max\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"buckets\":[",
+	                 h->count, h->max_us, hist_percentile(h, 50), hist_percentile(h, 90), hist_percentile(h, 99));
+	if ((index < 0) || (index >= max_len))
+		return -1;
+	for (i = 0; i < HIST_NB_BUCKETS; i++) {
+		j = snprintf(out + index, max_len - index, (i == 0) ? "%u" : ",%u", h->bucket[i]);
+		if ((j < 0) || (j >= max_len - index))
+			return -1;
+		index += j;
+	}
+	j = snprintf(out + index, max_len - index, "]}");
+	if ((j < 0) || (j >= max_len - index))
+		return -1;
+	return index + j;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,60 @@
+/*
+ * histogram.h
+ *
+ * Log-bucketed latency histograms. Bucket i counts values in
+ * [2^i, 2^(i+1)) microseconds (bucket 0 also counts 0), the last bucket is
+ * open ended. Samples are added with atomic operations so any thread can
+ * feed a histogram without a lock; they accumulate since start-up.
+ */
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define HIST_NB_BUCKETS		24	/* last bucket starts at 2^23 us (~8.4 s) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct hist_s {
+	uint32_t	count;		/* number of samples */
+	uint32_t	max_us;		/* largest sample */
+	uint32_t	bucket[HIST_NB_BUCKETS];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Record one sample, lock-free, callable from any thread
+*/
+void hist_add(struct hist_s *h, uint32_t value_us);
+
+/**
+@brief Copy a histogram being updated into a private one
+*/
+void hist_snapshot(const struct hist_s *h, struct hist_s *copy);
+
+/**
+@brief Upper bound of the bucket holding the given percentile of a snapshot
+@return value in microseconds, 0 if the histogram is empty
+*/
+uint32_t hist_percentile(const struct hist_s *h, unsigned pct);
+
+/**
+@brief Serialize a snapshot as a JSON object
+@return number of characters written, or -1 if out is too small
+Format: {"count":N,"max":us,"p50":us,"p90":us,"p99":us,"buckets":[...]}
+*/
+int hist_to_json(const struct hist_s *h, char *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
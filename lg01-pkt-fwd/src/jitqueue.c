@@ -0,0 +1,193 @@
+/*
+ * jitqueue.c
+ *
+ * Just-in-time queue for downlinks. Frames are stored in a binary min-heap
+ * ordered by emit time. A frame is refused when its air time overlaps a
+ * frame already queued, or when it is too far in the future to be kept.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <string.h>		/* memset, memcpy */
+
+#include "jitqueue.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+/* signed distance between two wrapping microsecond counters */
+#define TIME_DIFF(a, b)		((int32_t)((uint32_t)(a) - (uint32_t)(b)))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void heap_swap(struct jit_queue_s *queue, int a, int b);
+static void heap_sift_up(struct jit_queue_s *queue, int i);
+static void heap_sift_down(struct jit_queue_s *queue, int i);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void heap_swap(struct jit_queue_s *queue, int a, int b) {
+	struct jit_node_s tmp;
+
+	tmp = queue->nodes[a];
+	queue->nodes[a] = queue->nodes[b];
+	queue->nodes[b] = tmp;
+}
+
+static void heap_sift_up(struct jit_queue_s *queue, int i) {
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (TIME_DIFF(queue->nodes[i].emit_us, queue->nodes[parent].emit_us) >= 0)
+			break;
+		heap_swap(queue, i, parent);
+		i = parent;
+	}
+}
+
+static void heap_sift_down(struct jit_queue_s *queue, int i) {
+	int child, smallest;
+
+	while (1) {
+		smallest = i;
+		for (child = 2*i + 1; (child <= 2*i + 2) && (child < queue->num_pkt); child++) {
+			if (TIME_DIFF(queue->nodes[child].emit_us, queue->nodes[smallest].emit_us) < 0)
+				smallest = child;
+		}
+		if (smallest == i)
+			break;
+		heap_swap(queue, i, smallest);
+		i = smallest;
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void jit_queue_init(struct jit_queue_s *queue) {
+	memset(queue, 0, sizeof *queue);
+}
+
+bool jit_queue_is_empty(struct jit_queue_s *queue) {
+	return (queue->num_pkt == 0);
+}
+
+enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, const struct lgw_pkt_tx_s *packet, uint16_t tag) {
+	struct jit_node_s *node;
+	uint32_t emit_us, toa_us;
+	int32_t delta;
+	bool timed;
+	int i;
+
+	if (queue->num_pkt >= JIT_QUEUE_MAX)
+		return JIT_ERROR_FULL;
+
+	/* immediate frames are due now, timestamped ones at their tmst; the MCU
+	   transmits on the next uplink of the device anyway, so a timestamped frame
+	   past its tmst is still handed over, now, like an immediate one */
+	emit_us = (packet->tx_mode == IMMEDIATE) ? time_us : packet->count_us;
+	delta = TIME_DIFF(emit_us, time_us);
+	if (delta > JIT_MAX_ADVANCE_US)
+		return JIT_ERROR_TOO_EARLY;
+	timed = (packet->tx_mode != IMMEDIATE) && (delta >= 0);
+	if (!timed)
+		emit_us = time_us;
+
+	/* only one frame on air at a time, the others just go out as soon as possible */
+	toa_us = jit_time_on_air(packet);
+	for (i = 0; timed && (i < queue->num_pkt); i++) {
+		if ((TIME_DIFF(emit_us, queue->nodes[i].emit_us + queue->nodes[i].toa_us) <= 0) &&
+		    (TIME_DIFF(queue->nodes[i].emit_us, emit_us + toa_us) <= 0))
+			return JIT_ERROR_COLLISION;
+	}
+
+	node = &queue->nodes[queue->num_pkt];
+	memcpy(&node->pkt, packet, sizeof node->pkt);
+	node->emit_us = emit_us;
+	node->toa_us = toa_us;
+	node->queue_us = time_us;
+	node->tag = tag;
+	queue->num_pkt++;
+	heap_sift_up(queue, queue->num_pkt - 1);
+	return JIT_ERROR_OK;
+}
+
+enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, uint32_t *wait_us) {
+	const struct jit_node_s *head;
+	int32_t delta;
+
+	*wait_us = 0;
+	if (queue->num_pkt == 0)
+		return JIT_ERROR_EMPTY;
+
+	head = &queue->nodes[0];
+	delta = TIME_DIFF(head->emit_us, time_us);
+	if (delta > JIT_LEAD_US) {
+		*wait_us = delta - JIT_LEAD_US;
+		return JIT_ERROR_TOO_EARLY;
+	}
+	return JIT_ERROR_OK;
+}
+
+enum jit_error_e jit_dequeue(struct jit_queue_s *queue, struct jit_node_s *node) {
+	if (queue->num_pkt == 0)
+		return JIT_ERROR_EMPTY;
+
+	memcpy(node, &queue->nodes[0], sizeof *node);
+	queue->num_pkt--;
+	if (queue->num_pkt > 0) {
+		queue->nodes[0] = queue->nodes[queue->num_pkt];
+		heap_sift_down(queue, 0);
+	}
+	return JIT_ERROR_OK;
+}
+
+uint32_t jit_time_on_air(const struct lgw_pkt_tx_s *packet) {
+	int sf, bw_hz, cr, de, h, crc;
+	int num, den, n_payload;
+	double t_sym;
+	uint16_t preamble;
+
+	if (packet->modulation == MOD_LORA) {
+		switch (packet->datarate) {
+			case DR_LORA_SF7:  sf = 7;  break;
+			case DR_LORA_SF8:  sf = 8;  break;
+			case DR_LORA_SF9:  sf = 9;  break;
+			case DR_LORA_SF10: sf = 10; break;
+			case DR_LORA_SF11: sf = 11; break;
+			case DR_LORA_SF12: sf = 12; break;
+			default: return 0;
+		}
+		switch (packet->bandwidth) {
+			case BW_125KHZ: bw_hz = 125000; break;
+			case BW_250KHZ: bw_hz = 250000; break;
+			case BW_500KHZ: bw_hz = 500000; break;
+			default: return 0;
+		}
+		cr = (packet->coderate >= CR_LORA_4_5 && packet->coderate <= CR_LORA_4_8) ? packet->coderate : CR_LORA_4_5;
+		preamble = (packet->preamble == 0) ? STD_LORA_PREAMB : packet->preamble;
+		de = ((sf >= 11) && (bw_hz == 125000)) ? 1 : 0; /* low data rate optimisation */
+		h = packet->no_header ? 1 : 0;
+		crc = packet->no_crc ? 0 : 1;
+
+		/* Semtech SX1276 datasheet, section 4.1.1.7 */
+		t_sym = (double)(1 << sf) / (double)bw_hz;
+		num = 8 * packet->size - 4 * sf + 28 + 16 * crc - 20 * h;
+		den = 4 * (sf - 2 * de);
+		n_payload = (num > 0) ? ((num + den - 1) / den) * (cr + 4) : 0;
+		return (uint32_t)(1e6 * t_sym * ((preamble + 4.25) + 8 + n_payload));
+	} else if ((packet->modulation == MOD_FSK) && (packet->datarate > 0)) {
+		preamble = (packet->preamble == 0) ? STD_FSK_PREAMB : packet->preamble;
+		/* preamble + sync word + length + payload + CRC, in bits */
+		return (uint32_t)(1e6 * (8.0 * (preamble + 3 + 1 + packet->size + 2)) / (double)packet->datarate);
+	}
+	return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,101 @@
+/*
+ * jitqueue.h
+ *
+ * Just-in-time queue for downlinks: frames are kept ordered by the time they
+ * must be emitted and handed over to the MCU when they are due. The MCU does
+ * not transmit at that time, only after the next uplink of the device, so the
+ * queue orders the frames and keeps their air times apart, it does not make
+ * the RX1/RX2 timing: a frame past its time is not refused, it is due at once.
+ * Times are 32-bit microsecond counters in the tmst time base and wrap.
+ */
+
+#ifndef _JITQUEUE_H
+#define _JITQUEUE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "lgw_pkt.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define JIT_QUEUE_MAX			32			/* max number of frames waiting in the queue */
+#define JIT_LEAD_US				200000		/* frames are released this long before their emit time (file write and Bridge latency) */
+#define JIT_MAX_ADVANCE_US		10000000	/* frames further in the future are refused as too early */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+enum jit_error_e {
+	JIT_ERROR_OK,			/* frame ok to be sent */
+	JIT_ERROR_TOO_LATE,		/* too late to send this frame */
+	JIT_ERROR_TOO_EARLY,	/* too early to queue this frame */
+	JIT_ERROR_FULL,			/* downlink queue is full */
+	JIT_ERROR_EMPTY,		/* downlink queue is empty */
+	JIT_ERROR_COLLISION		/* a frame is already programmed at this time */
+};
+
+struct jit_node_s {
+	struct lgw_pkt_tx_s	pkt;		/* frame to be handed over to the MCU */
+	uint32_t			emit_us;	/* when the frame should be on air */
+	uint32_t			toa_us;		/* time on air, the frame occupies [emit_us, emit_us + toa_us] */
+	uint32_t			queue_us;	/* when the frame was queued */
+	uint16_t			tag;		/* reference of the caller, handed back with the frame */
+};
+
+struct jit_queue_s {
+	int					num_pkt;				/* number of frames in the heap */
+	struct jit_node_s	nodes[JIT_QUEUE_MAX];	/* binary min-heap ordered by emit_us */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Empty the queue
+*/
+void jit_queue_init(struct jit_queue_s *queue);
+
+/**
+@brief Check if the queue holds no frame
+*/
+bool jit_queue_is_empty(struct jit_queue_s *queue);
+
+/**
+@brief Queue a frame at the emit time given by its tx_mode and count_us
+@param queue the queue
+@param time_us current time in the tmst time base
+@param packet frame to queue, IMMEDIATE frames and frames past their count_us
+are due at time_us
+@param tag reference kept with the frame
+@return JIT_ERROR_OK if queued, TOO_EARLY/COLLISION/FULL otherwise
+*/
+enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, const struct lgw_pkt_tx_s *packet, uint16_t tag);
+
+/**
+@brief Look at the frame with the earliest emit time
+@param queue the queue
+@param time_us current time in the tmst time base
+@param wait_us filled with the time left before the frame must be released
+@return JIT_ERROR_OK if it must be released now (wait_us is 0), JIT_ERROR_EMPTY
+if there is nothing queued, JIT_ERROR_TOO_EARLY if it is not due yet
+*/
+enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, uint32_t *wait_us);
+
+/**
+@brief Remove the frame with the earliest emit time
+*/
+enum jit_error_e jit_dequeue(struct jit_queue_s *queue, struct jit_node_s *node);
+
+/**
+@brief Time on air of a frame, in microseconds, 0 if its modulation is unknown
+*/
+uint32_t jit_time_on_air(const struct lgw_pkt_tx_s *packet);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,203 @@
+/*
+ * journal.c
+ *
+ * Store-and-forward journal, see journal.h. head and tail are free-running
+ * byte offsets, records wrap around the end of the data area. head is only
+ * moved once a record is completely written, so a crash while appending
+ * loses that record and nothing else.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <string.h>		/* memset, memcpy */
+#include <errno.h>		/* errno */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>	/* mmap, msync, munmap */
+#include <fcntl.h>		/* open */
+#include <unistd.h>		/* ftruncate, close */
+
+#include "journal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define REC_SIZE(len)	((sizeof(struct journal_rec_s) + (len) + 3) & ~3U)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void ring_write(struct journal_s *jn, uint32_t off, const void *src, uint32_t len);
+static void ring_read(struct journal_s *jn, uint32_t off, void *dst, uint32_t len);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void ring_write(struct journal_s *jn, uint32_t off, const void *src, uint32_t len) {
+	uint32_t pos = off % jn->hdr->data_size;
+	uint32_t first = jn->hdr->data_size - pos;
+
+	if (first >= len) {
+		memcpy(jn->data + pos, src, len);
+	} else {
+		memcpy(jn->data + pos, src, first);
+		memcpy(jn->data, (const uint8_t *)src + first, len - first);
+	}
+}
+
+static void ring_read(struct journal_s *jn, uint32_t off, void *dst, uint32_t len) {
+	uint32_t pos = off % jn->hdr->data_size;
+	uint32_t first = jn->hdr->data_size - pos;
+
+	if (first >= len) {
+		memcpy(dst, jn->data + pos, len);
+	} else {
+		memcpy(dst, jn->data + pos, first);
+		memcpy((uint8_t *)dst + first, jn->data, len - first);
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int journal_open(struct journal_s *jn, const char *path, uint32_t size) {
+	struct journal_hdr_s *hdr;
+	void *map;
+	uint32_t map_size;
+	int fd, err;
+
+	if (size < JOURNAL_MIN_SIZE)
+		size = JOURNAL_MIN_SIZE;
+	while ((size & (size - 1)) != 0) /* power of 2, so that offsets wrap cleanly */
+		size &= size - 1;
+	map_size = sizeof(struct journal_hdr_s) + size;
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, map_size) != 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	hdr = (struct journal_hdr_s *)map;
+	if ((hdr->magic != JOURNAL_MAGIC) || (hdr->version != JOURNAL_VERSION) || (hdr->data_size != size) ||
+	    ((uint32_t)(hdr->head - hdr->tail) > size)) {
+		memset(hdr, 0, sizeof *hdr);
+		hdr->magic = JOURNAL_MAGIC;
+		hdr->version = JOURNAL_VERSION;
+		hdr->data_size = size;
+	}
+
+	jn->fd = fd;
+	jn->hdr = hdr;
+	jn->data = (uint8_t *)map + sizeof(struct journal_hdr_s);
+	jn->map_size = map_size;
+	return 0;
+}
+
+void journal_close(struct journal_s *jn) {
+	if (jn->hdr != NULL) {
+		msync(jn->hdr, jn->map_size, MS_SYNC);
+		munmap(jn->hdr, jn->map_size);
+		close(jn->fd);
+	}
+	jn->hdr = NULL;
+	jn->data = NULL;
+	jn->fd = -1;
+}
+
+int journal_append(struct journal_s *jn, const void *data, uint16_t len, uint16_t nb_pkt, uint32_t time) {
+	struct journal_hdr_s *hdr = jn->hdr;
+	struct journal_rec_s rec;
+	uint32_t need = REC_SIZE(len);
+	int dropped = 0;
+
+	if (need > hdr->data_size)
+		return -1;
+
+	/* make room by giving up the oldest records */
+	while (hdr->data_size - (uint32_t)(hdr->head - hdr->tail) < need) {
+		if (hdr->nb_rec == 0) { /* damaged header, nothing left to give up */
+			hdr->tail = hdr->head;
+			break;
+		}
+		journal_drop(jn);
+		dropped++;
+	}
+
+	rec.len = len;
+	rec.nb_pkt = nb_pkt;
+	rec.time = time;
+	ring_write(jn, hdr->head, &rec, sizeof rec);
+	ring_write(jn, hdr->head + sizeof rec, data, len);
+	hdr->head += need;
+	hdr->nb_rec += 1;
+	hdr->nb_pkt += nb_pkt;
+	msync(jn->hdr, jn->map_size, MS_ASYNC);
+	return dropped;
+}
+
+bool journal_peek(struct journal_s *jn, struct journal_rec_s *rec, void *data, int max_len) {
+	if (jn->hdr->nb_rec == 0)
+		return false;
+	ring_read(jn, jn->hdr->tail, rec, sizeof *rec);
+	if (rec->len > max_len)
+		return false;
+	ring_read(jn, jn->hdr->tail + sizeof *rec, data, rec->len);
+	return true;
+}
+
+void journal_drop(struct journal_s *jn) {
+	struct journal_hdr_s *hdr = jn->hdr;
+	struct journal_rec_s rec;
+
+	if (hdr->nb_rec == 0)
+		return;
+	ring_read(jn, hdr->tail, &rec, sizeof rec);
+	hdr->tail += REC_SIZE(rec.len);
+	hdr->nb_rec -= 1;
+	hdr->nb_pkt -= (rec.nb_pkt <= hdr->nb_pkt) ? rec.nb_pkt : hdr->nb_pkt;
+	if (hdr->nb_rec == 0) { /* resynchronize, also recovers from a damaged header */
+		hdr->tail = hdr->head;
+		hdr->nb_pkt = 0;
+	}
+}
+
+int journal_expire(struct journal_s *jn, uint32_t now, uint32_t max_age) {
+	struct journal_rec_s rec;
+	int nb = 0;
+
+	while (jn->hdr->nb_rec > 0) {
+		ring_read(jn, jn->hdr->tail, &rec, sizeof rec);
+		if ((int32_t)(now - rec.time) <= (int32_t)max_age)
+			break;
+		journal_drop(jn);
+		nb++;
+	}
+	return nb;
+}
+
+uint32_t journal_oldest(struct journal_s *jn) {
+	struct journal_rec_s rec;
+
+	if (jn->hdr->nb_rec == 0)
+		return 0;
+	ring_read(jn, jn->hdr->tail, &rec, sizeof rec);
+	return rec.time;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
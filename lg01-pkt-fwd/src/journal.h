@@ -0,0 +1,108 @@
+/*
+ * journal.h
+ *
+ * Store-and-forward journal for uplinks the server did not acknowledge.
+ * Records are appended to a circular log in an mmap'd file so they survive
+ * a restart of the forwarder; when the log is full the oldest records are
+ * given up. The journal is not thread-safe, callers serialize access.
+ */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define JOURNAL_MAGIC		0x4C474A4EU	/* "LGJN" */
+#define JOURNAL_VERSION		1
+#define JOURNAL_MIN_SIZE	8192		/* smallest data area accepted, in bytes */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* file layout: header followed by data_size bytes of records */
+struct journal_hdr_s {
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	reserved;
+	uint32_t	data_size;	/* size of the record area */
+	uint32_t	head;		/* free-running offset where the next record is written */
+	uint32_t	tail;		/* free-running offset of the oldest record */
+	uint32_t	nb_rec;		/* number of records between tail and head */
+	uint32_t	nb_pkt;		/* number of packets held by those records */
+};
+
+/* each record starts with this header, the record is padded to 4 bytes */
+struct journal_rec_s {
+	uint16_t	len;		/* number of data bytes following */
+	uint16_t	nb_pkt;		/* number of packets in the data */
+	uint32_t	time;		/* when the record was written, UNIX time */
+};
+
+struct journal_s {
+	int						fd;
+	struct journal_hdr_s	*hdr;
+	uint8_t					*data;
+	uint32_t				map_size;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Map a journal file, creating it empty if needed
+@param jn journal handle to fill
+@param path file holding the journal
+@param size size of the record area in bytes, rounded down to a power of 2
+(at least JOURNAL_MIN_SIZE)
+@return 0 on success, -1 on error (errno is set)
+Records of an existing journal with the same size are kept, a journal with
+another size or an unknown layout is emptied.
+*/
+int journal_open(struct journal_s *jn, const char *path, uint32_t size);
+
+/**
+@brief Flush and unmap a journal
+*/
+void journal_close(struct journal_s *jn);
+
+/**
+@brief Append a record, giving up the oldest ones if there is no room
+@return number of records given up to make room, -1 if the record can never fit
+*/
+int journal_append(struct journal_s *jn, const void *data, uint16_t len, uint16_t nb_pkt, uint32_t time);
+
+/**
+@brief Copy the oldest record without removing it
+@param rec filled with the record header
+@param data filled with rec->len bytes
+@param max_len size of data
+@return false if the journal is empty or the record is larger than max_len
+*/
+bool journal_peek(struct journal_s *jn, struct journal_rec_s *rec, void *data, int max_len);
+
+/**
+@brief Remove the oldest record
+*/
+void journal_drop(struct journal_s *jn);
+
+/**
+@brief Remove the records written before now - max_age
+@return number of records removed
+*/
+int journal_expire(struct journal_s *jn, uint32_t now, uint32_t max_age);
+
+/**
+@brief Time the oldest record was written, 0 if the journal is empty
+*/
+uint32_t journal_oldest(struct journal_s *jn);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -30,12 +30,29 @@
 #include <arpa/inet.h>  /* IP address conversion stuff */
 #include <netdb.h>		/* gai_strerror */
 
+#include <sys/inotify.h> /* inotify_init1, inotify_add_watch */
+#include <poll.h>		/* poll */
+#include <sys/epoll.h>	/* epoll_create, epoll_ctl, epoll_wait */
+#include <sys/timerfd.h> /* timerfd_create, timerfd_settime */
+#include <sys/uio.h>	/* readv */
+#include <limits.h>		/* NAME_MAX */
+
 #include <pthread.h>
 
-#include <uci.h>
 
 #include "parson.h"
 #include "base64.h"
+#include "lgw_pkt.h"
+#include "txpk.h"
+#include "jitqueue.h"
+#include "histogram.h"
+#include "journal.h"
+#include "mcurec.h"
+#include "rxpk.h"
+#include "dedup.h"
+#include "conf.h"
+#include "servaddr.h"
+#include "upfilter.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -57,26 +74,29 @@
 #define DEFAULT_STAT		300	/* default time interval for statistics */
 #define PUSH_TIMEOUT_MS		100
 #define PULL_TIMEOUT_MS		200
+#define PUSH_ACK_TIMEOUT_MS	1000	/* in-flight PUSH_DATA not acknowledged after this is counted as lost */
 #define FETCH_SLEEP_MS		500	/* nb of ms waited when a fetch return no packets */
 #define DEFAULT_PUSH_MS		60	/* default time interval for push data */
+#define NOTIFY_WAIT_MS		500	/* max time blocked on inotify before checking exit flags */
+#define JIT_WAIT_MS			500	/* max time the JIT thread sleeps before checking exit flags */
 
-#define	PROTOCOL_VERSION	1
+#define	PROTOCOL_VERSION	2	/* v2 adds TX_ACK */
+#define	PROTOCOL_VERSION_MIN	1	/* replies of servers still speaking v1 are accepted */
 
 #define PKT_PUSH_DATA	0
 #define PKT_PUSH_ACK	1
 #define PKT_PULL_DATA	2
 #define PKT_PULL_RESP	3
 #define PKT_PULL_ACK	4
+#define PKT_TX_ACK		5
 
 #define NB_PKT_MAX		8 /* max number of packets per fetch/send cycle */
 
-#define MIN_LORA_PREAMB	6 /* minimum Lora preamble length for this application */
-#define STD_LORA_PREAMB	8
-#define MIN_FSK_PREAMB	3 /* minimum FSK preamble length for this application */
-#define STD_FSK_PREAMB	4
+#define UP_INFLIGHT_MAX	16 /* max number of PUSH_DATA waiting for their PUSH_ACK */
 
 #define TX_BUFF_SIZE	((540 * NB_PKT_MAX) + 30)
 #define STATUS_SIZE	    1024
+#define JSON_ARENA_SIZE	16384 /* parson arena for PULL_RESP documents (buff_down is 1KB) */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
@@ -84,6 +104,7 @@
 /* signal handling variables */
 volatile bool exit_sig = false; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 volatile bool quit_sig = false; /* 1 -> application terminates without shutting down the hardware */
+volatile bool reload_sig = false; /* 1 -> configuration is reloaded (SIGHUP) */
 
 /* packets filtering configuration variables */
 static bool fwd_valid_pkt = true; /* packets with PAYLOAD CRC OK are forwarded */
@@ -92,25 +113,83 @@ static bool fwd_nocrc_pkt = false; /* packets with NO PAYLOAD CRC are NOT forwar
 
 /* network configuration variables */
 static uint64_t lgwm = 0; /* Lora gateway MAC address */
-static char server[64] = "server"; /* address of the server (host name or IPv4/IPv6) */
-static char port[8] = "port"; /* server port for upstream traffic */
-static char serv_port_down[8] = "1700"; /* server port for downstream traffic */
-static char serv_port_up[8] = "1700"; /* server port for downstream traffic */
 static int keepalive_time = DEFAULT_KEEPALIVE; /* send a PULL_DATA request every X seconds, negative = disabled */
 static char platform[16] = "LG01/OLG01";  /* platform definition */
 static char description[16] = "";                        /* used for free form description */
-static char email[32]  = "mail";                        /* used for contact email */
-static char LAT[16] = "lati";
-static char LON[16] = "long";
-static char gatewayid[64] = "gateway_id";
-static char sf[8] = "SF";
-static char bw[8] = "BW";
-static char coderate[16] = "coderate";
-static char frequency[16] = "rx_frequency";
+static char email[32]  = "";                        /* used for contact email */
+static char LAT[16] = "";
+static char LON[16] = "";
+static char gatewayid[64] = "";
+static char sf[8] = "";
+static char bw[8] = "";
+static char coderate[16] = "";
+static char frequency[16] = "";
 static char pfwd_debug[4] = "yes";
-
-/* Set center frequency */
-static uint32_t  freq = 868100000; /* in Mhz! (868.1) */
+static char ingest[8] = ""; /* uplink ingest mode: "inotify" or "poll" */
+
+/* uplink ingest modes */
+#define INGEST_POLL     0 /* stat() cfgdata every FETCH_SLEEP_MS, fixed settle delays */
+#define INGEST_INOTIFY  1 /* wake on close-after-write of the MCU data file */
+static int ingest_mode = INGEST_INOTIFY;
+
+/* runtime: one thread per path (historical) or a single epoll loop */
+static char runtime[16] = ""; /* "threads" or "epoll" */
+#define RUNTIME_THREADS 0
+#define RUNTIME_EPOLL   1
+static int runtime_mode = RUNTIME_THREADS;
+
+/* uplink aggregation: uplinks ingested within the window share one PUSH_DATA */
+static char push_window[16] = ""; /* aggregation window in ms, 0 = one packet per datagram */
+static char push_batch[16] = "";   /* max number of rxpk per datagram (1..NB_PKT_MAX) */
+
+/* uplink duplicate filter, owned by thread_up or the event loop */
+#define DEFAULT_DEDUP_MS 2000
+static char dedup_window[16] = ""; /* ms a packet is remembered, 0 = no filtering */
+static struct dedup_s dedup;
+
+/* uplink identity filter, owned by thread_up or the event loop; a (re)load
+   builds the rules into upfilter_next and moves filter_gen when they change */
+#define FILTER_RULE_MAX 64 /* rules read per option */
+static struct upfilter_s upfilter;
+static struct upfilter_s upfilter_next;
+static pthread_mutex_t mx_filter = PTHREAD_MUTEX_INITIALIZER; /* control access to upfilter_next, and to upfilter outside its owner */
+static uint32_t filter_gen = 0;
+
+#define LEGACY_LSNR 7.8 /* the text format has no SNR */
+
+/* settings of the uplink path that a reload can change; main() publishes
+   them under a sequence counter (odd while writing), the uplink path takes
+   a consistent copy when the counter moves */
+struct up_conf_s {
+    uint32_t freq_hz; /* radio settings reported for packets whose MCU format does not carry them */
+    uint32_t datarate;
+    uint8_t  bandwidth;
+    uint8_t  coderate;
+    int      aggr_window_ms;
+    int      aggr_max;
+    uint32_t dedup_ms;
+    uint32_t filter_gen; /* upfilter_next holds the rules of that generation */
+};
+static struct up_conf_s up_conf_pub;
+static volatile uint32_t up_conf_seq = 0;
+
+/* UCI configuration, loaded with a single parse; a reload parses into the
+   spare snapshot and swaps it in only if that succeeded */
+#define UCI_CONFIG_DIR "/etc/config"
+#define UCI_CONFIG_NAME "lorawan"
+#define UCI_CONFIG_FILE UCI_CONFIG_DIR "/" UCI_CONFIG_NAME
+static struct conf_s conf_snaps[2];
+static struct conf_s *conf = &conf_snaps[0];
+static int fd_conf = -1; /* inotify on UCI_CONFIG_DIR, reload when the package is rewritten */
+static const char *const conf_names[] = {UCI_CONFIG_NAME, NULL};
+
+/* servers as configured, applied to servers[] at start-up and on reload */
+struct serv_conf_s {
+    char    addr[64];
+    char    port[8];
+    bool    downlink;
+};
+static int nb_serv_conf = 0; /* servers configured at start-up, servers[] only keeps those that could be resolved */
 
 /* Set location */
 static float lat=0.0;
@@ -118,99 +197,20 @@ static float lon=0.0;
 static int   alt=0;
 
 /* lora packages data */
-#define UPCFGPATH "/var/iot/cfgdata"
-#define UPPATH "/var/iot/data"
+#define UPDIR "/var/iot"
+#define UPCFGPATH UPDIR "/cfgdata"
+#define UPPATH UPDIR "/data"
+#define UPFILE "data"   /* MCU writes cfgdata first, then data: closing data completes a packet */
+#define UPRECPATH UPDIR "/uprec"
+#define UPRECFILE "uprec" /* binary record, see mcurec.h, preferred over cfgdata/data */
+#define TXACKPATH UPDIR "/txack"
+#define TXACKFILE "txack" /* transmit reports of the MCU, see mcurec.h */
+#define TXTAKENPATH UPDIR "/txack.rd"
+#define TXTAKENFILE "txack.rd" /* reports taken from TXACKFILE, read from txrep_off on */
+static off_t txrep_off = 0;
 static char dlpath[32];
 static int roundtrip = 1;
 
-/* values available for the 'modulation' parameters */
-/* NOTE: arbitrary values */
-#define MOD_UNDEFINED   0
-#define MOD_LORA        0x10
-#define MOD_FSK         0x20
-
-/* values available for the 'bandwidth' parameters (LoRa & FSK) */
-/* NOTE: directly encode FSK RX bandwidth, do not change */
-#define BW_UNDEFINED    0
-#define BW_500KHZ       0x01
-#define BW_250KHZ       0x02
-#define BW_125KHZ       0x03
-#define BW_62K5HZ       0x04
-#define BW_31K2HZ       0x05
-#define BW_15K6HZ       0x06
-#define BW_7K8HZ        0x07
-
-/* values available for the 'datarate' parameters */
-/* NOTE: LoRa values used directly to code SF bitmask in 'multi' modem, do not change */
-#define DR_UNDEFINED    0
-#define DR_LORA_SF7     0x02
-#define DR_LORA_SF8     0x04
-#define DR_LORA_SF9     0x08
-#define DR_LORA_SF10    0x10
-#define DR_LORA_SF11    0x20
-#define DR_LORA_SF12    0x40
-#define DR_LORA_MULTI   0x7E
-
-/* values available for the 'coderate' parameters (LoRa only) */
-/* NOTE: arbitrary values */
-#define CR_UNDEFINED    0
-#define CR_LORA_4_5     0x01
-#define CR_LORA_4_6     0x02
-#define CR_LORA_4_7     0x03
-#define CR_LORA_4_8     0x04
-
-/* values available for the 'tx_mode' parameter */
-#define IMMEDIATE       0
-#define TIMESTAMPED     1
-#define ON_GPS          2
-
-/**
-@struct lgw_pkt_rx_s
-@brief Structure containing the metadata of a packet that was received and a pointer to the payload
-*/
-struct lgw_pkt_rx_s {
-    uint32_t    freq_hz;        /*!> central frequency of the IF chain */
-    uint8_t     if_chain;       /*!> by which IF chain was packet received */
-    uint8_t     status;         /*!> status of the received packet */
-    uint32_t    count_us;       /*!> internal concentrator counter for timestamping, 1 microsecond resolution */
-    uint8_t     rf_chain;       /*!> through which RF chain the packet was received */
-    uint8_t     modulation;     /*!> modulation used by the packet */
-    uint8_t     bandwidth;      /*!> modulation bandwidth (LoRa only) */
-    uint32_t    datarate;       /*!> RX datarate of the packet (SF for LoRa) */
-    uint8_t     coderate;       /*!> error-correcting code of the packet (LoRa only) */
-    float       rssi;           /*!> average packet RSSI in dB */
-    float       snr;            /*!> average packet SNR, in dB (LoRa only) */
-    float       snr_min;        /*!> minimum packet SNR, in dB (LoRa only) */
-    float       snr_max;        /*!> maximum packet SNR, in dB (LoRa only) */
-    uint16_t    crc;            /*!> CRC that was received in the payload */
-    uint16_t    size;           /*!> payload size in bytes */
-    uint8_t     payload[256];   /*!> buffer containing the payload */
-};
-
-/**
-@struct lgw_pkt_tx_s
-@brief Structure containing the configuration of a packet to send and a pointer to the payload
-*/
-struct lgw_pkt_tx_s {
-    uint32_t    freq_hz;        /*!> center frequency of TX */
-    uint8_t     tx_mode;        /*!> select on what event/time the TX is triggered */
-    uint32_t    count_us;       /*!> timestamp or delay in microseconds for TX trigger */
-    uint8_t     rf_chain;       /*!> through which RF chain will the packet be sent */
-    int8_t      rf_power;       /*!> TX power, in dBm */
-    uint8_t     modulation;     /*!> modulation to use for the packet */
-    uint8_t     bandwidth;      /*!> modulation bandwidth (LoRa only) */
-    uint32_t    datarate;       /*!> TX datarate (baudrate for FSK, SF for LoRa) */
-    uint8_t     coderate;       /*!> error-correcting code of the packet (LoRa only) */
-    bool        invert_pol;     /*!> invert signal polarity, for orthogonal downlinks (LoRa only) */
-    uint8_t     f_dev;          /*!> frequency deviation, in kHz (FSK only) */
-    uint16_t    preamble;       /*!> set the preamble length, 0 for default */
-    bool        no_crc;         /*!> if true, do not send a CRC in the packet */
-    bool        no_header;      /*!> if true, enable implicit header mode (LoRa), fixed length (FSK) */
-    uint16_t    size;           /*!> payload size in bytes */
-    uint8_t     payload[256];   /*!> buffer containing the payload */
-};
-
-
 /* statistics collection configuration variables */
 static unsigned stat_interval = DEFAULT_STAT; /* time interval (in sec) at which statistics are collected and displayed */
 
@@ -218,38 +218,202 @@ static unsigned stat_interval = DEFAULT_STAT; /* time interval (in sec) at which
 static uint32_t net_mac_h; /* Most Significant Nibble, network order */
 static uint32_t net_mac_l; /* Least Significant Nibble, network order */
 
-/* network sockets */
-static int sock_stat; /* socket for upstream traffic */
-static int sock_up; /* socket for upstream traffic */
-static int sock_down; /* socket for downstream traffic */
-
 /* network protocol variables */
 static struct timeval push_timeout_half = {0, (PUSH_TIMEOUT_MS * 500)}; /* cut in half, critical for throughput */
 static struct timeval pull_timeout = {0, (PULL_TIMEOUT_MS * 1000)}; /* non critical for throughput */
 
+/* PUSH_DATA sent and not yet acknowledged, matched by thread_up_ack */
+struct up_token_s {
+    bool            used;
+    uint8_t         token_h;
+    uint8_t         token_l;
+    int             nb_pkt;     /* number of rxpk carried by the datagram */
+    struct timespec send_time;
+    uint32_t        addr_gen;   /* generation of the server address it was sent to */
+    uint32_t        rx_time;    /* UNIX time the oldest packet was received, for the journal age limit */
+    uint16_t        rxpk_len;
+    uint8_t         rxpk[TX_BUFF_SIZE]; /* rxpk array content, journaled if never acknowledged */
+};
+
+/* store-and-forward journal of the uplinks never acknowledged */
+#define DEFAULT_JOURNAL_SIZE	256		/* in KB, 0 = disabled */
+#define DEFAULT_JOURNAL_AGE		86400	/* records older than this (in s) are given up */
+#define DEFAULT_JOURNAL_RATE	2		/* max replayed datagrams per second */
+static char journal_path[64] = "journal_path"; /* should be on a storage surviving reboots (USB/SD) for outages across power cycles */
+static char journal_size[16] = "journal_size";
+static char journal_age[16] = "journal_age";
+static char journal_rate[16] = "journal_rate";
+static pthread_mutex_t mx_journal = PTHREAD_MUTEX_INITIALIZER; /* control access to the journal */
+static struct journal_s journal;
+static bool journal_enabled = false;
+static uint32_t journal_max_age = DEFAULT_JOURNAL_AGE;
+static int replay_interval_ms = 1000 / DEFAULT_JOURNAL_RATE;
+
 /* hardware access control and correction */
 static pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* control access to the concentrator */
 
-/* measurements to establish statistics */
-static pthread_mutex_t mx_meas_up = PTHREAD_MUTEX_INITIALIZER; /* control access to the upstream measurements */
-static uint32_t meas_nb_rx_rcv = 0; /* count packets received */
-static uint32_t meas_nb_rx_ok = 0; /* count packets received with PAYLOAD CRC OK */
-static uint32_t meas_nb_rx_bad = 0; /* count packets received with PAYLOAD CRC ERROR */
-static uint32_t meas_nb_rx_nocrc = 0; /* count packets received with NO PAYLOAD CRC */
-static uint32_t meas_up_pkt_fwd = 0; /* number of radio packet forwarded to the server */
-static uint32_t meas_up_network_byte = 0; /* sum of UDP bytes sent for upstream traffic */
-static uint32_t meas_up_payload_byte = 0; /* sum of radio payload bytes sent for upstream traffic */
-static uint32_t meas_up_dgram_sent = 0; /* number of datagrams sent for upstream traffic */
-static uint32_t meas_up_ack_rcv = 0; /* number of datagrams acknowledged for upstream traffic */
-
-static pthread_mutex_t mx_meas_dw = PTHREAD_MUTEX_INITIALIZER; /* control access to the downstream measurements */
-static uint32_t meas_dw_pull_sent = 0; /* number of PULL requests sent for downstream traffic */
-static uint32_t meas_dw_ack_rcv = 0; /* number of PULL requests acknowledged for downstream traffic */
-static uint32_t meas_dw_dgram_rcv = 0; /* count PULL response packets received for downstream traffic */
-static uint32_t meas_dw_network_byte = 0; /* sum of UDP bytes sent for upstream traffic */
-static uint32_t meas_dw_payload_byte = 0; /* sum of radio payload bytes sent for upstream traffic */
-static uint32_t meas_nb_tx_ok = 0; /* count packets emitted successfully */
-static uint32_t meas_nb_tx_fail = 0; /* count packets were TX failed for other reasons */
+/* downlinks waiting for their emit time, protected by mx_concent */
+static struct jit_queue_s jit_queue;
+static pthread_cond_t cv_jit = PTHREAD_COND_INITIALIZER; /* signaled when a frame is queued */
+
+/* measurements to establish statistics
+   each group is written by a single thread and read-and-cleared by main(),
+   every access is atomic so no lock is taken on the packet path */
+#define MEAS_ADD(x, v)	__sync_fetch_and_add(&(x), (v))
+#define MEAS_TAKE(x)	__sync_fetch_and_and(&(x), 0) /* read and reset */
+#define MEAS_SET(x, v)	__sync_lock_test_and_set(&(x), (v))
+#define MEAS_GET(x)		__sync_fetch_and_add(&(x), 0)
+
+struct meas_up_s { /* thread_up */
+    uint32_t nb_rx_rcv; /* count packets received */
+    uint32_t nb_rx_ok; /* count packets received with PAYLOAD CRC OK */
+    uint32_t nb_rx_bad; /* count packets received with PAYLOAD CRC ERROR */
+    uint32_t nb_rx_nocrc; /* count packets received with NO PAYLOAD CRC */
+    uint32_t nb_rx_dup; /* count packets dropped as duplicates */
+    uint32_t nb_rx_filtered; /* count packets dropped by the identity filter */
+    uint32_t up_pkt_fwd; /* number of radio packet forwarded to the server */
+    uint32_t up_payload_byte; /* sum of radio payload bytes sent for upstream traffic */
+};
+static struct meas_up_s meas_up;
+
+struct meas_serv_s { /* per server, thread_up and the thread_up_ack of that server */
+    uint32_t up_network_byte; /* sum of UDP bytes sent for upstream traffic */
+    uint32_t up_dgram_sent; /* number of datagrams sent for upstream traffic */
+    uint32_t up_ack_evicted; /* number of datagrams given up because the in-flight table was full */
+    uint32_t up_ack_rcv; /* number of datagrams acknowledged for upstream traffic */
+    uint32_t up_ack_lost; /* number of datagrams not acknowledged within PUSH_ACK_TIMEOUT_MS */
+};
+
+struct meas_dw_s { /* per server, thread_down of that server */
+    uint32_t dw_pull_sent; /* number of PULL requests sent for downstream traffic */
+    uint32_t dw_ack_rcv; /* number of PULL requests acknowledged for downstream traffic */
+    uint32_t dw_dgram_rcv; /* count PULL response packets received for downstream traffic */
+    uint32_t dw_network_byte; /* sum of UDP bytes received for downstream traffic */
+    uint32_t dw_payload_byte; /* sum of radio payload bytes received for downstream traffic */
+    uint32_t nb_tx_requested; /* count TX request from server (downlinks) */
+    uint32_t nb_tx_rejected_collision; /* count packets were TX request were rejected due to collision with another packet already programmed */
+    uint32_t nb_tx_rejected_too_late; /* count packets were TX request were rejected because it is too late to send it */
+    uint32_t nb_tx_rejected_too_early; /* count packets were TX request were rejected because timestamp is too much in advance */
+    uint32_t nb_tx_queue_full; /* count packets were TX request were rejected because the JIT queue is full */
+    uint32_t nb_tx_denied; /* count TX request ignored because downlinks are not allowed from that server */
+};
+
+struct meas_jit_s { /* thread_jit, and the transmit reports of the MCU */
+    uint32_t nb_tx_handed; /* count packets handed over to the MCU */
+    uint32_t nb_tx_ok; /* count packets the MCU reported as transmitted */
+    uint32_t nb_tx_fail; /* count packets that could not be handed over or the MCU failed to transmit */
+    uint32_t nb_tx_unconfirmed; /* count packets handed over with no transmit report within DL_REPORT_TIMEOUT_MS */
+};
+static struct meas_jit_s meas_jit;
+
+struct meas_jn_s { /* thread_up and thread_up_ack, under mx_journal */
+    uint32_t stored; /* number of datagrams journaled because they were not acknowledged */
+    uint32_t overflow; /* number of records given up because the journal was full */
+    uint32_t expired; /* number of records given up because they were too old */
+    uint32_t replayed_rec; /* number of records sent again */
+    uint32_t replayed_pkt; /* number of packets sent again */
+};
+static struct meas_jn_s meas_jn;
+
+struct meas_dd_s { /* copy of the dedup filter state, set by its owner, read by answer_query */
+    uint32_t window_ms;
+    uint32_t hit;
+    uint32_t miss;
+};
+static struct meas_dd_s meas_dd;
+
+/* upstream servers: the first one comes from the "general" section, the
+   others from sections "server1".."server<SERV_MAX-1>"; every packet is
+   serialized once and sent to all of them, each with its own tokens */
+#define SERV_MAX	4
+struct serv_s {
+    char            addr[64]; /* address of the server (host name or IPv4) */
+    char            port[8]; /* server port for upstream and downstream traffic */
+    bool            downlink; /* PULL_RESP from this server are transmitted */
+    int             conf_idx; /* entry of the configured server list */
+    int             sock_up; /* socket for upstream traffic */
+    int             sock_down; /* socket for downstream traffic */
+    pthread_mutex_t mx_addr; /* control access to addrs, addr, port and the resolution schedule */
+    struct servaddr_set_s addrs; /* addresses addr resolves to, both sockets are connected to addrs.cur */
+    struct timespec resolve_next; /* when addr is resolved again */
+    bool            resolve_due; /* resolve addr at resolve_next even if re-resolution is disabled */
+    pthread_t       thrid_up_ack;
+    pthread_t       thrid_down;
+    pthread_mutex_t mx_inflight; /* control access to the in-flight table */
+    struct up_token_s inflight[UP_INFLIGHT_MAX];
+    volatile bool   backhaul_up; /* latest PUSH_DATA outcome was an ACK */
+    uint8_t         pull_token_h; /* token of the latest PULL_DATA */
+    uint8_t         pull_token_l;
+    bool            pull_acked; /* the latest PULL_DATA was acknowledged */
+    struct timespec pull_time; /* when the latest PULL_DATA was sent */
+    uint32_t        pull_gen; /* generation of the address it was sent to */
+    uint32_t        autoquit_cnt; /* number of PULL_DATA sent since the latest PULL_ACK */
+    JSON_Arena      arena; /* parse trees of the PULL_RESP, no heap traffic */
+    struct meas_serv_s meas;
+    struct meas_dw_s meas_dw;
+};
+static struct serv_s servers[SERV_MAX];
+static int nb_serv = 0;
+static uint8_t arena_buffs[SERV_MAX][JSON_ARENA_SIZE]; /* backing store of the arenas */
+
+/* downlinks from their PULL_RESP to the transmit report of the MCU: each
+   one gets a TX_ACK once its outcome is known, and the time of every stage
+   feeds the downlink histograms */
+#define DL_TRACK_MAX			(2 * JIT_QUEUE_MAX) /* queued, plus handed over and waiting for their report */
+#define DL_REPORT_TIMEOUT_MS	30000 /* the sketch only transmits after the next uplink of the device */
+struct dl_track_s {
+    uint16_t        id; /* 0 for a free entry */
+    uint8_t         token_h; /* token of the PULL_RESP, echoed in the TX_ACK */
+    uint8_t         token_l;
+    struct serv_s   *serv;
+    bool            handed; /* handed over to the MCU, waiting for its report */
+    char            name[MCUREC_TX_NAME_LEN + 1]; /* downlink file handed over */
+    uint32_t        rcv_us; /* PULL_RESP received, tmst time base */
+    uint32_t        queue_us; /* queued */
+    uint32_t        hand_us; /* handed over to the MCU */
+};
+static pthread_mutex_t mx_dl_track = PTHREAD_MUTEX_INITIALIZER; /* control access to dl_track */
+static struct dl_track_s dl_track[DL_TRACK_MAX];
+static uint16_t dl_track_id = 0; /* id of the latest downlink */
+
+/* server names are resolved again in the background, getaddrinfo() blocks;
+   a failed lookup keeps the cached addresses */
+#define DEFAULT_RESOLVE_S	300	/* re-resolution interval, 0 = only at start-up and on reload */
+#define RESOLVE_RETRY_S		30	/* interval after a failed lookup */
+static char resolve_interval[16] = "";
+static volatile int resolve_s = DEFAULT_RESOLVE_S;
+static pthread_mutex_t mx_resolve = PTHREAD_MUTEX_INITIALIZER; /* control access to resolve_wake */
+static pthread_cond_t cv_resolve = PTHREAD_COND_INITIALIZER; /* signaled when a server must be resolved now */
+static bool resolve_wake = false;
+
+/* uplink datagram being composed, owned by thread_up or the event loop */
+struct up_state_s {
+    uint8_t         buff[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
+    int             index;
+    int             nb_pkt; /* number of rxpk already in the datagram being composed */
+    uint32_t        payload_byte;
+    bool            replay; /* the datagram being sent comes from the journal */
+    struct timespec first_time; /* ingest time of the oldest packet in the datagram */
+    struct timespec next_replay; /* journal replay pacing */
+    uint32_t        rx_time; /* UNIX time of the oldest packet in the datagram */
+    struct rxpk_fmt_s rxpk_fmt; /* pre-rendered rxpk fragments */
+    struct up_conf_s conf; /* copy of the published settings */
+    uint32_t        conf_seq; /* sequence of that copy */
+};
+
+/* latency histograms, cumulative since start-up, served on the query socket */
+static struct hist_s hist_push_ack; /* PUSH_DATA -> PUSH_ACK round trip, all servers */
+static struct hist_s hist_pull_ack; /* PULL_DATA -> PULL_ACK round trip, all servers */
+static struct hist_s hist_up_latency; /* MCU write of the oldest packet -> PUSH_DATA sent */
+static struct hist_s hist_dw_queue; /* PULL_RESP queued -> frame handed over to the MCU */
+static struct hist_s hist_dw_tx; /* frame handed over to the MCU -> transmit report */
+static struct hist_s hist_dw_total; /* PULL_RESP received -> transmit report */
+
+/* local query socket */
+#define DEFAULT_QUERY_PORT	"1710"
+#define QUERY_SIZE			8192
+static char query_port[16] = "query_port"; /* UDP port on 127.0.0.1 returning the histograms, 0 = disabled */
+static int sock_query = -1;
 
 /* auto-quit function */
 static uint32_t autoquit_threshold = 0; /* enable auto-quit after a number of non-acknowledged PULL_DATA (0 = disabled)*/
@@ -259,18 +423,80 @@ static uint32_t autoquit_threshold = 0; /* enable auto-quit after a number of no
 
 static void sig_handler(int sigio);
 
-#define UCI_CONFIG_FILE "/etc/config/lorawan"
-static struct uci_context * ctx = NULL; 
-static bool get_lg01_config(const char *section, char *option, int len);
+static void report_conf_lost(const struct conf_s *c);
+static bool get_lg01_config(const char *section, const char *name, char *out, int len);
+static int read_config(bool reload, struct serv_conf_s *serv_conf, struct up_conf_s *up_conf);
+static void read_filter(struct up_conf_s *up_conf);
+static void publish_up_conf(const struct up_conf_s *up_conf);
+static bool reload_config(void);
+static int open_notify(const char *dir);
+static unsigned read_notify(int fd, const char *const *names);
 static bool get_lora_value(const char *data, char *option);
+static void fill_rx_defaults(const struct up_conf_s *up_conf, struct lgw_pkt_rx_s *pkt);
+static bool fetch_up_record(struct lgw_pkt_rx_s *pkt);
+static bool fetch_up_packet(struct lgw_pkt_rx_s *pkt, bool settle);
+static int open_up_notify(void);
+static bool read_up_notify(int fd);
+static bool wait_up_notify(int fd, int timeout_ms);
 
 static double difftimespec(struct timespec end, struct timespec beginning);
+static uint32_t timespec_to_tmst(const struct timespec *t);
+static uint32_t get_tmst(void);
 
 static void wait_ms(unsigned long a); 
 
+static int inflight_add(struct serv_s *serv, uint8_t *token_h, uint8_t *token_l, int nb_pkt, const uint8_t *rxpk, int rxpk_len, uint32_t rx_time);
+static bool inflight_ack(struct serv_s *serv, uint8_t token_h, uint8_t token_l, const struct timespec *recv_time, uint32_t *rtt_us, int *nb_pkt);
+static int inflight_expire(struct serv_s *serv, const struct timespec *now);
+static int inflight_wait_ms(struct serv_s *serv, const struct timespec *now);
+static void journal_store(const struct up_token_s *entry);
+static bool journal_pending(void);
+static int journal_replay(uint8_t *buff, int max_len, int *nb_pkt, uint32_t *rx_time);
+
+static int write_down_packet(const struct lgw_pkt_tx_s *pkt);
+static void send_tx_ack(struct serv_s *serv, uint8_t token_h, uint8_t token_l, const char *error);
+static uint16_t dl_track_open(struct serv_s *serv, uint8_t token_h, uint8_t token_l, uint32_t rcv_us, uint32_t queue_us);
+static void dl_track_handed(uint16_t id, const char *name, uint32_t hand_us);
+static void dl_track_close(uint16_t id, const char *error);
+static void dl_track_report(const struct mcurec_tx_s *tx, uint32_t now_us);
+static void dl_track_expire(uint32_t now_us);
+static bool read_tx_reports(int fd, off_t *off, uint32_t now_us);
+static void fetch_tx_report(void);
+static void wait_tx_report(int fd, int timeout_ms);
+
+static int resolve_server(const char *addr, const char *port, struct sockaddr_in *tab, int max);
+static bool serv_connect(struct serv_s *serv);
+static uint32_t serv_gen(struct serv_s *serv);
+static void serv_ack(struct serv_s *serv, uint32_t rtt_us);
+static void serv_lost(struct serv_s *serv, uint32_t gen, int nb);
+static int open_query_socket(const char *port);
+static void answer_query(void);
+static void serve_queries(int timeout_ms);
+static void report_stats(void);
+
+/* packet paths, shared by the threads and the event loop */
+static void up_init(struct up_state_s *up);
+static void up_refresh(struct up_state_s *up);
+static int up_wait_ms(const struct up_state_s *up, const struct timespec *now, int max_ms);
+static void up_ingest(struct up_state_s *up, struct lgw_pkt_rx_s *pkt, const struct timespec *ingest_time);
+static bool up_flush(struct up_state_s *up);
+static void up_ack_receive(struct serv_s *serv, const uint8_t *buff, int len, const struct timespec *recv_time);
+static void up_ack_expire(struct serv_s *serv, const struct timespec *now);
+static bool down_send_pull(struct serv_s *serv);
+static void down_receive(struct serv_s *serv, uint8_t *buff, int msg_len, const struct timespec *recv_time);
+static enum jit_error_e jit_dispatch(uint32_t *wait_us);
+
 /* threads */
-void thread_up(void);
-void thread_down(void);
+void * thread_up(void *arg); /* arg is unused */
+void * thread_up_ack(void *arg); /* arg is the struct serv_s of the server */
+void * thread_down(void *arg); /* arg is the struct serv_s of the server */
+void * thread_jit(void *arg); /* arg is unused */
+void * thread_resolve(void *arg); /* arg is unused */
+
+/* event loop */
+static int timerfd_periodic(int period_ms);
+static bool epoll_watch(int epfd, int fd, uint32_t tag);
+static void run_event_loop(void);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -280,39 +506,32 @@ static void sig_handler(int sigio) {
 		quit_sig = true;;
 	} else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
 		exit_sig = true;
+	} else if (sigio == SIGHUP) {
+		reload_sig = true;
 	}
 	return;
 }
 
-static bool get_lg01_config(const char *section, char *option, int len) {
-    struct uci_package * pkg = NULL;
-    struct uci_element *e;
+/* name the options a snapshot had to leave out rather than keep cut */
+static void report_conf_lost(const struct conf_s *c) {
+    int i;
+
+    for (i = 0; (i < c->nb_lost) && (i < CONF_LOST_MAX); i++)
+        MSG("WARNING: [main] option %s ignored, too long or too many options\n", c->lost[i]);
+    if (c->nb_lost > CONF_LOST_MAX)
+        MSG("WARNING: [main] %d more option(s) ignored\n", c->nb_lost - CONF_LOST_MAX);
+}
+
+/* copy an option of the current configuration snapshot, false if it is not set */
+static bool get_lg01_config(const char *section, const char *name, char *out, int len) {
     const char *value;
-    bool ret = false;
-
-    ctx = uci_alloc_context(); 
-    if (UCI_OK != uci_load(ctx, UCI_CONFIG_FILE, &pkg))  
-        goto cleanup;   /* load uci conifg failed*/
-
-    uci_foreach_element(&pkg->sections, e)
-    {
-        struct uci_section *st = uci_to_section(e);
-
-        if(!strcmp(section, st->e.name))  /* compare section name */ {
-            if (NULL != (value = uci_lookup_option_string(ctx, st, option))) {
-	                 memset(option, 0, len);
-                     strncpy(option, value, len); 
-                     //MSG("get config value here, option=%s, value=%s\n", option, value);
-                     ret = true;
-                     break;
-            }
-        }
-    }
-    uci_unload(ctx, pkg); /* free pkg which is UCI package */
-cleanup:
-    uci_free_context(ctx);
-    ctx = NULL;
-    return ret;
+
+    value = conf_get(conf, section, name);
+    if (value == NULL)
+        return false;
+    memset(out, 0, len);
+    strncpy(out, value, len - 1);
+    return true;
 }
 
 static double difftimespec(struct timespec end, struct timespec beginning) {
@@ -324,6 +543,18 @@ static double difftimespec(struct timespec end, struct timespec beginning) {
 	return x;
 }
 
+/* tmst time base: realtime clock in microseconds, wraps every ~71 minutes */
+static uint32_t timespec_to_tmst(const struct timespec *t) {
+	return (uint32_t)t->tv_sec * 1000000U + (uint32_t)(t->tv_nsec / 1000);
+}
+
+static uint32_t get_tmst(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return timespec_to_tmst(&now);
+}
+
 static void wait_ms(unsigned long a) {
     struct timespec dly;
     struct timespec rem;
@@ -340,414 +571,1961 @@ static void wait_ms(unsigned long a) {
     return;
 }
 
-static bool get_lora_value(const char *data, char *option) {
-    char *pt;
-    int i, j = 0;
+/* pick a token that is not already in flight for that server and register it,
+   the oldest entry is given up if the table is full, return the number of
+   entries given up; only the primary server keeps rxpk for the journal */
+static int inflight_add(struct serv_s *serv, uint8_t *token_h, uint8_t *token_l, int nb_pkt, const uint8_t *rxpk, int rxpk_len, uint32_t rx_time) {
+    struct up_token_s *tab = serv->inflight;
+    uint32_t gen = serv_gen(serv);
+    int i, slot = -1;
+    int evicted = 0;
+    bool clash;
+
+    if (serv != &servers[0])
+        rxpk_len = 0;
+
+    pthread_mutex_lock(&serv->mx_inflight);
+    for (i = 0; i < UP_INFLIGHT_MAX; i++) {
+        if (!tab[i].used) {
+            slot = i;
+            break;
+        }
+        if ((slot < 0) || (difftimespec(tab[slot].send_time, tab[i].send_time) > 0))
+            slot = i;
+    }
+    if (tab[slot].used) {
+        journal_store(&tab[slot]);
+        tab[slot].used = false;
+        evicted = 1;
+    }
+    do {
+        *token_h = (uint8_t)rand(); /* random token */
+        *token_l = (uint8_t)rand(); /* random token */
+        clash = false;
+        for (i = 0; i < UP_INFLIGHT_MAX; i++) {
+            if (tab[i].used && (tab[i].token_h == *token_h) && (tab[i].token_l == *token_l)) {
+                clash = true;
+                break;
+            }
+        }
+    } while (clash);
+    tab[slot].used = true;
+    tab[slot].token_h = *token_h;
+    tab[slot].token_l = *token_l;
+    tab[slot].nb_pkt = nb_pkt;
+    tab[slot].addr_gen = gen;
+    tab[slot].rx_time = rx_time;
+    tab[slot].rxpk_len = rxpk_len;
+    memcpy(tab[slot].rxpk, rxpk, rxpk_len);
+    clock_gettime(CLOCK_MONOTONIC, &tab[slot].send_time);
+    pthread_mutex_unlock(&serv->mx_inflight);
+    return evicted;
+}
 
-    pt = strstr(data, option);
-    if (NULL == pt)
-        return false;
+static bool inflight_ack(struct serv_s *serv, uint8_t token_h, uint8_t token_l, const struct timespec *recv_time, uint32_t *rtt_us, int *nb_pkt) {
+    struct up_token_s *tab = serv->inflight;
+    int i;
+    bool found = false;
+
+    pthread_mutex_lock(&serv->mx_inflight);
+    for (i = 0; i < UP_INFLIGHT_MAX; i++) {
+        if (tab[i].used && (tab[i].token_h == token_h) && (tab[i].token_l == token_l)) {
+            *rtt_us = (uint32_t)(1000000 * difftimespec(*recv_time, tab[i].send_time));
+            *nb_pkt = tab[i].nb_pkt;
+            tab[i].used = false;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&serv->mx_inflight);
+    return found;
+}
 
-    i = strlen(option);
-    while(pt[i] && pt[i] != '\n') { 
-        option[j] = pt[i];
-        j++;
-        i++;
+/* release the tokens whose ACK deadline has passed, each counts against the
+   health of the address it was sent to; return how many were dropped */
+static int inflight_expire(struct serv_s *serv, const struct timespec *now) {
+    struct up_token_s *tab = serv->inflight;
+    int i, nb = 0;
+
+    pthread_mutex_lock(&serv->mx_inflight);
+    for (i = 0; i < UP_INFLIGHT_MAX; i++) {
+        if (tab[i].used && ((int)(1000 * difftimespec(*now, tab[i].send_time)) >= PUSH_ACK_TIMEOUT_MS)) {
+            serv_lost(serv, tab[i].addr_gen, 1);
+            journal_store(&tab[i]);
+            tab[i].used = false;
+            nb++;
+        }
     }
-    option[j] = '\0';
-    return true;
+    pthread_mutex_unlock(&serv->mx_inflight);
+    return nb;
 }
 
-/* -------------------------------------------------------------------------- */
-/* --- MAIN FUNCTION -------------------------------------------------------- */
+/* time left before the oldest token of a server expires, -1 if none is in flight */
+static int inflight_wait_ms(struct serv_s *serv, const struct timespec *now) {
+    struct up_token_s *tab = serv->inflight;
+    int i, left, wait = -1;
 
-int main(void)
-{
-	struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
-	int i, j; /* loop variable and temporary variable for return value */
-	
-	/* threads */
-	pthread_t thrid_up;
-	pthread_t thrid_down;
-	
-	/* network socket creation */
-	struct addrinfo hints;
-	struct addrinfo *result; /* store result of getaddrinfo */
-	struct addrinfo *q; /* pointer to move into *result data */
-	char host_name[64];
-	char port_name[64];
-	
-	/* variables to get local copies of measurements */
-	uint32_t cp_nb_rx_rcv;
-	uint32_t cp_nb_rx_ok;
-	uint32_t cp_nb_rx_bad;
-	uint32_t cp_nb_rx_nocrc;
-	uint32_t cp_up_pkt_fwd;
-	uint32_t cp_up_network_byte;
-	uint32_t cp_up_payload_byte;
-	uint32_t cp_up_dgram_sent;
-	uint32_t cp_up_ack_rcv;
-	uint32_t cp_dw_pull_sent;
-	uint32_t cp_dw_ack_rcv;
-	uint32_t cp_dw_dgram_rcv;
-	uint32_t cp_dw_network_byte;
-	uint32_t cp_dw_payload_byte;
-	uint32_t cp_nb_tx_ok;
-	uint32_t cp_nb_tx_fail;
-	
-	/* statistics variable */
-	time_t t;
-	char stat_timestamp[24];
-	float rx_ok_ratio;
-	float rx_bad_ratio;
-	float rx_nocrc_ratio;
-	float up_ack_ratio;
-	float dw_ack_ratio;
-	
-    unsigned long long ull = 0;
+    pthread_mutex_lock(&serv->mx_inflight);
+    for (i = 0; i < UP_INFLIGHT_MAX; i++) {
+        if (!tab[i].used)
+            continue;
+        left = PUSH_ACK_TIMEOUT_MS - (int)(1000 * difftimespec(*now, tab[i].send_time));
+        if (left < 0)
+            left = 0;
+        if ((wait < 0) || (left < wait))
+            wait = left;
+    }
+    pthread_mutex_unlock(&serv->mx_inflight);
+    return wait;
+}
 
-	/* display version informations */
-	//MSG("*** Basic Packet Forwarder for LG01 ***\nVersion: " VERSION_STRING "\n");
-	
-	/* display host endianness 
-	#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-		MSG("INFO: Little endian host\n");
-	#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-		MSG("INFO: Big endian host\n");
-	#else
-		MSG("INFO: Host endianness unknown\n");
-	#endif
-    */
-	
-	/* load configuration */
-    if (!get_lg01_config("general", server, 64)){
-        strcpy(server, "52.169.76.203");  /*set default:router.eu.thethings.network*/
-        MSG("get option server=%s", server);
+/* keep the packets of a datagram that was never acknowledged, called with the mx_inflight of the server held */
+static void journal_store(const struct up_token_s *entry) {
+    int i;
+
+    if (!journal_enabled || (entry->rxpk_len == 0))
+        return;
+    pthread_mutex_lock(&mx_journal);
+    i = journal_append(&journal, entry->rxpk, entry->rxpk_len, entry->nb_pkt, entry->rx_time);
+    pthread_mutex_unlock(&mx_journal);
+    if (i < 0) {
+        MSG("WARNING: [up] datagram too large for the journal, packets lost\n");
+        return;
+    }
+    MEAS_ADD(meas_jn.stored, 1);
+    MEAS_ADD(meas_jn.overflow, i);
+}
+
+/* true if records wait for a replay, the journal thread appends meanwhile */
+static bool journal_pending(void) {
+    uint32_t nb_rec;
+
+    if (!journal_enabled)
+        return false;
+    pthread_mutex_lock(&mx_journal);
+    nb_rec = journal.hdr->nb_rec;
+    pthread_mutex_unlock(&mx_journal);
+    return (nb_rec > 0);
+}
+
+/* move the oldest journal records into buff as one rxpk array content,
+   at most NB_PKT_MAX packets, return the number of bytes written */
+static int journal_replay(uint8_t *buff, int max_len, int *nb_pkt, uint32_t *rx_time) {
+    struct journal_rec_s rec;
+    int len = 0, sep = 0;
+    int nb_rec = 0;
+
+    *nb_pkt = 0;
+    *rx_time = (uint32_t)time(NULL);
+    pthread_mutex_lock(&mx_journal);
+    MEAS_ADD(meas_jn.expired, journal_expire(&journal, (uint32_t)time(NULL), journal_max_age));
+    while (len + sep < max_len) {
+        if (len > 0) {
+            buff[len] = ','; /* only kept if another record follows */
+            sep = 1;
+        }
+        if (!journal_peek(&journal, &rec, buff + len + sep, max_len - len - sep)) {
+            if ((len == 0) && (journal.hdr->nb_rec > 0))
+                journal_drop(&journal); /* can never be replayed */
+            break;
+        }
+        if ((*nb_pkt > 0) && (*nb_pkt + rec.nb_pkt > NB_PKT_MAX))
+            break;
+        if (nb_rec == 0)
+            *rx_time = rec.time; /* records are in order, the first is the oldest */
+        journal_drop(&journal);
+        len += sep + rec.len;
+        *nb_pkt += rec.nb_pkt;
+        nb_rec++;
     }
+    pthread_mutex_unlock(&mx_journal);
+    if (nb_rec > 0) {
+        MEAS_ADD(meas_jn.replayed_rec, nb_rec);
+        MEAS_ADD(meas_jn.replayed_pkt, *nb_pkt);
+    }
+    return len;
+}
 
-    if (!get_lg01_config("general", port, 8)){
-        strcpy(port, "1700");
-        MSG("get option port=%s", port);
+/* hand a downlink over to the MCU, return 0 on success, -1 otherwise; the
+   name of the file written is left in dlpath */
+static int write_down_packet(const struct lgw_pkt_tx_s *pkt) {
+    int fd, i;
+    char tmp[4];
+
+    memset(dlpath, 0, sizeof(dlpath));
+
+    if ((uint8_t)pkt->payload[0] == 32) {//hex 0x20 = 32
+        if (roundtrip > 5) 
+            roundtrip = 1;
+        sprintf(dlpath, "/var/iot/dldata%d", roundtrip);
+        roundtrip++; 
+    } else {
+        sprintf(dlpath, "/var/iot/%x%x%x%x", pkt->payload[1], pkt->payload[2], pkt->payload[3], pkt->payload[4]);
     }
 
-    strcpy(serv_port_up, port);
-    strcpy(serv_port_down, port);
+    if ((fd = open(dlpath, O_CREAT|O_RDWR|O_TRUNC)) < 0 ){
+        MSG("WARNING: [down]can't open downstream data file for write!");
+        return -1;
+    } else {
+        if ((i = write(fd, pkt->payload, pkt->size)) < pkt->size){
+            close(fd);
+            MSG("WARNING: [down]write downstream data file error!");
+            return -1;
+        }
+    }
 
-    if (!get_lg01_config("general", email, 32)){
-        strcpy(email, "dragino@dragino.com");
-        MSG("get option email=%s", email);
+    if (close(fd) != 0)
+        MSG("can't close updata file!");
+
+    printf("INFO: [down]txpk payload in hex(%dbyte): ", pkt->size);
+    for (i = 0; i < pkt->size; i++) {
+        memset(tmp, 0, sizeof(tmp));
+        sprintf(tmp, "%x", pkt->payload[i]);
+        if (strlen(tmp) == 2)
+            printf("%s", tmp);
+        else
+            printf("0%s", tmp);
     }
+    printf("\n");
+    return 0;
+}
 
-    if (!get_lg01_config("general", gatewayid, 64)){
-        MSG("get option gatewayid=%s", gatewayid);
-    } 
+/* answer a PULL_RESP, error is one of the protocol v2 codes ("NONE" if it was sent) */
+static void send_tx_ack(struct serv_s *serv, uint8_t token_h, uint8_t token_l, const char *error) {
+    uint8_t buff[64];
+    int len;
+
+    buff[0] = PROTOCOL_VERSION;
+    buff[1] = token_h;
+    buff[2] = token_l;
+    buff[3] = PKT_TX_ACK;
+    *(uint32_t *)(buff + 4) = net_mac_h;
+    *(uint32_t *)(buff + 8) = net_mac_l;
+    len = 12 + snprintf((char *)(buff + 12), sizeof buff - 12, "{\"txpk_ack\":{\"error\":\"%s\"}}", error);
+    send(serv->sock_down, (void *)buff, len, MSG_DONTWAIT);
+}
 
-    if (!get_lg01_config("general", LAT, 16)){
-        strcpy(LAT, "0");
-        MSG("get option lat=%s", LAT);
+/* start the timeline of a downlink, return the id it is queued with */
+static uint16_t dl_track_open(struct serv_s *serv, uint8_t token_h, uint8_t token_l, uint32_t rcv_us, uint32_t queue_us) {
+    struct dl_track_s *e = NULL;
+    uint16_t id;
+    int i;
+
+    pthread_mutex_lock(&mx_dl_track);
+    for (i = 0; i < DL_TRACK_MAX; i++) {
+        if (dl_track[i].id == 0) {
+            e = &dl_track[i];
+            break;
+        }
+        if ((e == NULL) || ((int32_t)(dl_track[i].rcv_us - e->rcv_us) < 0))
+            e = &dl_track[i]; /* table full: the oldest one goes without a TX_ACK */
     }
+    do {
+        dl_track_id++;
+    } while (dl_track_id == 0);
+    memset(e, 0, sizeof *e);
+    e->id = dl_track_id;
+    e->token_h = token_h;
+    e->token_l = token_l;
+    e->serv = serv;
+    e->rcv_us = rcv_us;
+    e->queue_us = queue_us;
+    id = e->id;
+    pthread_mutex_unlock(&mx_dl_track);
+    return id;
+}
 
-    if (!get_lg01_config("general", LON, 16)){
-        strcpy(LON, "0");
-        MSG("get option lon=%s", LON);
+/* the downlink is with the MCU, its transmit report closes it */
+static void dl_track_handed(uint16_t id, const char *name, uint32_t hand_us) {
+    size_t len;
+    int i;
+
+    pthread_mutex_lock(&mx_dl_track);
+    for (i = 0; i < DL_TRACK_MAX; i++) {
+        if (dl_track[i].id == id) {
+            dl_track[i].handed = true;
+            dl_track[i].hand_us = hand_us;
+            for (len = 0; (len < MCUREC_TX_NAME_LEN) && (name[len] != '\0'); len++)
+                ;
+            memcpy(dl_track[i].name, name, len);
+            dl_track[i].name[len] = '\0';
+            break;
+        }
     }
+    pthread_mutex_unlock(&mx_dl_track);
+}
 
-    /*
-    if (!get_lg01_config("general", pfwd_debug, 4)){
-        MSG("get option pfwd_debug=%s", pfwd_debug);
+/* the downlink will not be transmitted, tell its server why */
+static void dl_track_close(uint16_t id, const char *error) {
+    struct dl_track_s e;
+    int i;
+
+    e.id = 0;
+    pthread_mutex_lock(&mx_dl_track);
+    for (i = 0; i < DL_TRACK_MAX; i++) {
+        if (dl_track[i].id == id) {
+            e = dl_track[i];
+            dl_track[i].id = 0;
+            break;
+        }
     }
-    */
+    pthread_mutex_unlock(&mx_dl_track);
+    if (e.id != 0)
+        send_tx_ack(e.serv, e.token_h, e.token_l, error);
+}
 
-    if (!get_lg01_config("radio", sf, 8)){
-        MSG("get option sf=%s", sf);
+/* match a transmit report of the MCU with its downlink by file name, the
+   latest downlink written to a file is the one the MCU read; the sketch
+   reports the join accepts as "dldata" whatever the slot, so the name is
+   matched as a prefix, and an empty name matches nothing */
+static void dl_track_report(const struct mcurec_tx_s *tx, uint32_t now_us) {
+    struct dl_track_s *e = NULL;
+    struct dl_track_s found;
+    int i;
+
+    if (tx->name[0] == '\0') {
+        MSG("WARNING: [down] transmit report with no file name, ignored\n");
+        return;
+    }
+    pthread_mutex_lock(&mx_dl_track);
+    for (i = 0; i < DL_TRACK_MAX; i++) {
+        if ((dl_track[i].id == 0) || !dl_track[i].handed)
+            continue;
+        if (strncmp(dl_track[i].name, tx->name, strlen(tx->name)))
+            continue;
+        if ((e == NULL) || ((int32_t)(dl_track[i].hand_us - e->hand_us) > 0))
+            e = &dl_track[i];
     }
+    if (e != NULL) {
+        found = *e;
+        e->id = 0;
+    }
+    pthread_mutex_unlock(&mx_dl_track);
 
-    if (!get_lg01_config("radio", coderate, 8)){
-        MSG("get option coderate=%s", coderate);
+    if (e == NULL) {
+        MSG("WARNING: [down] transmit report for an unknown downlink (file \"%s\")\n", tx->name);
+        return;
     }
+    if (tx->result != MCUREC_TX_OK) {
+        MSG("WARNING: [down] downlink %u NOT transmitted by the MCU\n", found.id);
+        MEAS_ADD(meas_jit.nb_tx_fail, 1);
+        send_tx_ack(found.serv, found.token_h, found.token_l, "TOO_LATE"); /* v2 has no code for a failure, the frame missed its time */
+        return;
+    }
+    MSG("INFO: [down] downlink %u transmitted, timeline: queued +%u ms, handed over +%u ms, on air +%u ms\n", found.id,
+        (found.queue_us - found.rcv_us) / 1000, (found.hand_us - found.rcv_us) / 1000, (now_us - found.rcv_us) / 1000);
+    MEAS_ADD(meas_jit.nb_tx_ok, 1);
+    hist_add(&hist_dw_tx, now_us - found.hand_us);
+    hist_add(&hist_dw_total, now_us - found.rcv_us);
+    send_tx_ack(found.serv, found.token_h, found.token_l, "NONE");
+}
 
-    if (!get_lg01_config("radio", bw, 8)){
-        MSG("get option bw=%s", bw);
+/* give up on the downlinks the MCU did not report, no TX_ACK is sent for them */
+static void dl_track_expire(uint32_t now_us) {
+    int i, nb = 0;
+
+    pthread_mutex_lock(&mx_dl_track);
+    for (i = 0; i < DL_TRACK_MAX; i++) {
+        if ((dl_track[i].id != 0) && dl_track[i].handed && (now_us - dl_track[i].hand_us > 1000U * DL_REPORT_TIMEOUT_MS)) {
+            dl_track[i].id = 0;
+            nb++;
+        }
     }
+    pthread_mutex_unlock(&mx_dl_track);
+    if (nb > 0)
+        MEAS_ADD(meas_jit.nb_tx_unconfirmed, nb);
+}
 
-    if (!get_lg01_config("radio", frequency, 16)){
-        strcpy(frequency, "868100000"); /* default frequency*/
-        MSG("get option frequency=%s", frequency);
+/* report the complete transmit reports of fd from *off to its end, *off is
+   moved past them; return true if nothing is left, false if a report is
+   still being written */
+static bool read_tx_reports(int fd, off_t *off, uint32_t now_us) {
+    uint8_t buff[8 * MCUREC_TX_LEN];
+    struct mcurec_tx_s tx;
+    struct stat st;
+    int len, pos, i;
+
+    for (;;) {
+        len = pread(fd, buff, sizeof buff, *off);
+        if (len <= 0)
+            return true;
+        for (pos = 0; pos < len; pos += i) {
+            i = mcurec_decode_tx(buff + pos, len - pos, &tx);
+            if (i < 0) { /* out of sync, nothing after it can be trusted */
+                if (fstat(fd, &st) == 0) {
+                    MSG("WARNING: [down] invalid MCU transmit report, %ld byte(s) dropped\n", (long)(st.st_size - *off - pos));
+                    *off = st.st_size;
+                }
+                return true;
+            }
+            if (i == 0)
+                break;
+            dl_track_report(&tx, now_us);
+        }
+        *off += pos;
+        if ((pos < len) && (len < (int)sizeof buff))
+            return false;
     }
+}
 
-    lat = atof(LAT);
-    lon = atof(LON);
-    freq = atof(frequency);
+/* read the transmit reports of the MCU. It appends them to TXACKFILE, one
+   open/write/close per report; the file is renamed before it is read, so the
+   MCU starts a new one and nothing is lost to a truncation. The taken file is
+   read again from where it was left, a report the MCU was still writing when
+   it was renamed is completed there; once the MCU has started the new file,
+   it is done with the old one and an incomplete report is dropped */
+static void fetch_tx_report(void) {
+    uint32_t now_us = get_tmst();
+    int fd;
 
-    sscanf(gatewayid, "%llx", &ull);
-    lgwm = ull;
-	
-	/* sanity check on configuration variables */
-	// TODO
-	
-	/* process some of the configuration variables */
-	net_mac_h = htonl((uint32_t)(0xFFFFFFFF & (lgwm>>32)));
-	net_mac_l = htonl((uint32_t)(0xFFFFFFFF &  lgwm  ));
-	
-	/* prepare hints to open network sockets */
-	memset(&hints, 0, sizeof hints);
-	hints.ai_family = AF_INET; /* should handle IP v4 or v6 automatically */
-	hints.ai_socktype = SOCK_DGRAM;
-	
-	/* look for server address w/ upstream port */
-    //MSG("Looking for server with upstream port......\n");
-	i = getaddrinfo(server, serv_port_up, &hints, &result);
-	if (i != 0) {
-		MSG("ERROR: [up] getaddrinfo on address %s (PORT %s) returned %s\n", server, serv_port_up, gai_strerror(i));
-		exit(EXIT_FAILURE);
-	}
-	
-	/* try to open socket for upstream traffic */
-    //MSG("Try to open socket for upstream......\n");
-	for (q=result; q!=NULL; q=q->ai_next) {
-		sock_up = socket(q->ai_family, q->ai_socktype,q->ai_protocol);
-		if (sock_up == -1) continue; /* try next field */
-		else break; /* success, get out of loop */
-	}
-	if (q == NULL) {
-		MSG("ERROR: [up] failed to open socket to any of server %s addresses (port %s)\n", server, serv_port_up);
-		i = 1;
-		for (q=result; q!=NULL; q=q->ai_next) {
-			getnameinfo(q->ai_addr, q->ai_addrlen, host_name, sizeof host_name, port_name, sizeof port_name, NI_NUMERICHOST);
-			MSG("INFO: [up] result %i host:%s service:%s\n", i, host_name, port_name);
-			++i;
-		}
-		exit(EXIT_FAILURE);
-	}
-	
-	/* connect so we can send/receive packet with the server only */
-	i = connect(sock_up, q->ai_addr, q->ai_addrlen);
-	if (i != 0) {
-		MSG("ERROR: [up] connect returned %s\n", strerror(errno));
-		exit(EXIT_FAILURE);
-	}
-	freeaddrinfo(result);
+    if ((fd = open(TXTAKENPATH, O_RDONLY)) >= 0) {
+        if (!read_tx_reports(fd, &txrep_off, now_us)) {
+            if (access(TXACKPATH, F_OK) != 0) {
+                close(fd);
+                return;
+            }
+            MSG("WARNING: [down] incomplete MCU transmit report, dropped\n");
+        }
+        close(fd);
+    }
+    if (rename(TXACKPATH, TXTAKENPATH) != 0)
+        return;
+    txrep_off = 0;
+    if ((fd = open(TXTAKENPATH, O_RDONLY)) < 0)
+        return;
+    read_tx_reports(fd, &txrep_off, now_us);
+    close(fd);
+}
 
-	/* look for server address w/ status port */
-    MSG("loor for server with status port......\n");
-	i = getaddrinfo(server, port, &hints, &result);
-	if (i != 0) {
-		MSG("ERROR: [up] getaddrinfo on address %s (PORT %s) returned %s\n", server, serv_port_up, gai_strerror(i));
-		exit(EXIT_FAILURE);
-	}
-	/* try to open socket for status traffic */
-	for (q=result; q!=NULL; q=q->ai_next) {
-		sock_stat = socket(q->ai_family, q->ai_socktype,q->ai_protocol);
-		if (sock_stat == -1) continue; /* try next field */
-		else break; /* success, get out of loop */
-	}
-	if (q == NULL) {
-		MSG("ERROR: [stat] failed to open socket to any of server %s addresses (port %s)\n", server, port);
-		i = 1;
-		for (q=result; q!=NULL; q=q->ai_next) {
-			getnameinfo(q->ai_addr, q->ai_addrlen, host_name, sizeof host_name, port_name, sizeof port_name, NI_NUMERICHOST);
-			MSG("INFO: [stat] result %i host:%s service:%s\n", i, host_name, port_name);
-			++i;
-		}
-		exit(EXIT_FAILURE);
-	}
-	
-	/* connect so we can send/receive packet with the server only */
-	i = connect(sock_stat, q->ai_addr, q->ai_addrlen);
-	if (i != 0) {
-		MSG("ERROR: [stat] connect returned %s\n", strerror(errno));
-		exit(EXIT_FAILURE);
-	}
-	freeaddrinfo(result);
+/* sleep up to timeout_ms while watching for transmit reports with fd, an
+   inotify on the MCU directory; without one, look for reports afterwards */
+static void wait_tx_report(int fd, int timeout_ms) {
+    static const char *const names[] = {TXACKFILE, TXTAKENFILE, NULL};
+    struct pollfd pfd;
 
-	/* look for server address w/ downstream port */
-    //MSG("loor for server with downstream port......\n");
-	i = getaddrinfo(server, serv_port_down, &hints, &result);
-	if (i != 0) {
-		MSG("ERROR: [down] getaddrinfo on address %s (port %s) returned %s\n", server, serv_port_up, gai_strerror(i));
-		exit(EXIT_FAILURE);
-	}
-	
-	/* try to open socket for downstream traffic */
-	for (q=result; q!=NULL; q=q->ai_next) {
-		sock_down = socket(q->ai_family, q->ai_socktype,q->ai_protocol);
-		if (sock_down == -1) continue; /* try next field */
-		else break; /* success, get out of loop */
-	}
-	if (q == NULL) {
-		MSG("ERROR: [down] failed to open socket to any of server %s addresses (port %s)\n", server, serv_port_up);
-		i = 1;
-		for (q=result; q!=NULL; q=q->ai_next) {
-			getnameinfo(q->ai_addr, q->ai_addrlen, host_name, sizeof host_name, port_name, sizeof port_name, NI_NUMERICHOST);
-			MSG("INFO: [down] result %i host:%s service:%s\n", i, host_name, port_name);
-			++i;
-		}
-		exit(EXIT_FAILURE);
-	}
-	
-	/* connect so we can send/receive packet with the server only */
-	i = connect(sock_down, q->ai_addr, q->ai_addrlen);
-	if (i != 0) {
-		MSG("ERROR: [down] connect returned %s\n", strerror(errno));
-		exit(EXIT_FAILURE);
-	}
-	freeaddrinfo(result);
-	
-	/* spawn threads to manage upstream and downstream */
-    MSG("spawn threads to manage upsteam and downstream...\n");
-	i = pthread_create( &thrid_up, NULL, (void * (*)(void *))thread_up, NULL);
-	if (i != 0) {
-		MSG("ERROR: [main] impossible to create upstream thread\n");
-		exit(EXIT_FAILURE);
-	}
+    if (fd < 0) {
+        wait_ms(timeout_ms);
+        fetch_tx_report();
+        return;
+    }
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if ((poll(&pfd, 1, timeout_ms) > 0) && read_notify(fd, names))
+        fetch_tx_report();
+}
 
-	i = pthread_create( &thrid_down, NULL, (void * (*)(void *))thread_down, NULL);
-	if (i != 0) {
-		MSG("ERROR: [main] impossible to create downstream thread\n");
-		exit(EXIT_FAILURE);
-	}
-	
-	/* configure signal handling */
-	sigemptyset(&sigact.sa_mask);
-	sigact.sa_flags = 0;
-	sigact.sa_handler = sig_handler;
-	sigaction(SIGQUIT, &sigact, NULL); /* Ctrl-\ */
-	sigaction(SIGINT, &sigact, NULL); /* Ctrl-C */
-	sigaction(SIGTERM, &sigact, NULL); /* default "kill" command */
-    
-    MSG("Start lora packet forward daemon, server = %s, port = %s\n", server, port);
-/* ------------------------------------------------------------------------------------ */
-	/* main loop task : statistics collection and send status to server */
+/* IPv4 addresses of a server, return how many were found or -1 on error */
+static int resolve_server(const char *addr, const char *port, struct sockaddr_in *tab, int max) {
+    struct addrinfo hints;
+    struct addrinfo *result; /* store result of getaddrinfo */
+    struct addrinfo *q; /* pointer to move into *result data */
+    int i, nb = 0;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET; /* the server sockets are IPv4 */
+    hints.ai_socktype = SOCK_DGRAM;
+
+    i = getaddrinfo(addr, port, &hints, &result);
+    if (i != 0) {
+        MSG("ERROR: [resolve] getaddrinfo on address %s (port %s) returned %s\n", addr, port, gai_strerror(i));
+        return -1;
+    }
+    for (q = result; (q != NULL) && (nb < max); q = q->ai_next) {
+        if ((q->ai_family == AF_INET) && (q->ai_addrlen == sizeof tab[0]))
+            memcpy(&tab[nb++], q->ai_addr, sizeof tab[0]);
+    }
+    freeaddrinfo(result);
+    return nb;
+}
 
-    static char status_report[STATUS_SIZE]; /* status report as a JSON object */
+/* connect both sockets of a server to the address in use, called with mx_addr held */
+static bool serv_connect(struct serv_s *serv) {
+    const struct sockaddr_in *sa = &serv->addrs.tab[serv->addrs.cur].sa;
+    char ip[INET_ADDRSTRLEN];
 
-    int stat_index=0;
+    if ((connect(serv->sock_up, (const struct sockaddr *)sa, sizeof *sa) != 0) ||
+        (connect(serv->sock_down, (const struct sockaddr *)sa, sizeof *sa) != 0)) {
+        MSG("ERROR: [main] connect to %s returned %s\n", serv->addr, strerror(errno));
+        return false;
+    }
+    inet_ntop(AF_INET, &sa->sin_addr, ip, sizeof ip);
+    MSG("INFO: [main] server %s: using %s (%d of %d address(es))\n", serv->addr, ip, serv->addrs.cur + 1, serv->addrs.nb);
+    return true;
+}
 
-    /* pre-fill the data buffer with fixed fields */
-    status_report[0] = PROTOCOL_VERSION;
-    status_report[3] = PKT_PUSH_DATA;
+/* generation of the address in use, to attribute the outcome of a request to it */
+static uint32_t serv_gen(struct serv_s *serv) {
+    uint32_t gen;
 
-    /* fill GEUI  8bytes */
-    *(uint32_t *)(status_report + 4) = net_mac_h; 
-    *(uint32_t *)(status_report + 8) = net_mac_l; 
-	
-	while (!exit_sig && !quit_sig) {
-		
-		/* get timestamp for statistics */
-		t = time(NULL);
-		strftime(stat_timestamp, sizeof stat_timestamp, "%F %T %Z", gmtime(&t));
-		
-		/* access upstream statistics, copy and reset them */
-		pthread_mutex_lock(&mx_meas_up);
-		cp_nb_rx_rcv       = meas_nb_rx_rcv;
-		cp_nb_rx_ok        = meas_nb_rx_ok;
-		cp_nb_rx_bad       = meas_nb_rx_bad;
-		cp_nb_rx_nocrc     = meas_nb_rx_nocrc;
-		cp_up_pkt_fwd      = meas_up_pkt_fwd;
-		cp_up_network_byte = meas_up_network_byte;
-		cp_up_payload_byte = meas_up_payload_byte;
-		cp_up_dgram_sent   = meas_up_dgram_sent;
-		cp_up_ack_rcv      = meas_up_ack_rcv;
-		meas_nb_rx_rcv = 0;
-		meas_nb_rx_ok = 0;
-		meas_nb_rx_bad = 0;
-		meas_nb_rx_nocrc = 0;
-		meas_up_pkt_fwd = 0;
-		meas_up_network_byte = 0;
-		meas_up_payload_byte = 0;
-		meas_up_dgram_sent = 0;
-		meas_up_ack_rcv = 0;
-		pthread_mutex_unlock(&mx_meas_up);
-		if (cp_nb_rx_rcv > 0) {
-			rx_ok_ratio = (float)cp_nb_rx_ok / (float)cp_nb_rx_rcv;
-			rx_bad_ratio = (float)cp_nb_rx_bad / (float)cp_nb_rx_rcv;
-			rx_nocrc_ratio = (float)cp_nb_rx_nocrc / (float)cp_nb_rx_rcv;
-		} else {
-			rx_ok_ratio = 0.0;
-			rx_bad_ratio = 0.0;
-			rx_nocrc_ratio = 0.0;
-		}
-		if (cp_up_dgram_sent > 0) {
-			up_ack_ratio = (float)cp_up_ack_rcv / (float)cp_up_dgram_sent;
-		} else {
+    pthread_mutex_lock(&serv->mx_addr);
+    gen = serv->addrs.gen;
+    pthread_mutex_unlock(&serv->mx_addr);
+    return gen;
+}
+
+/* a request was acknowledged, the sockets are connected so it came from the address in use */
+static void serv_ack(struct serv_s *serv, uint32_t rtt_us) {
+    pthread_mutex_lock(&serv->mx_addr);
+    servaddr_ack(&serv->addrs, rtt_us);
+    pthread_mutex_unlock(&serv->mx_addr);
+}
+
+/* requests sent to address generation gen went unanswered, fail over to
+   another address if that one looks dead; the outcome of requests sent
+   before a failover says nothing about the new address and is ignored */
+static void serv_lost(struct serv_s *serv, uint32_t gen, int nb) {
+    pthread_mutex_lock(&serv->mx_addr);
+    if ((gen == serv->addrs.gen) && servaddr_lost(&serv->addrs, nb)) {
+        MSG("WARNING: [main] server %s: %d request(s) in a row unanswered, failing over\n", serv->addr, SERVADDR_FAIL_RUN);
+        serv_connect(serv);
+    }
+    pthread_mutex_unlock(&serv->mx_addr);
+}
+
+/* UDP socket bound to the loopback interface, return -1 on error */
+static int open_query_socket(const char *port) {
+    struct sockaddr_in addr;
+    int sock;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)atoi(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* answer one datagram received on the query socket with the latency histograms */
+static void answer_query(void) {
+    static const struct {
+        const char *name;
+        struct hist_s *hist;
+    } hists[] = {
+        {"push_ack", &hist_push_ack},
+        {"pull_ack", &hist_pull_ack},
+        {"up_latency", &hist_up_latency},
+        {"dw_queue", &hist_dw_queue},
+        {"dw_tx", &hist_dw_tx},
+        {"dw_total", &hist_dw_total}
+    };
+    char buff[QUERY_SIZE];
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    struct hist_s snap;
+    int index, j = 0, k;
+    unsigned i;
+    uint32_t jn_rec, jn_pkt, jn_oldest;
+
+    peer_len = sizeof peer;
+    if (recvfrom(sock_query, buff, sizeof buff, MSG_DONTWAIT, (struct sockaddr *)&peer, &peer_len) < 0)
+        return;
+
+    index = snprintf(buff, sizeof buff, "{\"hist\":{");
+    for (i = 0; i < ARRAY_SIZE(hists); i++) {
+        hist_snapshot(hists[i].hist, &snap);
+        index += snprintf(buff + index, sizeof buff - index, "%s\"%s\":", (i == 0) ? "" : ",", hists[i].name);
+        j = hist_to_json(&snap, buff + index, sizeof buff - index - 3);
+        if (j < 0)
+            break;
+        index += j;
+    }
+    if (j < 0) {
+        MSG("WARNING: [main] query reply does not fit in %d bytes\n", QUERY_SIZE);
+        return;
+    }
+    index += snprintf(buff + index, sizeof buff - index, "}");
+    if (journal_enabled) {
+        pthread_mutex_lock(&mx_journal);
+        jn_rec = journal.hdr->nb_rec;
+        jn_pkt = journal.hdr->nb_pkt;
+        jn_oldest = journal_oldest(&journal);
+        pthread_mutex_unlock(&mx_journal);
+        index += snprintf(buff + index, sizeof buff - index, ",\"journal\":{\"records\":%u,\"packets\":%u,\"age\":%u}",
+                          jn_rec, jn_pkt, (jn_rec > 0) ? (uint32_t)time(NULL) - jn_oldest : 0);
+    }
+    if (MEAS_GET(meas_dd.window_ms) > 0) {
+        index += snprintf(buff + index, sizeof buff - index, ",\"dedup\":{\"window\":%u,\"hit\":%u,\"miss\":%u}",
+                          MEAS_GET(meas_dd.window_ms), MEAS_GET(meas_dd.hit), MEAS_GET(meas_dd.miss));
+    }
+    j = 0;
+    pthread_mutex_lock(&mx_filter); /* thread_up swaps it and counts in it */
+    if (upfilter_active(&upfilter)) {
+        index += snprintf(buff + index, sizeof buff - index, ",\"filter\":");
+        j = upfilter_to_json(&upfilter, buff + index, sizeof buff - index - 3);
+    }
+    pthread_mutex_unlock(&mx_filter);
+    if (j < 0) {
+        MSG("WARNING: [main] query reply does not fit in %d bytes\n", QUERY_SIZE);
+        return;
+    }
+    index += j;
+    index += snprintf(buff + index, sizeof buff - index, ",\"servers\":[");
+    for (k = 0; k < nb_serv; k++) {
+        index += snprintf(buff + index, sizeof buff - index, "%s{\"name\":\"%s\",\"addrs\":", (k == 0) ? "" : ",", servers[k].addr);
+        pthread_mutex_lock(&servers[k].mx_addr);
+        j = servaddr_to_json(&servers[k].addrs, buff + index, sizeof buff - index - 4);
+        pthread_mutex_unlock(&servers[k].mx_addr);
+        if (j < 0) {
+            MSG("WARNING: [main] query reply does not fit in %d bytes\n", QUERY_SIZE);
+            return;
+        }
+        index += j;
+        index += snprintf(buff + index, sizeof buff - index, "}");
+    }
+    index += snprintf(buff + index, sizeof buff - index, "]}");
+    sendto(sock_query, buff, index, 0, (struct sockaddr *)&peer, peer_len);
+}
+
+/* answer the queries and reload the configuration when asked to until
+   timeout_ms elapsed, a missing socket (-1) is ignored by poll() */
+static void serve_queries(int timeout_ms) {
+    struct timespec start, now;
+    struct pollfd pfd[2];
+    int left;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pfd[0].fd = sock_query;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = fd_conf;
+    pfd[1].events = POLLIN;
+    while (!exit_sig && !quit_sig) {
+        if (reload_sig) {
+            reload_sig = false;
+            reload_config();
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = timeout_ms - (int)(1000 * difftimespec(now, start));
+        if (left <= 0)
+            break;
+        if (poll(pfd, 2, left) <= 0)
+            continue; /* timeout, or interrupted by a signal */
+        if (pfd[0].revents & POLLIN)
+            answer_query();
+        if ((pfd[1].revents & POLLIN) && read_notify(fd_conf, conf_names))
+            reload_config();
+    }
+}
+
+static bool get_lora_value(const char *data, char *option) {
+    char *pt;
+    int i, j = 0;
+
+    pt = strstr(data, option);
+    if (NULL == pt)
+        return false;
+
+    i = strlen(option);
+    while(pt[i] && pt[i] != '\n') { 
+        option[j] = pt[i];
+        j++;
+        i++;
+    }
+    option[j] = '\0';
+    return true;
+}
+
+/* complete the metadata the MCU did not report with the UCI radio settings */
+static void fill_rx_defaults(const struct up_conf_s *up_conf, struct lgw_pkt_rx_s *pkt) {
+    if (pkt->freq_hz == 0)
+        pkt->freq_hz = up_conf->freq_hz;
+    if (pkt->status == STAT_UNDEFINED)
+        pkt->status = STAT_CRC_OK; /* the MCU used to hand over valid frames only */
+    pkt->modulation = MOD_LORA;
+    if (pkt->datarate == DR_UNDEFINED)
+        pkt->datarate = up_conf->datarate;
+    if (pkt->bandwidth == BW_UNDEFINED)
+        pkt->bandwidth = up_conf->bandwidth;
+    if (pkt->coderate == CR_UNDEFINED)
+        pkt->coderate = up_conf->coderate;
+}
+
+/* read the binary record of the MCU, the payload lands in place in pkt */
+static bool fetch_up_record(struct lgw_pkt_rx_s *pkt) {
+    uint8_t hdr[MCUREC_HDR_LEN];
+    struct iovec iov[2];
+    int fd, len, off;
+
+    if ((fd = open(UPRECPATH, O_RDWR)) < 0)
+        return false;
+    memset(pkt, 0, sizeof *pkt);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof hdr;
+    iov[1].iov_base = pkt->payload;
+    iov[1].iov_len = sizeof pkt->payload;
+    len = readv(fd, iov, 2);
+    off = (len > 0) ? mcurec_decode(hdr, len, pkt) : 0;
+    if ((off != 0) && (ftruncate(fd, 0) != 0)) /* consumed, or not a record at all */
+        MSG("can't clear up_rec file!");
+    if (close(fd) != 0) {
+        MSG("can't close up_rec file!");
+    }
+    if (off < 0)
+        MSG("WARNING: [up] invalid MCU record (%d bytes), dropped\n", len);
+    if (off <= 0)
+        return false; /* nothing, or the MCU is still writing */
+
+    if (off > MCUREC_HDR_LEN) /* header fields of a later version */
+        memmove(pkt->payload, pkt->payload + (off - MCUREC_HDR_LEN), pkt->size);
+    return true;
+}
+
+static bool fetch_up_packet(struct lgw_pkt_rx_s *pkt, bool settle) {
+    int fd, len;
+    char updata[32];
+    char rssi[16] = "rssi=";
+    char size[16] = "size=";
+    struct stat statbuf;
+
+    if (fetch_up_record(pkt))
+        return true;
+
+    /* text format of older sketches: rssi= size= in cfgdata, payload in data */
+    if ((stat(UPCFGPATH, &statbuf) == -1) || (statbuf.st_size < 3))
+        return false;
+
+    if ((fd = open(UPCFGPATH, O_RDONLY)) < 0)
+        return false;
+    memset(updata, 0, sizeof(updata));
+    len = read(fd, updata, sizeof(updata) - 1);  /* file format: rssi= size= */
+    if (close(fd) != 0) {
+        MSG("can't close up_cfg_data file!");
+    }
+    if (len < 0)
+        return false;
+
+    if (!get_lora_value(updata, rssi) || !get_lora_value(updata, size))
+        return false;
+
+    if (settle)
+        wait_ms(DEFAULT_STAT); /* wait a short time after arduino write data to file */
+
+    memset(pkt, 0, sizeof *pkt);
+    if ((fd = open(UPPATH, O_RDONLY)) < 0)
+        return false;
+    len = read(fd, pkt->payload, sizeof pkt->payload);
+    if (close(fd) != 0) {
+        MSG("can't close up_data file!");
+    }
+    if (len < 0)
+        return false;
+
+    if ((fd = open(UPCFGPATH, O_WRONLY|O_TRUNC)) < 0 ){   /* clear the upfile */
+        MSG("can't reopen data file!");
+    } else 
+        close(fd);
+
+    pkt->rssi = atoi(rssi);
+    pkt->snr = LEGACY_LSNR;
+    len = atoi(size);
+    pkt->size = (len > 255) ? 255 : ((len < 0) ? 0 : len); /* 255 bytes = 340 chars in b64 */
+    return true;
+}
+
+/* non-blocking inotify on the files written or renamed into dir, -1 on error */
+static int open_notify(const char *dir) {
+    int fd;
+
+    fd = inotify_init1(IN_NONBLOCK);
+    if ((fd >= 0) && (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* drain the pending inotify events, return a mask with bit i set if one is
+   about names[i]; names ends with NULL */
+static unsigned read_notify(int fd, const char *const *names) {
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    unsigned ready = 0;
+    ssize_t len;
+    char *ptr;
+    int i;
+
+    len = read(fd, buf, sizeof buf);
+    if (len <= 0)
+        return 0;
+    for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ev->len) {
+        ev = (const struct inotify_event *)ptr;
+        for (i = 0; (ev->len > 0) && (names[i] != NULL); i++) {
+            if (!strcmp(ev->name, names[i]))
+                ready |= 1U << i;
+        }
+    }
+    return ready;
+}
+
+/* watch the MCU data directory, fall back to polling if inotify is not usable */
+static int open_up_notify(void) {
+    int fd;
+
+    if (ingest_mode != INGEST_INOTIFY)
+        return -1;
+
+    fd = open_notify(UPDIR);
+    if (fd < 0) {
+        MSG("WARNING: [up] inotify on %s failed (%s), falling back to polling\n", UPDIR, strerror(errno));
+        ingest_mode = INGEST_POLL;
+    }
+    return fd;
+}
+
+/* return true if the MCU completed a packet, its transmit reports are read on the way */
+static bool read_up_notify(int fd) {
+    static const char *const names[] = {TXACKFILE, TXTAKENFILE, UPRECFILE, UPFILE, NULL};
+    unsigned ready;
+
+    ready = read_notify(fd, names);
+    if (ready & 3)
+        fetch_tx_report();
+    return (ready & ~3U) != 0;
+}
+
+static bool wait_up_notify(int fd, int timeout_ms) {
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return false;
+    return read_up_notify(fd);
+}
+
+/* fill the fixed fields of the PUSH_DATA header */
+static void up_init(struct up_state_s *up) {
+	memset(up, 0, sizeof *up);
+	up->buff[0] = PROTOCOL_VERSION;
+	up->buff[3] = PKT_PUSH_DATA;
+	*(uint32_t *)(up->buff + 4) = net_mac_h;
+	*(uint32_t *)(up->buff + 8) = net_mac_l;
+	up->conf_seq = 1; /* odd, never matches a published sequence */
+	up_refresh(up);
+}
+
+/* take the settings published by the last (re)load and rebuild what
+   depends on them, cheap when nothing changed */
+static void up_refresh(struct up_state_s *up) {
+	struct up_conf_s c;
+	uint32_t seq;
+
+	if (up->conf_seq == up_conf_seq)
+		return;
+	do {
+		seq = up_conf_seq;
+		__sync_synchronize();
+		c = up_conf_pub;
+		__sync_synchronize();
+	} while ((seq & 1) || (seq != up_conf_seq));
+
+	if ((up->conf_seq == 1) || (c.dedup_ms != up->conf.dedup_ms)) {
+		dedup_init(&dedup, c.dedup_ms);
+		MEAS_SET(meas_dd.hit, 0);
+		MEAS_SET(meas_dd.miss, 0);
+		MEAS_SET(meas_dd.window_ms, c.dedup_ms);
+	}
+	if ((up->conf_seq == 1) || (c.filter_gen != up->conf.filter_gen)) {
+		pthread_mutex_lock(&mx_filter);
+		upfilter = upfilter_next;
+		pthread_mutex_unlock(&mx_filter);
+	}
+	up->conf = c;
+	up->conf_seq = seq;
+	rxpk_fmt_init(&up->rxpk_fmt);
+}
+
+/* how long the uplink path may sleep: until the aggregation window of the
+   pending datagram closes or the next journal replay is due, at most max_ms */
+static int up_wait_ms(const struct up_state_s *up, const struct timespec *now, int max_ms) {
+	int i;
+
+	if (up->nb_pkt > 0)
+		i = up->conf.aggr_window_ms - (int)(1000 * difftimespec(*now, up->first_time));
+	else if (servers[0].backhaul_up && journal_pending())
+		i = (int)(1000 * difftimespec(up->next_replay, *now));
+	else
+		return max_ms;
+	return (i < 0) ? 0 : ((i < max_ms) ? i : max_ms);
+}
+
+/* add a packet handed over by the MCU to the datagram being composed */
+static void up_ingest(struct up_state_s *up, struct lgw_pkt_rx_s *pkt, const struct timespec *ingest_time) {
+	struct timespec fetch_time; /* local timestamp until we get accurate GPS time */
+	bool keep, dup;
+	int j;
+
+	up_refresh(up);
+	fill_rx_defaults(&up->conf, pkt);
+
+	MEAS_ADD(meas_up.nb_rx_rcv, 1);
+	switch (pkt->status) {
+		case STAT_CRC_OK:
+			MEAS_ADD(meas_up.nb_rx_ok, 1);
+			if (!fwd_valid_pkt)
+				return;
+			break;
+		case STAT_CRC_BAD:
+			MEAS_ADD(meas_up.nb_rx_bad, 1);
+			if (!fwd_error_pkt)
+				return;
+			break;
+		case STAT_NO_CRC:
+			MEAS_ADD(meas_up.nb_rx_nocrc, 1);
+			if (!fwd_nocrc_pkt)
+				return;
+			break;
+		default:
+			MSG("WARNING: [up] received packet with unknown status %u\n", pkt->status);
+			return;
+	}
+
+	/* frames of other networks go before any hashing or encoding */
+	pthread_mutex_lock(&mx_filter);
+	keep = upfilter_check(&upfilter, pkt->payload, pkt->size);
+	pthread_mutex_unlock(&mx_filter);
+	if (!keep) {
+		MEAS_ADD(meas_up.nb_rx_filtered, 1);
+		return;
+	}
+
+	/* MCU rewriting the same frame, or a node retransmitting it */
+	dup = dedup_check(&dedup, dedup_key(pkt), (uint32_t)ingest_time->tv_sec * 1000U + ingest_time->tv_nsec / 1000000);
+	MEAS_SET(meas_dd.hit, dedup.hit);
+	MEAS_SET(meas_dd.miss, dedup.miss);
+	if (dup) {
+		MEAS_ADD(meas_up.nb_rx_dup, 1);
+		return;
+	}
+
+	/* get timestamp for statistics */
+	clock_gettime(CLOCK_REALTIME, &fetch_time);
+	pkt->count_us = timespec_to_tmst(&fetch_time); /* the MCU counter is not in the time base the server sees */
+
+	if (up->nb_pkt == 0) {
+		/* start composing datagram with the header, token is set at send time */
+		up->index = 12; /* 12-byte header */
+		memcpy((void *)(up->buff + up->index), (void *)"{\"rxpk\":[", 9);
+		up->index += 9;
+		up->payload_byte = 0;
+		up->first_time = *ingest_time;
+		up->rx_time = (uint32_t)fetch_time.tv_sec;
+	} else {
+		up->buff[up->index] = ',';
+		++up->index;
+	}
+
+
+	j = rxpk_serialize(&up->rxpk_fmt, pkt, &fetch_time, (char *)(up->buff + up->index), TX_BUFF_SIZE - up->index - 3);
+	if (j < 0) {
+		MSG("WARNING: [up] failed to serialize rxpk, packet dropped\n");
+		if (up->nb_pkt > 0)
+			--up->index; /* remove the separator */
+	} else {
+		up->index += j;
+		up->payload_byte += pkt->size;
+		++up->nb_pkt;
+	}
+}
+
+/* send the datagram being composed once its aggregation window is over, or a
+   journal replay if there is no live traffic, return true if one was sent */
+static bool up_flush(struct up_state_s *up) {
+	struct serv_s *serv;
+	struct timespec now, send_time;
+	uint8_t token_h; /* random token for acknowledgement matching */
+	uint8_t token_l; /* random token for acknowledgement matching */
+	int i, j, k;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	/* no live traffic: replay the journal, paced to replay_interval_ms */
+	up->replay = false;
+	if ((up->nb_pkt == 0) && servers[0].backhaul_up && (difftimespec(now, up->next_replay) >= 0) &&
+	    journal_pending()) {
+		up->next_replay = now;
+		up->next_replay.tv_sec += replay_interval_ms / 1000;
+		up->next_replay.tv_nsec += (long)(replay_interval_ms % 1000) * 1000000;
+		if (up->next_replay.tv_nsec >= 1000000000) {
+			up->next_replay.tv_sec += 1;
+			up->next_replay.tv_nsec -= 1000000000;
+		}
+		up->index = 12; /* 12-byte header */
+		memcpy((void *)(up->buff + up->index), (void *)"{\"rxpk\":[", 9);
+		up->index += 9;
+		up->index += journal_replay(up->buff + up->index, TX_BUFF_SIZE - up->index - 3, &up->nb_pkt, &up->rx_time);
+		up->payload_byte = 0;
+		up->first_time = now;
+		up->replay = (up->nb_pkt > 0);
+	}
+
+	if (up->nb_pkt == 0)
+		return false;
+
+	/* keep the datagram open while the aggregation window runs */
+	if (!up->replay && (up->nb_pkt < up->conf.aggr_max) && ((int)(1000 * difftimespec(now, up->first_time)) < up->conf.aggr_window_ms))
+		return false;
+
+	j = up->index - 12 - 9; /* rxpk array content, kept in case it is never acknowledged */
+	up->buff[up->index] = ']';
+	++up->index;
+	up->buff[up->index] = '}';
+	++up->index;
+	up->buff[up->index] = '\0'; /* add string terminator, for safety */
+
+	printf("\nINFO (JSON): [up] %s\n", (char *)(up->buff + 12)); /* DEBUG: display JSON payload */
+
+	/* the same datagram goes to every server, only the token differs;
+	   journal records were not acknowledged by the primary server, they only go there */
+	for (k = 0; k < (up->replay ? 1 : nb_serv); k++) {
+		serv = &servers[k];
+
+		/* register the datagram, the ACK is matched asynchronously on the upstream socket of that server */
+		i = inflight_add(serv, &token_h, &token_l, up->nb_pkt, up->buff + 12 + 9, j, up->rx_time);
+		up->buff[1] = token_h;
+		up->buff[2] = token_l;
+
+		/* send datagram to server */
+		if (send(serv->sock_up, (void *)up->buff, up->index, MSG_DONTWAIT) < 0) {
+			MSG("WARNING: [up] send to %s returned %s\n", serv->addr, strerror(errno));
+		}
+		MEAS_ADD(serv->meas.up_dgram_sent, 1);
+		MEAS_ADD(serv->meas.up_network_byte, up->index);
+		MEAS_ADD(serv->meas.up_ack_evicted, i); /* in-flight table was full */
+	}
+	clock_gettime(CLOCK_MONOTONIC, &send_time);
+	if (up->replay) {
+		MSG("INFO: [up] %d packet(s) replayed from the journal\n", up->nb_pkt);
+	} else {
+		MSG("INFO: [up] %d packet(s) sent, oldest %i us after MCU write\n", up->nb_pkt, (int)(1000000 * difftimespec(send_time, up->first_time)));
+		MEAS_ADD(meas_up.up_pkt_fwd, up->nb_pkt);
+		MEAS_ADD(meas_up.up_payload_byte, up->payload_byte);
+		hist_add(&hist_up_latency, (uint32_t)(1000000 * difftimespec(send_time, up->first_time)));
+	}
+	up->nb_pkt = 0;
+	return true;
+}
+
+/* match a datagram received on the upstream socket of a server with its PUSH_DATA */
+static void up_ack_receive(struct serv_s *serv, const uint8_t *buff, int len, const struct timespec *recv_time) {
+	uint32_t rtt_us;
+	int nb_pkt;
+
+	if ((len < 4) || (buff[0] < PROTOCOL_VERSION_MIN) || (buff[0] > PROTOCOL_VERSION) || (buff[3] != PKT_PUSH_ACK)) {
+		//MSG("WARNING: [up] ignored invalid non-ACL packet\n");
+		return;
+	}
+	if (!inflight_ack(serv, buff[1], buff[2], recv_time, &rtt_us, &nb_pkt)) {
+		//MSG("WARNING: [up] ignored out-of sync ACK packet\n");
+		return;
+	}
+	MSG("INFO: [up] PUSH_ACK from %s received in %u ms (%d packet(s))\n", serv->addr, rtt_us / 1000, nb_pkt);
+	MEAS_ADD(serv->meas.up_ack_rcv, 1);
+	hist_add(&hist_push_ack, rtt_us);
+	serv_ack(serv, rtt_us);
+	serv->backhaul_up = true;
+}
+
+/* per-token timeouts */
+static void up_ack_expire(struct serv_s *serv, const struct timespec *now) {
+	int i;
+
+	i = inflight_expire(serv, now);
+	if (i > 0) {
+		MEAS_ADD(serv->meas.up_ack_lost, i);
+		serv->backhaul_up = false; /* hold the journal replay until the server answers again */
+	}
+}
+
+/* send a PULL_DATA to a server, return false if the auto-quit threshold is crossed */
+static bool down_send_pull(struct serv_s *serv) {
+	uint8_t buff_req[12]; /* buffer to compose pull requests */
+
+	/* auto-quit if the threshold is crossed */
+	if ((autoquit_threshold > 0) && (serv->autoquit_cnt >= autoquit_threshold)) {
+		exit_sig = true;
+		MSG("INFO: [down] the last %u PULL_DATA were not ACKed, exiting application\n", autoquit_threshold);
+		return false;
+	}
+
+	/* the previous PULL_DATA was not acknowledged */
+	if (serv->autoquit_cnt > 0)
+		serv_lost(serv, serv->pull_gen, 1);
+
+	/* generate random token for request */
+	serv->pull_token_h = (uint8_t)rand(); /* random token */
+	serv->pull_token_l = (uint8_t)rand(); /* random token */
+	buff_req[0] = PROTOCOL_VERSION;
+	buff_req[1] = serv->pull_token_h;
+	buff_req[2] = serv->pull_token_l;
+	buff_req[3] = PKT_PULL_DATA;
+	*(uint32_t *)(buff_req + 4) = net_mac_h;
+	*(uint32_t *)(buff_req + 8) = net_mac_l;
+
+	/* send PULL request and record time */
+	send(serv->sock_down, (void *)buff_req, sizeof buff_req, MSG_DONTWAIT);
+	clock_gettime(CLOCK_MONOTONIC, &serv->pull_time);
+	serv->pull_gen = serv_gen(serv);
+	MEAS_ADD(serv->meas_dw.dw_pull_sent, 1);
+	serv->pull_acked = false;
+	serv->autoquit_cnt++;
+	return true;
+}
+
+/* process a datagram received on the downstream socket of a server,
+   buff must have room for a string terminator after msg_len bytes */
+static void down_receive(struct serv_s *serv, uint8_t *buff, int msg_len, const struct timespec *recv_time) {
+	int i;
+	uint32_t rtt_us;
+	uint32_t rcv_us = get_tmst(); /* start of the downlink timeline */
+	uint16_t dl_id;
+	
+	/* configuration and metadata for an outbound packet */
+	struct lgw_pkt_tx_s txpkt;
+	enum jit_error_e jit_result;
+	
+	/* JSON parsing variables */
+	bool heap_val; /* the tree was allocated on the heap, must be freed */
+	JSON_Value *root_val = NULL;
+	JSON_Object *txpk_obj = NULL;
+	JSON_Value *val = NULL; /* needed to detect the absence of some fields */
+	const char *str; /* pointer to sub-strings in the JSON data */
+	
+	/* if the datagram does not respect protocol, just ignore it */
+	if ((msg_len < 4) || (buff[0] < PROTOCOL_VERSION_MIN) || (buff[0] > PROTOCOL_VERSION) ||
+	    ((buff[3] != PKT_PULL_RESP) && (buff[3] != PKT_PULL_ACK))) {
+		MSG("WARNING: [down] ignoring invalid packet\n");
+		return;
+	}
+	
+	/* if the datagram is an ACK, check token */
+	if (buff[3] == PKT_PULL_ACK) {
+		if ((buff[1] == serv->pull_token_h) && (buff[2] == serv->pull_token_l)) {
+			if (serv->pull_acked) {
+				MSG("INFO: [down] duplicate ACK received :)\n");
+			} else { /* if that packet was not already acknowledged */
+				serv->pull_acked = true;
+				serv->autoquit_cnt = 0;
+				MEAS_ADD(serv->meas_dw.dw_ack_rcv, 1);
+				rtt_us = (uint32_t)(1000000 * difftimespec(*recv_time, serv->pull_time));
+				hist_add(&hist_pull_ack, rtt_us);
+				serv_ack(serv, rtt_us);
+				//MSG("INFO: [down] PULL_ACK received in %i ms\n", (int)(1000 * difftimespec(*recv_time, serv->pull_time)));
+			}
+		} else { /* out-of-sync token */
+			MSG("INFO: [down] received out-of-sync ACK\n");
+		}
+		return;
+	}
+	
+	/* the datagram is a PULL_RESP, only transmitted if that server may send downlinks */
+	if (!serv->downlink) {
+		MSG("INFO: [down] PULL_RESP from %s ignored, downlink not allowed\n", serv->addr);
+		MEAS_ADD(serv->meas_dw.nb_tx_denied, 1);
+		return;
+	}
+	buff[msg_len] = 0; /* add string terminator, just to be safe */
+	//MSG("INFO: [down] PULL_RESP received :)\n"); /* very verbose */
+	printf("\nINFO (json): [down] %s\n", (char *)(buff + 4)); /* DEBUG: display JSON payload */
+	
+	/* decode txpk straight from the buffer, use parson for what the scanner does not handle */
+	i = txpk_parse((const char *)(buff + 4), &txpkt); /* JSON offset */
+	if (i < 0) {
+		/* initialize TX struct and try to parse JSON, in the arena first */
+		memset(&txpkt, 0, sizeof txpkt);
+		json_arena_reset(&serv->arena);
+		root_val = json_parse_string_with_comments_arena(&serv->arena, (const char *)(buff + 4)); /* JSON offset */
+		heap_val = (root_val == NULL);
+		if (heap_val) { /* invalid, or too big for the arena */
+			root_val = json_parse_string_with_comments((const char *)(buff + 4)); /* JSON offset */
+		}
+		if (root_val == NULL) {
+			MSG("WARNING: [down] invalid JSON, TX aborted\n");
+			return;
+		}
+		
+		/* look for JSON sub-object 'txpk' */
+		txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
+		if (txpk_obj == NULL) {
+			MSG("WARNING: [down] no \"txpk\" object in JSON, TX aborted\n");
+			if (heap_val) json_value_free(root_val);
+			return;
+		}
+		
+		/* Parse payload length (mandatory) */
+		val = json_object_get_value(txpk_obj,"size");
+		if (val == NULL) {
+			MSG("WARNING: [down] no mandatory \"txpk.size\" object in JSON, TX aborted\n");
+			if (heap_val) json_value_free(root_val);
+			return;
+		}
+		txpkt.size = (uint16_t)json_value_get_number(val);
+		
+		/* Parse payload data (mandatory) */
+		str = json_object_get_string(txpk_obj, "data"); if (str == NULL) {
+			MSG("WARNING: [down] no mandatory \"txpk.data\" object in JSON, TX aborted\n");
+			if (heap_val) json_value_free(root_val);
+			return;
+		}
+		i = b64_to_bin(str, strlen(str), txpkt.payload, sizeof txpkt.payload);
+		txpk_parse_json(txpk_obj, &txpkt);
+		
+		/* free the JSON parse tree from memory, arena trees go with the next reset */
+		if (heap_val) json_value_free(root_val);
+	}
+	if (i != txpkt.size) {
+		MSG("WARNING: [down] mismatch between .size and .data size once converter to binary\n");
+	}
+
+	/* record measurement data */
+	MEAS_ADD(serv->meas_dw.dw_dgram_rcv, 1); /* count only datagrams with no JSON errors */
+	MEAS_ADD(serv->meas_dw.dw_network_byte, msg_len);
+	MEAS_ADD(serv->meas_dw.dw_payload_byte, txpkt.size);
+	MEAS_ADD(serv->meas_dw.nb_tx_requested, 1);
+	
+	/* queue the frame, the JIT path hands it over to the MCU when it is due */
+	dl_id = dl_track_open(serv, buff[1], buff[2], rcv_us, get_tmst());
+	pthread_mutex_lock(&mx_concent);
+	jit_result = jit_enqueue(&jit_queue, get_tmst(), &txpkt, dl_id);
+	if (jit_result == JIT_ERROR_OK)
+		pthread_cond_signal(&cv_jit);
+	pthread_mutex_unlock(&mx_concent);
+	
+	switch (jit_result) {
+		case JIT_ERROR_OK:
+			if (txpkt.tx_mode == IMMEDIATE) {
+				MSG("INFO: [down] immediate packet queued\n");
+			} else {
+				MSG("INFO: [down] packet queued for tmst %u\n", txpkt.count_us);
+			}
+			break;
+		case JIT_ERROR_TOO_EARLY:
+			MSG("WARNING: [down] packet REJECTED, tmst %u is too much in advance\n", txpkt.count_us);
+			MEAS_ADD(serv->meas_dw.nb_tx_rejected_too_early, 1);
+			dl_track_close(dl_id, "TOO_EARLY");
+			break;
+		case JIT_ERROR_COLLISION:
+			MSG("WARNING: [down] packet REJECTED, collides with a packet already programmed\n");
+			MEAS_ADD(serv->meas_dw.nb_tx_rejected_collision, 1);
+			dl_track_close(dl_id, "COLLISION_PACKET");
+			break;
+		default:
+			MSG("WARNING: [down] packet REJECTED, downlink queue is full\n");
+			MEAS_ADD(serv->meas_dw.nb_tx_queue_full, 1);
+			dl_track_close(dl_id, "TOO_LATE"); /* v2 has no code for a full queue, it will not make its time */
+			break;
+	}
+}
+
+/* hand the downlinks that are due over to the MCU, called with mx_concent held;
+   return JIT_ERROR_EMPTY, or JIT_ERROR_TOO_EARLY with the time until the next one */
+static enum jit_error_e jit_dispatch(uint32_t *wait_us) {
+	enum jit_error_e jit_result;
+	struct jit_node_s node;
+	uint32_t now_us;
+	int lateness;
+
+	for (;;) {
+		jit_result = jit_peek(&jit_queue, get_tmst(), wait_us);
+		if ((jit_result == JIT_ERROR_EMPTY) || (jit_result == JIT_ERROR_TOO_EARLY))
+			return jit_result;
+
+		jit_dequeue(&jit_queue, &node);
+		pthread_mutex_unlock(&mx_concent);
+
+		now_us = get_tmst();
+		lateness = (int)(now_us - node.queue_us);
+		if (write_down_packet(&node.pkt) == 0) {
+			MSG("INFO: [jit] packet handed over to the MCU %d ms after being queued\n", lateness / 1000);
+			MEAS_ADD(meas_jit.nb_tx_handed, 1);
+			hist_add(&hist_dw_queue, (uint32_t)lateness);
+			dl_track_handed(node.tag, dlpath + strlen(UPDIR "/"), now_us);
+		} else {
+			MEAS_ADD(meas_jit.nb_tx_fail, 1);
+			dl_track_close(node.tag, "TOO_LATE"); /* it did not reach the MCU in time */
+		}
+
+		pthread_mutex_lock(&mx_concent);
+	}
+}
+
+/* collect the statistics of the last interval, log them and send a status
+   report to every server */
+static void report_stats(void) {
+	static char status_report[STATUS_SIZE]; /* status report as a JSON object */
+	int stat_index;
+	struct serv_s *serv;
+	int i, j;
+	
+	/* variables to get local copies of measurements */
+	uint32_t cp_nb_rx_rcv;
+	uint32_t cp_nb_rx_ok;
+	uint32_t cp_nb_rx_bad;
+	uint32_t cp_nb_rx_nocrc;
+	uint32_t cp_up_pkt_fwd;
+	uint32_t cp_up_network_byte;
+	uint32_t cp_up_payload_byte;
+	uint32_t cp_nb_rx_dup;
+	uint32_t cp_nb_rx_filtered;
+	uint32_t cp_up_dgram_sent;
+	uint32_t cp_up_ack_rcv;
+	uint32_t cp_up_ack_lost;
+	uint32_t cp_dw_pull_sent;
+	uint32_t cp_dw_ack_rcv;
+	uint32_t cp_dw_dgram_rcv;
+	uint32_t cp_dw_network_byte;
+	uint32_t cp_dw_payload_byte;
+	uint32_t cp_nb_tx_handed;
+	uint32_t cp_nb_tx_ok;
+	uint32_t cp_nb_tx_fail;
+	uint32_t cp_nb_tx_unconfirmed;
+	uint32_t cp_nb_tx_requested;
+	uint32_t cp_nb_tx_rejected_collision;
+	uint32_t cp_nb_tx_rejected_too_late;
+	uint32_t cp_nb_tx_rejected_too_early;
+	uint32_t cp_nb_tx_queue_full;
+	uint32_t cp_nb_tx_denied;
+	uint32_t cp_jn_stored;
+	uint32_t cp_jn_overflow;
+	uint32_t cp_jn_expired;
+	uint32_t cp_jn_replayed_rec;
+	uint32_t cp_jn_replayed_pkt;
+	uint32_t jn_rec, jn_pkt, jn_oldest;
+	
+	/* statistics variable */
+	time_t t;
+	char stat_timestamp[24];
+	float rx_ok_ratio;
+	float rx_bad_ratio;
+	float rx_nocrc_ratio;
+	float up_ack_ratio;
+	float dw_ack_ratio;
+	
+	/* pre-fill the data buffer with fixed fields */
+	status_report[0] = PROTOCOL_VERSION;
+	status_report[3] = PKT_PUSH_DATA;
+
+	/* fill GEUI  8bytes */
+	*(uint32_t *)(status_report + 4) = net_mac_h;
+	*(uint32_t *)(status_report + 8) = net_mac_l;
+	
+	/* get timestamp for statistics */
+	t = time(NULL);
+	strftime(stat_timestamp, sizeof stat_timestamp, "%F %T %Z", gmtime(&t));
+	
+	/* access upstream statistics shared by all servers, copy and reset them */
+	cp_nb_rx_rcv       = MEAS_TAKE(meas_up.nb_rx_rcv);
+	cp_nb_rx_ok        = MEAS_TAKE(meas_up.nb_rx_ok);
+	cp_nb_rx_bad       = MEAS_TAKE(meas_up.nb_rx_bad);
+	cp_nb_rx_nocrc     = MEAS_TAKE(meas_up.nb_rx_nocrc);
+	cp_up_pkt_fwd      = MEAS_TAKE(meas_up.up_pkt_fwd);
+	cp_up_payload_byte = MEAS_TAKE(meas_up.up_payload_byte);
+	cp_nb_rx_dup       = MEAS_TAKE(meas_up.nb_rx_dup);
+	if (cp_nb_rx_dup > 0) {
+		MSG("INFO: [up] %u duplicate packet(s) dropped\n", cp_nb_rx_dup);
+	}
+	cp_nb_rx_filtered  = MEAS_TAKE(meas_up.nb_rx_filtered);
+	if (cp_nb_rx_filtered > 0) {
+		MSG("INFO: [up] %u packet(s) of other networks dropped\n", cp_nb_rx_filtered);
+	}
+	if (cp_nb_rx_rcv > 0) {
+		rx_ok_ratio = (float)cp_nb_rx_ok / (float)cp_nb_rx_rcv;
+		rx_bad_ratio = (float)cp_nb_rx_bad / (float)cp_nb_rx_rcv;
+		rx_nocrc_ratio = (float)cp_nb_rx_nocrc / (float)cp_nb_rx_rcv;
+	} else {
+		rx_ok_ratio = 0.0;
+		rx_bad_ratio = 0.0;
+		rx_nocrc_ratio = 0.0;
+	}
+	
+	/* access transmission statistics, copy and reset them */
+	cp_nb_tx_handed    =  MEAS_TAKE(meas_jit.nb_tx_handed);
+	cp_nb_tx_ok        =  MEAS_TAKE(meas_jit.nb_tx_ok);
+	cp_nb_tx_fail      =  MEAS_TAKE(meas_jit.nb_tx_fail);
+	cp_nb_tx_unconfirmed = MEAS_TAKE(meas_jit.nb_tx_unconfirmed);
+	if ((cp_nb_tx_handed + cp_nb_tx_ok + cp_nb_tx_fail + cp_nb_tx_unconfirmed) > 0) {
+		MSG("INFO: [down] %u handed over to the MCU, %u transmitted, %u failed, %u unconfirmed\n",
+		    cp_nb_tx_handed, cp_nb_tx_ok, cp_nb_tx_fail, cp_nb_tx_unconfirmed);
+	}
+	
+	/* access journal statistics, copy and reset them */
+	if (journal_enabled) {
+		cp_jn_stored       = MEAS_TAKE(meas_jn.stored);
+		cp_jn_overflow     = MEAS_TAKE(meas_jn.overflow);
+		cp_jn_expired      = MEAS_TAKE(meas_jn.expired);
+		cp_jn_replayed_rec = MEAS_TAKE(meas_jn.replayed_rec);
+		cp_jn_replayed_pkt = MEAS_TAKE(meas_jn.replayed_pkt);
+		pthread_mutex_lock(&mx_journal);
+		jn_rec = journal.hdr->nb_rec;
+		jn_pkt = journal.hdr->nb_pkt;
+		jn_oldest = journal_oldest(&journal);
+		pthread_mutex_unlock(&mx_journal);
+		if ((jn_rec > 0) || (cp_jn_stored > 0) || (cp_jn_replayed_rec > 0)) {
+			MSG("INFO: [journal] depth %u record(s) / %u packet(s), oldest %u s, stored %u, replayed %u record(s) / %u packet(s) (%.2f pkt/s)\n",
+			    jn_rec, jn_pkt, (jn_rec > 0) ? (uint32_t)t - jn_oldest : 0, cp_jn_stored, cp_jn_replayed_rec, cp_jn_replayed_pkt, (float)cp_jn_replayed_pkt / (float)stat_interval);
+		}
+		if ((cp_jn_overflow + cp_jn_expired) > 0) {
+			MSG("WARNING: [journal] %u record(s) given up (journal full), %u record(s) older than %u s\n", cp_jn_overflow, cp_jn_expired, journal_max_age);
+		}
+	}
+	
+	/* display a report */
+        /*
+	printf("\n##### %s #####\n", stat_timestamp);
+	printf("### [UPSTREAM] ###\n");
+	printf("# RF packets received by concentrator: %u\n", cp_nb_rx_rcv);
+	printf("# CRC_OK: %.2f%%, CRC_FAIL: %.2f%%, NO_CRC: %.2f%%\n", 100.0 * rx_ok_ratio, 100.0 * rx_bad_ratio, 100.0 * rx_nocrc_ratio);
+	printf("# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
+	printf("# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
+	printf("# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
+	printf("### [DOWNSTREAM] ###\n");
+	printf("# PULL_DATA sent: %u (%.2f%% acknowledged)\n", cp_dw_pull_sent, 100.0 * dw_ack_ratio);
+	printf("# PULL_RESP(onse) datagrams received: %u (%u bytes)\n", cp_dw_dgram_rcv, cp_dw_network_byte);
+	printf("# RF packets sent to concentrator: %u (%u bytes)\n", (cp_nb_tx_ok+cp_nb_tx_fail), cp_dw_payload_byte);
+	printf("# TX errors: %u\n", cp_nb_tx_fail);
+	printf("##### END #####\n");
+        */
+
+	/* per server statistics, each server gets its own status report */
+	for (i = 0; i < nb_serv; i++) {
+		serv = &servers[i];
+		
+		/* access upstream statistics of that server, copy and reset them */
+		cp_up_network_byte = MEAS_TAKE(serv->meas.up_network_byte);
+		cp_up_dgram_sent   = MEAS_TAKE(serv->meas.up_dgram_sent);
+		cp_up_ack_rcv      = MEAS_TAKE(serv->meas.up_ack_rcv);
+		cp_up_ack_lost     = MEAS_TAKE(serv->meas.up_ack_lost) + MEAS_TAKE(serv->meas.up_ack_evicted);
+		if (cp_up_ack_lost > 0) {
+			MSG("INFO: [up] %s: %u PUSH_DATA not acknowledged within %d ms\n", serv->addr, cp_up_ack_lost, PUSH_ACK_TIMEOUT_MS);
+		}
+		if (cp_up_dgram_sent > 0) {
+			up_ack_ratio = (float)cp_up_ack_rcv / (float)cp_up_dgram_sent;
+		} else {
 			up_ack_ratio = 0.0;
 		}
-		
-		/* access downstream statistics, copy and reset them */
-		pthread_mutex_lock(&mx_meas_dw);
-		cp_dw_pull_sent    =  meas_dw_pull_sent;
-		cp_dw_ack_rcv      =  meas_dw_ack_rcv;
-		cp_dw_dgram_rcv    =  meas_dw_dgram_rcv;
-		cp_dw_network_byte =  meas_dw_network_byte;
-		cp_dw_payload_byte =  meas_dw_payload_byte;
-		cp_nb_tx_ok        =  meas_nb_tx_ok;
-		cp_nb_tx_fail      =  meas_nb_tx_fail;
-		meas_dw_pull_sent = 0;
-		meas_dw_ack_rcv = 0;
-		meas_dw_dgram_rcv = 0;
-		meas_dw_network_byte = 0;
-		meas_dw_payload_byte = 0;
-		meas_nb_tx_ok = 0;
-		meas_nb_tx_fail = 0;
-		pthread_mutex_unlock(&mx_meas_dw);
-		if (cp_dw_pull_sent > 0) {
-			dw_ack_ratio = (float)cp_dw_ack_rcv / (float)cp_dw_pull_sent;
+		
+		/* access downstream statistics of that server, copy and reset them */
+		cp_dw_pull_sent    =  MEAS_TAKE(serv->meas_dw.dw_pull_sent);
+		cp_dw_ack_rcv      =  MEAS_TAKE(serv->meas_dw.dw_ack_rcv);
+		cp_dw_dgram_rcv    =  MEAS_TAKE(serv->meas_dw.dw_dgram_rcv);
+		cp_dw_network_byte =  MEAS_TAKE(serv->meas_dw.dw_network_byte);
+		cp_dw_payload_byte =  MEAS_TAKE(serv->meas_dw.dw_payload_byte);
+		cp_nb_tx_requested                 =  MEAS_TAKE(serv->meas_dw.nb_tx_requested);
+		cp_nb_tx_rejected_collision        =  MEAS_TAKE(serv->meas_dw.nb_tx_rejected_collision);
+		cp_nb_tx_rejected_too_late         =  MEAS_TAKE(serv->meas_dw.nb_tx_rejected_too_late);
+		cp_nb_tx_rejected_too_early        =  MEAS_TAKE(serv->meas_dw.nb_tx_rejected_too_early);
+		cp_nb_tx_queue_full                =  MEAS_TAKE(serv->meas_dw.nb_tx_queue_full);
+		cp_nb_tx_denied                    =  MEAS_TAKE(serv->meas_dw.nb_tx_denied);
+		if ((cp_nb_tx_rejected_collision + cp_nb_tx_rejected_too_late + cp_nb_tx_rejected_too_early + cp_nb_tx_queue_full) > 0) {
+			MSG("INFO: [down] %s: %u TX request(s), rejected: %u collision, %u too late, %u too early, %u queue full\n", serv->addr, cp_nb_tx_requested, cp_nb_tx_rejected_collision, cp_nb_tx_rejected_too_late, cp_nb_tx_rejected_too_early, cp_nb_tx_queue_full);
+		}
+		if (cp_nb_tx_denied > 0) {
+			MSG("INFO: [down] %s: %u TX request(s) ignored, downlink not allowed\n", serv->addr, cp_nb_tx_denied);
+		}
+		if (cp_dw_pull_sent > 0) {
+			dw_ack_ratio = (float)cp_dw_ack_rcv / (float)cp_dw_pull_sent;
+		} else {
+			dw_ack_ratio = 0.0;
+		}
+
+		/* start composing datagram with the header */
+		status_report[1] = (uint8_t)rand(); /* random token */
+		status_report[2] = (uint8_t)rand(); /* random token */
+
+		stat_index = 12; /* 12-byte header */
+
+		j = snprintf((char *)(status_report + stat_index), STATUS_SIZE - stat_index, "{\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"pfrm\":\"%s\",\"mail\":\"%s\",\"desc\":\"%s\"}}", stat_timestamp, lat, lon, (int)alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, serv->downlink ? cp_nb_tx_ok : 0, platform, email, description);
+		stat_index += j;
+		status_report[stat_index] = 0; /* add string terminator, for safety */
+
+		MSG("\nINFO (json): [stat update] %s: %s\n", serv->addr, (char *)(status_report + 12)); /* DEBUG: display JSON stat */
+
+		/* send the update on the upstream socket, its PUSH_ACK matches no token and is ignored */
+		send(serv->sock_up, (void *)status_report, stat_index, MSG_DONTWAIT);
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- CONFIGURATION: START-UP AND LIVE RELOAD ------------------------------ */
+
+/* read the settings from the current snapshot; a reload only takes the
+   settings that can change while running (servers, radio, aggregation,
+   dedup, filter, location and contact), the others need a restart;
+   returns the number of servers configured */
+static int read_config(bool reload, struct serv_conf_s *serv_conf, struct up_conf_s *up_conf) {
+    struct serv_conf_s *sc;
+    char section[16];
+    char opt_downlink[16];
+    unsigned long long ull = 0;
+    int i, nb;
+
+    /* primary server, downlinks allowed unless downlink=0 */
+    sc = &serv_conf[0];
+    if (!get_lg01_config("general", "server", sc->addr, sizeof sc->addr)){
+        strcpy(sc->addr, "52.169.76.203");  /*set default:router.eu.thethings.network*/
+        MSG("get option server=%s", sc->addr);
+    }
+
+    if (!get_lg01_config("general", "port", sc->port, sizeof sc->port)){
+        strcpy(sc->port, "1700");
+        MSG("get option port=%s", sc->port);
+    }
+
+    sc->downlink = !(get_lg01_config("general", "downlink", opt_downlink, sizeof opt_downlink) && !strcmp(opt_downlink, "0"));
+    nb = 1;
+
+    /* additional servers, uplinks only unless downlink=1 */
+    for (i = 1; i < SERV_MAX; i++) {
+        sc = &serv_conf[nb];
+        sprintf(section, "server%d", i);
+        if (!get_lg01_config(section, "server", sc->addr, sizeof sc->addr))
+            continue;
+        if (!get_lg01_config(section, "port", sc->port, sizeof sc->port))
+            strcpy(sc->port, serv_conf[0].port);
+        sc->downlink = get_lg01_config(section, "downlink", opt_downlink, sizeof opt_downlink) && !strcmp(opt_downlink, "1");
+        nb++;
+    }
+
+    if (!get_lg01_config("general", "mail", email, sizeof email)){
+        strcpy(email, "dragino@dragino.com");
+        MSG("get option email=%s", email);
+    }
+
+    if (!get_lg01_config("general", "lati", LAT, sizeof LAT)){
+        strcpy(LAT, "0");
+        MSG("get option lat=%s", LAT);
+    }
+
+    if (!get_lg01_config("general", "long", LON, sizeof LON)){
+        strcpy(LON, "0");
+        MSG("get option lon=%s", LON);
+    }
+
+    /*
+    if (!get_lg01_config("general", "pfwd_debug", pfwd_debug, sizeof pfwd_debug)){
+        MSG("get option pfwd_debug=%s", pfwd_debug);
+    }
+    */
+
+    if (!reload) {
+        if (!get_lg01_config("general", "gateway_id", gatewayid, sizeof gatewayid)){
+            MSG("get option gatewayid=%s", gatewayid);
+        } 
+
+        if (get_lg01_config("general", "ingest", ingest, sizeof ingest)){
+            if (!strcmp(ingest, "poll"))
+                ingest_mode = INGEST_POLL;
+        }
+
+        if (get_lg01_config("general", "runtime", runtime, sizeof runtime)){
+            if (!strcmp(runtime, "epoll"))
+                runtime_mode = RUNTIME_EPOLL;
+        }
+
+        if (!get_lg01_config("general", "query_port", query_port, sizeof query_port)){
+            strcpy(query_port, DEFAULT_QUERY_PORT);
+        }
+
+        if (!get_lg01_config("general", "journal_path", journal_path, sizeof journal_path)){
+            strcpy(journal_path, "/var/iot/journal");
+        }
+
+        if (!get_lg01_config("general", "journal_size", journal_size, sizeof journal_size)){
+            sprintf(journal_size, "%d", DEFAULT_JOURNAL_SIZE);
+        }
+
+        if (get_lg01_config("general", "journal_age", journal_age, sizeof journal_age) && (atoi(journal_age) > 0)){
+            journal_max_age = atoi(journal_age);
+        }
+
+        if (get_lg01_config("general", "journal_rate", journal_rate, sizeof journal_rate) && (atoi(journal_rate) > 0)){
+            replay_interval_ms = 1000 / atoi(journal_rate);
+        }
+
+        sscanf(gatewayid, "%llx", &ull);
+        lgwm = ull;
+    }
+
+    up_conf->aggr_window_ms = 0;
+    if (get_lg01_config("general", "push_window", push_window, sizeof push_window)){
+        up_conf->aggr_window_ms = atoi(push_window);
+        if (up_conf->aggr_window_ms < 0)
+            up_conf->aggr_window_ms = 0;
+    }
+
+    up_conf->aggr_max = 1;
+    if (get_lg01_config("general", "push_batch", push_batch, sizeof push_batch)){
+        up_conf->aggr_max = atoi(push_batch);
+    }
+    if ((up_conf->aggr_max < 1) || (up_conf->aggr_window_ms == 0))
+        up_conf->aggr_max = 1;
+    else if (up_conf->aggr_max > NB_PKT_MAX)
+        up_conf->aggr_max = NB_PKT_MAX;
+
+    if (!get_lg01_config("general", "dedup_window", dedup_window, sizeof dedup_window) || (atoi(dedup_window) < 0)){
+        sprintf(dedup_window, "%d", DEFAULT_DEDUP_MS);
+    }
+    up_conf->dedup_ms = atoi(dedup_window);
+
+    read_filter(up_conf);
+
+    if (!get_lg01_config("general", "resolve_interval", resolve_interval, sizeof resolve_interval) || (atoi(resolve_interval) < 0)){
+        sprintf(resolve_interval, "%d", DEFAULT_RESOLVE_S);
+    }
+    resolve_s = atoi(resolve_interval);
+
+    if (!get_lg01_config("radio", "SF", sf, sizeof sf)){
+        MSG("get option sf=%s", sf);
+    }
+
+    if (!get_lg01_config("radio", "coderate", coderate, sizeof coderate)){
+        MSG("get option coderate=%s", coderate);
+    }
+
+    if (!get_lg01_config("radio", "BW", bw, sizeof bw)){
+        MSG("get option bw=%s", bw);
+        strcpy(bw, "7"); /* 125 kHz */
+    }
+
+    if (!get_lg01_config("radio", "rx_frequency", frequency, sizeof frequency)){
+        strcpy(frequency, "868100000"); /* default frequency*/
+        MSG("get option frequency=%s", frequency);
+    }
+
+    lat = atof(LAT);
+    lon = atof(LON);
+    up_conf->freq_hz = atof(frequency);
+
+    i = atoi(sf);
+    up_conf->datarate = ((i >= 7) && (i <= 12)) ? (1U << (i - 6)) : DR_LORA_SF7; /* DR_LORA_SF7..DR_LORA_SF12 */
+    i = atoi(coderate);
+    up_conf->coderate = ((i >= 5) && (i <= 8)) ? (i - 4) : CR_LORA_4_5; /* CR_LORA_4_5..CR_LORA_4_8 */
+    switch (atoi(bw)) { /* same index as the MCU sketch */
+        case 0: up_conf->bandwidth = BW_7K8HZ; break;
+        case 2: up_conf->bandwidth = BW_15K6HZ; break;
+        case 4: up_conf->bandwidth = BW_31K2HZ; break;
+        case 6: up_conf->bandwidth = BW_62K5HZ; break;
+        case 8: up_conf->bandwidth = BW_250KHZ; break;
+        case 9: up_conf->bandwidth = BW_500KHZ; break;
+        default: up_conf->bandwidth = BW_125KHZ; break;
+    }
+    return nb;
+}
+
+/* build the identity filter from the "filter" section; each option is a
+   list, or a string of rules separated by spaces:
+     devaddr_allow / devaddr_deny: DevAddr, or prefix "26000000/7"
+     netid_allow / netid_deny: NetID, "000013"
+     joineui_allow / joineui_deny: JoinEUI, or prefix "70B3D57ED0000000/36"
+   the rules only reach the uplink path if they changed, so that a reload
+   leaves the counters alone */
+static void read_filter(struct up_conf_s *up_conf) {
+    static const struct {
+        const char *name;
+        int kind;
+        bool deny;
+    } opts[] = {
+        {"devaddr_allow", UPFILTER_DEVADDR, false}, {"devaddr_deny", UPFILTER_DEVADDR, true},
+        {"netid_allow", UPFILTER_NETID, false}, {"netid_deny", UPFILTER_NETID, true},
+        {"joineui_allow", UPFILTER_JOINEUI, false}, {"joineui_deny", UPFILTER_JOINEUI, true}
+    };
+    static struct upfilter_s uf; /* 4 KB, kept off the stack */
+    const char *values[FILTER_RULE_MAX];
+    char bad[32];
+    int i, j, nb, nb_bad;
+
+    upfilter_init(&uf);
+    for (i = 0; i < (int)ARRAY_SIZE(opts); i++) {
+        nb = conf_get_list(conf, "filter", opts[i].name, values, FILTER_RULE_MAX);
+        for (j = 0; j < nb; j++) {
+            nb_bad = upfilter_add_list(&uf, opts[i].kind, opts[i].deny, values[j], bad, sizeof bad);
+            if (nb_bad > 0)
+                MSG("WARNING: [main] filter %s: %d rule(s) ignored, invalid or too many rules, first \"%s\"\n", opts[i].name, nb_bad, bad);
+        }
+    }
+    upfilter_finish(&uf);
+
+    pthread_mutex_lock(&mx_filter);
+    if ((filter_gen == 0) || !upfilter_same(&uf, &upfilter_next)) {
+        upfilter_next = uf;
+        filter_gen++;
+        MSG("INFO: [main] uplink filter: %d/%d DevAddr range(s) allowed/denied, %d/%d JoinEUI range(s) allowed/denied\n",
+            uf.set[UPFILTER_DEVADDR_ALLOW].nb, uf.set[UPFILTER_DEVADDR_DENY].nb, uf.set[UPFILTER_JOINEUI_ALLOW].nb, uf.set[UPFILTER_JOINEUI_DENY].nb);
+    }
+    up_conf->filter_gen = filter_gen;
+    pthread_mutex_unlock(&mx_filter);
+}
+
+/* hand the uplink settings over to the uplink path */
+static void publish_up_conf(const struct up_conf_s *up_conf) {
+    __sync_fetch_and_add(&up_conf_seq, 1); /* odd: being written */
+    up_conf_pub = *up_conf;
+    __sync_fetch_and_add(&up_conf_seq, 1);
+}
+
+/* parse the configuration again and apply it without stopping anything:
+   the uplink path picks its new settings up on the next packet, the servers
+   are resolved again by thread_resolve, which moves their sockets if the
+   addresses changed; false if nothing was applied */
+static bool reload_config(void) {
+    struct conf_s *spare = (conf == &conf_snaps[0]) ? &conf_snaps[1] : &conf_snaps[0];
+    struct serv_conf_s serv_conf[SERV_MAX];
+    struct serv_conf_s *sc;
+    struct up_conf_s up_conf;
+    struct serv_s *serv;
+    int i, nb;
+
+    if (conf_load(spare, UCI_CONFIG_FILE) < 0) {
+        MSG("WARNING: [main] can't load %s, configuration unchanged\n", UCI_CONFIG_FILE);
+        return false;
+    }
+    conf = spare; /* only main() reads the snapshot */
+    report_conf_lost(conf);
+
+    memset(serv_conf, 0, sizeof serv_conf);
+    nb = read_config(true, serv_conf, &up_conf);
+    publish_up_conf(&up_conf);
+
+    if (nb != nb_serv_conf) {
+        MSG("WARNING: [main] %d server(s) configured instead of %d: restart to add or remove servers\n", nb, nb_serv_conf);
+    }
+    for (i = 0; i < nb_serv; i++) {
+        serv = &servers[i];
+        if (serv->conf_idx >= nb)
+            continue;
+        sc = &serv_conf[serv->conf_idx];
+        pthread_mutex_lock(&serv->mx_addr);
+        strcpy(serv->addr, sc->addr);
+        strcpy(serv->port, sc->port);
+        serv->downlink = sc->downlink;
+        serv->resolve_due = true;
+        serv->resolve_next.tv_sec = 0; /* now */
+        pthread_mutex_unlock(&serv->mx_addr);
+        MSG("INFO: [main] server %d: %s, port %s, downlink %s\n", i, sc->addr, sc->port, sc->downlink ? "allowed" : "ignored");
+    }
+    pthread_mutex_lock(&mx_resolve);
+    resolve_wake = true;
+    pthread_cond_signal(&cv_resolve);
+    pthread_mutex_unlock(&mx_resolve);
+    MSG("INFO: [main] configuration reloaded\n");
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+	struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+	sigset_t sigset_hup;
+	int i, j; /* loop variable and temporary variable for return value */
+	
+	/* threads */
+	pthread_t thrid_up;
+	pthread_t thrid_jit;
+	pthread_t thrid_resolve;
+	
+	/* configuration */
+	struct serv_conf_s serv_conf[SERV_MAX];
+	struct up_conf_s up_conf;
+	struct serv_s *serv;
+	struct sockaddr_in resolved[SERVADDR_MAX];
+	int k;
+
+	/* display version informations */
+	//MSG("*** Basic Packet Forwarder for LG01 ***\nVersion: " VERSION_STRING "\n");
+	
+	/* display host endianness 
+	#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		MSG("INFO: Little endian host\n");
+	#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		MSG("INFO: Big endian host\n");
+	#else
+		MSG("INFO: Host endianness unknown\n");
+	#endif
+    */
+	
+	/* load configuration, one parse of the UCI package */
+	if (conf_load(conf, UCI_CONFIG_FILE) < 0) {
+		MSG("WARNING: [main] can't load %s, using defaults\n", UCI_CONFIG_FILE);
+	} else {
+		report_conf_lost(conf);
+	}
+	memset(serv_conf, 0, sizeof serv_conf);
+	nb_serv_conf = read_config(false, serv_conf, &up_conf);
+	publish_up_conf(&up_conf);
+
+	/* sanity check on configuration variables */
+	// TODO
+	
+	/* process some of the configuration variables */
+	net_mac_h = htonl((uint32_t)(0xFFFFFFFF & (lgwm>>32)));
+	net_mac_l = htonl((uint32_t)(0xFFFFFFFF &  lgwm  ));
+	
+	/* resolve each server and open its sockets, only the primary one is mandatory */
+	for (i = 0, j = 0; i < nb_serv_conf; i++) {
+		serv = &servers[j];
+		strcpy(serv->addr, serv_conf[i].addr);
+		strcpy(serv->port, serv_conf[i].port);
+		serv->downlink = serv_conf[i].downlink;
+		serv->conf_idx = i;
+		servaddr_init(&serv->addrs);
+		k = resolve_server(serv->addr, serv->port, resolved, SERVADDR_MAX);
+		if (k > 0) {
+			servaddr_merge(&serv->addrs, resolved, k);
+			serv->sock_up = socket(AF_INET, SOCK_DGRAM, 0);
+			serv->sock_down = socket(AF_INET, SOCK_DGRAM, 0);
+		} else {
+			serv->sock_up = serv->sock_down = -1;
+		}
+		if ((serv->sock_up < 0) || (serv->sock_down < 0) || !serv_connect(serv)) {
+			if (i == 0)
+				exit(EXIT_FAILURE);
+			MSG("WARNING: [main] server %s (port %s) skipped\n", serv->addr, serv->port);
+			if (serv->sock_up >= 0)
+				close(serv->sock_up);
+			if (serv->sock_down >= 0)
+				close(serv->sock_down);
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &serv->resolve_next);
+		serv->resolve_next.tv_sec += resolve_s;
+		pthread_mutex_init(&serv->mx_addr, NULL);
+		pthread_mutex_init(&serv->mx_inflight, NULL);
+		serv->backhaul_up = true;
+		json_arena_init(&serv->arena, arena_buffs[j], JSON_ARENA_SIZE);
+		MSG("INFO: [main] server %d: %s, port %s, downlink %s\n", j, serv->addr, serv->port, serv->downlink ? "allowed" : "ignored");
+		j++;
+	}
+	nb_serv = j;
+	
+	jit_queue_init(&jit_queue);
+
+	/* local query socket for the latency histograms */
+	if (atoi(query_port) > 0) {
+		sock_query = open_query_socket(query_port);
+		if (sock_query < 0) {
+			MSG("WARNING: [main] can't open query socket on 127.0.0.1:%s (%s)\n", query_port, strerror(errno));
+		}
+	}
+
+	/* map the store-and-forward journal, records of a previous run are replayed */
+	if (atoi(journal_size) > 0) {
+		if (journal_open(&journal, journal_path, 1024 * (uint32_t)atoi(journal_size)) != 0) {
+			MSG("WARNING: [main] can't map journal %s (%s), uplinks not acknowledged will be lost\n", journal_path, strerror(errno));
 		} else {
-			dw_ack_ratio = 0.0;
+			journal_enabled = true;
+			MSG("INFO: [main] journal %s: %u KB, %u record(s) to replay\n", journal_path, journal.hdr->data_size / 1024, journal.hdr->nb_rec);
 		}
-		
-		/* display a report */
-        /*
-		printf("\n##### %s #####\n", stat_timestamp);
-		printf("### [UPSTREAM] ###\n");
-		printf("# RF packets received by concentrator: %u\n", cp_nb_rx_rcv);
-		printf("# CRC_OK: %.2f%%, CRC_FAIL: %.2f%%, NO_CRC: %.2f%%\n", 100.0 * rx_ok_ratio, 100.0 * rx_bad_ratio, 100.0 * rx_nocrc_ratio);
-		printf("# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
-		printf("# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
-		printf("# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
-		printf("### [DOWNSTREAM] ###\n");
-		printf("# PULL_DATA sent: %u (%.2f%% acknowledged)\n", cp_dw_pull_sent, 100.0 * dw_ack_ratio);
-		printf("# PULL_RESP(onse) datagrams received: %u (%u bytes)\n", cp_dw_dgram_rcv, cp_dw_network_byte);
-		printf("# RF packets sent to concentrator: %u (%u bytes)\n", (cp_nb_tx_ok+cp_nb_tx_fail), cp_dw_payload_byte);
-		printf("# TX errors: %u\n", cp_nb_tx_fail);
-		printf("##### END #####\n");
-        */
+	}
 
-        /* start composing datagram with the header */
-        uint8_t token_h = (uint8_t)rand(); /* random token */
-        uint8_t token_l = (uint8_t)rand(); /* random token */
-        status_report[1] = token_h;
-        status_report[2] = token_l;
+	/* reload the configuration when it is committed */
+	fd_conf = open_notify(UCI_CONFIG_DIR);
+	if (fd_conf < 0) {
+		MSG("WARNING: [main] can't watch %s (%s), reload with SIGHUP only\n", UCI_CONFIG_DIR, strerror(errno));
+	}
 
-        stat_index = 12; /* 12-byte header */
+	/* SIGHUP is kept away from the threads, main() does the reloads */
+	sigemptyset(&sigset_hup);
+	sigaddset(&sigset_hup, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &sigset_hup, NULL);
 
-        /* get timestamp for statistics */
-        t = time(NULL);
-        strftime(stat_timestamp, sizeof stat_timestamp, "%F %T %Z", gmtime(&t));
+	/* server names are resolved again off the packet path, in both runtimes */
+	i = pthread_create( &thrid_resolve, NULL, thread_resolve, NULL);
+	if (i != 0) {
+		MSG("ERROR: [main] impossible to create resolver thread\n");
+		exit(EXIT_FAILURE);
+	}
 
-        j = snprintf((char *)(status_report + stat_index), STATUS_SIZE - stat_index, "{\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"pfrm\":\"%s\",\"mail\":\"%s\",\"desc\":\"%s\"}}", stat_timestamp, lat, lon, (int)alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, (float)0, 0, 0, platform, email, description);
-        stat_index += j;
-        status_report[stat_index] = 0; /* add string terminator, for safety */
+	/* spawn threads to manage upstream and downstream, the event loop needs none */
+	if (runtime_mode == RUNTIME_THREADS) {
+		MSG("spawn threads to manage upsteam and downstream...\n");
+		i = pthread_create( &thrid_up, NULL, thread_up, NULL);
+		if (i != 0) {
+			MSG("ERROR: [main] impossible to create upstream thread\n");
+			exit(EXIT_FAILURE);
+		}
 
-        MSG("\nINFO (json): [stat update] %s\n", (char *)(status_report + 12)); /* DEBUG: display JSON stat */
+		for (j = 0; j < nb_serv; j++) {
+			i = pthread_create( &servers[j].thrid_up_ack, NULL, thread_up_ack, &servers[j]);
+			if (i != 0) {
+				MSG("ERROR: [main] impossible to create upstream ACK thread\n");
+				exit(EXIT_FAILURE);
+			}
 
-        //send the update
-        send(sock_stat, (void *)status_report, stat_index, 0);
+			i = pthread_create( &servers[j].thrid_down, NULL, thread_down, &servers[j]);
+			if (i != 0) {
+				MSG("ERROR: [main] impossible to create downstream thread\n");
+				exit(EXIT_FAILURE);
+			}
+		}
 
-		/* wait for next reporting interval */
-		wait_ms(1000 * stat_interval);
+		i = pthread_create( &thrid_jit, NULL, thread_jit, NULL);
+		if (i != 0) {
+			MSG("ERROR: [main] impossible to create JIT thread\n");
+			exit(EXIT_FAILURE);
+		}
 	}
 	
-	/* wait for upstream thread to finish (1 fetch cycle max) */
-	pthread_join(thrid_up, NULL);
-	pthread_cancel(thrid_down); /* don't wait for downstream thread */
+	/* configure signal handling */
+	sigemptyset(&sigact.sa_mask);
+	sigact.sa_flags = 0;
+	sigact.sa_handler = sig_handler;
+	sigaction(SIGQUIT, &sigact, NULL); /* Ctrl-\ */
+	sigaction(SIGINT, &sigact, NULL); /* Ctrl-C */
+	sigaction(SIGTERM, &sigact, NULL); /* default "kill" command */
+	sigaction(SIGHUP, &sigact, NULL); /* reload the configuration */
+	pthread_sigmask(SIG_UNBLOCK, &sigset_hup, NULL);
+    
+    MSG("Start lora packet forward daemon, server = %s, port = %s, %d server(s)\n", servers[0].addr, servers[0].port, nb_serv);
+	
+	if (runtime_mode == RUNTIME_EPOLL) {
+		/* everything on this thread, returns on exit or quit signal */
+		run_event_loop();
+	} else {
+		/* main loop task : statistics collection and send status to server */
+		while (!exit_sig && !quit_sig) {
+			report_stats();
+
+			/* wait for next reporting interval, answering local queries meanwhile */
+			serve_queries(1000 * stat_interval);
+		}
+
+		/* wait for upstream thread to finish (1 fetch cycle max) */
+		pthread_join(thrid_up, NULL);
+		for (i = 0; i < nb_serv; i++) {
+			pthread_join(servers[i].thrid_up_ack, NULL); /* 1 receive timeout max */
+			pthread_cancel(servers[i].thrid_down); /* don't wait for downstream thread */
+		}
+		pthread_join(thrid_jit, NULL); /* JIT_WAIT_MS max */
+	}
+	pthread_cancel(thrid_resolve); /* don't wait for a DNS lookup */
+
+	/* keep what the primary server did not acknowledge yet for the next run */
+	if (journal_enabled) {
+		pthread_mutex_lock(&servers[0].mx_inflight);
+		for (i = 0; i < UP_INFLIGHT_MAX; i++) {
+			if (servers[0].inflight[i].used)
+				journal_store(&servers[0].inflight[i]);
+		}
+		pthread_mutex_unlock(&servers[0].mx_inflight);
+		journal_close(&journal);
+	}
 	
 	/* if an exit signal was received, try to quit properly */
 	if (exit_sig) {
 		/* shut down network sockets */
-		shutdown(sock_stat, SHUT_RDWR);
-		shutdown(sock_up, SHUT_RDWR);
-		shutdown(sock_down, SHUT_RDWR);
+		for (i = 0; i < nb_serv; i++) {
+			shutdown(servers[i].sock_up, SHUT_RDWR);
+			shutdown(servers[i].sock_down, SHUT_RDWR);
+		}
+		if (sock_query >= 0)
+			close(sock_query);
 	}
 	
 	MSG("INFO: Exiting packet forwarder program\n");
@@ -757,282 +2535,116 @@ int main(void)
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 1: RECEIVING PACKETS AND FORWARDING THEM ---------------------- */
 
-void thread_up(void) {
-	int i, j; /* loop variables */
-    int fd;
-
-    /* lora package */
-    char rssi[16] = "rssi=";
-    char size[16] = "size=";
-	
-	/* allocate memory for packet fetching and processing */
-	int nb_pkt;
-	
-	/* local timestamp variables until we get accurate GPS time */
-	struct timespec fetch_time;
-	struct tm * x;
-	char fetch_timestamp[28]; /* timestamp as a text string */
-	
-	/* data buffers */
-	uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
-	int buff_index;
-	uint8_t buff_ack[32]; /* buffer to receive acknowledges */
+void * thread_up(void *arg) {
+	struct up_state_s up; /* datagram being composed */
+	struct lgw_pkt_rx_s rxpkt; /* lora package */
+	struct timespec ingest_time;
+	int fd_notify; /* inotify instance watching the MCU data directory */
+	int fd_txack; /* the same for the transmit reports only, when fd_notify is not used */
+	bool pending = true; /* try once at start, the MCU may have written a packet before we were up */
+	bool got_pkt;
+	int wait_time;
+
+	(void)arg;
+	fd_notify = open_up_notify();
+	fd_txack = (fd_notify < 0) ? open_notify(UPDIR) : -1;
+	up_init(&up);
 
-    char up_data[TX_BUFF_SIZE - 128];
-    char updata[32];
-	
-	/* protocol variables */
-	uint8_t token_h; /* random token for acknowledgement matching */
-	uint8_t token_l; /* random token for acknowledgement matching */
-	
-	/* ping measurement variables */
-	struct timespec send_time;
-	struct timespec recv_time;
-    struct stat statbuf;
-	
-	/* set upstream socket RX timeout */
-	i = setsockopt(sock_up, SOL_SOCKET, SO_RCVTIMEO, (void *)&push_timeout_half, sizeof push_timeout_half);
-	if (i != 0) {
-		MSG("ERROR: [up] setsockopt returned %s\n", strerror(errno));
-		exit(EXIT_FAILURE);
-	}
-	
-	/* pre-fill the data buffer with fixed fields */
-	buff_up[0] = PROTOCOL_VERSION;
-	buff_up[3] = PKT_PUSH_DATA;
-	*(uint32_t *)(buff_up + 4) = net_mac_h;
-	*(uint32_t *)(buff_up + 8) = net_mac_l;
-	
 	while (!exit_sig && !quit_sig) {
 
-        //MSG("INFO: [up] loop...\n");
-		/* fetch packets */
-        if (stat(UPCFGPATH, &statbuf) == -1) {
-            wait_ms(FETCH_SLEEP_MS); 
-            continue;
-        } else {
-            if (statbuf.st_size < 3) {
-                wait_ms(FETCH_SLEEP_MS); 
-                continue;
-            }
-        }
-
-        if ((fd = open(UPCFGPATH, O_RDONLY)) < 0 ){
-            wait_ms(FETCH_SLEEP_MS); /* wait a short time if no packets */
-            continue;
-        } else {
-            memset(updata, 0, sizeof(updata));
-            if ((i = read(fd, updata, sizeof(updata))) < 0){  /* file format: rssi= size= data= */
-                //MSG("No more content!");
-                close(fd);
-                wait_ms(FETCH_SLEEP_MS); /* wait a short time if no packets */
-                continue;
-            }
-        }
-
-        if (close(fd) != 0) {
-            MSG("can't close up_cfg_data file!");
-        }
-
-        strcpy(rssi, "rssi=");
-        strcpy(size, "size=");
-
-        if(!get_lora_value(updata, rssi)) {
-            wait_ms(FETCH_SLEEP_MS); /* wait a short time if no packets */
-            continue;
-        }
-        
-        if(!get_lora_value(updata, size)) {
-            wait_ms(FETCH_SLEEP_MS); /* wait a short time if no packets */
-            continue;
-        }
-
-        wait_ms(DEFAULT_STAT); /* wait a short time after arduino write data to file */
-
-        if ((fd = open(UPPATH, O_RDONLY)) < 0 ){
-            wait_ms(FETCH_SLEEP_MS); /* wait a short time if no packets */
-            continue;
-        } else {
-            memset(up_data, 0, sizeof(up_data));
-            if ((i = read(fd, up_data, sizeof(up_data))) < 0){  /* file format: rssi= size= data= */
-                //MSG("No more content!");
-                close(fd);
-                wait_ms(FETCH_SLEEP_MS); /* wait a short time if no packets */
-                continue;
-            }
-
-        }
+		/* how long we may block: until the aggregation window of a pending datagram closes */
+		clock_gettime(CLOCK_MONOTONIC, &ingest_time);
+		wait_time = up_wait_ms(&up, &ingest_time, NOTIFY_WAIT_MS);
 
-        if (close(fd) != 0) {
-            MSG("can't close up_data file!");
-        }
+		/* fetch packets */
+		got_pkt = false;
+		if (ingest_mode == INGEST_INOTIFY) {
+			if (pending || wait_up_notify(fd_notify, wait_time)) {
+				pending = false;
+				clock_gettime(CLOCK_MONOTONIC, &ingest_time);
+				got_pkt = fetch_up_packet(&rxpkt, false);
+			}
+		} else {
+			clock_gettime(CLOCK_MONOTONIC, &ingest_time);
+			got_pkt = fetch_up_packet(&rxpkt, true);
+			if (!got_pkt)
+				wait_tx_report(fd_txack, (up.nb_pkt > 0 && wait_time < FETCH_SLEEP_MS) ? wait_time : FETCH_SLEEP_MS); /* wait a short time if no packets */
+		}
 
-		/* local timestamp generation until we get accurate GPS time */
-		clock_gettime(CLOCK_REALTIME, &fetch_time);
-		x = gmtime(&(fetch_time.tv_sec)); /* split the UNIX timestamp to its calendar components */
-		snprintf(fetch_timestamp, sizeof fetch_timestamp, "%04i-%02i-%02iT%02i:%02i:%02i.%06liZ", (x->tm_year)+1900, (x->tm_mon)+1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (fetch_time.tv_nsec)/1000); /* ISO 8601 format */
-		
-        /* get timestamp for statistics */
-        struct timeval now;
-        gettimeofday(&now, NULL);
-        uint32_t tmst = (uint32_t)(now.tv_sec*1000000 + now.tv_usec);
+		if (got_pkt)
+			up_ingest(&up, &rxpkt, &ingest_time);
 
-		/* start composing datagram with the header */
-		token_h = (uint8_t)rand(); /* random token */
-		token_l = (uint8_t)rand(); /* random token */
-		buff_up[1] = token_h;
-		buff_up[2] = token_l;
-		buff_index = 12; /* 12-byte header */
+		if (!up_flush(&up))
+			continue;
 
-        j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, "{\"rxpk\":[{\"tmst\":%u,\"time\":\"%s\",\"chan\":7,\"rfch\":0,\"freq\":%u,\"stat\":1,\"modu\":\"LORA\",\"datr\":\"SF%sBW125\",\"codr\":\"4/%s\",\"lsnr\":7.8", tmst, fetch_timestamp, freq, sf, coderate);
-    
-        buff_index += j;
+		if (!up.replay && (ingest_mode == INGEST_POLL))
+			wait_ms(4 * FETCH_SLEEP_MS); /* wait 2 seconds after receive a packet */
+	}
+	if (fd_notify >= 0) {
+		close(fd_notify);
+	}
+	if (fd_txack >= 0) {
+		close(fd_txack);
+	}
+	MSG("\nINFO: End of upstream thread\n");
+	return NULL;
+}
 
-        j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index, ",\"rssi\":%d,\"size\":%u", atoi(rssi), atoi(size));
-		
-        buff_index += j;
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1b: MATCHING PUSH_ACK WITH IN-FLIGHT PUSH_DATA ---------------- */
 
-        memcpy((void *)(buff_up + buff_index), (void *)",\"data\":\"", 9);
-		buff_index += 9;
-		
-        j = bin_to_b64((uint8_t *)up_data, atoi(size), (char *)(buff_up + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
-
-        buff_index += j;
-        buff_up[buff_index] = '"';
-        ++buff_index;
-        buff_up[buff_index] = '}';
-        ++buff_index;
-        buff_up[buff_index] = ']';
-        ++buff_index;
-        buff_up[buff_index] = '}';
-        ++buff_index;
-        buff_up[buff_index] = '\0'; /* add string terminator, for safety */
-		
-	    printf("\nINFO (JSON): [up] %s\n", (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
-		
-		/* send datagram to server */
-		send(sock_up, (void *)buff_up, buff_index, 0);
-		clock_gettime(CLOCK_MONOTONIC, &send_time);
-		pthread_mutex_lock(&mx_meas_up);
-		meas_up_dgram_sent += 1;
-		meas_up_network_byte += buff_index;
-		
-		/* wait for acknowledge (in 2 times, to catch extra packets) */
-		for (i=0; i<2; ++i) {
-			j = recv(sock_up, (void *)buff_ack, sizeof buff_ack, 0);
-			clock_gettime(CLOCK_MONOTONIC, &recv_time);
-			if (j == -1) {
-				if (errno == EAGAIN) { /* timeout */
-					continue;
-				} else { /* server connection error */
-					break;
-				}
-			} else if ((j < 4) || (buff_ack[0] != PROTOCOL_VERSION) || (buff_ack[3] != PKT_PUSH_ACK)) {
-				//MSG("WARNING: [up] ignored invalid non-ACL packet\n");
-				continue;
-			} else if ((buff_ack[1] != token_h) || (buff_ack[2] != token_l)) {
-				//MSG("WARNING: [up] ignored out-of sync ACK packet\n");
-				continue;
-			} else {
-				MSG("INFO: [up] PUSH_ACK received in %i ms\n", (int)(1000 * difftimespec(recv_time, send_time)));
-				meas_up_ack_rcv += 1;
-				break;
-			}
-		}
-		pthread_mutex_unlock(&mx_meas_up);
+void * thread_up_ack(void *arg) {
+	struct serv_s *serv = (struct serv_s *)arg;
+	int i, j;
+	uint8_t buff_ack[32]; /* buffer to receive acknowledges */
+	struct timespec recv_time;
 
-        if ((fd = open(UPCFGPATH, O_WRONLY|O_TRUNC)) < 0 ){   /* clear the upfile */
-            MSG("can't reopen data file!");
-        } else 
-            close(fd);
+	/* set upstream socket RX timeout, bounds the latency of expiry and exit */
+	i = setsockopt(serv->sock_up, SOL_SOCKET, SO_RCVTIMEO, (void *)&push_timeout_half, sizeof push_timeout_half);
+	if (i != 0) {
+		MSG("ERROR: [up] setsockopt returned %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
-        wait_ms(4 * FETCH_SLEEP_MS); /* wait 2 seconds after receive a packet */
-        //MSG("INFO: [up]return loop\n");
+	while (!exit_sig && !quit_sig) {
+		j = recv(serv->sock_up, (void *)buff_ack, sizeof buff_ack, 0);
+		clock_gettime(CLOCK_MONOTONIC, &recv_time);
+		if (j >= 0)
+			up_ack_receive(serv, buff_ack, j, &recv_time);
+		up_ack_expire(serv, &recv_time);
 	}
-	MSG("\nINFO: End of upstream thread\n");
+	MSG("\nINFO: End of upstream ACK thread\n");
+	return NULL;
 }
 
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 2: POLLING SERVER AND EMITTING PACKETS ------------------------ */
 
-void thread_down(void) {
-	int i; /* loop variables */
-
-    int fd;
-	
-	/* configuration and metadata for an outbound packet */
-	struct lgw_pkt_tx_s txpkt;
-	bool sent_immediate = false; /* option to sent the packet immediately */
-	
-	/* local timekeeping variables */
-	struct timespec send_time; /* time of the pull request */
+void * thread_down(void *arg) {
+	struct serv_s *serv = (struct serv_s *)arg;
+	int i;
 	struct timespec recv_time; /* time of return from recv socket call */
-	
-	/* data buffers */
 	uint8_t buff_down[1024]; /* buffer to receive downstream packets */
-	uint8_t buff_req[12]; /* buffer to compose pull requests */
 	int msg_len;
 	
-	/* protocol variables */
-	uint8_t token_h; /* random token for acknowledgement matching */
-	uint8_t token_l; /* random token for acknowledgement matching */
-	bool req_ack = false; /* keep track of whether PULL_DATA was acknowledged or not */
-	
-    /* JSON parsing variables */
-    JSON_Value *root_val = NULL;
-    JSON_Object *txpk_obj = NULL;
-	JSON_Value *val = NULL; /* needed to detect the absence of some fields */
-	const char *str; /* pointer to sub-strings in the JSON data */
-	short x0, x1;
-	
-	/* auto-quit variable */
-	uint32_t autoquit_cnt = 0; /* count the number of PULL_DATA sent since the latest PULL_ACK */
-	
 	/* set downstream socket RX timeout */
-	i = setsockopt(sock_down, SOL_SOCKET, SO_RCVTIMEO, (void *)&pull_timeout, sizeof pull_timeout);
+	i = setsockopt(serv->sock_down, SOL_SOCKET, SO_RCVTIMEO, (void *)&pull_timeout, sizeof pull_timeout);
 	if (i != 0) {
 		MSG("ERROR: [down] setsockopt returned %s\n", strerror(errno));
 		exit(EXIT_FAILURE);
 	}
-	
-	/* pre-fill the pull request buffer with fixed fields */
-	buff_req[0] = PROTOCOL_VERSION;
-	buff_req[3] = PKT_PULL_DATA;
-	*(uint32_t *)(buff_req + 4) = net_mac_h;
-	*(uint32_t *)(buff_req + 8) = net_mac_l;
-	
 
 	while (!exit_sig && !quit_sig) {
 		
-		/* auto-quit if the threshold is crossed */
-		if ((autoquit_threshold > 0) && (autoquit_cnt >= autoquit_threshold)) {
-			exit_sig = true;
-			MSG("INFO: [down] the last %u PULL_DATA were not ACKed, exiting application\n", autoquit_threshold);
+		if (!down_send_pull(serv))
 			break;
-		}
-		
-		/* generate random token for request */
-		token_h = (uint8_t)rand(); /* random token */
-		token_l = (uint8_t)rand(); /* random token */
-		buff_req[1] = token_h;
-		buff_req[2] = token_l;
-		
-		/* send PULL request and record time */
-		send(sock_down, (void *)buff_req, sizeof buff_req, 0);
-		clock_gettime(CLOCK_MONOTONIC, &send_time);
-        //MSG("INFO: [down] send pull_data, %ld\n", send_time.tv_nsec);
-		pthread_mutex_lock(&mx_meas_dw);
-		meas_dw_pull_sent += 1;
-		pthread_mutex_unlock(&mx_meas_dw);
-		req_ack = false;
-		autoquit_cnt++;
 		
 		/* listen to packets and process them until a new PULL request must be sent */
-		recv_time = send_time;
-		while ((int)difftimespec(recv_time, send_time) < keepalive_time) {
+		recv_time = serv->pull_time;
+		while ((int)difftimespec(recv_time, serv->pull_time) < keepalive_time) {
 			
 			/* try to receive a datagram */
-			msg_len = recv(sock_down, (void *)buff_down, (sizeof buff_down)-1, 0);
+			msg_len = recv(serv->sock_down, (void *)buff_down, (sizeof buff_down)-1, 0);
 			clock_gettime(CLOCK_MONOTONIC, &recv_time);
 			
 			/* if no network message was received, got back to listening sock_down socket */
@@ -1041,149 +2653,333 @@ void thread_down(void) {
 				continue;
 			}
 			
-			/* if the datagram does not respect protocol, just ignore it */
-			if ((msg_len < 4) || (buff_down[0] != PROTOCOL_VERSION) || ((buff_down[3] != PKT_PULL_RESP) && (buff_down[3] != PKT_PULL_ACK))) {
-				MSG("WARNING: [down] ignoring invalid packet\n");
-				continue;
-			}
-			
-			/* if the datagram is an ACK, check token */
-			if (buff_down[3] == PKT_PULL_ACK) {
-				if ((buff_down[1] == token_h) && (buff_down[2] == token_l)) {
-					if (req_ack) {
-						MSG("INFO: [down] duplicate ACK received :)\n");
-					} else { /* if that packet was not already acknowledged */
-						req_ack = true;
-						autoquit_cnt = 0;
-						pthread_mutex_lock(&mx_meas_dw);
-						meas_dw_ack_rcv += 1;
-						pthread_mutex_unlock(&mx_meas_dw);
-						//MSG("INFO: [down] PULL_ACK received in %i ms\n", (int)(1000 * difftimespec(recv_time, send_time)));
-					}
-				} else { /* out-of-sync token */
-					MSG("INFO: [down] received out-of-sync ACK\n");
+			down_receive(serv, buff_down, msg_len, &recv_time);
+		}
+	}
+	MSG("\nINFO: End of downstream thread\n");
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 3: HANDING DOWNLINKS OVER TO THE MCU WHEN THEY ARE DUE -------- */
+
+void * thread_jit(void *arg) {
+	enum jit_error_e jit_result;
+	struct timespec deadline;
+	uint32_t wait_us;
+
+	(void)arg;
+	pthread_mutex_lock(&mx_concent);
+	while (!exit_sig && !quit_sig) {
+		jit_result = jit_dispatch(&wait_us);
+		dl_track_expire(get_tmst());
+
+		/* sleep until the head is due or a frame is queued, bounded to check exit flags */
+		if ((jit_result == JIT_ERROR_EMPTY) || (wait_us > JIT_WAIT_MS * 1000))
+			wait_us = JIT_WAIT_MS * 1000;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += wait_us / 1000000;
+		deadline.tv_nsec += (long)(wait_us % 1000000) * 1000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&cv_jit, &mx_concent, &deadline);
+	}
+	pthread_mutex_unlock(&mx_concent);
+	MSG("\nINFO: End of JIT thread\n");
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 4: RESOLVING THE SERVER NAMES AGAIN --------------------------- */
+
+void * thread_resolve(void *arg) {
+	struct sockaddr_in resolved[SERVADDR_MAX];
+	struct serv_s *serv;
+	struct timespec now, deadline;
+	char addr[64];
+	char port[8];
+	int i, nb, left, wait_s;
+	bool due;
+
+	(void)arg;
+	while (!exit_sig && !quit_sig) {
+		wait_s = -1;
+		for (i = 0; i < nb_serv; i++) {
+			serv = &servers[i];
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			pthread_mutex_lock(&serv->mx_addr);
+			due = (serv->resolve_due || (resolve_s > 0)) && (difftimespec(now, serv->resolve_next) >= 0);
+			strcpy(addr, serv->addr);
+			strcpy(port, serv->port);
+			pthread_mutex_unlock(&serv->mx_addr);
+
+			if (due) {
+				/* blocking lookup, with no lock held: the packet path keeps the cached addresses meanwhile */
+				nb = resolve_server(addr, port, resolved, SERVADDR_MAX);
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				pthread_mutex_lock(&serv->mx_addr);
+				if (strcmp(addr, serv->addr) || strcmp(port, serv->port)) {
+					pthread_mutex_unlock(&serv->mx_addr); /* changed by a reload meanwhile, resolve the new name */
+					i--;
+					continue;
 				}
-				continue;
-			}
-			
-			/* the datagram is a PULL_RESP */
-			buff_down[msg_len] = 0; /* add string terminator, just to be safe */
-			//MSG("INFO: [down] PULL_RESP received :)\n"); /* very verbose */
-			printf("\nINFO (json): [down] %s\n", (char *)(buff_down + 4)); /* DEBUG: display JSON payload */
-			
-			/* initialize TX struct and try to parse JSON */
-			memset(&txpkt, 0, sizeof txpkt);
-			root_val = json_parse_string_with_comments((const char *)(buff_down + 4)); /* JSON offset */
-			if (root_val == NULL) {
-				MSG("WARNING: [down] invalid JSON, TX aborted\n");
-				continue;
-			}
-			
-			/* look for JSON sub-object 'txpk' */
-			txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
-			if (txpk_obj == NULL) {
-				MSG("WARNING: [down] no \"txpk\" object in JSON, TX aborted\n");
-				json_value_free(root_val);
-				continue;
-			}
-			
-			/* Parse payload length (mandatory) */
-			val = json_object_get_value(txpk_obj,"size");
-			if (val == NULL) {
-				MSG("WARNING: [down] no mandatory \"txpk.size\" object in JSON, TX aborted\n");
-				json_value_free(root_val);
-				continue;
+				serv->resolve_next = now;
+				if (nb > 0) {
+					if (servaddr_merge(&serv->addrs, resolved, nb))
+						serv_connect(serv);
+					serv->resolve_due = false;
+					serv->resolve_next.tv_sec += resolve_s;
+				} else {
+					MSG("WARNING: [resolve] server %s: keeping %d cached address(es), retry in %d s\n", addr, serv->addrs.nb, RESOLVE_RETRY_S);
+					serv->resolve_due = true;
+					serv->resolve_next.tv_sec += RESOLVE_RETRY_S;
+				}
+				pthread_mutex_unlock(&serv->mx_addr);
 			}
-			txpkt.size = (uint16_t)json_value_get_number(val);
-			
-			/* Parse payload data (mandatory) */
-			str = json_object_get_string(txpk_obj, "data"); if (str == NULL) {
-				MSG("WARNING: [down] no mandatory \"txpk.data\" object in JSON, TX aborted\n");
-				json_value_free(root_val);
-				continue;
+
+			/* time left before this server is due */
+			pthread_mutex_lock(&serv->mx_addr);
+			if (serv->resolve_due || (resolve_s > 0)) {
+				left = (int)difftimespec(serv->resolve_next, now) + 1;
+				if (left < 1)
+					left = 1;
+				if ((wait_s < 0) || (left < wait_s))
+					wait_s = left;
 			}
-			i = b64_to_bin(str, strlen(str), txpkt.payload, sizeof txpkt.payload);
-			if (i != txpkt.size) {
-				MSG("WARNING: [down] mismatch between .size and .data size once converter to binary\n");
+			pthread_mutex_unlock(&serv->mx_addr);
+		}
+
+		/* sleep until the next server is due or a reload asks for a lookup */
+		pthread_mutex_lock(&mx_resolve);
+		if (!resolve_wake) {
+			if (wait_s < 0) {
+				pthread_cond_wait(&cv_resolve, &mx_resolve);
+			} else {
+				clock_gettime(CLOCK_REALTIME, &deadline);
+				deadline.tv_sec += wait_s;
+				pthread_cond_timedwait(&cv_resolve, &mx_resolve, &deadline);
 			}
+		}
+		resolve_wake = false;
+		pthread_mutex_unlock(&mx_resolve);
+	}
+	MSG("\nINFO: End of resolver thread\n");
+	return NULL;
+}
 
-            memset(dlpath, 0, sizeof(dlpath));
+/* -------------------------------------------------------------------------- */
+/* --- EVENT LOOP: ALL OF THE ABOVE ON THE MAIN THREAD ---------------------- */
+
+/* epoll tags, the low byte holds the server index of the network sockets */
+#define EV_INGEST		0x0100	/* inotify, or the poll timer */
+#define EV_KEEPALIVE	0x0200	/* PULL_DATA timer */
+#define EV_STAT			0x0300	/* statistics timer */
+#define EV_QUERY		0x0400	/* local query socket */
+#define EV_UP			0x0500	/* upstream socket, PUSH_ACK */
+#define EV_DOWN			0x0600	/* downstream socket, PULL_ACK and PULL_RESP */
+#define EV_CONF			0x0700	/* inotify on the UCI configuration */
+#define EV_TXACK		0x0800	/* inotify for the transmit reports, when EV_INGEST is a timer */
+#define EV_MAX			(6 + 2 * SERV_MAX)
+
+/* non-blocking timer firing every period_ms, -1 on error */
+static int timerfd_periodic(int period_ms) {
+	struct itimerspec its;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (fd < 0)
+		return -1;
+	its.it_interval.tv_sec = period_ms / 1000;
+	its.it_interval.tv_nsec = (long)(period_ms % 1000) * 1000000;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(fd, 0, &its, NULL) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
 
-            
-            if ((uint8_t)txpkt.payload[0] == 32) {//hex 0x20 = 32
-                if (roundtrip > 5) 
-                    roundtrip = 1;
-                sprintf(dlpath, "/var/iot/dldata%d", roundtrip);
-                roundtrip++; 
-            } else {
-                sprintf(dlpath, "/var/iot/%x%x%x%x", txpkt.payload[1], txpkt.payload[2], txpkt.payload[3], txpkt.payload[4]);
-            }
-            
-            if ((fd = open(dlpath, O_CREAT|O_RDWR|O_TRUNC)) < 0 ){
-                MSG("WARNING: [down]can't open downstream data file for write!");
-                continue;
-            } else {
-                if ((i = write(fd, txpkt.payload, txpkt.size)) < txpkt.size){
-                    close(fd);
-                    MSG("WARNING: [down]write downstream data file error!");
-                    continue;
-                }
-            }
+static bool epoll_watch(int epfd, int fd, uint32_t tag) {
+	struct epoll_event ev;
 
-            if (close(fd) != 0)
-                MSG("can't close updata file!");
-
-            printf("INFO: [down]txpk payload in hex(%dbyte): ", txpkt.size);
-            char tmp[4];
-            for (i = 0; i < txpkt.size; i++) {
-                memset(tmp, 0, sizeof(tmp));
-                sprintf(tmp, "%x", txpkt.payload[i]);
-                if (strlen(tmp) == 2)
-                    printf("%s", tmp);
-                else
-                    printf("0%s", tmp);
-            }
-            printf("\n");
-
-            /*
-            if ((fd = open(DLBAKPATH, O_CREAT|O_RDWR|O_TRUNC)) < 0 ){
-                MSG("WARNING: [down]can't open downstream data file for write!");
-                continue;
-            } else {
-                if ((i = write(fd, payload, txpkt.size)) < txpkt.size){
-                    close(fd);
-                    MSG("WARNING: [down]write downstream data file error!");
-                    continue;
-                }
-            }
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.u32 = tag;
+	return (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0);
+}
+
+/* single-threaded runtime: every file descriptor is non-blocking and watched
+   by one epoll set, the periodic work runs on timerfds and the deadlines
+   (aggregation window, journal pacing, PUSH_ACK timeout, downlink emit time)
+   bound the epoll_wait timeout, so the process only wakes up when there is
+   something to do; returns when an exit or quit signal is received */
+static void run_event_loop(void) {
+	struct up_state_s up; /* datagram being composed */
+	struct lgw_pkt_rx_s rxpkt; /* lora package */
+	struct epoll_event events[EV_MAX];
+	struct timespec now;
+	uint8_t buff[1024]; /* buffer to receive datagrams from the servers */
+	uint64_t expirations;
+	uint32_t wait_us;
+	int epfd, fd_notify, fd_txack = -1, tfd_ingest = -1, tfd_keepalive = -1, tfd_stat = -1;
+	static const char *const txack_names[] = {TXACKFILE, TXTAKENFILE, NULL};
+	int i, k, nb_ev, len, timeout;
+	bool ok;
+
+	epfd = epoll_create(EV_MAX);
+	if (epfd < 0) {
+		MSG("ERROR: [main] epoll_create returned %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
-            if (close(fd) != 0)
-                MSG("can't close updata file!");
-            */
+	/* ingest: inotify on the MCU directory, a timer for the poll mode;
+	   with the timer, the transmit reports get their own inotify when possible */
+	fd_notify = open_up_notify();
+	if (fd_notify >= 0) {
+		ok = epoll_watch(epfd, fd_notify, EV_INGEST);
+	} else {
+		tfd_ingest = timerfd_periodic(FETCH_SLEEP_MS);
+		ok = (tfd_ingest >= 0) && epoll_watch(epfd, tfd_ingest, EV_INGEST);
+		fd_txack = open_notify(UPDIR);
+		if (fd_txack >= 0)
+			ok = ok && epoll_watch(epfd, fd_txack, EV_TXACK);
+	}
 
-			
-			/* free the JSON parse tree from memory */
-			json_value_free(root_val);
-			
-			/* select TX mode */
-			if (sent_immediate) {
-				txpkt.tx_mode = IMMEDIATE;
-			} else {
-				txpkt.tx_mode = TIMESTAMPED;
+	/* keepalive and statistics */
+	tfd_keepalive = timerfd_periodic(1000 * ((keepalive_time > 0) ? keepalive_time : DEFAULT_KEEPALIVE));
+	ok = ok && (tfd_keepalive >= 0) && epoll_watch(epfd, tfd_keepalive, EV_KEEPALIVE);
+	tfd_stat = timerfd_periodic(1000 * stat_interval);
+	ok = ok && (tfd_stat >= 0) && epoll_watch(epfd, tfd_stat, EV_STAT);
+	if (sock_query >= 0)
+		ok = ok && epoll_watch(epfd, sock_query, EV_QUERY);
+	if (fd_conf >= 0)
+		ok = ok && epoll_watch(epfd, fd_conf, EV_CONF);
+
+	/* network sockets, replies are read until the socket is drained */
+	for (k = 0; k < nb_serv; k++) {
+		fcntl(servers[k].sock_up, F_SETFL, fcntl(servers[k].sock_up, F_GETFL) | O_NONBLOCK);
+		fcntl(servers[k].sock_down, F_SETFL, fcntl(servers[k].sock_down, F_GETFL) | O_NONBLOCK);
+		ok = ok && epoll_watch(epfd, servers[k].sock_up, EV_UP | k) && epoll_watch(epfd, servers[k].sock_down, EV_DOWN | k);
+	}
+	if (!ok) {
+		MSG("ERROR: [main] can't set up the event loop (%s)\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	up_init(&up);
+	for (k = 0; k < nb_serv; k++)
+		down_send_pull(&servers[k]);
+	report_stats();
+
+	/* the MCU may have written a packet before we were up */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (fetch_up_packet(&rxpkt, false))
+		up_ingest(&up, &rxpkt, &now);
+
+	while (!exit_sig && !quit_sig) {
+
+		/* hand over the downlinks that are due, then sleep until the next deadline */
+		pthread_mutex_lock(&mx_concent);
+		timeout = (jit_dispatch(&wait_us) == JIT_ERROR_TOO_EARLY) ? (int)((wait_us + 999) / 1000) : INT_MAX;
+		pthread_mutex_unlock(&mx_concent);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout = up_wait_ms(&up, &now, timeout);
+		for (k = 0; k < nb_serv; k++) {
+			i = inflight_wait_ms(&servers[k], &now);
+			if ((i >= 0) && (i < timeout))
+				timeout = i;
+		}
+
+		nb_ev = epoll_wait(epfd, events, EV_MAX, (timeout == INT_MAX) ? -1 : timeout);
+		if ((nb_ev < 0) && (errno != EINTR)) {
+			MSG("ERROR: [main] epoll_wait returned %s\n", strerror(errno));
+			exit_sig = true;
+			break;
+		}
+
+		for (i = 0; i < nb_ev; i++) {
+			k = events[i].data.u32 & 0xFF;
+			switch (events[i].data.u32 & ~0xFFU) {
+				case EV_INGEST:
+					if (fd_notify >= 0) {
+						if (!read_up_notify(fd_notify))
+							break;
+					} else if (read(tfd_ingest, &expirations, sizeof expirations) < 0) {
+						break;
+					} else if (fd_txack < 0) {
+						fetch_tx_report();
+					}
+					clock_gettime(CLOCK_MONOTONIC, &now);
+					if (fetch_up_packet(&rxpkt, (fd_notify < 0))) { /* one packet per notification */
+						up_ingest(&up, &rxpkt, &now);
+						up_flush(&up);
+					}
+					break;
+				case EV_KEEPALIVE:
+					if (read(tfd_keepalive, &expirations, sizeof expirations) < 0)
+						break;
+					for (k = 0; k < nb_serv; k++) {
+						if (!down_send_pull(&servers[k]))
+							break;
+					}
+					break;
+				case EV_STAT:
+					if (read(tfd_stat, &expirations, sizeof expirations) >= 0)
+						report_stats();
+					break;
+				case EV_QUERY:
+					answer_query();
+					break;
+				case EV_UP:
+					while ((len = recv(servers[k].sock_up, (void *)buff, sizeof buff, 0)) >= 0) {
+						clock_gettime(CLOCK_MONOTONIC, &now);
+						up_ack_receive(&servers[k], buff, len, &now);
+					}
+					break;
+				case EV_DOWN:
+					while ((len = recv(servers[k].sock_down, (void *)buff, (sizeof buff)-1, 0)) >= 0) {
+						clock_gettime(CLOCK_MONOTONIC, &now);
+						down_receive(&servers[k], buff, len, &now);
+					}
+					break;
+				case EV_CONF:
+					if (read_notify(fd_conf, conf_names))
+						reload_sig = true;
+					break;
+				case EV_TXACK:
+					if (read_notify(fd_txack, txack_names))
+						fetch_tx_report();
+					break;
+				default:
+					break;
 			}
-			
-			/* record measurement data */
-			pthread_mutex_lock(&mx_meas_dw);
-			meas_dw_dgram_rcv += 1; /* count only datagrams with no JSON errors */
-			meas_dw_network_byte += msg_len; /* meas_dw_network_byte */
-			meas_dw_payload_byte += txpkt.size;
-            meas_nb_tx_ok += 1;
-            pthread_mutex_unlock(&mx_meas_dw);
-			
-			/* transfer data and metadata to the concentrator, and schedule TX */
 		}
+
+		if (reload_sig) {
+			reload_sig = false;
+			reload_config();
+		}
+
+		/* deadlines: PUSH_ACK timeouts, aggregation window, journal replay and transmit reports */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for (k = 0; k < nb_serv; k++)
+			up_ack_expire(&servers[k], &now);
+		up_flush(&up);
+		dl_track_expire(get_tmst());
 	}
-	MSG("\nINFO: End of downstream thread\n");
+
+	if (fd_notify >= 0)
+		close(fd_notify);
+	if (fd_txack >= 0)
+		close(fd_txack);
+	if (tfd_ingest >= 0)
+		close(tfd_ingest);
+	close(tfd_keepalive);
+	close(tfd_stat);
+	close(epfd);
+	MSG("\nINFO: End of event loop\n");
 }
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,92 @@
+/*
+ * mcurec.c
+ *
+ * Binary uplink record and transmit report of the MCU, see mcurec.h. The MCU is little-endian
+ * and the gateway CPU is not, fields are assembled byte by byte.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <string.h>		/* memcpy */
+
+#include "mcurec.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static uint16_t get_le16(const uint8_t *b);
+static uint32_t get_le32(const uint8_t *b);
+static uint8_t bw_of_hz(uint32_t bw_hz);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint16_t get_le16(const uint8_t *b) {
+	return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *b) {
+	return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint8_t bw_of_hz(uint32_t bw_hz) {
+	switch (bw_hz) {
+		case 500000: return BW_500KHZ;
+		case 250000: return BW_250KHZ;
+		case 125000: return BW_125KHZ;
+		case 62500: return BW_62K5HZ;
+		case 31250: return BW_31K2HZ;
+		case 15600: return BW_15K6HZ;
+		case 7800: return BW_7K8HZ;
+		default: return BW_UNDEFINED;
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int mcurec_decode(const uint8_t *hdr, int rec_len, struct lgw_pkt_rx_s *pkt) {
+	int hdr_len, size;
+
+	if ((rec_len < 2) || (hdr[0] != MCUREC_SYNC0) || (hdr[1] != MCUREC_SYNC1))
+		return -1;
+	if (rec_len < MCUREC_HDR_LEN)
+		return 0;
+	hdr_len = hdr[3];
+	size = get_le16(hdr + 4);
+	if ((hdr[2] < MCUREC_VERSION) || (hdr_len < MCUREC_HDR_LEN) || (hdr_len + size > MCUREC_HDR_LEN + (int)sizeof pkt->payload))
+		return -1; /* a longer header shortens the payload accepted */
+	if (hdr_len + size > rec_len)
+		return 0;
+
+	pkt->size = size;
+	pkt->status = hdr[6];
+	pkt->modulation = MOD_LORA;
+	pkt->datarate = ((hdr[7] >= 7) && (hdr[7] <= 12)) ? (1U << (hdr[7] - 6)) : DR_UNDEFINED;
+	pkt->freq_hz = get_le32(hdr + 8);
+	pkt->bandwidth = bw_of_hz(get_le32(hdr + 12));
+	pkt->coderate = ((hdr[16] >= 5) && (hdr[16] <= 8)) ? (hdr[16] - 4) : CR_UNDEFINED;
+	pkt->rssi = (int16_t)get_le16(hdr + 18);
+	pkt->snr = (int16_t)get_le16(hdr + 20) / 10.0;
+	pkt->count_us = get_le32(hdr + 24);
+	return hdr_len;
+}
+
+int mcurec_decode_tx(const uint8_t *rec, int rec_len, struct mcurec_tx_s *tx) {
+	if ((rec_len < 2) || (rec[0] != MCUREC_SYNC0) || (rec[1] != MCUREC_TX_SYNC1))
+		return -1;
+	if (rec_len < MCUREC_TX_LEN)
+		return 0;
+	if (rec[2] < MCUREC_VERSION)
+		return -1;
+
+	tx->result = rec[3];
+	tx->count_us = get_le32(rec + 8);
+	memcpy(tx->name, rec + 12, MCUREC_TX_NAME_LEN);
+	tx->name[MCUREC_TX_NAME_LEN] = 0;
+	return MCUREC_TX_LEN;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,97 @@
+/*
+ * mcurec.h
+ *
+ * Binary uplink record written by the MCU for every frame it receives: a
+ * fixed little-endian header carrying the radio metadata of the frame,
+ * followed by the payload. hdr_len is the offset of the payload, so later
+ * versions may append fields to the header and older readers skip them; the
+ * whole record is at most MCUREC_HDR_LEN + 256 bytes.
+ *
+ * Header, version 1 (MCUREC_HDR_LEN bytes):
+ *   offset size
+ *    0     2    sync, 'L' 'R'
+ *    2     1    version
+ *    3     1    hdr_len, offset of the payload
+ *    4     2    size, payload length in bytes
+ *    6     1    status, STAT_CRC_OK, STAT_CRC_BAD or STAT_NO_CRC
+ *    7     1    spreading factor, 7..12
+ *    8     4    frequency in Hz
+ *   12     4    bandwidth in Hz
+ *   16     1    coding rate denominator, 5..8 for 4/5..4/8
+ *   17     1    reserved
+ *   18     2    RSSI in dBm, signed
+ *   20     2    SNR in 0.1 dB, signed
+ *   22     2    reserved
+ *   24     4    MCU microsecond counter at the end of the reception
+ *
+ * Transmit report, written by the MCU once it is done with a downlink; a
+ * file may hold several reports back to back (MCUREC_TX_LEN bytes each):
+ *   offset size
+ *    0     2    sync, 'L' 'T'
+ *    2     1    version
+ *    3     1    result, MCUREC_TX_OK or MCUREC_TX_FAILED
+ *    4     4    reserved
+ *    8     4    MCU microsecond counter at the end of the transmission
+ *   12    20    name of the downlink file, NUL padded
+ */
+
+#ifndef _MCUREC_H
+#define _MCUREC_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+
+#include "lgw_pkt.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define MCUREC_SYNC0		'L'
+#define MCUREC_SYNC1		'R'
+#define MCUREC_VERSION		1
+#define MCUREC_HDR_LEN		28	/* header size of version 1 */
+
+#define MCUREC_TX_SYNC1		'T'
+#define MCUREC_TX_LEN		32	/* transmit report size of version 1 */
+#define MCUREC_TX_NAME_LEN	20
+#define MCUREC_TX_OK		0	/* the frame went on air */
+#define MCUREC_TX_FAILED	1	/* the radio did not send it */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct mcurec_tx_s {
+	uint8_t		result;
+	uint32_t	count_us;
+	char		name[MCUREC_TX_NAME_LEN + 1];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Decode the header of a record into packet metadata
+@param hdr first MCUREC_HDR_LEN bytes of the record
+@param rec_len number of bytes of the whole record
+@param pkt metadata filled, the payload is left untouched; count_us gets the
+MCU counter, fields the MCU left at 0 are left undefined
+@return offset of the payload in the record, 0 if the record is not complete
+yet, -1 if it is not a valid record
+*/
+int mcurec_decode(const uint8_t *hdr, int rec_len, struct lgw_pkt_rx_s *pkt);
+
+/**
+@brief Decode a transmit report
+@param rec start of the report
+@param rec_len number of bytes available from rec
+@param tx filled with the report, name is always terminated
+@return number of bytes the report takes, 0 if it is not complete yet, -1 if
+it is not a valid report
+*/
+int mcurec_decode_tx(const uint8_t *rec, int rec_len, struct mcurec_tx_s *tx);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -32,16 +32,23 @@
 #define SUCCESS                    1
 #define STARTING_CAPACITY         15
 #define ARRAY_MAX_CAPACITY    122880 /* 15*(2^13) */
-#define OBJECT_MAX_CAPACITY      960 /* 15*(2^6)  */
+#define OBJECT_MAX_CAPACITY    15360 /* 15*(2^10) */
+#define OBJECT_HASH_THRESHOLD      8 /* objects with more names get a hash index */
+#define OBJECT_HASH_EMPTY  ((size_t)-1)
 #define MAX_NESTING               19
 #define sizeof_token(a)       (sizeof(a) - 1)
 #define skip_char(str)        ((*str)++)
 #define skip_whitespaces(str) while (isspace(**str)) { skip_char(str); }
 #define MAX(a, b)             ((a) > (b) ? (a) : (b))
 
-#define parson_malloc(a)     malloc(a)
-#define parson_free(a)       free((void*)a)
-#define parson_realloc(a, b) realloc(a, b)
+#define ARENA_ALIGN          sizeof(double)
+#define ARENA_HEADER         ARENA_ALIGN /* block size is stored in front of each block */
+#define arena_round(a)       (((a) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/* all allocations go to parson_arena while an arena parse runs in this thread */
+#define parson_malloc(a)     (parson_arena ? arena_malloc(parson_arena, a) : malloc(a))
+#define parson_free(a)       do { if (!parson_arena) free((void*)a); } while (0)
+#define parson_realloc(a, b) (parson_arena ? arena_realloc(parson_arena, a, b) : realloc(a, b))
 
 /* Type definitions */
 typedef union json_value_value {
@@ -63,6 +70,8 @@ struct json_object_t {
     JSON_Value **values;
     size_t       count;
     size_t       capacity;
+    size_t      *hash_slots;    /* open addressing on names, holds indexes, NULL for small objects */
+    size_t       hash_capacity; /* power of 2, at least twice capacity */
 };
 
 struct json_array_t {
@@ -71,6 +80,12 @@ struct json_array_t {
     size_t       capacity;
 };
 
+static __thread JSON_Arena *parson_arena = NULL;
+
+/* Arena */
+static void * arena_malloc(JSON_Arena *arena, size_t size);
+static void * arena_realloc(JSON_Arena *arena, void *ptr, size_t size);
+
 /* Various */
 static char * read_file(const char *filename);
 static void   remove_comments(char *string, const char *start_token, const char *end_token);
@@ -85,6 +100,9 @@ static int           json_object_add(JSON_Object *object, const char *name, JSON
 static int           json_object_resize(JSON_Object *object, size_t capacity);
 static JSON_Value  * json_object_nget_value(const JSON_Object *object, const char *name, size_t n);
 static void          json_object_free(JSON_Object *object);
+static size_t        json_object_hash(const char *name, size_t n);
+static int           json_object_hash_build(JSON_Object *object, size_t min_capacity);
+static void          json_object_hash_insert(JSON_Object *object, size_t index);
 
 /* JSON Array */
 static JSON_Array * json_array_init(void);
@@ -111,6 +129,43 @@ static JSON_Value * parse_number_value(const char **string);
 static JSON_Value * parse_null_value(const char **string);
 static JSON_Value * parse_value(const char **string, size_t nesting);
 
+/* Arena */
+static void * arena_malloc(JSON_Arena *arena, size_t size) {
+    size_t need = ARENA_HEADER + arena_round(size);
+    unsigned char *block;
+    if (arena->size - arena->used < need)
+        return NULL;
+    block = arena->base + arena->used;
+    *(size_t*)block = size;
+    arena->last = arena->used;
+    arena->used += need;
+    return block + ARENA_HEADER;
+}
+
+static void * arena_realloc(JSON_Arena *arena, void *ptr, size_t size) {
+    unsigned char *block, *new_ptr;
+    size_t old_size, need;
+    if (!ptr)
+        return arena_malloc(arena, size);
+    block = (unsigned char*)ptr - ARENA_HEADER;
+    old_size = *(size_t*)block;
+    if (block == arena->base + arena->last) { /* latest block, grow or shrink in place */
+        need = ARENA_HEADER + arena_round(size);
+        if (arena->size - arena->last < need)
+            return NULL;
+        *(size_t*)block = size;
+        arena->used = arena->last + need;
+        return ptr;
+    }
+    if (size <= old_size)
+        return ptr;
+    new_ptr = (unsigned char*)arena_malloc(arena, size);
+    if (!new_ptr)
+        return NULL;
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
 /* Various */
 static int try_realloc(void **ptr, size_t new_size) {
     void *reallocated_ptr = parson_realloc(*ptr, new_size);
@@ -210,6 +265,8 @@ static JSON_Object * json_object_init(void) {
     new_obj->values = (JSON_Value**)NULL;
     new_obj->capacity = 0;
     new_obj->count = 0;
+    new_obj->hash_slots = (size_t*)NULL;
+    new_obj->hash_capacity = 0;
     return new_obj;
 }
 
@@ -230,6 +287,10 @@ static int json_object_add(JSON_Object *object, const char *name, JSON_Value *va
         return ERROR;
     object->values[index] = value;
     object->count++;
+    if (object->hash_slots)
+        json_object_hash_insert(object, index);
+    else if (object->count > OBJECT_HASH_THRESHOLD)
+        json_object_hash_build(object, 2 * object->capacity); /* stays linear on failure */
     return SUCCESS;
 }
 
@@ -239,11 +300,21 @@ static int json_object_resize(JSON_Object *object, size_t capacity) {
     if (try_realloc((void**)&object->values, capacity * sizeof(JSON_Value*)) == ERROR)
         return ERROR;
     object->capacity = capacity;
+    if (object->hash_slots && object->hash_capacity < 2 * capacity)
+        json_object_hash_build(object, 2 * capacity);
     return SUCCESS;
 }
 
 static JSON_Value * json_object_nget_value(const JSON_Object *object, const char *name, size_t n) {
-    size_t i, name_length;
+    size_t i, name_length, slot, mask;
+    if (object && object->hash_slots) {
+        mask = object->hash_capacity - 1;
+        for (slot = json_object_hash(name, n) & mask; (i = object->hash_slots[slot]) != OBJECT_HASH_EMPTY; slot = (slot + 1) & mask) {
+            if (strlen(object->names[i]) == n && strncmp(object->names[i], name, n) == 0)
+                return object->values[i];
+        }
+        return NULL;
+    }
     for (i = 0; i < json_object_get_count(object); i++) {
         name_length = strlen(object->names[i]);
         if (name_length != n)
@@ -261,9 +332,48 @@ static void json_object_free(JSON_Object *object) {
     }
     parson_free(object->names);
     parson_free(object->values);
+    parson_free(object->hash_slots);
     parson_free(object);
 }
 
+/* FNV-1a over the first n chars of name */
+static size_t json_object_hash(const char *name, size_t n) {
+    size_t hash = 2166136261u;
+    while (n--) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* (re)build the index with room for min_capacity slots, the object keeps
+   a linear lookup if memory is short */
+static int json_object_hash_build(JSON_Object *object, size_t min_capacity) {
+    size_t i, capacity = 16;
+    size_t *slots;
+    while (capacity < min_capacity)
+        capacity <<= 1;
+    slots = (size_t*)parson_malloc(capacity * sizeof(size_t));
+    parson_free(object->hash_slots);
+    object->hash_slots = slots;
+    object->hash_capacity = capacity;
+    if (!slots)
+        return ERROR;
+    for (i = 0; i < capacity; i++)
+        slots[i] = OBJECT_HASH_EMPTY;
+    for (i = 0; i < object->count; i++)
+        json_object_hash_insert(object, i);
+    return SUCCESS;
+}
+
+static void json_object_hash_insert(JSON_Object *object, size_t index) {
+    size_t mask = object->hash_capacity - 1;
+    size_t slot = json_object_hash(object->names[index], strlen(object->names[index])) & mask;
+    while (object->hash_slots[slot] != OBJECT_HASH_EMPTY)
+        slot = (slot + 1) & mask;
+    object->hash_slots[slot] = index;
+}
+
 /* JSON Array */
 static JSON_Array * json_array_init(void) {
     JSON_Array *new_array = (JSON_Array*)parson_malloc(sizeof(JSON_Array));
@@ -644,6 +754,37 @@ JSON_Value * json_parse_string_with_comments(const char *string) {
 }
 
 
+void json_arena_init(JSON_Arena *arena, void *buffer, size_t size) {
+    size_t skew = (ARENA_ALIGN - ((size_t)buffer & (ARENA_ALIGN - 1))) & (ARENA_ALIGN - 1);
+    if (size < skew)
+        skew = size;
+    arena->base = (unsigned char*)buffer + skew;
+    arena->size = size - skew;
+    arena->used = 0;
+    arena->last = 0;
+}
+
+void json_arena_reset(JSON_Arena *arena) {
+    arena->used = 0;
+    arena->last = 0;
+}
+
+JSON_Value * json_parse_string_arena(JSON_Arena *arena, const char *string) {
+    JSON_Value *result = NULL;
+    parson_arena = arena;
+    result = json_parse_string(string);
+    parson_arena = NULL;
+    return result;
+}
+
+JSON_Value * json_parse_string_with_comments_arena(JSON_Arena *arena, const char *string) {
+    JSON_Value *result = NULL;
+    parson_arena = arena;
+    result = json_parse_string_with_comments(string);
+    parson_arena = NULL;
+    return result;
+}
+
 /* JSON Object API */
 
 JSON_Value * json_object_get_value(const JSON_Object *object, const char *name) {
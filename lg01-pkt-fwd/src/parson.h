@@ -40,6 +40,14 @@ typedef struct json_object_t JSON_Object;
 typedef struct json_array_t  JSON_Array;
 typedef struct json_value_t  JSON_Value;
 
+/* Caller-supplied memory for arena parsing, see json_arena_init */
+typedef struct json_arena_t {
+    unsigned char *base;
+    size_t         size;
+    size_t         used;
+    size_t         last; /* offset of the latest block, can be resized in place */
+} JSON_Arena;
+
 typedef enum json_value_type {
     JSONError   = 0,
     JSONNull    = 1,
@@ -65,6 +73,15 @@ JSON_Value  * json_parse_string(const char *string);
     returns NULL in case of error */
 JSON_Value  * json_parse_string_with_comments(const char *string);
     
+/* Arena parsing: every node of the returned tree is carved out of the arena
+   buffer instead of the heap. Such a tree must not be passed to
+   json_value_free, json_arena_reset releases it at once in O(1).
+   Returns NULL in case of error or if the arena is too small. */
+void          json_arena_init(JSON_Arena *arena, void *buffer, size_t size);
+void          json_arena_reset(JSON_Arena *arena);
+JSON_Value  * json_parse_string_arena(JSON_Arena *arena, const char *string);
+JSON_Value  * json_parse_string_with_comments_arena(JSON_Arena *arena, const char *string);
+    
 /* JSON Object */
 JSON_Value  * json_object_get_value  (const JSON_Object *object, const char *name);
 const char  * json_object_get_string (const JSON_Object *object, const char *name);
@@ -0,0 +1,172 @@
+/*
+ * rxpk.c
+ *
+ * Encoding of the Semtech UDP protocol "rxpk" object carried by PUSH_DATA.
+ *
+ * The object is assembled from fragments: the constant text, including
+ * "datr" for every SF and bandwidth, is rendered by rxpk_fmt_init(), the
+ * calendar part of "time" is rendered once per second, and only the numbers
+ * that change with every packet are formatted, without going through
+ * printf. The output is the same as the snprintf() version it replaces.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* snprintf */
+#include <string.h>		/* memcpy */
+#include <time.h>		/* gmtime_r */
+
+#include "base64.h"
+#include "rxpk.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define PUT_LIT(p, lit)		(memcpy((p), (lit), sizeof(lit) - 1), (p) += sizeof(lit) - 1)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static char * put_u32(char *p, uint32_t v);
+static char * put_i32(char *p, int32_t v);
+static char * put_digits(char *p, uint32_t v, int n);
+static int sf_index(uint32_t datarate);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static char * put_u32(char *p, uint32_t v) {
+	char tmp[10];
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + (v % 10);
+		v /= 10;
+	} while (v != 0);
+	while (n > 0)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static char * put_i32(char *p, int32_t v) {
+	if (v < 0) {
+		*p++ = '-';
+		return put_u32(p, -(uint32_t)v);
+	}
+	return put_u32(p, v);
+}
+
+/* exactly n digits, zero padded */
+static char * put_digits(char *p, uint32_t v, int n) {
+	int i;
+
+	for (i = n - 1; i >= 0; i--) {
+		p[i] = '0' + (v % 10);
+		v /= 10;
+	}
+	return p + n;
+}
+
+static int sf_index(uint32_t datarate) {
+	switch (datarate) {
+		case DR_LORA_SF8: return 1;
+		case DR_LORA_SF9: return 2;
+		case DR_LORA_SF10: return 3;
+		case DR_LORA_SF11: return 4;
+		case DR_LORA_SF12: return 5;
+		default: return 0;
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void rxpk_fmt_init(struct rxpk_fmt_s *fmt) {
+	static const int bw_khz[8] = {125, 500, 250, 125, 62, 31, 15, 7}; /* by BW_ code, undefined as 125 */
+	int i, j;
+
+	for (i = 0; i < 6; i++)
+		for (j = 0; j < 8; j++)
+			fmt->datr[i][j].len = snprintf(fmt->datr[i][j].str, sizeof fmt->datr[i][j].str,
+			                               ",\"modu\":\"LORA\",\"datr\":\"SF%dBW%d\",\"codr\":\"4/", i + 7, bw_khz[j]);
+	fmt->sec = (time_t)-1;
+}
+
+int rxpk_serialize(struct rxpk_fmt_s *fmt, const struct lgw_pkt_rx_s *pkt, const struct timespec *rx_time, char *out, int max_len) {
+	const struct rxpk_frag_s *frag;
+	struct tm x;
+	char *p = out;
+	char *t;
+	int snr_dt, j;
+
+	if (max_len < RXPK_META_MAX + 4 * ((pkt->size + 2) / 3) + 1)
+		return -1;
+
+	/* local timestamp until we get accurate GPS time, ISO 8601 */
+	if (rx_time->tv_sec != fmt->sec) {
+		gmtime_r(&rx_time->tv_sec, &x);
+		t = put_digits(fmt->time_prefix, x.tm_year + 1900, 4);
+		*t++ = '-';
+		t = put_digits(t, x.tm_mon + 1, 2);
+		*t++ = '-';
+		t = put_digits(t, x.tm_mday, 2);
+		*t++ = 'T';
+		t = put_digits(t, x.tm_hour, 2);
+		*t++ = ':';
+		t = put_digits(t, x.tm_min, 2);
+		*t++ = ':';
+		t = put_digits(t, x.tm_sec, 2);
+		*t = '.';
+		fmt->sec = rx_time->tv_sec;
+	}
+
+	PUT_LIT(p, "{\"tmst\":");
+	p = put_u32(p, pkt->count_us);
+	PUT_LIT(p, ",\"time\":\"");
+	memcpy(p, fmt->time_prefix, sizeof fmt->time_prefix);
+	p += sizeof fmt->time_prefix;
+	p = put_digits(p, rx_time->tv_nsec / 1000, 6);
+	PUT_LIT(p, "Z\",\"chan\":7,\"rfch\":0,\"freq\":");
+	p = put_u32(p, pkt->freq_hz / 1000000); /* MHz with Hz precision */
+	*p++ = '.';
+	p = put_digits(p, pkt->freq_hz % 1000000, 6);
+
+	switch (pkt->status) {
+		case STAT_CRC_OK: PUT_LIT(p, ",\"stat\":1"); break;
+		case STAT_CRC_BAD: PUT_LIT(p, ",\"stat\":-1"); break;
+		default: PUT_LIT(p, ",\"stat\":0"); break;
+	}
+
+	frag = &fmt->datr[sf_index(pkt->datarate)][pkt->bandwidth & 7];
+	memcpy(p, frag->str, frag->len);
+	p += frag->len;
+	*p++ = ((pkt->coderate >= CR_LORA_4_5) && (pkt->coderate <= CR_LORA_4_8)) ? '4' + pkt->coderate : '5';
+
+	PUT_LIT(p, "\",\"lsnr\":");
+	snr_dt = (int)(pkt->snr * 10 + ((pkt->snr < 0) ? -0.5f : 0.5f)); /* tenths of dB */
+	if (snr_dt < 0) {
+		*p++ = '-';
+		snr_dt = -snr_dt;
+	}
+	p = put_u32(p, snr_dt / 10);
+	*p++ = '.';
+	*p++ = '0' + (snr_dt % 10);
+
+	PUT_LIT(p, ",\"rssi\":");
+	p = put_i32(p, (int32_t)pkt->rssi);
+	PUT_LIT(p, ",\"size\":");
+	p = put_u32(p, pkt->size);
+	PUT_LIT(p, ",\"data\":\"");
+
+	j = bin_to_b64(pkt->payload, pkt->size, p, max_len - (p - out));
+	if (j < 0)
+		return -1;
+	p += j;
+	*p++ = '"';
+	*p++ = '}';
+	return p - out;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,60 @@
+/*
+ * rxpk.h
+ *
+ * Encoding of the Semtech UDP protocol "rxpk" object carried by PUSH_DATA.
+ */
+
+#ifndef _RXPK_H
+#define _RXPK_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <time.h>		/* time_t, timespec */
+
+#include "lgw_pkt.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define RXPK_META_MAX	240	/* longest rxpk without the base64 payload */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* fragments rendered once, "modu" to "codr" for each SF and bandwidth */
+struct rxpk_frag_s {
+	uint8_t		len;
+	char		str[47];
+};
+
+struct rxpk_fmt_s {
+	struct rxpk_frag_s	datr[6][8];		/* SF7..SF12, bandwidth code */
+	time_t				sec;			/* second of the cached time prefix */
+	char				time_prefix[20];	/* "YYYY-MM-DDTHH:MM:SS." */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Render the constant fragments of the rxpk object
+*/
+void rxpk_fmt_init(struct rxpk_fmt_s *fmt);
+
+/**
+@brief Encode a received packet as an rxpk object
+@param fmt fragments from rxpk_fmt_init, the time prefix cache is updated
+@param pkt received packet, count_us is reported as tmst
+@param rx_time UTC time reported as "time"
+@param out destination, not null-terminated
+@param max_len size of out
+@return number of characters written, -1 if out is too small
+Not thread-safe for a given fmt.
+*/
+int rxpk_serialize(struct rxpk_fmt_s *fmt, const struct lgw_pkt_rx_s *pkt, const struct timespec *rx_time, char *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
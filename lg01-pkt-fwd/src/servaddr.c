@@ -0,0 +1,168 @@
+/*
+ * servaddr.c
+ *
+ * Server addresses and their health score, see servaddr.h. Both averages
+ * move by 1/8 of the difference with each sample; two addresses whose ACK
+ * ratios are within SERVADDR_ACK_BAND of each other are ranked on their
+ * round-trip time, an address never measured ranks first among those.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* snprintf */
+#include <string.h>		/* memset, memcpy */
+
+#include <arpa/inet.h>	/* inet_ntop, ntohs */
+
+#include "servaddr.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define SERVADDR_ACK_BAND	(SERVADDR_ACK_ONE / 8)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static bool same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b);
+static bool better(const struct servaddr_s *a, const struct servaddr_s *b);
+static int best_other(const struct servaddr_set_s *set, int exclude);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+	return (a->sin_addr.s_addr == b->sin_addr.s_addr) && (a->sin_port == b->sin_port);
+}
+
+static bool better(const struct servaddr_s *a, const struct servaddr_s *b) {
+	if (a->ack_q8 > b->ack_q8 + SERVADDR_ACK_BAND)
+		return true;
+	if (b->ack_q8 > a->ack_q8 + SERVADDR_ACK_BAND)
+		return false;
+	return (b->rtt_us != 0) && (a->rtt_us < b->rtt_us);
+}
+
+/* healthiest address other than exclude, -1 if there is none */
+static int best_other(const struct servaddr_set_s *set, int exclude) {
+	int i, best = -1;
+
+	for (i = 0; i < set->nb; i++) {
+		if ((i != exclude) && ((best < 0) || better(&set->tab[i], &set->tab[best])))
+			best = i;
+	}
+	return best;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void servaddr_init(struct servaddr_set_s *set) {
+	memset(set, 0, sizeof *set);
+	set->cur = -1;
+}
+
+bool servaddr_merge(struct servaddr_set_s *set, const struct sockaddr_in *sa, int nb) {
+	struct servaddr_s tab[SERVADDR_MAX];
+	struct servaddr_s *e;
+	int i, j, n = 0, cur = -1;
+
+	for (i = 0; (i < nb) && (n < SERVADDR_MAX); i++) {
+		for (j = 0; j < n; j++) {
+			if (same_addr(&tab[j].sa, &sa[i]))
+				break;
+		}
+		if (j < n)
+			continue; /* duplicate */
+		e = &tab[n];
+		for (j = 0; j < set->nb; j++) {
+			if (same_addr(&set->tab[j].sa, &sa[i]))
+				break;
+		}
+		if (j < set->nb) { /* known address, keep its score */
+			*e = set->tab[j];
+			e->ack_q8 += (SERVADDR_ACK_ONE - e->ack_q8) / 2;
+			e->lost_run = 0;
+			if (j == set->cur)
+				cur = n;
+		} else {
+			memset(e, 0, sizeof *e);
+			e->sa = sa[i];
+			e->ack_q8 = SERVADDR_ACK_ONE;
+		}
+		n++;
+	}
+
+	memcpy(set->tab, tab, n * sizeof tab[0]);
+	set->nb = n;
+	if (cur >= 0) {
+		set->cur = cur;
+		return false;
+	}
+	set->cur = best_other(set, -1);
+	set->gen++;
+	return true;
+}
+
+void servaddr_ack(struct servaddr_set_s *set, uint32_t rtt_us) {
+	struct servaddr_s *e;
+
+	if (set->cur < 0)
+		return;
+	e = &set->tab[set->cur];
+	e->ack_q8 += (SERVADDR_ACK_ONE - e->ack_q8 + 7) / 8;
+	if (e->rtt_us == 0)
+		e->rtt_us = rtt_us;
+	else
+		e->rtt_us = (uint32_t)((int32_t)e->rtt_us + ((int32_t)rtt_us - (int32_t)e->rtt_us) / 8);
+	e->lost_run = 0;
+	e->nb_ack++;
+}
+
+bool servaddr_lost(struct servaddr_set_s *set, int nb) {
+	struct servaddr_s *e;
+	int i;
+
+	if ((set->cur < 0) || (nb <= 0))
+		return false;
+	e = &set->tab[set->cur];
+	for (i = 0; i < nb; i++)
+		e->ack_q8 -= (e->ack_q8 + 7) / 8;
+	e->lost_run += nb;
+	e->nb_lost += nb;
+	if ((e->lost_run < SERVADDR_FAIL_RUN) || (set->nb < 2))
+		return false;
+
+	e->lost_run = 0; /* a fresh run if it is ever used again */
+	set->cur = best_other(set, set->cur);
+	set->tab[set->cur].lost_run = 0;
+	set->gen++;
+	return true;
+}
+
+int servaddr_to_json(const struct servaddr_set_s *set, char *out, int max_len) {
+	const struct servaddr_s *e;
+	char ip[INET_ADDRSTRLEN];
+	int i, j, index = 0;
+
+	for (i = 0; i <= set->nb; i++) {
+		if (i == set->nb) {
+			j = snprintf(out + index, max_len - index, (i == 0) ? "[]" : "]");
+		} else {
+			e = &set->tab[i];
+			inet_ntop(AF_INET, &e->sa.sin_addr, ip, sizeof ip);
+			j = snprintf(out + index, max_len - index, "%c{\"ip\":\"%s\",\"port\":%u,\"ack\":%u,\"rtt\":%u,\"lost\":%u,\"cur\":%s}",
+			             (i == 0) ? '[' : ',', ip, ntohs(e->sa.sin_port), (100U * e->ack_q8) / SERVADDR_ACK_ONE,
+			             e->rtt_us, e->nb_lost, (i == set->cur) ? "true" : "false");
+		}
+		if ((j < 0) || (j >= max_len - index))
+			return -1;
+		index += j;
+	}
+	return index;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,88 @@
+/*
+ * servaddr.h
+ *
+ * Addresses a server name resolves to, each with a health score: a smoothed
+ * ratio of the requests it acknowledged and a smoothed round-trip time. The
+ * sockets of a server are connected to one of them at a time, after
+ * SERVADDR_FAIL_RUN unanswered requests in a row they move to the healthiest
+ * other one. A new resolution replaces the list and keeps the score of the
+ * addresses still present. The set is not thread-safe, callers serialize
+ * access.
+ */
+
+#ifndef _SERVADDR_H
+#define _SERVADDR_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include <netinet/in.h>	/* sockaddr_in */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define SERVADDR_MAX		8	/* addresses kept per server */
+#define SERVADDR_FAIL_RUN	3	/* unanswered requests in a row before failing over */
+#define SERVADDR_ACK_ONE	256	/* ack_q8 of an address that answers every request */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct servaddr_s {
+	struct sockaddr_in	sa;
+	uint32_t			rtt_us;		/* smoothed round-trip time, 0 until measured */
+	uint16_t			ack_q8;		/* smoothed ACK ratio, SERVADDR_ACK_ONE = 100% */
+	uint16_t			lost_run;	/* requests unanswered since the latest ACK */
+	uint32_t			nb_ack;		/* totals since the address was first resolved */
+	uint32_t			nb_lost;
+};
+
+struct servaddr_set_s {
+	int					nb;
+	int					cur;		/* address in use, -1 if none */
+	uint32_t			gen;		/* incremented each time cur changes */
+	struct servaddr_s	tab[SERVADDR_MAX];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Empty a set
+*/
+void servaddr_init(struct servaddr_set_s *set);
+
+/**
+@brief Replace the addresses of a set with the result of a resolution
+@param sa addresses resolved, duplicates are ignored
+@param nb number of addresses, at least 1
+@return true if the address in use changed (it is gone, or the set was empty)
+The addresses still present keep their score, halfway back to a perfect one,
+so that an address that failed once gets another chance after a resolution.
+*/
+bool servaddr_merge(struct servaddr_set_s *set, const struct sockaddr_in *sa, int nb);
+
+/**
+@brief Account a request acknowledged by the address in use
+*/
+void servaddr_ack(struct servaddr_set_s *set, uint32_t rtt_us);
+
+/**
+@brief Account requests left unanswered by the address in use
+@return true if the set failed over to another address
+*/
+bool servaddr_lost(struct servaddr_set_s *set, int nb);
+
+/**
+@brief Serialize a set as a JSON array
+@return number of characters written, or -1 if out is too small
+Format: [{"ip":"a.b.c.d","port":N,"ack":pct,"rtt":us,"lost":N,"cur":bool},...]
+*/
+int servaddr_to_json(const struct servaddr_set_s *set, char *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
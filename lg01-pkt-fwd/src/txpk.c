@@ -0,0 +1,333 @@
+/*
+ * txpk.c
+ *
+ * Decoding of the Semtech UDP protocol "txpk" object carried by PULL_RESP.
+ *
+ * txpk_parse() scans the receive buffer once and writes the fields straight
+ * into struct lgw_pkt_tx_s, without building a parson tree: keys and string
+ * values are compared in place and "data" is base64 decoded from the buffer.
+ * It only handles what network servers actually send (no escaped strings);
+ * anything else makes it fail so that the caller can retry with parson.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdlib.h>		/* strtod, strtoul, strtol */
+#include <string.h>		/* memset, memcmp, strncmp */
+
+#include "base64.h"
+#include "txpk.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define IS_WS(c)				(((c) == ' ') || ((c) == '\t') || ((c) == '\n') || ((c) == '\r'))
+#define KEY_IS(k, l, lit)		(((l) == sizeof(lit) - 1) && !memcmp((k), (lit), sizeof(lit) - 1))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* fields seen while scanning the txpk object */
+#define SEEN_SIZE		0x01
+#define SEEN_DATA		0x02
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static const char * skip_ws(const char *p);
+static const char * scan_string(const char *p, const char **str, int *len);
+static const char * scan_bool(const char *p, bool *b);
+static const char * skip_value(const char *p);
+static int datr_decode(const char *s, struct lgw_pkt_tx_s *pkt);
+static int codr_decode(const char *s, struct lgw_pkt_tx_s *pkt);
+static const char * parse_member(const char *key, int key_len, const char *p, struct lgw_pkt_tx_s *pkt, int *seen, int *data_len);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static const char * skip_ws(const char *p) {
+	while (IS_WS(*p))
+		p++;
+	return p;
+}
+
+/* string without escape sequences, returns a pointer past the closing quote */
+static const char * scan_string(const char *p, const char **str, int *len) {
+	const char *q;
+
+	if (*p != '"')
+		return NULL;
+	for (q = p + 1; *q != '"'; q++) {
+		if ((*q == '\0') || (*q == '\\'))
+			return NULL;
+	}
+	*str = p + 1;
+	*len = q - p - 1;
+	return q + 1;
+}
+
+static const char * scan_bool(const char *p, bool *b) {
+	if (!strncmp(p, "true", 4)) {
+		*b = true;
+		return p + 4;
+	} else if (!strncmp(p, "false", 5)) {
+		*b = false;
+		return p + 5;
+	}
+	return NULL;
+}
+
+/* skip any value, including nested objects and arrays */
+static const char * skip_value(const char *p) {
+	const char *str;
+	int len;
+	int level = 0;
+
+	do {
+		switch (*p) {
+			case '\0':
+				return NULL;
+			case '"':
+				p = scan_string(p, &str, &len);
+				if (p == NULL)
+					return NULL;
+				continue;
+			case '{': case '[':
+				level++;
+				break;
+			case '}': case ']':
+				level--;
+				break;
+			default:
+				if (level == 0) { /* number or literal */
+					while ((*p != '\0') && !IS_WS(*p) && (*p != ',') && (*p != '}') && (*p != ']'))
+						p++;
+					return p;
+				}
+				break;
+		}
+		p++;
+	} while (level > 0);
+	return p;
+}
+
+/* "SFxxBWyyy", terminated by anything that is not a digit */
+static int datr_decode(const char *s, struct lgw_pkt_tx_s *pkt) {
+	char *end;
+	unsigned long sf, bw;
+
+	if ((s[0] != 'S') || (s[1] != 'F'))
+		return -1;
+	sf = strtoul(s + 2, &end, 10);
+	if ((end[0] != 'B') || (end[1] != 'W'))
+		return -1;
+	bw = strtoul(end + 2, NULL, 10);
+
+	switch (sf) {
+		case  7: pkt->datarate = DR_LORA_SF7;  break;
+		case  8: pkt->datarate = DR_LORA_SF8;  break;
+		case  9: pkt->datarate = DR_LORA_SF9;  break;
+		case 10: pkt->datarate = DR_LORA_SF10; break;
+		case 11: pkt->datarate = DR_LORA_SF11; break;
+		case 12: pkt->datarate = DR_LORA_SF12; break;
+		default: return -1;
+	}
+	switch (bw) {
+		case 125: pkt->bandwidth = BW_125KHZ; break;
+		case 250: pkt->bandwidth = BW_250KHZ; break;
+		case 500: pkt->bandwidth = BW_500KHZ; break;
+		default: return -1;
+	}
+	return 0;
+}
+
+static int codr_decode(const char *s, struct lgw_pkt_tx_s *pkt) {
+	if (!strncmp(s, "4/5", 3)) {
+		pkt->coderate = CR_LORA_4_5;
+	} else if (!strncmp(s, "4/6", 3) || !strncmp(s, "2/3", 3)) {
+		pkt->coderate = CR_LORA_4_6;
+	} else if (!strncmp(s, "4/7", 3)) {
+		pkt->coderate = CR_LORA_4_7;
+	} else if (!strncmp(s, "4/8", 3) || !strncmp(s, "1/2", 3)) {
+		pkt->coderate = CR_LORA_4_8;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/* decode the value of one txpk member, returns a pointer past the value */
+static const char * parse_member(const char *key, int key_len, const char *p, struct lgw_pkt_tx_s *pkt, int *seen, int *data_len) {
+	const char *str;
+	char *end;
+	int len;
+	bool b;
+
+	if (KEY_IS(key, key_len, "imme")) {
+		p = scan_bool(p, &b);
+		if (p != NULL)
+			pkt->tx_mode = b ? IMMEDIATE : TIMESTAMPED;
+		return p;
+	} else if (KEY_IS(key, key_len, "tmst")) {
+		pkt->count_us = (uint32_t)strtoul(p, &end, 10);
+	} else if (KEY_IS(key, key_len, "freq")) {
+		pkt->freq_hz = (uint32_t)((double)(1.0e6) * strtod(p, &end));
+	} else if (KEY_IS(key, key_len, "rfch")) {
+		pkt->rf_chain = (uint8_t)strtoul(p, &end, 10);
+	} else if (KEY_IS(key, key_len, "powe")) {
+		pkt->rf_power = (int8_t)strtol(p, &end, 10);
+	} else if (KEY_IS(key, key_len, "prea")) {
+		pkt->preamble = (uint16_t)strtoul(p, &end, 10);
+	} else if (KEY_IS(key, key_len, "fdev")) {
+		pkt->f_dev = (uint8_t)(strtoul(p, &end, 10) / 1000); /* Hz -> kHz */
+	} else if (KEY_IS(key, key_len, "size")) {
+		pkt->size = (uint16_t)strtoul(p, &end, 10);
+		*seen |= SEEN_SIZE;
+	} else if (KEY_IS(key, key_len, "ipol")) {
+		p = scan_bool(p, &pkt->invert_pol);
+		return p;
+	} else if (KEY_IS(key, key_len, "ncrc")) {
+		p = scan_bool(p, &pkt->no_crc);
+		return p;
+	} else if (KEY_IS(key, key_len, "modu")) {
+		p = scan_string(p, &str, &len);
+		if (p == NULL)
+			return NULL;
+		if ((len == 4) && !memcmp(str, "LORA", 4)) {
+			pkt->modulation = MOD_LORA;
+		} else if ((len == 3) && !memcmp(str, "FSK", 3)) {
+			pkt->modulation = MOD_FSK;
+		} else {
+			return NULL;
+		}
+		return p;
+	} else if (KEY_IS(key, key_len, "datr")) {
+		if (*p == '"') { /* LoRa: "SFxxBWyyy" */
+			p = scan_string(p, &str, &len);
+			if ((p == NULL) || (datr_decode(str, pkt) != 0))
+				return NULL;
+			return p;
+		}
+		pkt->datarate = (uint32_t)strtoul(p, &end, 10); /* FSK: bits per second */
+	} else if (KEY_IS(key, key_len, "codr")) {
+		p = scan_string(p, &str, &len);
+		if ((p == NULL) || (len != 3) || (codr_decode(str, pkt) != 0))
+			return NULL;
+		return p;
+	} else if (KEY_IS(key, key_len, "data")) {
+		p = scan_string(p, &str, &len);
+		if (p == NULL)
+			return NULL;
+		*data_len = b64_to_bin(str, len, pkt->payload, sizeof pkt->payload);
+		if (*data_len < 0)
+			return NULL;
+		*seen |= SEEN_DATA;
+		return p;
+	} else {
+		return skip_value(p);
+	}
+
+	/* numeric fields end up here */
+	return (end == p) ? NULL : end;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int txpk_parse(const char *json, struct lgw_pkt_tx_s *pkt) {
+	const char *p, *key;
+	int key_len;
+	int seen = 0;
+	int data_len = 0;
+	bool in_txpk = false;
+
+	memset(pkt, 0, sizeof *pkt);
+	pkt->tx_mode = TIMESTAMPED;
+
+	p = skip_ws(json);
+	if (*p != '{')
+		return -1;
+	p = skip_ws(p + 1);
+
+	/* members of the root object, then of the txpk object */
+	while (1) {
+		if (*p == '}') {
+			if (!in_txpk)
+				break;
+			in_txpk = false;
+			p++;	/* the root object goes on after the txpk one */
+		} else {
+			p = scan_string(p, &key, &key_len);
+			if (p == NULL)
+				return -1;
+			p = skip_ws(p);
+			if (*p != ':')
+				return -1;
+			p = skip_ws(p + 1);
+			if (!in_txpk && KEY_IS(key, key_len, "txpk") && (*p == '{')) {
+				in_txpk = true;
+				p = skip_ws(p + 1);
+				continue;
+			} else if (in_txpk) {
+				p = parse_member(key, key_len, p, pkt, &seen, &data_len);
+			} else {
+				p = skip_value(p);
+			}
+			if (p == NULL)
+				return -1;
+		}
+		p = skip_ws(p);
+		if (*p == ',') {
+			p = skip_ws(p + 1);
+			if (*p != '"') /* a member must follow */
+				return -1;
+		} else if (*p != '}') {
+			return -1;
+		}
+	}
+	if (*skip_ws(p + 1) != '\0')
+		return -1;
+
+	return ((seen & (SEEN_SIZE | SEEN_DATA)) == (SEEN_SIZE | SEEN_DATA)) ? data_len : -1;
+}
+
+void txpk_parse_json(const JSON_Object *txpk_obj, struct lgw_pkt_tx_s *pkt) {
+	JSON_Value *val;
+	const char *str;
+
+	pkt->tx_mode = (json_object_get_boolean(txpk_obj, "imme") == 1) ? IMMEDIATE : TIMESTAMPED;
+	pkt->count_us = (uint32_t)json_object_get_number(txpk_obj, "tmst");
+	pkt->freq_hz = (uint32_t)((double)(1.0e6) * json_object_get_number(txpk_obj, "freq"));
+	pkt->rf_chain = (uint8_t)json_object_get_number(txpk_obj, "rfch");
+	pkt->rf_power = (int8_t)json_object_get_number(txpk_obj, "powe");
+	pkt->preamble = (uint16_t)json_object_get_number(txpk_obj, "prea");
+	pkt->f_dev = (uint8_t)(json_object_get_number(txpk_obj, "fdev") / 1000.0); /* Hz -> kHz */
+	pkt->invert_pol = (json_object_get_boolean(txpk_obj, "ipol") == 1);
+	pkt->no_crc = (json_object_get_boolean(txpk_obj, "ncrc") == 1);
+
+	str = json_object_get_string(txpk_obj, "modu");
+	if (str != NULL) {
+		if (!strcmp(str, "LORA")) {
+			pkt->modulation = MOD_LORA;
+		} else if (!strcmp(str, "FSK")) {
+			pkt->modulation = MOD_FSK;
+		}
+	}
+
+	val = json_object_get_value(txpk_obj, "datr");
+	if (json_value_get_type(val) == JSONString) {
+		datr_decode(json_value_get_string(val), pkt);
+	} else if (json_value_get_type(val) == JSONNumber) {
+		pkt->datarate = (uint32_t)json_value_get_number(val);
+	}
+
+	str = json_object_get_string(txpk_obj, "codr");
+	if (str != NULL) {
+		codr_decode(str, pkt);
+	}
+}
+
+/* --- EOF ------------------------------------------------------------------ */
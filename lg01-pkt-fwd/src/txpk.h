@@ -0,0 +1,42 @@
+/*
+ * txpk.h
+ *
+ * Decoding of the Semtech UDP protocol "txpk" object carried by PULL_RESP.
+ */
+
+#ifndef _TXPK_H
+#define _TXPK_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+
+#include "parson.h"
+#include "lgw_pkt.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Decode a PULL_RESP JSON document straight from the receive buffer
+@param json null-terminated JSON text ({"txpk":{...}})
+@param pkt packet structure to fill, cleared by the function
+@return number of payload bytes decoded from txpk.data on success, -1 if the
+document is malformed, lacks txpk.size or txpk.data, or uses a construct the
+scanner does not handle (escaped strings), in which case the caller should
+fall back to parson.
+No memory is allocated, strings are decoded in place.
+*/
+int txpk_parse(const char *json, struct lgw_pkt_tx_s *pkt);
+
+/**
+@brief Fill the optional txpk fields from an already parsed parson object
+@param txpk_obj the "txpk" JSON object
+@param pkt packet structure to fill (size and payload are left untouched)
+*/
+void txpk_parse_json(const JSON_Object *txpk_obj, struct lgw_pkt_tx_s *pkt);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
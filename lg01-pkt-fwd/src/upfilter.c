@@ -0,0 +1,275 @@
+/*
+ * upfilter.c
+ *
+ * Uplink identity filter, see upfilter.h. Keys are held as 64-bit values,
+ * a DevAddr uses the low 32 bits. The NetID to DevAddr block mapping follows
+ * the NwkID lengths of the LoRaWAN backend interfaces 1.1.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* snprintf */
+#include <stdlib.h>		/* strtoul, strtoull, qsort */
+#include <string.h>		/* memset, memcmp, memcpy, strspn, strcspn, strlen */
+
+#include "upfilter.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define MTYPE_JOIN_REQUEST	0
+#define MTYPE_DATA_FIRST	2	/* unconfirmed data up */
+#define MTYPE_DATA_LAST		5	/* confirmed data down */
+#define JOIN_REQUEST_SIZE	23	/* MHDR, JoinEUI, DevEUI, DevNonce, MIC */
+#define DATA_SIZE_MIN		12	/* MHDR, FHDR without FOpts, MIC */
+
+#define HEX_DIGITS			"0123456789abcdefABCDEF"
+#define RULE_SEPARATORS		" ,"
+#define RULE_SIZE			32	/* longer than any valid rule */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* NwkID bits of each NetID type */
+static const uint8_t nwkid_bits[8] = {6, 6, 9, 11, 12, 13, 15, 17};
+
+static const char *const set_names[UPFILTER_NB_SET] = {"devaddr_allow", "devaddr_deny", "joineui_allow", "joineui_deny"};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static int parse_key(const char *rule, int width, uint64_t *lo, uint64_t *hi);
+static int parse_netid(const char *rule, uint64_t *lo, uint64_t *hi);
+static int compare_range(const void *a, const void *b);
+static bool contains(const struct upfilter_set_s *set, uint64_t key);
+static bool check_key(struct upfilter_s *uf, int allow, uint64_t key);
+static uint64_t get_le(const uint8_t *b, int len);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* "key" or "key/bits", width bits wide, return 0 or -1 */
+static int parse_key(const char *rule, int width, uint64_t *lo, uint64_t *hi) {
+	unsigned long long value;
+	unsigned long bits = width;
+	uint64_t low_mask;
+	char *end;
+	size_t digits;
+
+	digits = strspn(rule, HEX_DIGITS);
+	if ((digits == 0) || (digits > (size_t)width / 4))
+		return -1;
+	value = strtoull(rule, &end, 16);
+	if (*end == '/') {
+		if ((end[1] < '0') || (end[1] > '9'))
+			return -1;
+		bits = strtoul(end + 1, &end, 10);
+		if (bits > (unsigned long)width)
+			return -1;
+	}
+	if (*end != '\0')
+		return -1;
+
+	low_mask = (width - bits >= 64) ? UINT64_MAX : ((1ULL << (width - bits)) - 1);
+	*lo = value & ~low_mask;
+	*hi = *lo | low_mask;
+	return 0;
+}
+
+/* the DevAddr block of a NetID: type prefix, then the NwkID (NetID low bits) */
+static int parse_netid(const char *rule, uint64_t *lo, uint64_t *hi) {
+	unsigned long netid;
+	unsigned type, bits, len;
+	uint32_t prefix;
+	char *end;
+
+	if ((strspn(rule, HEX_DIGITS) != strlen(rule)) || (strlen(rule) == 0) || (strlen(rule) > 6))
+		return -1;
+	netid = strtoul(rule, &end, 16);
+	type = netid >> 21;
+	bits = nwkid_bits[type];
+	len = type + 1 + bits;
+	prefix = (((1U << (type + 1)) - 2) << bits) | (netid & ((1U << bits) - 1));
+	*lo = (uint64_t)prefix << (32 - len);
+	*hi = *lo | ((1ULL << (32 - len)) - 1);
+	return 0;
+}
+
+static int compare_range(const void *a, const void *b) {
+	const struct upfilter_range_s *ra = a, *rb = b;
+
+	return (ra->lo < rb->lo) ? -1 : (ra->lo > rb->lo);
+}
+
+/* binary search for the last range starting at or below key */
+static bool contains(const struct upfilter_set_s *set, uint64_t key) {
+	int low = 0, high = set->nb, mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (set->r[mid].lo <= key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return (low > 0) && (key <= set->r[low - 1].hi);
+}
+
+/* deny set first, then the allow set if it is not empty */
+static bool check_key(struct upfilter_s *uf, int allow, uint64_t key) {
+	const int deny = allow + 1;
+
+	if ((uf->set[deny].nb > 0) && contains(&uf->set[deny], key)) {
+		uf->hit[deny]++;
+		uf->drop++;
+		return false;
+	}
+	if (uf->set[allow].nb > 0) {
+		if (!contains(&uf->set[allow], key)) {
+			uf->miss[allow]++;
+			uf->drop++;
+			return false;
+		}
+		uf->hit[allow]++;
+	}
+	uf->pass++;
+	return true;
+}
+
+static uint64_t get_le(const uint8_t *b, int len) {
+	uint64_t v = 0;
+
+	while (len-- > 0)
+		v = (v << 8) | b[len];
+	return v;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void upfilter_init(struct upfilter_s *uf) {
+	memset(uf, 0, sizeof *uf);
+}
+
+int upfilter_add(struct upfilter_s *uf, int kind, bool deny, const char *rule) {
+	struct upfilter_set_s *set;
+	uint64_t lo, hi;
+	int err;
+
+	switch (kind) {
+		case UPFILTER_DEVADDR:
+			err = parse_key(rule, 32, &lo, &hi);
+			set = &uf->set[deny ? UPFILTER_DEVADDR_DENY : UPFILTER_DEVADDR_ALLOW];
+			break;
+		case UPFILTER_NETID:
+			err = parse_netid(rule, &lo, &hi);
+			set = &uf->set[deny ? UPFILTER_DEVADDR_DENY : UPFILTER_DEVADDR_ALLOW];
+			break;
+		case UPFILTER_JOINEUI:
+			err = parse_key(rule, 64, &lo, &hi);
+			set = &uf->set[deny ? UPFILTER_JOINEUI_DENY : UPFILTER_JOINEUI_ALLOW];
+			break;
+		default:
+			return -1;
+	}
+	if ((err != 0) || (set->nb == UPFILTER_RANGE_MAX))
+		return -1;
+	set->r[set->nb].lo = lo;
+	set->r[set->nb].hi = hi;
+	set->nb++;
+	return 0;
+}
+
+int upfilter_add_list(struct upfilter_s *uf, int kind, bool deny, const char *list, char *bad, int bad_size) {
+	char rule[RULE_SIZE];
+	size_t len;
+	int nb_bad = 0;
+
+	for (list += strspn(list, RULE_SEPARATORS); *list != '\0'; list += strspn(list, RULE_SEPARATORS)) {
+		len = strcspn(list, RULE_SEPARATORS);
+		if (len < sizeof rule) {
+			memcpy(rule, list, len);
+			rule[len] = '\0';
+		}
+		if ((len >= sizeof rule) || (upfilter_add(uf, kind, deny, rule) != 0)) {
+			if ((nb_bad++ == 0) && (bad_size > 0))
+				snprintf(bad, bad_size, "%.*s", (int)len, list);
+		}
+		list += len;
+	}
+	return nb_bad;
+}
+
+void upfilter_finish(struct upfilter_s *uf) {
+	struct upfilter_set_s *set;
+	int i, j, n;
+
+	for (i = 0; i < UPFILTER_NB_SET; i++) {
+		set = &uf->set[i];
+		if (set->nb < 2)
+			continue;
+		qsort(set->r, set->nb, sizeof set->r[0], compare_range);
+		n = 0;
+		for (j = 1; j < set->nb; j++) {
+			if ((set->r[n].hi == UINT64_MAX) || (set->r[j].lo <= set->r[n].hi + 1)) {
+				if (set->r[j].hi > set->r[n].hi)
+					set->r[n].hi = set->r[j].hi;
+			} else {
+				set->r[++n] = set->r[j];
+			}
+		}
+		set->nb = n + 1;
+		memset(&set->r[set->nb], 0, (UPFILTER_RANGE_MAX - set->nb) * sizeof set->r[0]);
+	}
+}
+
+bool upfilter_active(const struct upfilter_s *uf) {
+	int i;
+
+	for (i = 0; i < UPFILTER_NB_SET; i++) {
+		if (uf->set[i].nb > 0)
+			return true;
+	}
+	return false;
+}
+
+bool upfilter_same(const struct upfilter_s *a, const struct upfilter_s *b) {
+	return memcmp(a->set, b->set, sizeof a->set) == 0;
+}
+
+bool upfilter_check(struct upfilter_s *uf, const uint8_t *payload, int size) {
+	unsigned mtype;
+
+	if ((size < 1) || ((payload[0] & 0x03) != 0)) /* not LoRaWAN R1 */
+		return true;
+	mtype = payload[0] >> 5;
+	if ((mtype == MTYPE_JOIN_REQUEST) && (size == JOIN_REQUEST_SIZE))
+		return check_key(uf, UPFILTER_JOINEUI_ALLOW, get_le(payload + 1, 8));
+	if ((mtype >= MTYPE_DATA_FIRST) && (mtype <= MTYPE_DATA_LAST) && (size >= DATA_SIZE_MIN))
+		return check_key(uf, UPFILTER_DEVADDR_ALLOW, get_le(payload + 1, 4));
+	return true;
+}
+
+int upfilter_to_json(const struct upfilter_s *uf, char *out, int max_len) {
+	int i, j, index;
+
+	index = snprintf(out, max_len, "{\"pass\":%u,\"drop\":%u", uf->pass, uf->drop);
+	if ((index < 0) || (index >= max_len))
+		return -1;
+	for (i = 0; i <= UPFILTER_NB_SET; i++) {
+		if (i == UPFILTER_NB_SET)
+			j = snprintf(out + index, max_len - index, "}");
+		else
+			j = snprintf(out + index, max_len - index, ",\"%s\":{\"ranges\":%d,\"hit\":%u,\"miss\":%u}",
+			             set_names[i], uf->set[i].nb, uf->hit[i], uf->miss[i]);
+		if ((j < 0) || (j >= max_len - index))
+			return -1;
+		index += j;
+	}
+	return index;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,117 @@
+/*
+ * upfilter.h
+ *
+ * Uplink filter on the LoRaWAN identity of a frame: the DevAddr of data
+ * frames and the JoinEUI of join requests. A NetID stands for the block of
+ * DevAddr it owns. Each key has an allow and a deny set, held as sorted and
+ * merged ranges looked up by binary search; a deny match drops the frame, a
+ * non-empty allow set drops the frames it does not hold. Other frames, and
+ * frames too short to carry their key, always pass. The filter is not
+ * thread-safe, it belongs to the uplink path.
+ */
+
+#ifndef _UPFILTER_H
+#define _UPFILTER_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define UPFILTER_RANGE_MAX	64	/* ranges per set, the rules beyond are refused */
+
+/* rule kinds */
+#define UPFILTER_DEVADDR	0	/* "26011234", or a prefix "26000000/7" */
+#define UPFILTER_NETID		1	/* "000013", the DevAddr block of that NetID */
+#define UPFILTER_JOINEUI	2	/* "70B3D57ED0000001", or a prefix "70B3D57ED0000000/36" */
+
+/* sets, the DevAddr and NetID rules share the DevAddr ones */
+#define UPFILTER_DEVADDR_ALLOW	0
+#define UPFILTER_DEVADDR_DENY	1
+#define UPFILTER_JOINEUI_ALLOW	2
+#define UPFILTER_JOINEUI_DENY	3
+#define UPFILTER_NB_SET			4
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct upfilter_range_s {
+	uint64_t	lo;
+	uint64_t	hi;			/* inclusive */
+};
+
+struct upfilter_set_s {
+	int						nb;
+	struct upfilter_range_s	r[UPFILTER_RANGE_MAX];
+};
+
+struct upfilter_s {
+	struct upfilter_set_s	set[UPFILTER_NB_SET];
+	uint32_t				hit[UPFILTER_NB_SET];	/* frames found in each set */
+	uint32_t				miss[UPFILTER_NB_SET];	/* frames a non-empty allow set did not hold */
+	uint32_t				pass;					/* frames checked and kept */
+	uint32_t				drop;					/* frames checked and dropped */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Empty the filter, every frame passes
+*/
+void upfilter_init(struct upfilter_s *uf);
+
+/**
+@brief Add a rule, upfilter_finish() must be called once all are added
+@param kind UPFILTER_DEVADDR, UPFILTER_NETID or UPFILTER_JOINEUI
+@param deny true for the deny set, false for the allow set
+@param rule hexadecimal key, with "/bits" for a prefix (not for a NetID)
+@return 0 on success, -1 if the rule is invalid or the set is full
+*/
+int upfilter_add(struct upfilter_s *uf, int kind, bool deny, const char *rule);
+
+/**
+@brief Add the rules of a list, separated by spaces or commas
+@param list the rules, a rule is never cut: one too long is refused whole
+@param bad receives the first refused rule, cut to bad_size
+@return number of rules refused, invalid or past a full set
+*/
+int upfilter_add_list(struct upfilter_s *uf, int kind, bool deny, const char *list, char *bad, int bad_size);
+
+/**
+@brief Sort the sets and merge the ranges that overlap or touch
+*/
+void upfilter_finish(struct upfilter_s *uf);
+
+/**
+@brief true if the filter holds at least one rule
+*/
+bool upfilter_active(const struct upfilter_s *uf);
+
+/**
+@brief true if both filters hold the same rules, the counters are not compared
+*/
+bool upfilter_same(const struct upfilter_s *a, const struct upfilter_s *b);
+
+/**
+@brief Check a frame against the filter and count it
+@param payload PHYPayload, as received
+@param size payload size
+@return true if the frame must be forwarded
+*/
+bool upfilter_check(struct upfilter_s *uf, const uint8_t *payload, int size);
+
+/**
+@brief Serialize the counters as a JSON object
+@return number of characters written, or -1 if out is too small
+Format: {"pass":N,"drop":N,"devaddr_allow":{"ranges":N,"hit":N,"miss":N},...}
+*/
+int upfilter_to_json(const struct upfilter_s *uf, char *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
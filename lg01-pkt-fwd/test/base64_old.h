@@ -0,0 +1,19 @@
+/*
+ * base64_old.h
+ *
+ * The former base64 codec, see base64_old.c.
+ */
+
+#ifndef _BASE64_OLD_H
+#define _BASE64_OLD_H
+
+#include <stdint.h>		/* C99 types */
+
+int old_bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len);
+int old_b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len);
+int old_bin_to_b64(const uint8_t * in, int size, char * out, int max_len);
+int old_b64_to_bin(const char * in, int size, uint8_t * out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
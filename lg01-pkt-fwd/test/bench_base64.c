@@ -0,0 +1,64 @@
+/*
+ * bench_base64.c
+ *
+ * Cost of the table-driven base64 codec against the former one, on the
+ * sizes of LoRa payloads.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "base64_old.h"
+#include "test.h"
+
+#define LOOPS	200000
+
+static volatile int sink;
+
+int main(void) {
+	static const int sizes[] = { 12, 51, 255 };
+	uint8_t bin[256];
+	char b64[400], what[64];
+	double t0;
+	long i;
+	unsigned k;
+	int len;
+
+	srand(1);
+	for (i = 0; i < (long)sizeof bin; i++)
+		bin[i] = rand();
+	printf("per call:\n");
+
+	for (k = 0; k < sizeof sizes / sizeof sizes[0]; k++) {
+		t0 = bench_now();
+		for (i = 0; i < LOOPS; i++)
+			sink = bin_to_b64(bin, sizes[k], b64, sizeof b64);
+		sprintf(what, "%3d bytes, encode", sizes[k]);
+		bench_report(what, t0, LOOPS);
+
+		t0 = bench_now();
+		for (i = 0; i < LOOPS; i++)
+			sink = old_bin_to_b64(bin, sizes[k], b64, sizeof b64);
+		sprintf(what, "%3d bytes, encode, former codec", sizes[k]);
+		bench_report(what, t0, LOOPS);
+
+		len = strlen(b64);
+		t0 = bench_now();
+		for (i = 0; i < LOOPS; i++)
+			sink = b64_to_bin(b64, len, bin, sizeof bin);
+		sprintf(what, "%3d bytes, decode", sizes[k]);
+		bench_report(what, t0, LOOPS);
+
+		t0 = bench_now();
+		for (i = 0; i < LOOPS; i++)
+			sink = old_b64_to_bin(b64, len, bin, sizeof bin);
+		sprintf(what, "%3d bytes, decode, former codec", sizes[k]);
+		bench_report(what, t0, LOOPS);
+	}
+
+	return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
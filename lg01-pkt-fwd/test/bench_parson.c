@@ -0,0 +1,116 @@
+/*
+ * bench_parson.c
+ *
+ * Allocation cost of parsing a stream of PULL_RESP documents: heap trees
+ * freed after each packet against one arena reset before each packet.
+ * Cost of json_object_get_value against the linear scan of the names it
+ * did before objects got a hash index.
+ */
+
+#define TEST_COUNT_ALLOC
+
+#include <stdint.h>
+#include <string.h>
+
+#include "parson.h"
+#include "test.h"
+
+#define LOOPS	200000
+
+static const char *docs[] = {
+	"{\"txpk\":{\"imme\":false,\"tmst\":3512348611,\"freq\":868.1,\"rfch\":0,\"powe\":14,"
+		"\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":32,"
+		"\"data\":\"YAQAAAKgAQABNvbGjGP89a1FZ6q0S2M7hFmGrzQwHvRz\"}}",
+	"{\"txpk\":{\"imme\":true,\"freq\":869.525,\"rfch\":0,\"powe\":27,\"modu\":\"LORA\",\"datr\":\"SF12BW125\","
+		"\"codr\":\"4/5\",\"ipol\":true,\"size\":12,\"data\":\"IAECAwQFBgcICQoL\"}}",
+};
+
+static volatile double sink;
+
+static char doc[1024 * 24];
+
+/* the lookup without an index: strlen and strncmp on every name, returns the index */
+static long linear_get(const JSON_Object *obj, const char *name) {
+	size_t i, n = strlen(name);
+
+	for (i = 0; i < json_object_get_count(obj); i++) {
+		if ((strlen(json_object_get_name(obj, i)) == n) && !strncmp(json_object_get_name(obj, i), name, n))
+			return i;
+	}
+	return -1;
+}
+
+static void bench_lookup(int n) {
+	char names[64][16], what[64];
+	JSON_Value *val;
+	const JSON_Object *obj;
+	double t0;
+	long i;
+	int len;
+
+	len = sprintf(doc, "{");
+	for (i = 0; i < n; i++)
+		len += sprintf(doc + len, "%s\"name_%ld\":%ld", i ? "," : "", i, i);
+	sprintf(doc + len, "}");
+	val = json_parse_string(doc);
+	obj = json_value_get_object(val);
+	for (i = 0; i < 64; i++)
+		sprintf(names[i], "name_%ld", (i * 7919) % n);
+
+	t0 = bench_now();
+	for (i = 0; i < LOOPS; i++)
+		sink = json_value_get_number(json_object_get_value(obj, names[i & 63]));
+	sprintf(what, "%5d names, json_object_get_value", n);
+	bench_report(what, t0, LOOPS);
+
+	t0 = bench_now();
+	for (i = 0; i < LOOPS; i++)
+		sink = linear_get(obj, names[i & 63]);
+	sprintf(what, "%5d names, linear scan", n);
+	bench_report(what, t0, LOOPS);
+
+	json_value_free(val);
+}
+
+int main(void) {
+	static double buf[2048];	/* JSON_ARENA_SIZE */
+	JSON_Arena arena;
+	JSON_Value *val;
+	double t0;
+	long i, calls;
+
+	json_arena_init(&arena, buf, sizeof buf);
+	printf("parse of a PULL_RESP stream, per packet:\n");
+
+	calls = alloc_calls;
+	t0 = bench_now();
+	for (i = 0; i < LOOPS; i++) {
+		val = json_parse_string_with_comments(docs[i & 1]);
+		sink = json_object_dotget_number(json_value_get_object(val), "txpk.size");
+		json_value_free(val);
+	}
+	bench_report("heap, parse and free", t0, LOOPS);
+	printf("  %-40s %10.1f\n", "heap calls", (double)(alloc_calls - calls) / LOOPS);
+
+	calls = alloc_calls;
+	t0 = bench_now();
+	for (i = 0; i < LOOPS; i++) {
+		json_arena_reset(&arena);
+		val = json_parse_string_with_comments_arena(&arena, docs[i & 1]);
+		sink = json_object_dotget_number(json_value_get_object(val), "txpk.size");
+	}
+	bench_report("arena, reset and parse", t0, LOOPS);
+	printf("  %-40s %10.1f\n", "heap calls", (double)(alloc_calls - calls) / LOOPS);
+	printf("  %-40s %10u B\n", "arena used", (unsigned)arena.used);
+
+	printf("lookup of a present name:\n");
+	bench_lookup(8);
+	bench_lookup(16);
+	bench_lookup(64);
+	bench_lookup(256);
+	bench_lookup(1024);
+
+	return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
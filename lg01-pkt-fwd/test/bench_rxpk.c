@@ -0,0 +1,74 @@
+/*
+ * bench_rxpk.c
+ *
+ * Cost of an rxpk object with rxpk_serialize() against the snprintf()
+ * serializer it replaces, for the sizes of LoRa payloads. The time advances
+ * by 1 ms per packet, so the time prefix is rebuilt once per 1000 packets.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rxpk.h"
+#include "rxpk_old.h"
+#include "test.h"
+
+#define LOOPS	500000
+
+static volatile int sink;
+
+int main(void) {
+	static const int sizes[] = { 0, 23, 51, 255 };
+	static struct rxpk_fmt_s fmt;
+	struct lgw_pkt_rx_s pkt;
+	struct timespec t;
+	char out[700], what[64];
+	double t0;
+	long i;
+	unsigned k;
+
+	rxpk_fmt_init(&fmt);
+	memset(&pkt, 0, sizeof pkt);
+	srand(1);
+	for (i = 0; i < (long)sizeof pkt.payload; i++)
+		pkt.payload[i] = rand();
+	pkt.freq_hz = 868100000;
+	pkt.status = STAT_CRC_OK;
+	pkt.datarate = DR_LORA_SF9;
+	pkt.bandwidth = BW_125KHZ;
+	pkt.coderate = CR_LORA_4_5;
+	pkt.rssi = -97;
+	pkt.snr = -7.5f;
+	printf("per packet:\n");
+
+	for (k = 0; k < sizeof sizes / sizeof sizes[0]; k++) {
+		pkt.size = sizes[k];
+
+		t.tv_sec = 1767225600;
+		t.tv_nsec = 0;
+		t0 = bench_now();
+		for (i = 0; i < LOOPS; i++) {
+			pkt.count_us = i;
+			t.tv_sec = 1767225600 + i / 1000;
+			t.tv_nsec = (i % 1000) * 1000000;
+			sink = rxpk_serialize(&fmt, &pkt, &t, out, sizeof out);
+		}
+		sprintf(what, "%3d bytes, rxpk_serialize", sizes[k]);
+		bench_report(what, t0, LOOPS);
+
+		t0 = bench_now();
+		for (i = 0; i < LOOPS; i++) {
+			pkt.count_us = i;
+			t.tv_sec = 1767225600 + i / 1000;
+			t.tv_nsec = (i % 1000) * 1000000;
+			sink = old_serialize_rxpk(&pkt, &t, out, sizeof out);
+		}
+		sprintf(what, "%3d bytes, former serializer", sizes[k]);
+		bench_report(what, t0, LOOPS);
+	}
+	return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,74 @@
+/*
+ * bench_txpk.c
+ *
+ * Cost of decoding a PULL_RESP: txpk_parse() against the parson tree, on
+ * the heap and in an arena, that main.c falls back to.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "base64.h"
+#include "parson.h"
+#include "txpk.h"
+#include "test.h"
+
+#define LOOPS	200000
+
+static const char *json =
+	"{\"txpk\":{\"imme\":false,\"tmst\":3512348611,\"freq\":868.1,\"rfch\":0,\"powe\":14,"
+	"\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":32,"
+	"\"data\":\"YAQAAAKgAQABNvbGjGP89a1FZ6q0S2M7hFmGrzQwHvRz\"}}";
+
+static volatile int sink;
+
+static void decode_tree(JSON_Value *root_val, struct lgw_pkt_tx_s *pkt) {
+	JSON_Object *txpk_obj;
+	const char *str;
+
+	txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
+	pkt->size = (uint16_t)json_object_get_number(txpk_obj, "size");
+	str = json_object_get_string(txpk_obj, "data");
+	sink = b64_to_bin(str, strlen(str), pkt->payload, sizeof pkt->payload);
+	txpk_parse_json(txpk_obj, pkt);
+}
+
+int main(void) {
+	static uint8_t arena_buf[4096];
+	struct lgw_pkt_tx_s pkt;
+	JSON_Arena arena;
+	JSON_Value *root_val;
+	double t0;
+	long i;
+
+	json_arena_init(&arena, arena_buf, sizeof arena_buf);
+	printf("PULL_RESP of %u bytes, per document:\n", (unsigned)strlen(json));
+
+	t0 = bench_now();
+	for (i = 0; i < LOOPS; i++)
+		sink = txpk_parse(json, &pkt);
+	bench_report("txpk_parse", t0, LOOPS);
+
+	t0 = bench_now();
+	for (i = 0; i < LOOPS; i++) {
+		memset(&pkt, 0, sizeof pkt);
+		root_val = json_parse_string_with_comments(json);
+		decode_tree(root_val, &pkt);
+		json_value_free(root_val);
+	}
+	bench_report("parson, heap", t0, LOOPS);
+
+	t0 = bench_now();
+	for (i = 0; i < LOOPS; i++) {
+		memset(&pkt, 0, sizeof pkt);
+		json_arena_reset(&arena);
+		root_val = json_parse_string_with_comments_arena(&arena, json);
+		decode_tree(root_val, &pkt);
+	}
+	bench_report("parson, arena", t0, LOOPS);
+
+	return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,58 @@
+/*
+ * rxpk_old.c
+ *
+ * serialize_rxpk() of main.c before rxpk.c, with the former base64 codec it
+ * called then. Reference of test_rxpk and bench_rxpk.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "base64_old.h"
+#include "rxpk_old.h"
+
+int old_serialize_rxpk(const struct lgw_pkt_rx_s *pkt, const struct timespec *fetch_time, char *out, int max_len) {
+    struct tm * x;
+    char fetch_timestamp[28]; /* timestamp as a text string */
+    int index, j, stat, bw_khz;
+
+    switch (pkt->status) {
+        case STAT_CRC_OK: stat = 1; break;
+        case STAT_CRC_BAD: stat = -1; break;
+        default: stat = 0; break;
+    }
+    switch (pkt->bandwidth) {
+        case BW_500KHZ: bw_khz = 500; break;
+        case BW_250KHZ: bw_khz = 250; break;
+        case BW_62K5HZ: bw_khz = 62; break;
+        case BW_31K2HZ: bw_khz = 31; break;
+        case BW_15K6HZ: bw_khz = 15; break;
+        case BW_7K8HZ: bw_khz = 7; break;
+        default: bw_khz = 125; break;
+    }
+
+    /* local timestamp generation until we get accurate GPS time */
+    x = gmtime(&(fetch_time->tv_sec)); /* split the UNIX timestamp to its calendar components */
+    snprintf(fetch_timestamp, sizeof fetch_timestamp, "%04i-%02i-%02iT%02i:%02i:%02i.%06liZ", (x->tm_year)+1900, (x->tm_mon)+1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (fetch_time->tv_nsec)/1000); /* ISO 8601 format */
+
+    /* freq in MHz with Hz precision, without going through a float */
+    index = snprintf(out, max_len, "{\"tmst\":%u,\"time\":\"%s\",\"chan\":7,\"rfch\":0,\"freq\":%u.%06u,\"stat\":%d,\"modu\":\"LORA\",\"datr\":\"SF%dBW%d\",\"codr\":\"4/%d\",\"lsnr\":%.1f", pkt->count_us, fetch_timestamp, pkt->freq_hz / 1000000, pkt->freq_hz % 1000000, stat, __builtin_ctz(pkt->datarate) + 6, bw_khz, pkt->coderate + 4, pkt->snr);
+    index += snprintf(out + index, max_len - index, ",\"rssi\":%d,\"size\":%u", (int)pkt->rssi, pkt->size);
+    if (index + 9 + 341 + 2 > max_len)
+        return -1;
+
+    memcpy((void *)(out + index), (void *)",\"data\":\"", 9);
+    index += 9;
+
+    j = old_bin_to_b64(pkt->payload, pkt->size, out + index, 341); /* 255 bytes = 340 chars in b64 + null char */
+    if (j < 0)
+        return -1;
+    index += j;
+    out[index++] = '"';
+    out[index++] = '}';
+    return index;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,18 @@
+/*
+ * rxpk_old.h
+ *
+ * The former rxpk serializer, see rxpk_old.c.
+ */
+
+#ifndef _RXPK_OLD_H
+#define _RXPK_OLD_H
+
+#include <time.h>		/* timespec */
+
+#include "lgw_pkt.h"
+
+int old_serialize_rxpk(const struct lgw_pkt_rx_s *pkt, const struct timespec *fetch_time, char *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
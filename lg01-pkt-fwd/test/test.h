@@ -0,0 +1,89 @@
+/*
+ * test.h
+ *
+ * Checks and timing shared by the host tests and benchmarks of the
+ * forwarder modules, see Makefile.
+ */
+
+#ifndef _TEST_H
+#define _TEST_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdio.h>		/* printf, fprintf */
+#include <time.h>		/* clock_gettime */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC MACROS -------------------------------------------------------- */
+
+static int test_fail __attribute__((unused)) = 0;
+
+/* report a failed condition and go on with the other checks */
+#define CHECK(cond) do { \
+		if (!(cond)) { \
+			fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			test_fail++; \
+		} \
+	} while (0)
+
+/* exit status of a test program */
+#define TEST_END(name) ( \
+		printf("%s: %s\n", (name), test_fail ? "FAILED" : "passed"), \
+		test_fail ? 1 : 0)
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS ----------------------------------------------------- */
+
+#ifdef TEST_COUNT_ALLOC
+/* heap calls of the modules, the program is linked with
+   -Wl,--wrap=malloc,--wrap=realloc,--wrap=free */
+#include <stddef.h>
+
+static long alloc_calls = 0;	/* malloc and realloc */
+static long alloc_live = 0;		/* blocks not freed yet */
+
+void * __real_malloc(size_t size);
+void * __real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void * __wrap_malloc(size_t size) {
+	void *p = __real_malloc(size);
+
+	alloc_calls++;
+	if (p != NULL)
+		alloc_live++;
+	return p;
+}
+
+void * __wrap_realloc(void *ptr, size_t size) {
+	void *p = __real_realloc(ptr, size);
+
+	alloc_calls++;
+	if ((ptr == NULL) && (p != NULL))
+		alloc_live++;
+	return p;
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr != NULL)
+		alloc_live--;
+	__real_free(ptr);
+}
+#endif
+
+static inline double bench_now(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* print the cost of one of n iterations started at t0 */
+static inline void bench_report(const char *what, double t0, long n) {
+	printf("  %-40s %10.1f ns\n", what, (bench_now() - t0) * 1e9 / n);
+}
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
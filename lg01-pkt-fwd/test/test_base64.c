@@ -0,0 +1,128 @@
+/*
+ * test_base64.c
+ *
+ * Round trip of the base64 codec over every input of up to 3 bytes and
+ * every size up to a LoRa payload, output identical to the former codec,
+ * and rejection of malformed strings.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "base64_old.h"
+#include "test.h"
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* encode in both codecs, with and without padding, and decode back */
+static void round_trip(const uint8_t *in, int size) {
+	char b64[400], ref[400];
+	uint8_t out[300];
+	int len, ref_len;
+
+	len = bin_to_b64(in, size, b64, sizeof b64);
+	ref_len = old_bin_to_b64(in, size, ref, sizeof ref);
+	CHECK((len == ref_len) && (len == 4 * ((size + 2) / 3)) && !strcmp(b64, ref));
+	CHECK(b64_to_bin(b64, len, out, sizeof out) == size);
+	CHECK(!memcmp(in, out, size));
+
+	len = bin_to_b64_nopad(in, size, b64, sizeof b64);
+	ref_len = old_bin_to_b64_nopad(in, size, ref, sizeof ref);
+	CHECK((len == ref_len) && (len == (4 * size + 2) / 3) && !strcmp(b64, ref));
+	CHECK(b64_to_bin(b64, len, out, sizeof out) == size);
+	CHECK(b64_to_bin_nopad(b64, len, out, sizeof out) == size);
+	CHECK(!memcmp(in, out, size));
+}
+
+static int decode(const char *s) {
+	uint8_t out[64];
+
+	return b64_to_bin(s, strlen(s), out, sizeof out);
+}
+
+int main(void) {
+	uint8_t in[256], out[256], ref[256];
+	char s[16];
+	int i, c, pos, size;
+
+	/* every input of 1 to 3 bytes */
+	for (i = 0; i < (1 << 8); i++) {
+		in[0] = i;
+		round_trip(in, 1);
+	}
+	for (i = 0; i < (1 << 16); i++) {
+		in[0] = i >> 8; in[1] = i;
+		round_trip(in, 2);
+	}
+	for (i = 0; i < (1 << 24); i++) {
+		in[0] = i >> 16; in[1] = i >> 8; in[2] = i;
+		bin_to_b64_nopad(in, 3, s, sizeof s);
+		if ((b64_to_bin(s, 4, out, sizeof out) != 3) || memcmp(in, out, 3)) {
+			CHECK(!"3 byte round trip");
+			break;
+		}
+	}
+
+	/* every 4 character group decodes as in the former codec */
+	for (i = 0; i < (1 << 24); i++) {
+		s[0] = alphabet[i >> 18]; s[1] = alphabet[(i >> 12) & 63];
+		s[2] = alphabet[(i >> 6) & 63]; s[3] = alphabet[i & 63];
+		if ((b64_to_bin_nopad(s, 4, out, 3) != 3) || (old_b64_to_bin_nopad(s, 4, ref, 3) != 3) || memcmp(out, ref, 3)) {
+			CHECK(!"4 character group");
+			break;
+		}
+	}
+
+	/* every size up to the payload buffer, random data */
+	srand(1);
+	for (size = 0; size <= 255; size++) {
+		for (i = 0; i < size; i++)
+			in[i] = rand();
+		round_trip(in, size);
+	}
+
+	/* padding */
+	CHECK(decode("") == 0);
+	CHECK((decode("QQ==") == 1) && (decode("QQ") == 1) && (decode("QUI=") == 2) && (decode("QUI") == 2));
+	CHECK(decode("QUJD") == 3);
+	CHECK(decode("Q") == -1);
+	CHECK(decode("QUJDQ") == -1);
+	CHECK(decode("Q===") == -1);
+	CHECK(decode("====") == -1);
+	CHECK(decode("QQ=") == -1);
+	CHECK(decode("QQ=A") == -1);
+	CHECK(decode("=QQQ") == -1);
+	CHECK(decode("QQ==QQ==") == -1);
+	CHECK(decode("QUI=QUJD") == -1);
+	CHECK(decode("QR==") == 1);	/* unused bits set, accepted as before */
+
+	/* any character out of the alphabet, at any position, full and last group */
+	for (c = 0; c < 256; c++) {
+		if ((c == 0) || strchr(alphabet, c))
+			continue;
+		for (pos = 0; pos < 7; pos++) {
+			strcpy(s, "QUJDQUI");
+			s[pos] = c;
+			CHECK(b64_to_bin(s, 7, out, sizeof out) == -1);
+			CHECK(b64_to_bin_nopad(s, 7, out, sizeof out) == -1);
+		}
+	}
+	strcpy(s, "QUJD");
+	s[1] = '\0';
+	CHECK(b64_to_bin(s, 4, out, sizeof out) == -1);
+
+	/* output buffers */
+	CHECK(b64_to_bin("QUJD", 4, out, 2) == -1);
+	CHECK(b64_to_bin("QUJD", 4, out, 3) == 3);
+	CHECK(bin_to_b64_nopad((const uint8_t *)"AB", 2, s, 3) == -1);
+	CHECK(bin_to_b64_nopad((const uint8_t *)"AB", 2, s, 4) == 3);
+	CHECK(bin_to_b64((const uint8_t *)"AB", 2, s, 5) == -1);	/* one byte more than needed, as before */
+	CHECK(bin_to_b64((const uint8_t *)"AB", 2, s, 6) == 4);
+	CHECK((b64_to_bin(NULL, 4, out, 3) == -1) && (bin_to_b64(NULL, 1, s, 8) == -1));
+
+	return TEST_END("test_base64");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,92 @@
+/*
+ * test_conf.c
+ *
+ * UCI snapshot: values are kept whole whatever their length, options that
+ * can't be kept are left out and reported, never stored cut.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uci.h"
+#include "conf.h"
+#include "test.h"
+
+int main(void) {
+	static struct conf_s conf;
+	static char big[CONF_TEXT_SIZE];
+	char name[32], value[32], rule[600];
+	const char *values[CONF_OPT_MAX];
+	int i, len;
+
+	/* nothing to load: the snapshot is left untouched */
+	conf.nb_opt = 12345;
+	CHECK(conf_load(&conf, "lorawan") == -1);
+	CHECK(conf.nb_opt == 12345);
+
+	/* a long string option and a long list item are kept whole */
+	for (len = 0, i = 0; len < 500; i++)
+		len += sprintf(rule + len, "%s%08X", i ? " " : "", 0x26011234 + i);
+	uci_stub_add("general", "server", "router.eu.thethings.network", 0);
+	uci_stub_add("filter", "devaddr_allow", rule, 0);
+	uci_stub_add("filter", "joineui_deny", "70B3D57ED0000000/24", 1);
+	uci_stub_add("filter", "joineui_deny", rule, 1);
+	uci_stub_add("filter", "joineui_deny", "0000000000000001", 1);
+	CHECK(conf_load(&conf, "lorawan") == 5);
+	CHECK(conf.nb_lost == 0);
+	CHECK(!strcmp(conf_get(&conf, "general", "server"), "router.eu.thethings.network"));
+	CHECK(!strcmp(conf_get(&conf, "filter", "devaddr_allow"), rule));
+	CHECK(conf_get(&conf, "filter", "joineui_deny") == NULL);	/* list items are not options */
+	CHECK(conf_get_list(&conf, "filter", "joineui_deny", values, CONF_OPT_MAX) == 3);
+	CHECK(!strcmp(values[0], "70B3D57ED0000000/24") && !strcmp(values[1], rule) && !strcmp(values[2], "0000000000000001"));
+	CHECK(conf_get_list(&conf, "filter", "devaddr_allow", values, 1) == 1);
+	CHECK(conf_get(&conf, "general", "port") == NULL);
+
+	/* names that do not fit are reported, the other options are kept */
+	uci_stub_reset();
+	uci_stub_add("general", "a_name_far_too_long_for_the_snapshot", "1", 0);
+	uci_stub_add("a_section_far_too_long_for_the_snapshot", "port", "1700", 0);
+	uci_stub_add("general", "port", "1700", 0);
+	CHECK(conf_load(&conf, "lorawan") == 1);
+	CHECK(conf.nb_lost == 2);
+	CHECK(!strcmp(conf.lost[0], "general.a_name_far_too_long_for_the_snapshot"));
+	CHECK(!strncmp(conf.lost[1], "a_section_far_too_long_for_the_snapshot.", strlen("a_section_far_too_long_for_the_snapshot.")));
+	CHECK(!strcmp(conf_get(&conf, "general", "port"), "1700"));
+
+	/* a value that does not fit in what is left of the text is not cut */
+	uci_stub_reset();
+	memset(big, 'x', sizeof big - 16);
+	big[sizeof big - 16] = '\0';
+	uci_stub_add("general", "first", big, 0);
+	uci_stub_add("general", "second", "0123456789ABCDEF", 0);
+	uci_stub_add("general", "third", "ok", 0);
+	CHECK(conf_load(&conf, "lorawan") == 2);
+	CHECK((conf.nb_lost == 1) && !strcmp(conf.lost[0], "general.second"));
+	CHECK(conf_get(&conf, "general", "second") == NULL);
+	CHECK(!strcmp(conf_get(&conf, "general", "first"), big) && !strcmp(conf_get(&conf, "general", "third"), "ok"));
+
+	/* past CONF_OPT_MAX */
+	uci_stub_reset();
+	for (i = 0; i < CONF_OPT_MAX + 20; i++) {
+		sprintf(name, "opt%d", i);
+		sprintf(value, "%d", i);
+		uci_stub_add("many", name, value, 0);
+	}
+	CHECK(conf_load(&conf, "lorawan") == CONF_OPT_MAX);
+	CHECK(conf.nb_lost == 20);
+	CHECK(!strcmp(conf.lost[0], "many.opt160"));
+	CHECK(!strcmp(conf_get(&conf, "many", "opt159"), "159"));
+	CHECK(conf_get(&conf, "many", "opt160") == NULL);
+
+	/* a reload starts from scratch */
+	uci_stub_reset();
+	uci_stub_add("general", "port", "1680", 0);
+	CHECK((conf_load(&conf, "lorawan") == 1) && (conf.nb_lost == 0) && (conf.text_len == 5));
+	CHECK(!strcmp(conf_get(&conf, "general", "port"), "1680"));
+	uci_stub_reset();
+
+	return TEST_END("test_conf");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,74 @@
+/*
+ * test_dedup.c
+ *
+ * Duplicate filter lookups across expired entries: an entry that expires
+ * before a later one of the same probe sequence must not hide it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dedup.h"
+#include "test.h"
+
+/* keys of the same probe sequence */
+#define KEY(n)	(((uint32_t)(n) << 8) | 0x05)
+
+static int count_key(const struct dedup_s *dd, uint32_t key) {
+	int i, n = 0;
+
+	for (i = 0; i < DEDUP_SIZE; i++)
+		n += (dd->slot[i].key == key);
+	return n;
+}
+
+int main(void) {
+	static struct dedup_s dd;
+	uint32_t t0 = 0xFFFFFE00;	/* the clock wraps during the test */
+	int i;
+
+	dedup_init(&dd, 1000);
+
+	/* A, then B after it in the same sequence; A expires first */
+	CHECK(!dedup_check(&dd, KEY(1), t0));
+	CHECK(!dedup_check(&dd, KEY(2), t0 + 500));
+	CHECK(dedup_check(&dd, KEY(2), t0 + 1200));		/* found past the expired A */
+	CHECK(count_key(&dd, KEY(2)) == 1);
+	CHECK((dd.hit == 1) && (dd.miss == 2));
+
+	/* a new key takes the expired slot of A, ahead of B, B still found */
+	CHECK(!dedup_check(&dd, KEY(3), t0 + 1200));
+	CHECK(dd.slot[0x05].key == KEY(3));
+	CHECK(dedup_check(&dd, KEY(2), t0 + 1300));
+	CHECK(dedup_check(&dd, KEY(3), t0 + 1300));
+
+	/* A again once expired: a new packet, kept once */
+	CHECK(!dedup_check(&dd, KEY(1), t0 + 1400));
+	CHECK(count_key(&dd, KEY(1)) == 1);
+	CHECK(dedup_check(&dd, KEY(1), t0 + 1401));
+
+	/* several expired entries in front of a live one */
+	dedup_init(&dd, 1000);
+	for (i = 0; i < DEDUP_PROBE_MAX - 1; i++)
+		CHECK(!dedup_check(&dd, KEY(10 + i), t0));
+	CHECK(!dedup_check(&dd, KEY(99), t0 + 900));
+	CHECK(dedup_check(&dd, KEY(99), t0 + 1500));
+	CHECK(!dedup_check(&dd, KEY(10), t0 + 1500));
+
+	/* a full sequence gives its oldest entry up */
+	dedup_init(&dd, 1000);
+	for (i = 0; i < DEDUP_PROBE_MAX; i++)
+		CHECK(!dedup_check(&dd, KEY(20 + i), t0 + i));
+	CHECK(!dedup_check(&dd, KEY(50), t0 + 100));
+	CHECK(count_key(&dd, KEY(20)) == 0);
+	CHECK(dedup_check(&dd, KEY(50), t0 + 101) && dedup_check(&dd, KEY(21), t0 + 101));
+
+	/* window 0 filters nothing */
+	dedup_init(&dd, 0);
+	CHECK(!dedup_check(&dd, KEY(1), t0) && !dedup_check(&dd, KEY(1), t0));
+
+	return TEST_END("test_dedup");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
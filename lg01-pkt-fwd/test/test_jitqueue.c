@@ -0,0 +1,82 @@
+/*
+ * test_jitqueue.c
+ *
+ * The queue orders the downlinks: frames past their tmst or with less than
+ * JIT_LEAD_US of lead are taken and due at once, the others wait until
+ * JIT_LEAD_US before their tmst, overlapping air times are refused.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "jitqueue.h"
+#include "test.h"
+
+static struct lgw_pkt_tx_s frame(uint8_t mode, uint32_t tmst) {
+	struct lgw_pkt_tx_s pkt;
+
+	memset(&pkt, 0, sizeof pkt);
+	pkt.tx_mode = mode;
+	pkt.count_us = tmst;
+	pkt.modulation = MOD_LORA;
+	pkt.datarate = DR_LORA_SF7;
+	pkt.bandwidth = BW_125KHZ;
+	pkt.coderate = CR_LORA_4_5;
+	pkt.size = 12;
+	return pkt;
+}
+
+int main(void) {
+	static struct jit_queue_s q;
+	struct lgw_pkt_tx_s pkt;
+	struct jit_node_s node;
+	uint32_t now = 0xFFFF0000, wait;	/* about to wrap */
+
+	jit_queue_init(&q);
+	CHECK(jit_peek(&q, now, &wait) == JIT_ERROR_EMPTY);
+
+	/* RX2 in 2 s: held until JIT_LEAD_US before it */
+	pkt = frame(TIMESTAMPED, now + 2000000);
+	CHECK(jit_enqueue(&q, now, &pkt, 1) == JIT_ERROR_OK);
+	CHECK((jit_peek(&q, now, &wait) == JIT_ERROR_TOO_EARLY) && (wait == 2000000 - JIT_LEAD_US));
+	CHECK(jit_peek(&q, now + 2000000 - JIT_LEAD_US, &wait) == JIT_ERROR_OK);
+
+	/* less lead than JIT_LEAD_US, and past its tmst: taken, due now, ahead of the RX2 one */
+	pkt = frame(TIMESTAMPED, now + 50000);
+	CHECK(jit_enqueue(&q, now, &pkt, 2) == JIT_ERROR_OK);
+	pkt = frame(TIMESTAMPED, now - 3000000);
+	CHECK(jit_enqueue(&q, now, &pkt, 3) == JIT_ERROR_OK);
+	CHECK((jit_peek(&q, now, &wait) == JIT_ERROR_OK) && (wait == 0));
+	CHECK((jit_dequeue(&q, &node) == JIT_ERROR_OK) && (node.tag == 3) && (node.emit_us == now));
+	CHECK((jit_dequeue(&q, &node) == JIT_ERROR_OK) && (node.tag == 2));
+
+	/* a late frame is due long after: never dropped */
+	CHECK(jit_peek(&q, now + 5000000, &wait) == JIT_ERROR_OK);
+	CHECK((jit_dequeue(&q, &node) == JIT_ERROR_OK) && (node.tag == 1));
+	CHECK(jit_queue_is_empty(&q));
+
+	/* timed frames still keep their air times apart, late ones go as soon as possible */
+	pkt = frame(TIMESTAMPED, now + 1000000);
+	CHECK(jit_enqueue(&q, now, &pkt, 4) == JIT_ERROR_OK);
+	pkt = frame(TIMESTAMPED, now + 1000000 + jit_time_on_air(&pkt) / 2);
+	CHECK(jit_enqueue(&q, now, &pkt, 5) == JIT_ERROR_COLLISION);
+	pkt = frame(TIMESTAMPED, now + 1000000);
+	CHECK(jit_enqueue(&q, now + 1500000, &pkt, 6) == JIT_ERROR_OK);
+	pkt = frame(IMMEDIATE, 0);
+	CHECK(jit_enqueue(&q, now, &pkt, 7) == JIT_ERROR_OK);
+
+	/* too far ahead, and full */
+	pkt = frame(TIMESTAMPED, now + JIT_MAX_ADVANCE_US + 1);
+	CHECK(jit_enqueue(&q, now, &pkt, 8) == JIT_ERROR_TOO_EARLY);
+	jit_queue_init(&q);
+	while (q.num_pkt < JIT_QUEUE_MAX) {
+		pkt = frame(IMMEDIATE, 0);
+		CHECK(jit_enqueue(&q, now, &pkt, 9) == JIT_ERROR_OK);
+	}
+	CHECK(jit_enqueue(&q, now, &pkt, 10) == JIT_ERROR_FULL);
+
+	return TEST_END("test_jitqueue");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,133 @@
+/*
+ * test_parson_arena.c
+ *
+ * Arena parsing of parson: the trees match the heap ones, no heap call is
+ * made, and resetting the arena for every packet reuses the same memory.
+ */
+
+#define TEST_COUNT_ALLOC
+
+#include <stdint.h>
+#include <string.h>
+
+#include "parson.h"
+#include "test.h"
+
+static const char *docs[] = {
+	"{\"txpk\":{\"imme\":false,\"tmst\":3512348611,\"freq\":868.1,\"rfch\":0,\"powe\":14,"
+		"\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":4,\"data\":\"AQIDBA==\"}}",
+	"{\"txpk\":{\"imme\":true,\"freq\":869.525,\"rfch\":0,\"powe\":27,\"modu\":\"LORA\",\"datr\":\"SF12BW125\","
+		"\"codr\":\"4/6\",\"ipol\":true,\"size\":1,\"data\":\"/w==\"}} /* comment */",
+	"{\"a\":[1,2.5,-3e2,true,false,null,\"s\",[],{}],\"b\":{\"c\":{\"d\":[[[\"deep\"]]]}},"
+		"\"esc\":\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0041\",\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9}",
+	"[]",
+	"[{\"a\":[]},\"s\",1]",
+};
+
+static int same_value(const JSON_Value *a, const JSON_Value *b) {
+	const JSON_Object *oa, *ob;
+	const JSON_Array *aa, *ab;
+	size_t i;
+
+	if (json_value_get_type(a) != json_value_get_type(b))
+		return 0;
+	switch (json_value_get_type(a)) {
+		case JSONString:
+			return !strcmp(json_value_get_string(a), json_value_get_string(b));
+		case JSONNumber:
+			return json_value_get_number(a) == json_value_get_number(b);
+		case JSONBoolean:
+			return json_value_get_boolean(a) == json_value_get_boolean(b);
+		case JSONObject:
+			oa = json_value_get_object(a);
+			ob = json_value_get_object(b);
+			if (json_object_get_count(oa) != json_object_get_count(ob))
+				return 0;
+			for (i = 0; i < json_object_get_count(oa); i++) {
+				if (!same_value(json_object_get_value(oa, json_object_get_name(oa, i)),
+				                json_object_get_value(ob, json_object_get_name(oa, i))))
+					return 0;
+			}
+			return 1;
+		case JSONArray:
+			aa = json_value_get_array(a);
+			ab = json_value_get_array(b);
+			if (json_array_get_count(aa) != json_array_get_count(ab))
+				return 0;
+			for (i = 0; i < json_array_get_count(aa); i++) {
+				if (!same_value(json_array_get_value(aa, i), json_array_get_value(ab, i)))
+					return 0;
+			}
+			return 1;
+		default:
+			return 1;
+	}
+}
+
+int main(void) {
+	static double buf1[2048], buf2[2048];	/* 16 KB each, like JSON_ARENA_SIZE */
+	static char small[64];
+	JSON_Arena arena1, arena2, tiny;
+	JSON_Value *val, *kept, *heap[sizeof docs / sizeof docs[0]];
+	size_t used[sizeof docs / sizeof docs[0]];
+	long calls;
+	unsigned i, n = sizeof docs / sizeof docs[0];
+
+	for (i = 0; i < n; i++) {
+		heap[i] = json_parse_string_with_comments(docs[i]);
+		CHECK(heap[i] != NULL);
+	}
+
+	/* one arena reused for a stream of packets, as by down_receive */
+	json_arena_init(&arena1, buf1, sizeof buf1);
+	calls = alloc_calls;
+	for (i = 0; i < 10000; i++) {
+		json_arena_reset(&arena1);
+		val = json_parse_string_with_comments_arena(&arena1, docs[i % n]);
+		CHECK(val != NULL);
+		CHECK(same_value(val, heap[i % n]));
+		if (i < n)
+			used[i] = arena1.used;
+		else
+			CHECK(arena1.used == used[i % n]);	/* nothing accumulates across packets */
+		CHECK(((uintptr_t)val % sizeof(double)) == 0);
+	}
+	CHECK(alloc_calls == calls);
+
+	/* a tree lives until its own arena is reset, whatever the other arenas do */
+	json_arena_init(&arena2, (char *)buf2 + 1, sizeof buf2 - 1);	/* misaligned on purpose */
+	json_arena_reset(&arena1);
+	kept = json_parse_string_arena(&arena1, docs[2]);
+	for (i = 0; i < 100; i++) {
+		json_arena_reset(&arena2);
+		val = json_parse_string_arena(&arena2, docs[i % 2]);
+		CHECK(val != NULL);
+		CHECK(((uintptr_t)val % sizeof(double)) == 0);
+	}
+	CHECK(same_value(kept, heap[2]));
+
+	/* too small or invalid: NULL without heap calls, the arena stays usable */
+	json_arena_init(&tiny, small, sizeof small);
+	calls = alloc_calls;
+	CHECK(json_parse_string_arena(&tiny, docs[0]) == NULL);
+	json_arena_reset(&arena1);
+	CHECK(json_parse_string_arena(&arena1, "{\"txpk\":{\"size\":2,") == NULL);
+	CHECK(json_parse_string_arena(&arena1, "{\"a\":1,\"a\":2}") == NULL);
+	CHECK(alloc_calls == calls);
+	json_arena_reset(&arena1);
+	val = json_parse_string_with_comments_arena(&arena1, docs[0]);
+	CHECK((val != NULL) && same_value(val, heap[0]) && (arena1.used == used[0]));
+
+	/* the heap parser is back once an arena parse is over */
+	for (i = 0; i < n; i++)
+		json_value_free(heap[i]);
+	CHECK(alloc_live == 0);
+	val = json_parse_string(docs[2]);
+	CHECK((val != NULL) && (alloc_calls > calls));
+	json_value_free(val);
+	CHECK(alloc_live == 0);
+
+	return TEST_END("test_parson_arena");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,110 @@
+/*
+ * test_parson_hash.c
+ *
+ * Name lookup of parson objects below and above OBJECT_HASH_THRESHOLD:
+ * growth up to OBJECT_MAX_CAPACITY, duplicate names, and the objects
+ * going away on free and on parse errors.
+ */
+
+#define TEST_COUNT_ALLOC
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parson.h"
+#include "test.h"
+
+#define MAX_NAMES	15360	/* OBJECT_MAX_CAPACITY */
+
+static char doc[MAX_NAMES * 24 + 64];
+
+/* {"k0":0,"k1":1,...} with n names, dup repeats the name of index dup at the end */
+static const char * make_doc(int n, int dup) {
+	int i, len;
+
+	len = sprintf(doc, "{");
+	for (i = 0; i < n; i++)
+		len += sprintf(doc + len, "%s\"k%d\":%d", i ? "," : "", i, i);
+	if (dup >= 0)
+		len += sprintf(doc + len, ",\"k%d\":-1", dup);
+	sprintf(doc + len, "}");
+	return doc;
+}
+
+static void check_object(const JSON_Object *obj, int n) {
+	char name[16];
+	int i;
+
+	CHECK((int)json_object_get_count(obj) == n);
+	for (i = 0; i < n; i++) {
+		sprintf(name, "k%d", i);
+		CHECK(json_object_get_number(obj, name) == i);
+		CHECK(!strcmp(json_object_get_name(obj, i), name));
+	}
+	for (i = n; i < n + 50; i++) {
+		sprintf(name, "k%d", i);
+		CHECK(json_object_get_value(obj, name) == NULL);
+	}
+	CHECK(json_object_get_value(obj, "k") == NULL);
+	CHECK(json_object_get_value(obj, "") == NULL);
+	CHECK(json_object_get_value(obj, "K0") == NULL);
+}
+
+int main(void) {
+	static const int sizes[] = { 1, 7, 8, 9, 15, 16, 17, 100, 1000, MAX_NAMES };
+	static double buf[MAX_NAMES * 16];
+	JSON_Arena arena;
+	JSON_Value *val;
+	JSON_Object *obj;
+	unsigned i;
+
+	/* growth, across the threshold and every capacity doubling, on the heap and in an arena */
+	json_arena_init(&arena, buf, sizeof buf);
+	for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		val = json_parse_string(make_doc(sizes[i], -1));
+		CHECK(val != NULL);
+		check_object(json_value_get_object(val), sizes[i]);
+		json_value_free(val);
+		CHECK(alloc_live == 0);
+
+		json_arena_reset(&arena);
+		val = json_parse_string_arena(&arena, make_doc(sizes[i], -1));
+		CHECK(val != NULL);
+		check_object(json_value_get_object(val), sizes[i]);
+	}
+	CHECK(json_parse_string(make_doc(MAX_NAMES + 1, -1)) == NULL);
+	CHECK(alloc_live == 0);
+
+	/* duplicate names fail the parse, before and after the index exists */
+	CHECK(json_parse_string(make_doc(3, 1)) == NULL);
+	CHECK(json_parse_string(make_doc(8, 0)) == NULL);
+	CHECK(json_parse_string(make_doc(9, 8)) == NULL);
+	CHECK(json_parse_string(make_doc(500, 250)) == NULL);
+	CHECK(json_parse_string(make_doc(MAX_NAMES - 1, MAX_NAMES - 2)) == NULL);
+	CHECK(alloc_live == 0);
+
+	/* names that share a prefix, the empty name, and dotget through indexed objects */
+	val = json_parse_string("{\"a\":1,\"aa\":2,\"aaa\":3,\"\":4,\"a.b\":5,\"ab\":6,\"ba\":7,\"b\":8,"
+	                        "\"o\":{\"x1\":1,\"x2\":2,\"x3\":3,\"x4\":4,\"x5\":5,\"x6\":6,\"x7\":7,\"x8\":8,\"x9\":{\"y\":9}}}");
+	CHECK(val != NULL);
+	obj = json_value_get_object(val);
+	CHECK(json_object_get_number(obj, "a") == 1);
+	CHECK(json_object_get_number(obj, "aa") == 2);
+	CHECK(json_object_get_number(obj, "aaa") == 3);
+	CHECK(json_object_get_number(obj, "") == 4);
+	CHECK(json_object_get_number(obj, "a.b") == 5);
+	CHECK(json_object_get_number(obj, "ab") == 6);
+	CHECK(json_object_get_number(obj, "b") == 8);
+	CHECK(json_object_get_value(obj, "aaaa") == NULL);
+	CHECK(json_object_dotget_number(obj, "o.x8") == 8);
+	CHECK(json_object_dotget_number(obj, "o.x9.y") == 9);
+	CHECK(json_object_dotget_value(obj, "o.x") == NULL);
+	CHECK(json_object_dotget_value(obj, "o.x10") == NULL);
+	json_value_free(val);
+	CHECK(alloc_live == 0);
+
+	return TEST_END("test_parson_hash");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
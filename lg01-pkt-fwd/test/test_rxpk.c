@@ -0,0 +1,134 @@
+/*
+ * test_rxpk.c
+ *
+ * rxpk_serialize() byte for byte against the snprintf() serializer it
+ * replaces, on every SF, bandwidth, coding rate and status, the SNR in
+ * tenths of dB as the MCU reports it, and the edges of each field. The
+ * former one refused 253 and 254 byte payloads (no room left for the base64
+ * padding), for those the data is checked to decode back to the payload.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "base64.h"
+#include "rxpk.h"
+#include "rxpk_old.h"
+#include "test.h"
+
+static struct rxpk_fmt_s fmt;
+static int nb_cmp, nb_old_refused;
+
+static void compare(const struct lgw_pkt_rx_s *pkt, time_t sec, long nsec) {
+	struct timespec t = { sec, nsec };
+	char new_out[700], old_out[700];
+	uint8_t bin[256];
+	char *data;
+	int n, o;
+
+	n = rxpk_serialize(&fmt, pkt, &t, new_out, sizeof new_out);
+	o = old_serialize_rxpk(pkt, &t, old_out, sizeof old_out);
+	nb_cmp++;
+	if ((o < 0) && (n > 0)) {
+		nb_old_refused++;
+		new_out[n] = '\0';
+		data = strstr(new_out, ",\"data\":\"");
+		CHECK((pkt->size == 253) || (pkt->size == 254));
+		CHECK((data != NULL) && !strcmp(new_out + n - 2, "\"}"));
+		if (data != NULL) {
+			data += 9;
+			CHECK(b64_to_bin(data, new_out + n - 2 - data, bin, sizeof bin) == pkt->size);
+			CHECK(!memcmp(bin, pkt->payload, pkt->size));
+		}
+		return;
+	}
+	if ((n != o) || (n < 0) || memcmp(new_out, old_out, n)) {
+		CHECK(!"same output");
+		fprintf(stderr, "  new %.*s\n  old %.*s\n", n, new_out, o, old_out);
+	}
+}
+
+int main(void) {
+	static const uint32_t sf[] = { DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12 };
+	static const uint8_t stat[] = { STAT_CRC_OK, STAT_CRC_BAD, STAT_NO_CRC, STAT_UNDEFINED };
+	static const uint32_t u32_edges[] = { 0, 1, 9, 10, 999999, 1000000, 868100000, 2147483647, 4294967295U };
+	static const float rssi[] = { 0, -1, -9, -10, -99, -100, -137, -0.5f, -137.9f, 5, 32767, -32768 };
+	static const long nsec[] = { 0, 999, 1000, 1999, 500000000, 999999999 };
+	static const time_t secs[] = { 0, 59, 86399, 951782400 /* 2000-02-29 */, 1767225599, 4102444800LL, 253402300799LL };
+	struct lgw_pkt_rx_s pkt;
+	char out[700];
+	unsigned i, j, k;
+	int n;
+
+	rxpk_fmt_init(&fmt);
+	memset(&pkt, 0, sizeof pkt);
+	srand(1);
+	for (i = 0; i < sizeof pkt.payload; i++)
+		pkt.payload[i] = rand();
+	pkt.freq_hz = 868100000;
+	pkt.count_us = 3512348611U;
+	pkt.rssi = -57;
+	pkt.snr = 7.8f;
+	pkt.size = 23;
+
+	/* every datr and codr, every status */
+	for (i = 0; i < 6; i++)
+		for (j = 0; j <= BW_7K8HZ; j++)
+			for (k = CR_LORA_4_5; k <= CR_LORA_4_8; k++) {
+				pkt.datarate = sf[i];
+				pkt.bandwidth = j;
+				pkt.coderate = k;
+				pkt.status = stat[(i + j + k) % 4];
+				compare(&pkt, 1767225600, 123456000);
+			}
+	pkt.datarate = DR_LORA_SF9;
+	pkt.bandwidth = BW_125KHZ;
+	pkt.coderate = CR_LORA_4_5;
+	pkt.status = STAT_CRC_OK;
+
+	/* SNR in tenths of dB, -20.0 to +20.0, across zero */
+	for (n = -200; n <= 200; n++) {
+		pkt.snr = n / 10.0f;
+		compare(&pkt, 1767225600, 0);
+	}
+	pkt.snr = -7.5f;
+
+	/* edges of tmst, freq, rssi and size */
+	for (i = 0; i < sizeof u32_edges / sizeof u32_edges[0]; i++) {
+		pkt.count_us = u32_edges[i];
+		pkt.freq_hz = u32_edges[i];
+		compare(&pkt, 1767225600, 0);
+	}
+	pkt.freq_hz = 868100000;
+	for (i = 0; i < sizeof rssi / sizeof rssi[0]; i++) {
+		pkt.rssi = rssi[i];
+		compare(&pkt, 1767225600, 0);
+	}
+	for (i = 0; i <= 255; i++) {
+		pkt.size = i;
+		compare(&pkt, 1767225600, 0);
+	}
+
+	/* time: the cached second, a new one, going back, the edges of each field */
+	for (i = 0; i < sizeof secs / sizeof secs[0]; i++)
+		for (j = 0; j < sizeof nsec / sizeof nsec[0]; j++)
+			compare(&pkt, secs[i], nsec[j]);
+	compare(&pkt, 1767225600, 0);
+	compare(&pkt, 1767225600, 999999999);
+	compare(&pkt, 1767225601, 0);
+	compare(&pkt, 1767225599, 0);
+
+	/* too small a buffer is refused, not overrun */
+	{
+		struct timespec t = { 1767225600, 0 };
+		CHECK(rxpk_serialize(&fmt, &pkt, &t, out, RXPK_META_MAX) == -1);
+	}
+
+	CHECK(nb_old_refused == 2);
+	printf("test_rxpk: %d packets compared, %d the former serializer refused\n", nb_cmp, nb_old_refused);
+	return TEST_END("test_rxpk");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
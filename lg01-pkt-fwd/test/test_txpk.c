@@ -0,0 +1,107 @@
+/*
+ * test_txpk.c
+ *
+ * txpk_parse() against the parson path of main.c on well-formed PULL_RESP
+ * documents, and rejection of the malformed ones.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "base64.h"
+#include "parson.h"
+#include "txpk.h"
+#include "test.h"
+
+static const char *good[] = {
+	"{\"txpk\":{\"imme\":false,\"tmst\":3512348611,\"freq\":868.1,\"rfch\":0,\"powe\":14,"
+		"\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":4,\"data\":\"AQIDBA==\"}}",
+	"{ \"txpk\" : { \"imme\" : true , \"freq\" : 869.525 , \"rfch\" : 0 , \"powe\" : 27 , \"modu\" : \"LORA\" ,"
+		" \"datr\" : \"SF12BW125\" , \"codr\" : \"4/6\" , \"ipol\" : true , \"size\" : 1 , \"data\" : \"/w==\" } }\n",
+	"{\"txpk\":{\"tmst\":1,\"freq\":868.3,\"powe\":14,\"modu\":\"FSK\",\"datr\":50000,\"fdev\":3000,"
+		"\"prea\":5,\"ncrc\":true,\"size\":3,\"data\":\"AAEC\"}}",
+	/* members the scanner skips, before and after txpk */
+	"{\"v\":[1,{\"a\":\"}\"}],\"txpk\":{\"x\":{\"y\":[]},\"size\":2,\"data\":\"AQI=\",\"brd\":0},\"z\":null}",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"},\"x\":1,\"y\":\"s\"}",
+};
+
+static const char *bad[] = {
+	"",
+	"{",
+	"[]",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"}",					/* no root close */
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"},\"x\":",				/* root member without value */
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"},\"x\": ]]]",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"},\"x\":1",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"},\"x\"}",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"},}",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"}}}",					/* one close too many */
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"}} garbage",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\"} \"x\":1}",
+	"{\"txpk\":{\"data\":\"AQI=\"}}",								/* no size */
+	"{\"txpk\":{\"size\":2}}",										/* no data */
+	"{\"size\":2,\"data\":\"AQI=\"}",								/* not in txpk */
+	"{\"txpk\":{\"size\":2,\"data\":\"AQ!=\"}}",					/* bad base64 */
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\",\"modu\":\"L\\u004fRA\"}}",	/* escapes go to parson */
+	"{\"txpk\":{\"size\":,\"data\":\"AQI=\"}}",
+	"{\"txpk\":{\"size\":2,\"data\":\"AQI=\",\"datr\":\"SF6BW125\"}}",
+};
+
+/* the fallback path of main.c */
+static int parse_parson(const char *json, struct lgw_pkt_tx_s *pkt) {
+	JSON_Value *root_val;
+	JSON_Object *txpk_obj;
+	const char *str;
+	int len;
+
+	memset(pkt, 0, sizeof *pkt);
+	root_val = json_parse_string_with_comments(json);
+	if (root_val == NULL)
+		return -1;
+	txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
+	str = json_object_get_string(txpk_obj, "data");
+	if ((txpk_obj == NULL) || (json_object_get_value(txpk_obj, "size") == NULL) || (str == NULL)) {
+		json_value_free(root_val);
+		return -1;
+	}
+	pkt->size = (uint16_t)json_object_get_number(txpk_obj, "size");
+	len = b64_to_bin(str, strlen(str), pkt->payload, sizeof pkt->payload);
+	txpk_parse_json(txpk_obj, pkt);
+	json_value_free(root_val);
+	return len;
+}
+
+int main(void) {
+	struct lgw_pkt_tx_s a, b;
+	unsigned i;
+	int len;
+
+	for (i = 0; i < sizeof good / sizeof good[0]; i++) {
+		len = txpk_parse(good[i], &a);
+		CHECK(len > 0);
+		CHECK(len == a.size);
+		CHECK(parse_parson(good[i], &b) == len);
+		CHECK(!memcmp(&a, &b, sizeof a));
+	}
+
+	len = txpk_parse(good[0], &a);
+	CHECK((len == 4) && !memcmp(a.payload, "\1\2\3\4", 4));
+	CHECK(a.tx_mode == TIMESTAMPED);
+	CHECK(a.count_us == 3512348611u);
+	CHECK(a.freq_hz == 868100000);
+	CHECK(a.rf_power == 14);
+	CHECK((a.modulation == MOD_LORA) && (a.datarate == DR_LORA_SF7) && (a.bandwidth == BW_125KHZ));
+	CHECK((a.coderate == CR_LORA_4_5) && a.invert_pol);
+
+	for (i = 0; i < sizeof bad / sizeof bad[0]; i++) {
+		if (txpk_parse(bad[i], &a) >= 0) {
+			fprintf(stderr, "accepted: %s\n", bad[i]);
+			test_fail++;
+		}
+	}
+
+	return TEST_END("test_txpk");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
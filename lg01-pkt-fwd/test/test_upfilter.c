@@ -0,0 +1,75 @@
+/*
+ * test_upfilter.c
+ *
+ * Rule lists of the UCI snapshot: a list longer than any fixed buffer is
+ * read whole, a rule is never cut into another valid one.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uci.h"
+#include "conf.h"
+#include "upfilter.h"
+#include "test.h"
+
+/* unconfirmed data up frame of DevAddr addr */
+static bool check_devaddr(struct upfilter_s *uf, uint32_t addr) {
+	uint8_t frame[12] = {0x40};
+
+	frame[1] = addr & 0xff;
+	frame[2] = (addr >> 8) & 0xff;
+	frame[3] = (addr >> 16) & 0xff;
+	frame[4] = addr >> 24;
+	return upfilter_check(uf, frame, sizeof frame);
+}
+
+int main(void) {
+	static struct conf_s conf;
+	static struct upfilter_s uf;
+	char list[600], bad[32];
+	const char *values[4];
+	int i, len;
+
+	/* 40 DevAddr, the last one "26011234" far past the first 64 characters */
+	for (len = 0, i = 0; i < 39; i++)
+		len += sprintf(list + len, "%08X ", 0x26020000 + 2 * i);
+	len += sprintf(list + len, "26011234");
+	CHECK(len > 300);
+	uci_stub_add("filter", "devaddr_allow", list, 1);
+	CHECK(conf_load(&conf, "lorawan") == 1);
+	CHECK(conf_get_list(&conf, "filter", "devaddr_allow", values, 4) == 1);
+	CHECK(!strcmp(values[0], list));
+
+	upfilter_init(&uf);
+	CHECK(upfilter_add_list(&uf, UPFILTER_DEVADDR, false, values[0], bad, sizeof bad) == 0);
+	upfilter_finish(&uf);
+	CHECK(uf.set[UPFILTER_DEVADDR_ALLOW].nb == 40);
+	CHECK(check_devaddr(&uf, 0x26011234));
+	CHECK(check_devaddr(&uf, 0x26020000) && check_devaddr(&uf, 0x2602004C));
+	CHECK(!check_devaddr(&uf, 0x00002601));
+	CHECK(!check_devaddr(&uf, 0x26020001));
+
+	/* commas, runs of separators, and the refused rules counted */
+	upfilter_init(&uf);
+	CHECK(upfilter_add_list(&uf, UPFILTER_DEVADDR, true, " ,26011234,, 2601zz  26000000/7,", bad, sizeof bad) == 1);
+	CHECK(!strcmp(bad, "2601zz"));
+	upfilter_finish(&uf);
+	CHECK(uf.set[UPFILTER_DEVADDR_DENY].nb == 1);
+	CHECK(!check_devaddr(&uf, 0x26011234) && check_devaddr(&uf, 0x24000000));
+
+	/* a rule too long for any key is refused whole, not read from its start */
+	upfilter_init(&uf);
+	memset(list, '2', 100);
+	strcpy(list + 100, " 26011234");
+	CHECK(upfilter_add_list(&uf, UPFILTER_DEVADDR, false, list, bad, 8) == 1);
+	CHECK(!strcmp(bad, "2222222"));
+	CHECK(uf.set[UPFILTER_DEVADDR_ALLOW].nb == 1);
+	CHECK(upfilter_add_list(&uf, UPFILTER_DEVADDR, false, "", bad, sizeof bad) == 0);
+	uci_stub_reset();
+
+	return TEST_END("test_upfilter");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,49 @@
+/*
+ * uci.h
+ *
+ * The part of the libuci API conf.c uses, for the host tests: same names
+ * and same layout of the elements. The package is described by the test
+ * with uci_stub_add() instead of being read from a file, see uci_stub.c.
+ */
+
+#ifndef _UCI_STUB_H
+#define _UCI_STUB_H
+
+#include <stddef.h>		/* offsetof */
+
+#define UCI_OK			0
+#define UCI_ERR_NOTFOUND	3
+
+enum uci_option_type { UCI_TYPE_STRING = 0, UCI_TYPE_LIST = 1 };
+
+struct uci_list { struct uci_list *next, *prev; };
+struct uci_element { struct uci_list list; int type; char *name; };
+struct uci_context { int unused; };
+struct uci_package { struct uci_element e; struct uci_list sections; };
+struct uci_section { struct uci_element e; struct uci_list options; };
+struct uci_option {
+	struct uci_element e;
+	enum uci_option_type type;
+	union { struct uci_list list; char *string; } v;
+};
+
+#define uci_list_to_element(ptr)	((struct uci_element *)((char *)(ptr) - offsetof(struct uci_element, list)))
+#define uci_foreach_element(_list, _ptr) \
+	for (_ptr = uci_list_to_element((_list)->next); &_ptr->list != (_list); _ptr = uci_list_to_element(_ptr->list.next))
+#define uci_to_section(ptr)	((struct uci_section *)(ptr))
+#define uci_to_option(ptr)	((struct uci_option *)(ptr))
+
+struct uci_context * uci_alloc_context(void);
+void uci_free_context(struct uci_context *ctx);
+int uci_load(struct uci_context *ctx, const char *name, struct uci_package **package);
+int uci_unload(struct uci_context *ctx, struct uci_package *p);
+
+/* describe the package uci_load returns: options in order, list items of
+   the same option are grouped; uci_stub_reset() empties it, uci_load fails
+   until uci_stub_add() is called */
+void uci_stub_reset(void);
+void uci_stub_add(const char *section, const char *name, const char *value, int list);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,115 @@
+/*
+ * uci_stub.c
+ *
+ * In-memory package for the host tests, see uci/uci.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "uci.h"
+
+#define STUB_MAX	512
+
+static struct {
+	char	*section, *name, *value;
+	int		list;
+} stub[STUB_MAX];
+static int nb_stub = 0;
+static int loaded = 0;
+
+static struct uci_context stub_ctx;
+static struct uci_package pkg;
+static struct uci_section sec[STUB_MAX];
+static struct uci_option opt[STUB_MAX];
+static struct uci_element item[STUB_MAX];
+
+static void list_init(struct uci_list *l) {
+	l->next = l->prev = l;
+}
+
+static void list_add(struct uci_list *head, struct uci_list *l) {
+	l->prev = head->prev;
+	l->next = head;
+	head->prev->next = l;
+	head->prev = l;
+}
+
+void uci_stub_reset(void) {
+	int i;
+
+	for (i = 0; i < nb_stub; i++) {
+		free(stub[i].section);
+		free(stub[i].name);
+		free(stub[i].value);
+	}
+	nb_stub = 0;
+	loaded = 0;
+}
+
+void uci_stub_add(const char *section, const char *name, const char *value, int list) {
+	if (nb_stub == STUB_MAX)
+		abort();
+	stub[nb_stub].section = strdup(section);
+	stub[nb_stub].name = strdup(name);
+	stub[nb_stub].value = strdup(value);
+	stub[nb_stub].list = list;
+	nb_stub++;
+	loaded = 1;
+}
+
+struct uci_context * uci_alloc_context(void) {
+	return &stub_ctx;
+}
+
+void uci_free_context(struct uci_context *ctx) {
+	(void)ctx;
+}
+
+int uci_load(struct uci_context *ctx, const char *name, struct uci_package **package) {
+	int i, j, k, nb_sec = 0;
+
+	(void)ctx;
+	(void)name;
+	if (!loaded)
+		return UCI_ERR_NOTFOUND;
+	list_init(&pkg.sections);
+	for (i = 0; i < nb_stub; i++) {
+		for (j = 0; (j < nb_sec) && strcmp(sec[j].e.name, stub[i].section); j++)
+			;
+		if (j == nb_sec) {
+			sec[j].e.name = stub[i].section;
+			list_init(&sec[j].options);
+			list_add(&pkg.sections, &sec[j].e.list);
+			nb_sec++;
+		}
+		/* the items of a list go to the option of its first item */
+		for (k = 0; k < i; k++) {
+			if (stub[i].list && stub[k].list && !strcmp(stub[k].section, stub[i].section) && !strcmp(stub[k].name, stub[i].name))
+				break;
+		}
+		if (k == i) {
+			opt[i].e.name = stub[i].name;
+			opt[i].type = stub[i].list ? UCI_TYPE_LIST : UCI_TYPE_STRING;
+			if (stub[i].list)
+				list_init(&opt[i].v.list);
+			else
+				opt[i].v.string = stub[i].value;
+			list_add(&sec[j].options, &opt[i].e.list);
+		}
+		if (stub[i].list) {
+			item[i].name = stub[i].value;
+			list_add(&opt[k].v.list, &item[i].list);
+		}
+	}
+	*package = &pkg;
+	return UCI_OK;
+}
+
+int uci_unload(struct uci_context *ctx, struct uci_package *p) {
+	(void)ctx;
+	(void)p;
+	return UCI_OK;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
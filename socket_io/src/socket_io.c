@@ -14,6 +14,8 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/timerfd.h>
 
 #include <sys/ioctl.h>
 #include <net/if.h>
@@ -30,10 +32,10 @@
 #define STR_MAX		100		/* Maximum string length */
 #define MSG_MAX     500     /* Maximum UDP message length */
 #define UDP_ARGS_MAX 20		/* we can have that much arguments ('/' separated) on the UDP datagram */ 
-#define SIODS_MAX 100     	/* we may have that many SIOD devices in the mesh */ 
+#define SIODS_INIT 64     	/* initial slots of the GST and IPT, they grow with the mesh */ 
 #define SECSINDAY (24*60*60) /* That many seconds in a day */
 #define DAYSINWEEK (7) 		/* That many days in a week*/ 
-#define RULES_MAX	10		/* We may have not more than that many rules in the PLC table */
+#define SIOD_UCI_PKGS_MAX	8		/* uci packages we keep loaded */
 
 #define REL0	16			/* GPIOs controlling the outputs */
 #define REL1    1			/* The relay address is [REL0 REL1]  so REL1 is LSB */
@@ -51,27 +53,68 @@
 #define IN3     24
 
 #define IVRSETTIMEOUT 10    /* We have 1 sec to get Put message after IVRSet message */
+#define PULSE_US	100000L	/* Width of the pulse latching a relay, in us */
 
 struct GST_nod {
     int siod_id;                /* ID of the SIOD */
     unsigned char gpios;        /* the gpio byte for the siod_id. Check GPIOs variable */
 };
-struct GST_nod GST[SIODS_MAX];  /* Keeps the status of all IOs of including the local one at the first location 
-								   the list is terminated by a zero siod_id member */
+
+/* Tables keyed by siod_id, their entries start with the int siod_id.
+ * Open addressing with linear probing, a zero siod_id marks a free slot */
+struct SIOD_tab {
+	int n;						/* entries used */
+	int size;					/* slots allocated, a power of 2 */
+	int nod_size;				/* size of an entry */
+	char *slots;
+};
+#define SIODnod(tab, i) ((void *)((tab)->slots + (i)*(tab)->nod_size))
+#define SIODkey(tab, i) (*(int *)SIODnod(tab, i))
+
+struct GST_tab {
+	struct SIOD_tab tab;
+	unsigned char sum;			/* checksum of the GST data, kept up to date on every change */
+};
+struct GST_tab GST = {{0, 0, sizeof(struct GST_nod), NULL}, 0};
+								/* Keeps the status of all IOs of all SIODs including the local one */
 
 
 struct IPT_nod {
     int siod_id;                /* ID of the SIOD */
     unsigned long IPaddress;    /* IP address we can use to send message to this SIOD */
 };
-struct IPT_nod IPT[SIODS_MAX];  /* Keeps the IP addresses of all SIODs which have ever sent some data to us. 
-								   The local IP address is not included in this table. 
-								   The list is terminated by a zero siod_id member */
+struct SIOD_tab IPT = {0, 0, sizeof(struct IPT_nod), NULL};
+								/* Keeps the IP addresses of all SIODs which have ever sent some data to us. 
+								   The local IP address is not included in this table. */
+
+struct PLC_rule {
+	char *text;					/* The rule as it was added, for PLCprint and the config */
+	unsigned short siod1;		/* SIOD and output to update when the rule triggers */
+	unsigned char x1, y1;
+	unsigned short siod2;		/* The two IOs checked and their triggering states */
+	unsigned char x2, y2;
+	unsigned short siod3;
+	unsigned char x3, y3;
+	unsigned char and;			/* 1 for 'and', 0 for 'or' */
+	unsigned char triggered;	/* Notifies if rule has triggered */
+	unsigned char queued;		/* Waits in PLCT.queue for evaluation */
+};
+
+struct PLC_dep {
+	unsigned short siod_id;		/* SIOD checked by the rule */
+	unsigned char mask;			/* its IOs the rule depends on */
+	int rule;					/* index in PLCT.rules */
+};
 
 struct {
 	int	n;						/* amount of active rules */
-	char *rules[RULES_MAX];		/* Keep the rules in string form */
-	int triggered[RULES_MAX];	/* Notifies if rule has triggered */
+	int max;					/* amount of rules allocated, the table doubles when full */
+	struct PLC_rule *rules;		/* Keep the rules compiled */
+	int n_deps;
+	struct PLC_dep *deps;		/* Which rules depend on which IOs, sorted by siod_id */
+	int stale;					/* deps must be rebuilt as the rules changed */
+	int n_queue;
+	int *queue;					/* Rules to be evaluated as their IOs changed in the GST */
 } PLCT;
 
 
@@ -92,6 +135,7 @@ int uciset(const char *param, const char *value);
 int ucidelete(const char *param);
 int uciadd_list(const char *param, const char *value);
 void ucicommit(void);
+int uciforeach(const char *param, int (*fn)(const char *item));
 void restartnet(void);
 void uptime(char *uptime);
 int getsoftwarever(char *ver);
@@ -100,24 +144,29 @@ int unicast(char *msg);
 int gpios_init(void);
 int setgpio(char *X, char *Y);
 int getgpio(char *X, char *Y);
+int gpio_events(fd_set *eset, const struct timespec *t0);
+void relay_request(int x, char y);
+void relay_next(void);
+void relay_done(void);
 void intHandler(int dummy);
-unsigned char GSTchecksum(struct GST_nod *gst);
-int GSTadd(struct GST_nod *gst, unsigned short siod_id, unsigned char gpios);
-void GSTdel(struct GST_nod *gst, unsigned short siod_id);
-int GSTget(struct GST_nod *gst, unsigned short siod_id, unsigned char *gpios);
-int GSTset(struct GST_nod *gst, unsigned short siod_id, unsigned char gpios);
-void GSTprint(struct GST_nod *gst, char *str);
+unsigned char GSTchecksum(struct GST_tab *gst);
+int GSTadd(struct GST_tab *gst, unsigned short siod_id, unsigned char gpios);
+void GSTdel(struct GST_tab *gst, unsigned short siod_id);
+int GSTget(struct GST_tab *gst, unsigned short siod_id, unsigned char *gpios);
+int GSTset(struct GST_tab *gst, unsigned short siod_id, unsigned char gpios);
+int GSTprint(struct GST_tab *gst, char *str, int max_len, int first);
 void byte2binarystr(int n, char *str);
 unsigned char binarystr2byte(char *str);
-int IPTget(struct IPT_nod *ipt, unsigned short siod_id, unsigned long *IPaddress);
-void IPTset(struct IPT_nod *gst, unsigned short siod_id, unsigned long IPaddress);
+int IPTget(struct SIOD_tab *ipt, unsigned short siod_id, unsigned long *IPaddress);
+void IPTset(struct SIOD_tab *ipt, unsigned short siod_id, unsigned long IPaddress);
 int ParseTimeRange(char *TimeRangeStr);
 int CheckTimeRange(void);
-int PLCadd(char *rule);
+int PLCadd(const char *rule);
 int PLCdel(char *AAAA1, char *X1, char *Y1);
-int PLCdel_config(char *AAAA1, char *X1, char *Y1);
+int PLCwrite_config(void);
 int PLCread_config(void);
-void PLCprint(char *);
+void PLCprint(char *, int);
+void PLCchanged(unsigned short siod_id, unsigned char mask);
 void PLCexec(void);
 void bcast_init(void);
 void restart_asterisk(void);
@@ -164,6 +213,17 @@ struct sockaddr_in bcast_servaddr;
 /* global file descriptors so we don't have to open aand close all the time */
 int fd_in0, fd_in1, fd_in2, fd_in3, fd_fb0, fd_fb1, fd_fb2, fd_fb3, fd_rel0, fd_rel1, fd_s_r, fd_pulse;
 int IOs[OUTPUTS_NUM+INPUTS_NUM];
+int gpio_edge;					/* inputs and feedbacks report their changes through sysfs edge events */
+long gpio_edge_max_us;			/* the longest wakeup on an edge event to Put broadcast time seen */
+
+/* The relays share the REL0, REL1, S_R and PULSE lines so they are latched one at a time */
+struct {
+	int fd;						/* timerfd ending the pulse in progress */
+	int active;					/* output being pulsed, -1 if the lines are free */
+	char value;					/* '0' or '1' the active output is latched to */
+	int next;					/* output the search for a pending request starts from */
+	char pending[OUTPUTS_NUM];	/* '0' or '1' requested and not pulsed yet, 0 if none */
+} RELAYS;
 
 /* Time Range definitions */
 struct {
@@ -174,14 +234,28 @@ struct {
 
 } TIMERANGE;
 
+/* uci context kept open, with the packages loaded in it */
+struct uci_context *siod_uci_ctx;
+struct siod_uci_stamp {
+	struct timespec mtim;		/* modification time, to the nanosecond */
+	off_t size;					/* -1 if the file does not exist */
+};
+struct siod_uci_pkg {
+	char name[STR_MAX];			/* package name, empty for a free entry */
+	struct siod_uci_stamp conf;	/* config and delta files when it was loaded */
+	struct siod_uci_stamp delta;
+	int dirty;					/* changed and not committed yet */
+} siod_uci_pkgs[SIOD_UCI_PKGS_MAX];
+
 
 int main(int argc, char **argv){
 
-	int n, nready; 
-	char datagram[SOCKET_BUFLEN];
-	fd_set rset;
+	int n, nready, maxfd, i; 
+	char datagram[SOCKET_BUFLEN], Y[STR_MAX];
+	fd_set rset, eset;
 	socklen_t addrlen;
 	struct timeval	timeout;
+	struct timespec woken;
 	int res;	
 
 
@@ -230,7 +304,7 @@ int main(int argc, char **argv){
 	gpios_init();
 	
 	/* Insert the local gpios data in GST================================= */
-	GSTadd(GST, atoi(SIOD_ID), GPIOs);
+	GSTadd(&GST, atoi(SIOD_ID), GPIOs);
 	
 	/* Initialize the broadcasting socket  =============================== */
 	bcast_init();
@@ -274,12 +348,27 @@ int main(int argc, char **argv){
 		/* descritors set prepared */ 
         	FD_ZERO(&rset);
         	FD_SET(udpfd, &rset);
+		maxfd = udpfd;
+		if(RELAYS.fd >= 0){
+			FD_SET(RELAYS.fd, &rset);
+			if(RELAYS.fd > maxfd) maxfd = RELAYS.fd;
+		}
+
+		/* sysfs signals the gpio edges as exceptional conditions */
+		FD_ZERO(&eset);
+		if(gpio_edge){
+			for(i=0;i<INPUTS_NUM+OUTPUTS_NUM;i++){
+				FD_SET(IOs[i], &eset);
+				if(IOs[i] > maxfd) maxfd = IOs[i];
+			}
+		}
 
 		/* Set the timeout */
 		timeout.tv_sec  = 0;
 		timeout.tv_usec = TIMEOUT;
 
-		nready = select(udpfd+1, &rset, NULL, NULL, &timeout);
+		nready = select(maxfd+1, &rset, NULL, &eset, &timeout);
+		clock_gettime(CLOCK_MONOTONIC, &woken);		/* edge events are timed from here */
 		if (nready < 0) {
 			fprintf(stderr,"Error or signal\n");
 			if (errno == EINTR)
@@ -289,6 +378,17 @@ int main(int argc, char **argv){
 				exit(-1);
 			}
 		} else if (nready) {
+			/* Local IOs changed, first so that their Put goes out without delay */
+			if(gpio_edge)
+				gpio_events(&eset, &woken);
+
+			/* A relay pulse is over, start the next one */
+			if(RELAYS.fd >= 0 && FD_ISSET(RELAYS.fd, &rset))
+				relay_done();
+
+			if(!FD_ISSET(udpfd, &rset))
+				continue;
+
 			/* We have data to read */
 				
 			addrlen=sizeof(cliaddr);
@@ -310,6 +410,12 @@ int main(int argc, char **argv){
 				datagram[n] = '\0';
 				process_udp(datagram);
 
+				/* Rules depending on the GST changes of the message */
+				PLCexec();
+
+				/* A single commit for all the config changes of the message */
+				ucicommit();
+
 				/* Send it back */
 				//sendto(udpfd, datagram, n, 0, &cliaddr, addrlen);		
 	
@@ -321,8 +427,12 @@ int main(int argc, char **argv){
 		} else {
 			/* Expected to happens each 100ms or so */
 			
-			//Check PLC rule if local input change a Put message is broadcasted
+			//Read the local IOs unless edge events report them, if local input change a Put message is broadcasted
+			if(!gpio_edge) getgpio("", Y);
+
+			//Check the PLC rules depending on the IOs which changed
 			PLCexec();
+			ucicommit();
 
 			//Timer for the IVRSet message
 			IVRSetTimer();
@@ -353,7 +463,7 @@ void intHandler(int dummy) {
 	close(udpfd); close(bcast_sockfd);
 	
 	// free PLC rules memory 
-	for(i=0; i<PLCT.n; i++) free(PLCT.rules[i]);	
+	for(i=0; i<PLCT.n; i++) free(PLCT.rules[i].text);	
 
 	exit(0);
 }
@@ -559,7 +669,7 @@ int process_udp(char *datagram){
 				AAAA=args[6];
 				if(AAAA[0]!='\0'){
                 	/* add the message source IPaddress to our IPT */
-                	IPTset(IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);	
+                	IPTset(&IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);	
 				}
 				
 				
@@ -789,7 +899,6 @@ int process_udp(char *datagram){
 				NTPServer0=args[1]; NTPServer1=args[2]; NTPServer2=args[3]; NTPServer3=args[4]; enable_disable=args[5]; SyncTime=args[6];
 
 				ucidelete("system.ntp.server");
-				ucicommit();
 
 				uciadd_list("system.ntp.server", NTPServer0);
                 if (*NTPServer1) uciadd_list("system.ntp.server", NTPServer1);                
@@ -828,13 +937,20 @@ int process_udp(char *datagram){
 				X=args[1]; Y=args[2];
 
 				if(CheckTimeRange()){	
-					res = setgpio(X, Y); //In addition it updates outputs state in GST if successful
+					res = setgpio(X, Y); //The outputs state in GST is updated once the relays are latched
 				
 					if(!res){
 						if(X[0]=='\0') {
-                        	char Y[9];
-                        	byte2binarystr(GPIOs, Y);
-							sprintf(msg, "JNTCIT/Put/%s//%s", SIOD_ID, Y); //So we return 8 values for all IOs
+                        	char Y8[9];		//Announce the requested outputs with our inputs
+                        	unsigned char gpios = GPIOs;
+                        	int i;
+
+                        	for(i=0;i<OUTPUTS_NUM;i++){	//The digits setgpio skipped keep their current state
+                        		if(Y[OUTPUTS_NUM-1-i] == '0') gpios &= ~(1<<i);
+                        		else if(Y[OUTPUTS_NUM-1-i] == '1') gpios |= 1<<i;
+                        	}
+                        	byte2binarystr(gpios, Y8);
+							sprintf(msg, "JNTCIT/Put/%s//%s", SIOD_ID, Y8); //So we return 8 values for all IOs
 
 						} else {
 
@@ -885,12 +1001,11 @@ int process_udp(char *datagram){
 					If local output is updated the SIOD will broadcast a Put package in the mesh so all SIODs update their GST table. 
 					If a remote output has to be updated a Set packet is send to the target SIOD. That target SIOD may respond with Put or 
 					TimeRangeOut package. If all optional arguments are omitted the PLC rule defined by the triple (AAAA1, X1, Y1) 
-					is removed from PLC table. Maximum of 10 PLC rules is supported.  If SIOD already has 10 rules it will respond with 
-					PLCRes message.
+					is removed from PLC table. The PLC table grows as rules are added, only the rules whose IOs changed in the 
+					GST are evaluated.
 		*/
         case PLC:{
 				char *AAAA1, *X1, *Y1, *AAAA2, *X2, *Y2, *and_or, *AAAA3, *X3, *Y3;
-				char rule_list[STR_MAX];
 				int res;				
 
                 if(verbose>=2) fprintf(stderr,"Rcv: PLC\n");
@@ -905,14 +1020,10 @@ int process_udp(char *datagram){
 					//Add the PLC in the PLC table
 					res=PLCadd(rule);
 
-					//Add the PLC in the config if it is not already in
+					//Update the config, the rule may replace one with the same AAAA1/X1/Y1
 					if(!res){
-						uciget("siod.plcrules.rule", rule_list);
-						if(strfind(rule_list, rule)){ 
-    						uciadd_list("siod.plcrules.rule", rule);
-    						ucicommit();
-    						fprintf(stderr,"PLC rule have been added in the config file\n");
-						}
+						PLCwrite_config();
+						fprintf(stderr,"PLC rule have been added in the config file\n");
 					} else{
 						fprintf(stderr,"PLC rule have not been added in the config file\n");
 					}
@@ -923,7 +1034,7 @@ int process_udp(char *datagram){
 					res=PLCdel(AAAA1, X1, Y1);
 
 					//Delete from the config
-					if(!res) PLCdel_config(AAAA1, X1, Y1);
+					if(!res) PLCwrite_config();
 				}
 
             }
@@ -940,7 +1051,7 @@ int process_udp(char *datagram){
 
                 if(verbose>=2) fprintf(stderr,"Rcv: PLCReq\n");
 
-				PLCprint(PLCstr);
+				PLCprint(PLCstr, MSG_MAX-strlen("/JNTCIT/PLCRes/"));
 
 				sprintf(msg, "/JNTCIT/PLCRes/%s", PLCstr);
 
@@ -965,7 +1076,7 @@ int process_udp(char *datagram){
 			Y31  			State which triggers the PLC rule Active/not active [0, 1]
 			...	
 
-		Description: This message provides information of the PLC rules stored in the SIOD. Maximum of 10 PLC rules per SIOD is supported. 
+		Description: This message provides information of the PLC rules stored in the SIOD, as many as fit in a message. 
 		*/
         case PLCRes:{
 
@@ -1052,7 +1163,7 @@ int process_udp(char *datagram){
 				AAAA = args[1];
 				if(AAAA[0]!='\0'){
                 	/* add the message source IPaddress to our IPT */
-                	IPTset(IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
+                	IPTset(&IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
 				}
 
             }
@@ -1119,16 +1230,16 @@ int process_udp(char *datagram){
 
 				/* add the message source IPaddress to our IPT */
 				
-                IPTset(IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
+                IPTset(&IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
 
 				if(X[0] != '\0'){ // Empty X
-					res=GSTget(GST, atoi(AAAA), &gpios);					
+					res=GSTget(&GST, atoi(AAAA), &gpios);					
 					if(res == -1){
 						fprintf(stderr,"/JNTCIT/Put/AAAA/X/Y message ignored as we don't have SIOD_ID=%s in the GST\n", AAAA);
 						break; 
 					}
 					
-					GSTset(GST, atoi(AAAA), (Y[0]=='1')?(gpios|(1<<atoi(X))):(gpios&~(1<<atoi(X))));
+					GSTset(&GST, atoi(AAAA), (Y[0]=='1')?(gpios|(1<<atoi(X))):(gpios&~(1<<atoi(X))));
 
 				} else {
 
@@ -1140,7 +1251,7 @@ int process_udp(char *datagram){
                         close(fifofd);
                     }
 
-					res=GSTadd(GST, atoi(AAAA), binarystr2byte(Y));
+					res=GSTadd(&GST, atoi(AAAA), binarystr2byte(Y));
 					if(res==0){ //GST has been expanded with new SIOD, so initial SIOD startup is detected
 								//We send our local gpios so the newerly started SIOD update its GST
         				char msg[STR_MAX], Y[9];
@@ -1169,7 +1280,7 @@ int process_udp(char *datagram){
                 if(verbose>=2) fprintf(stderr,"Rcv: GSTCheckSumReq\n");
 
 				/* Send our GST check sum */
-				sprintf(msg, "JNTCIT/GSTCheckSum/%s/%d", SIOD_ID, GSTchecksum(GST));
+				sprintf(msg, "JNTCIT/GSTCheckSum/%s/%d", SIOD_ID, GSTchecksum(&GST));
 				if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
 				broadcast(msg);
             }
@@ -1197,10 +1308,10 @@ int process_udp(char *datagram){
 				AAAA=args[1]; Sum=args[2];
 
 				/* add the message source IPaddress to our IPT */
-                IPTset(IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
+                IPTset(&IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
 					
 				/* For now just print if our GST checksum matches */
-				sum = GSTchecksum(GST);
+				sum = GSTchecksum(&GST);
 				if(atoi(Sum) == sum)
 					fprintf(stderr,"Got checksum which match with ours\n");
 				else
@@ -1214,29 +1325,37 @@ int process_udp(char *datagram){
 		Arguments: 	
 		Description: Each SIOD device in the mesh is holding the whole information of IOs for all SIODs. 
 					 The information is maintained by the Global Status Table (GST). GST should stay in sync for all SIODs. 
-					 A SIOD requests the GST from a certain SIOD using this message. Note that no special efforts have been made 
-					 to sort the data records in the GST, so they may be not bit exact in all SIODs. They should represent however 
-					 the same SIOD states. The algebraic checksum used is invariant to swapping of the records. 
+					 A SIOD requests the GST from a certain SIOD using this message. The data records are sorted by SIOD ID, 
+					 so SIODs holding the same states send the same data. The algebraic checksum used is invariant to the order 
+					 of the records. The GST is sent in as many GSTdata messages as needed.
 					 If the checksum of the two GST is the same it is assumed that their GST are the same.
 		*/
 		case GSTReq:{
 
-				char GSTtextdata[STR_MAX];
+				char GSTtextdata[MSG_MAX];
+				int first, next;
 
                 if(verbose>=2) fprintf(stderr,"Rcv: GSTReq\n");
 			
-				/* Send our GST */
-				GSTprint(GST, GSTtextdata);
-				sprintf(msg, "JNTCIT/GSTdata/%s", GSTtextdata);
-				if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
-				unicast(msg);
+				/* Send our GST, a page of records per message. siod_id is an unsigned short, so are the record counts */
+				first=0;
+				do{
+					next=GSTprint(&GST, GSTtextdata, MSG_MAX-strlen("JNTCIT/GSTdata//65535/65535"), first);
+					sprintf(msg, "JNTCIT/GSTdata/%s/%d/%d", GSTtextdata, first, GST.tab.n);
+					if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
+					unicast(msg);
+					if(next == first) break;	//out of memory, nothing printed
+					first=next;
+				} while(first < GST.tab.n);
 
             }
             break;
 		/*
-		Message: /JNTCIT/GSTdata/Data
+		Message: /JNTCIT/GSTdata/Data/First/Total
 		Type: Unicast
 		Arguments: 	Data is mandatory argument
+		First:	Index of the first record of Data in the GST, from 0
+		Total:	Number of records in the GST
 		Data: 	GST sent in the UDP message body. The following text format is used  
 				SIOD_ID0, IO_STATE; ...
 				Example:
@@ -1249,9 +1368,10 @@ int process_udp(char *datagram){
 		Description: Each SIOD device in the mesh is holding the whole information of IOs for all SIODs. 
 					 The information is maintained by a data structure called Global Status Table (GST). 
 					 GSTs should stay in sync for all SIODs. This message pass the whole GST data. 
-					 Note that no special efforts have been made to sort the data records in the GST, 
-					 so they may be not bit exact in all SIODs. They should represent however the same SIOD states. 
-					 The algebraic checksum used is invariant to swapping of the records. 
+					 The data records are sorted by SIOD ID, so they are bit exact in all SIODs holding the same states. 
+					 The records which do not fit in a message come in the next ones, the GST is complete once First 
+					 plus the records of Data reach Total. 
+					 The algebraic checksum used is invariant to the order of the records. 
 					 If the checksum of the two GST is the same it is assumed that they are the same.
 		*/ 
         case GSTdata:{
@@ -1263,7 +1383,10 @@ int process_udp(char *datagram){
 				Data=args[1];
 
 				/* For now just display the received GST data */
-				fprintf(stderr,"%s\n", Data);
+				if(n_args >= 4)
+					fprintf(stderr,"GST records from %s of %s: %s\n", args[2], args[3], Data);
+				else
+					fprintf(stderr,"%s\n", Data);
 
             }
             break;
@@ -1323,7 +1446,7 @@ int process_udp(char *datagram){
 				AAAA = args[1];
 
 				/* add the message source IPaddress to our IPT */
-				IPTset(IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
+				IPTset(&IPT, atoi(AAAA), cliaddr.sin_addr.s_addr);
 
 			}
             break;
@@ -1346,7 +1469,7 @@ int process_udp(char *datagram){
                 AAAA = args[1]; X = args[2];                                                                                                                                                       
                 
                 fifofd=open("/tmp/ivrfifo", O_WRONLY|O_NONBLOCK);                                                                                                                                                                   
-				if(GSTget(GST, atoi(AAAA), &gpios)){
+				if(GSTget(&GST, atoi(AAAA), &gpios)){
                     sprintf(msg, "JNTCIT/IVRGetRes///");  //SIOD not available in the GST, assumed not available in the mesh
                     if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
                     write(fifofd, msg, strlen(msg));					
@@ -1399,7 +1522,7 @@ int process_udp(char *datagram){
 
 				if(!strcmp(AAAA, SIOD_ID)){
                 	if(CheckTimeRange()){
-                    	res = setgpio(X, Y); //In addition it updates outputs state in GST if successful
+                    	res = setgpio(X, Y); //The outputs state in GST is updated once the relay is latched
                     	if(!res){
                         	sprintf(msg, "JNTCIT/Put/%s/%s/%s", SIOD_ID, X, Y);
                         	if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
@@ -1419,7 +1542,7 @@ int process_udp(char *datagram){
                     	write(fifofd, msg, strlen(msg));
                     	close(fifofd);                	}
 
-                } else if(GSTget(GST, atoi(AAAA), &gpios)){     
+                } else if(GSTget(&GST, atoi(AAAA), &gpios)){     
 					fifofd=open("/tmp/ivrfifo", O_WRONLY|O_NONBLOCK);
                     sprintf(msg, "JNTCIT/IVRSetRes///");  //SIOD not available in the GST, assumed not available in the mesh
                     if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
@@ -1653,117 +1776,288 @@ unsigned long long wifiMAC(void){
 }
 
 /*
- * Execute uci get command to retreive a value from the openwrt configuration files 
- * Value should have at least STR_MAX bytes alocated.
- * returns 0 on success
+ * Find a package loaded in our uci context, NULL if it is not loaded
  */
-int uciget(const char *param, char *value){
+static struct uci_package *siod_uci_find(const char *name){
 
-    FILE *fp;
-	char *ret, str[100];
-	int i, len;	
+	struct uci_element *e;
+
+	uci_foreach_element(&siod_uci_ctx->root, e){
+		if(!strcmp(e->name, name)) return uci_to_package(e);
+	}
+
+	return NULL;
+}
 
+/*
+ * Modification time and size of a file. st_mtime alone has a one second
+ * granularity, a uci set done in the same second would go unnoticed
+ */
+static void siod_uci_stat(const char *dir, const char *name, struct siod_uci_stamp *stamp){
 
+	struct stat st;
+	char path[STR_MAX];
 
-	sprintf(str, "uci get %s", param);
+	snprintf(path, STR_MAX, "%s/%s", dir, name);
+	if(stat(path, &st)){
+		memset(stamp, 0, sizeof(*stamp));
+		stamp->size = -1;
+		return;
+	}
+	stamp->mtim = st.st_mtim;
+	stamp->size = st.st_size;
+}
 
-    fp=popen(str,"r");
-    ret=fgets(value, STR_MAX, fp);
-    pclose(fp);
+static int siod_uci_same(const struct siod_uci_stamp *a, const struct siod_uci_stamp *b){
+
+	return a->mtim.tv_sec == b->mtim.tv_sec && a->mtim.tv_nsec == b->mtim.tv_nsec && a->size == b->size;
+}
+
+/*
+ * Stamps of a package config file and of its delta file
+ */
+static void siod_uci_mtime(const char *name, struct siod_uci_stamp *conf, struct siod_uci_stamp *delta){
+
+	siod_uci_stat(siod_uci_ctx->confdir, name, conf);
+	siod_uci_stat(siod_uci_ctx->savedir, name, delta);
+}
+
+/*
+ * Look up a uci path ("package.section.option[=value]", extended syntax allowed)
+ * in our uci context. The context is created on the first call and the packages
+ * stay loaded in it. A package is dropped and read again if its files changed
+ * since it was loaded, unless it holds changes we did not commit yet.
+ * str is modified by the lookup. Returns the package cache entry, NULL on error
+ */
+static struct siod_uci_pkg *siod_uci_lookup(char *str, struct uci_ptr *ptr){
 
-	len=strlen(value);
-	if(value[len-1]=='\r' || value[len-1]=='\n') value[len-1]='\0';
+	struct uci_package *p;
+	struct siod_uci_pkg *pkg;
+	char name[STR_MAX];
+	struct siod_uci_stamp conf, delta;
+	int i;
+
+	if(siod_uci_ctx == NULL){
+		siod_uci_ctx = uci_alloc_context();
+		if(siod_uci_ctx == NULL){
+			fprintf(stderr,"Can not allocate uci context\n");
+			return NULL;
+		}
+	}
+
+	i = strcspn(str, ".=");
+	if(i == 0 || i >= STR_MAX) return NULL;
+	memcpy(name, str, i); name[i] = '\0';
+
+	pkg = NULL;
+	for(i=0;i<SIOD_UCI_PKGS_MAX && siod_uci_pkgs[i].name[0];i++){
+		if(!strcmp(siod_uci_pkgs[i].name, name)) { pkg = &siod_uci_pkgs[i]; break; }
+	}
+	if(pkg == NULL){
+		if(i == SIOD_UCI_PKGS_MAX){
+			fprintf(stderr,"Can not load uci package %s, too much packages already!\n", name);
+			return NULL;
+		}
+		pkg = &siod_uci_pkgs[i];
+		strcpy(pkg->name, name);
+	}
 
-	if(ret==NULL){
-		value[0]=' ';	//return a space string so we can still create valid UDP message 
-		value[0]='\0';
+	siod_uci_mtime(name, &conf, &delta);
+	p = siod_uci_find(name);
+	if(p != NULL && !pkg->dirty && (!siod_uci_same(&conf, &pkg->conf) || !siod_uci_same(&delta, &pkg->delta))){
+		if(verbose>=2) fprintf(stderr,"uci: %s changed, reloading it\n", name);
+		uci_unload(siod_uci_ctx, p);
+		p = NULL;
+	}
+	if(p == NULL){
+		pkg->conf = conf;
+		pkg->delta = delta;
+	}
+
+	memset(ptr, 0, sizeof(*ptr));
+	if(uci_lookup_ptr(siod_uci_ctx, ptr, str, true) != UCI_OK){
+		if(verbose) uci_perror(siod_uci_ctx, "uci");
+		return NULL;
+	}
+
+	return pkg;
+}
+
+/*
+ * Retreive a value from the openwrt configuration files, as uci get does.
+ * The items of a list are separated by spaces.
+ * Value should have at least STR_MAX bytes alocated.
+ * returns 0 on success
+ */
+int uciget(const char *param, char *value){
+
+	struct uci_ptr ptr;
+	struct uci_element *e;
+	char str[STR_MAX];
+	int len;
+
+	value[0]='\0';	//return an empty string so we can still create valid UDP message
+
+	if(snprintf(str, STR_MAX, "%s", param) >= STR_MAX) return -1;
+	if(siod_uci_lookup(str, &ptr) == NULL || !(ptr.flags & UCI_LOOKUP_COMPLETE))
 		return -1;
-	}else
-		return 0;
+
+	if(ptr.o == NULL){	//section, return its type
+		snprintf(value, STR_MAX, "%s", ptr.s->type);
+	} else if(ptr.o->type == UCI_TYPE_STRING){
+		snprintf(value, STR_MAX, "%s", ptr.o->v.string);
+	} else {
+		len=0;
+		uci_foreach_element(&ptr.o->v.list, e){
+			len += snprintf(value+len, STR_MAX-len, "%s%s", len?" ":"", e->name);
+			if(len >= STR_MAX) { len = STR_MAX-1; break; }
+		}
+	}
+
+	return 0;
 }
 
 /*
- * Execute uci set command to update value to the openwrt configuration files
+ * Update a value in the openwrt configuration files, as uci set does.
+ * Setting the value an option already holds is a no-op.
  * Note that you have to commit the change afterwords
  * returns 0 on success
  */
 int uciset(const char *param, const char *value){
 
-    FILE *fp;
-    char str[100];
-	char dummy[STR_MAX];
+	struct uci_ptr ptr;
+	struct siod_uci_pkg *pkg;
+	char str[2*STR_MAX];
 
-    sprintf(str, "uci set %s=%s 2>&1", param, value);
+	if(snprintf(str, sizeof(str), "%s=%s", param, value) >= (int)sizeof(str)) return -1;
+	if((pkg=siod_uci_lookup(str, &ptr)) == NULL)
+		return -1;
 
-    fp=popen(str,"r");
-    fgets(dummy, STR_MAX, fp);
-    pclose(fp);
+	if(ptr.o != NULL && ptr.o->type == UCI_TYPE_STRING && !strcmp(ptr.o->v.string, ptr.value))
+		return 0;
+	if(ptr.option != NULL && ptr.o == NULL && ptr.value[0] == '\0')
+		return 0;
 
-    if(!strfind(dummy, "Invalid"))
-        return -1;
-    else
-        return 0;
+	if(uci_set(siod_uci_ctx, &ptr) != UCI_OK){
+		if(verbose) uci_perror(siod_uci_ctx, param);
+		return -1;
+	}
+	pkg->dirty = 1;
+
+	return 0;
 }
 
 
 /*
- * Execute uci delete command in order to delete an option 
- * or all list items from  the openwrt configuration files
+ * Delete an option or all list items from the openwrt configuration files,
+ * as uci delete does.
  * Note that you have to commit the change afterwords
  * returns 0 on success
  */
 int ucidelete(const char *param){
 
-    FILE *fp;
-    char str[100];
-    char dummy[STR_MAX];
+	struct uci_ptr ptr;
+	struct siod_uci_pkg *pkg;
+	char str[STR_MAX];
 
-    sprintf(str, "uci delete %s 2>&1", param);
+	if(snprintf(str, STR_MAX, "%s", param) >= STR_MAX) return -1;
+	if((pkg=siod_uci_lookup(str, &ptr)) == NULL || !(ptr.flags & UCI_LOOKUP_COMPLETE))
+		return -1;
 
-    fp=popen(str,"r");
-    fgets(dummy, STR_MAX, fp);
-    pclose(fp);
+	if(uci_delete(siod_uci_ctx, &ptr) != UCI_OK){
+		if(verbose) uci_perror(siod_uci_ctx, param);
+		return -1;
+	}
+	pkg->dirty = 1;
 
-    if(!strfind(dummy, "Invalid"))
-        return -1;
-    else
-        return 0;
+	return 0;
 }
 
 
 /*
- * Execute uci add_list command in order to add new item to the list 
+ * Add new item to a list, as uci add_list does.
  * Note that you have to commit the change afterwords
  * returns 0 on success
  */
 int uciadd_list(const char *param, const char *value){
 
-    FILE *fp;
-    char str[100];
-    char dummy[STR_MAX];
+	struct uci_ptr ptr;
+	struct siod_uci_pkg *pkg;
+	char str[2*STR_MAX];
 
-    sprintf(str, "uci add_list %s=%s 2>&1", param, value);
+	if(snprintf(str, sizeof(str), "%s=%s", param, value) >= (int)sizeof(str)) return -1;
+	if((pkg=siod_uci_lookup(str, &ptr)) == NULL || ptr.s == NULL)
+		return -1;
 
-    fp=popen(str,"r");
-    fgets(dummy, STR_MAX, fp);
-    pclose(fp);
+	if(uci_add_list(siod_uci_ctx, &ptr) != UCI_OK){
+		if(verbose) uci_perror(siod_uci_ctx, param);
+		return -1;
+	}
+	pkg->dirty = 1;
 
-    if(!strfind(dummy, "Invalid"))
-        return -1;
-    else
-        return 0;
+	return 0;
 }
 
 
 /*
- * Commit all changes (in the config files) done by uci set commands
+ * Commit all changes (in the config files) done by uciset, ucidelete and uciadd_list.
+ * Only the packages we changed are written, nothing is done if there are none,
+ * so it is cheap to call once per processed message.
  */
 void ucicommit(void){
 
-    FILE *fp;
+	struct uci_package *p;
+	int i;
 
-    fp=popen("uci commit","r");
-    pclose(fp);
+	for(i=0;i<SIOD_UCI_PKGS_MAX && siod_uci_pkgs[i].name[0];i++){
+		if(!siod_uci_pkgs[i].dirty) continue;
+
+		siod_uci_pkgs[i].dirty = 0;
+		p = siod_uci_find(siod_uci_pkgs[i].name);
+		if(p == NULL) continue;
+
+		if(uci_commit(siod_uci_ctx, &p, false) != UCI_OK){
+			fprintf(stderr,"Can not commit uci package %s\n", siod_uci_pkgs[i].name);
+			if(verbose) uci_perror(siod_uci_ctx, siod_uci_pkgs[i].name);
+			siod_uci_pkgs[i].conf.size = -2;	//read it again from the files on next use
+			continue;
+		}
+		if(verbose>=2) fprintf(stderr,"uci: %s committed\n", siod_uci_pkgs[i].name);
+
+		siod_uci_mtime(siod_uci_pkgs[i].name, &siod_uci_pkgs[i].conf, &siod_uci_pkgs[i].delta);
+	}
+}
+
+
+/*
+ * Call fn for each item of a list in the openwrt configuration files,
+ * or for the value of an option which is not a list.
+ * Unlike uciget the items are not limited in number.
+ * returns the number of items, -1 if param is not found
+ */
+int uciforeach(const char *param, int (*fn)(const char *item)){
+
+	struct uci_ptr ptr;
+	struct uci_element *e;
+	char str[STR_MAX];
+	int n;
+
+	if(snprintf(str, STR_MAX, "%s", param) >= STR_MAX) return -1;
+	if(siod_uci_lookup(str, &ptr) == NULL || !(ptr.flags & UCI_LOOKUP_COMPLETE) || ptr.o == NULL)
+		return -1;
+
+	if(ptr.o->type == UCI_TYPE_STRING){
+		fn(ptr.o->v.string);
+		return 1;
+	}
+
+	n=0;
+	uci_foreach_element(&ptr.o->v.list, e){
+		fn(e->name);
+		n++;
+	}
+
+	return n;
 }
 
 
@@ -2011,6 +2305,24 @@ int gpios_init(void){
     IOs[0]=fd_fb0; IOs[1]=fd_fb1; IOs[2]=fd_fb2; IOs[3]=fd_fb3;
     IOs[4]=fd_in0; IOs[5]=fd_in1; IOs[6]=fd_in2; IOs[7]=fd_in3;
 
+	/* Ask for edge events on the inputs and feedbacks, they are polled if not supported */
+	{
+		const int IOgpio[OUTPUTS_NUM+INPUTS_NUM]={FB0, FB1, FB2, FB3, IN0, IN1, IN2, IN3};
+		int i;
+
+		gpio_edge=1;
+		for(i=0;i<INPUTS_NUM+OUTPUTS_NUM;i++){
+			snprintf(str, STR_MAX, "/sys/class/gpio/gpio%d/edge", IOgpio[i]);
+			fd = open(str, O_WRONLY);
+			if(fd < 0 || write(fd, "both", 4) != 4) gpio_edge=0;
+			if(fd >= 0) close(fd);
+
+			lseek(IOs[i], 0, SEEK_SET);	//A read clears the event pending since the open
+			read(IOs[i], str, 2);
+		}
+		if(verbose) fprintf(stderr,"GPIO inputs %s\n", gpio_edge?"monitored through edge events":"polled every 100ms");
+	}
+
 
 
 	/* Set the output information in GPIOS 
@@ -2022,6 +2334,10 @@ int gpios_init(void){
 	GPIOs |= (!(fb2) << 2);
 	GPIOs |= (!(fb3) << 3);
 	*/
+	RELAYS.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if(RELAYS.fd < 0) perror("timerfd_create() failed, relay pulses will block");
+	RELAYS.active = -1;
+
 	uciget("siod.@output[0].value", str);
 	setgpio("0", str);
 	uciget("siod.@output[1].value", str);
@@ -2030,6 +2346,12 @@ int gpios_init(void){
 	setgpio("2", str);
     uciget("siod.@output[3].value", str);
 	setgpio("3", str);
+
+	/* Nothing else runs yet, wait for the outputs to be latched */
+	while(RELAYS.active >= 0){
+		usleep(PULSE_US);
+		relay_done();
+	}
     
 	if(verbose) fprintf(stderr,"GPIOs = 0x%x\n", GPIOs);
 
@@ -2046,7 +2368,8 @@ int gpios_init(void){
  *	YYYY:			represent 4 digit binary number.(We have 4 outputs per SIOD) LSB specifies the state of the first IO, 			
  *					MSB of the 4th output. 
  *
- * The function updates outputs states in GST if successful
+ * The relays are pulsed asynchronously, the function returns as soon as the requests are queued.
+ * The outputs states in GST are updated as each pulse completes
  */
 int setgpio(char *X, char *Y){
 
@@ -2059,44 +2382,27 @@ int setgpio(char *X, char *Y){
 	if(xlen == 1 && ylen == 1){
 		
 		x=atoi(X);
-		if (x < 0 || x > OUTPUTS_NUM) {
+		if (x < 0 || x >= OUTPUTS_NUM) {
 			if(verbose) fprintf(stderr,"Output index out of range, ignoring\n");
 			return -1;
 		} else if (Y[0] !='0' && Y[0] !='1') {
 			if(verbose) fprintf(stderr,"Output value should be 0 or 1\n");
 			return -1;
 		}
-    
-    	write(fd_rel0, (x>1)?"1":"0", 1); write(fd_rel1, (x%2)?"1":"0", 1);
-    	write(fd_s_r, Y, 1);
-    	write(fd_pulse, "1", 1); usleep(100000L); write(fd_pulse, "0", 1);
-		      
-		GPIOs = (Y[0]-'0')?(GPIOs|(1<<x)):(GPIOs&~(1<<x));
 
-		if(verbose == 2) fprintf(stderr,"Set: OUT%d = %s\n", x, Y);
-
-		//Update GST
-		GST[0].gpios=GPIOs;
+		relay_request(x, Y[0]);
 
-		//Update the configs
+		//Update the configs, the caller commits them
 		sprintf(str, "siod.@output[%d].value", x);
 		uciset(str, Y);
-		ucicommit();
 
 	} else if (xlen == 0 && ylen == OUTPUTS_NUM){
 		int i;
 		
 		for(i=0;i<ylen;i++){
-			if (Y[i] == '0' || Y[i] == '1'){
-				
-					
-        		write(fd_rel0, (i>1)?"1":"0", 1); write(fd_rel1, (i%2)?"1":"0", 1);
-        		write(fd_s_r, (Y[OUTPUTS_NUM-1-i]-'0')?"1":"0", 1);
-        		write(fd_pulse, "1", 1); usleep(100000L); write(fd_pulse, "0", 1);
-
-				GPIOs = (Y[OUTPUTS_NUM-1-i]-'0')?(GPIOs|(1<<i)):(GPIOs&~(1<<i));
+			if (Y[OUTPUTS_NUM-1-i] == '0' || Y[OUTPUTS_NUM-1-i] == '1'){
 
-				if(verbose == 2) fprintf(stderr,"Set: OUT%d = %d\n", i, Y[OUTPUTS_NUM-1-i]-'0');
+				relay_request(i, Y[OUTPUTS_NUM-1-i]);
 
 				//Update the configs
         		sprintf(str, "siod.@output[%d].value", i);
@@ -2105,11 +2411,6 @@ int setgpio(char *X, char *Y){
 			}
 		}
 
-		ucicommit();
-
-        //Update GST
-        GST[0].gpios=GPIOs;
-
 	} else {
 		fprintf(stderr,"setgpio: Invalid X and Y\n");
 		return -1;
@@ -2119,6 +2420,80 @@ int setgpio(char *X, char *Y){
 
 }
 
+/*
+ * Queue a pulse latching output x to y ('0' or '1').
+ * A request replaces the one still pending for the same output
+ */
+void relay_request(int x, char y){
+
+	RELAYS.pending[x]=y;
+
+	if(RELAYS.active < 0) relay_next();
+}
+
+/*
+ * Start the pulse of the next pending output, in round robin order.
+ * The lines are released and the timer stopped if there is none
+ */
+void relay_next(void){
+
+	struct itimerspec its;
+	int i, x;
+
+	memset(&its, 0, sizeof(its));
+
+	for(i=0;i<OUTPUTS_NUM;i++){
+		x=(RELAYS.next+i)%OUTPUTS_NUM;
+		if(RELAYS.pending[x]) break;
+	}
+	if(i == OUTPUTS_NUM){
+		RELAYS.active=-1;
+		if(RELAYS.fd >= 0) timerfd_settime(RELAYS.fd, 0, &its, NULL);
+		return;
+	}
+
+	RELAYS.active=x;
+	RELAYS.value=RELAYS.pending[x];
+	RELAYS.pending[x]=0;
+	RELAYS.next=(x+1)%OUTPUTS_NUM;
+
+	write(fd_rel0, (x>1)?"1":"0", 1); write(fd_rel1, (x%2)?"1":"0", 1);
+	write(fd_s_r, (RELAYS.value=='1')?"1":"0", 1);
+	write(fd_pulse, "1", 1);
+
+	if(RELAYS.fd >= 0){
+		its.it_value.tv_nsec = PULSE_US*1000L;
+		timerfd_settime(RELAYS.fd, 0, &its, NULL);
+	} else {
+		usleep(PULSE_US);		//No timer, block as we used to
+		relay_done();
+	}
+}
+
+/*
+ * End the pulse in progress, update the output state in GST
+ * and start the pulse of the next pending output
+ */
+void relay_done(void){
+
+	unsigned long long expirations;
+	int x;
+
+	if(RELAYS.fd >= 0) read(RELAYS.fd, &expirations, sizeof(expirations));
+
+	x=RELAYS.active;
+	if(x < 0) return;
+
+	write(fd_pulse, "0", 1);
+
+	GPIOs = (RELAYS.value=='1')?(GPIOs|(1<<x)):(GPIOs&~(1<<x));
+	GSTset(&GST, atoi(SIOD_ID), GPIOs);
+
+	if(verbose == 2) fprintf(stderr,"Set: OUT%d = %c\n", x, RELAYS.value);
+
+	relay_next();
+}
+
 /*
  * Get local gpio
  * 
@@ -2159,7 +2534,7 @@ int getgpio(char *X, char *Y){
 		//GPIOs = (Y[0]-'0')?(GPIOs&~(1<<x)):(GPIOs|(1<<x));
 		GPIOs = (Y[0]-'0')?(GPIOs|(1<<x)):(GPIOs&~(1<<x));
 
-		GST[0].gpios=GPIOs;
+		GSTset(&GST, atoi(SIOD_ID), GPIOs);
 
     } else if (xlen == 0){
         int i;
@@ -2183,7 +2558,7 @@ int getgpio(char *X, char *Y){
 		Y[i]='\0';
 
 		//Update GST
-		GST[0].gpios=GPIOs;
+		GSTset(&GST, atoi(SIOD_ID), GPIOs);
 
     } else {
         fprintf(stderr,"getgpio: X must be empty or represent a number \n");
@@ -2195,52 +2570,200 @@ int getgpio(char *X, char *Y){
 
 
 /*
- * Calculates checksum of GST data. The data are terminated by zero siod_id
- * 
- * Note that no special efforts have been made to sort the data records in the GST, so they may be not bit exact in all SIODs. 
- * They should represent however the same SIOD states. The algebraic checksum used is invariant to swapping of the records. 
- * If the checksum of the two GST is the same it is assumed that they are the same. 
-*/
-unsigned char GSTchecksum(struct GST_nod *gst){
+ * Handle the sysfs edge events of the local inputs and relay feedbacks.
+ * Only the IOs which signalled a change are read again, getgpio broadcasts
+ * the Put message of an input right away, then the PLC rules are checked.
+ * t0 is the time select() returned: the latency reported runs from there,
+ * the kernel delay between the edge and our wakeup is not part of it.
+ * Returns the number of IOs read
+ */
+int gpio_events(fd_set *eset, const struct timespec *t0){
+
+	struct timespec t1;
+	char X[2], Y[STR_MAX];
+	long us;
+	int i, n;
+
+	n=0;
+	for(i=0;i<INPUTS_NUM+OUTPUTS_NUM;i++){
+		if(!FD_ISSET(IOs[i], eset)) continue;
+
+		X[0]='0'+i; X[1]='\0';
+		getgpio(X, Y);
+		n++;
+	}
+	if(n == 0) return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	us = (t1.tv_sec-t0->tv_sec)*1000000L + (t1.tv_nsec-t0->tv_nsec)/1000;
+	if(us > gpio_edge_max_us) gpio_edge_max_us = us;
+	if(verbose>=2) fprintf(stderr,"Edge: %d IOs read, Put sent %ld us after the wakeup (max %ld us)\n", n, us, gpio_edge_max_us);
+
+	PLCexec();
+	ucicommit();
+
+	return n;
+}
+
+
+/*
+ * First slot siod_id is looked for in a SIOD table
+ */
+static int SIODhome(struct SIOD_tab *tab, int siod_id){
+
+	return (((unsigned int)siod_id * 2654435761U) >> 16) & (tab->size-1);
+}
+
+/*
+ * Slot of a SIOD table, where siod_id is or has to be inserted.
+ * Linear probing, the table always keeps free slots
+ */
+static int SIODslot(struct SIOD_tab *tab, int siod_id){
 
-	unsigned char sum;
-	unsigned short siod_id;
 	int i;
-	sum=0; i=0;
-	while(siod_id = (gst+i)->siod_id) {
-		sum += (gst+i)->gpios + (siod_id&0xff) + ((siod_id>>8)&0xff);
-		i++;	
+
+	for(i = SIODhome(tab, siod_id); SIODkey(tab, i) && SIODkey(tab, i) != siod_id; i = (i+1) & (tab->size-1))
+		;
+
+	return i;
+}
+
+/*
+ * Find siod_id in a SIOD table, NULL if it is not there
+ */
+static void *SIODfind(struct SIOD_tab *tab, int siod_id){
+
+	int i;
+
+	if(tab->size == 0 || siod_id == 0) return NULL;
+
+	i = SIODslot(tab, siod_id);
+
+	return SIODkey(tab, i) ? SIODnod(tab, i) : NULL;
+}
+
+/*
+ * Find siod_id in a SIOD table or insert it, with the rest of its entry zeroed.
+ * The table doubles when it is 3/4 full. *added tells if the entry is new
+ * Returns the entry, NULL if no memory
+ */
+static void *SIODinsert(struct SIOD_tab *tab, int siod_id, int *added){
+
+	struct SIOD_tab grown;
+	int i;
+
+	*added = 0;
+	if(siod_id == 0) return NULL;
+
+	if(4*(tab->n+1) > 3*tab->size){
+		grown.size = tab->size ? 2*tab->size : SIODS_INIT;
+		grown.nod_size = tab->nod_size;
+		grown.n = tab->n;
+		grown.slots = calloc(grown.size, grown.nod_size);
+		if(grown.slots == NULL){
+			fprintf(stderr,"Can not grow the SIOD table to %d entries\n", grown.size);
+			if(tab->n+1 >= tab->size) return NULL;	//keep at least one free slot
+		} else {
+			for(i=0;i<tab->size;i++){
+				if(SIODkey(tab, i))
+					memcpy(SIODnod(&grown, SIODslot(&grown, SIODkey(tab, i))), SIODnod(tab, i), tab->nod_size);
+			}
+			free(tab->slots);
+			*tab = grown;
+		}
 	}
-	
-	return(sum);
+
+	i = SIODslot(tab, siod_id);
+	if(!SIODkey(tab, i)){
+		memset(SIODnod(tab, i), 0, tab->nod_size);
+		*(int *)SIODnod(tab, i) = siod_id;
+		tab->n++;
+		*added = 1;
+	}
+
+	return SIODnod(tab, i);
+}
+
+/*
+ * Remove siod_id from a SIOD table. The entries after it in its probe
+ * sequence move back so lookups never cross a hole
+ * Returns 0 if siod_id was removed, -1 if it is not there
+ */
+static int SIODremove(struct SIOD_tab *tab, int siod_id){
+
+	int i, j, k;
+
+	if(SIODfind(tab, siod_id) == NULL) return -1;
+
+	i = SIODslot(tab, siod_id);
+	for(j = (i+1) & (tab->size-1); SIODkey(tab, j); j = (j+1) & (tab->size-1)){
+		k = SIODhome(tab, SIODkey(tab, j));
+		if((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))){
+			memcpy(SIODnod(tab, i), SIODnod(tab, j), tab->nod_size);
+			i = j;
+		}
+	}
+	memset(SIODnod(tab, i), 0, tab->nod_size);
+	tab->n--;
+
+	return 0;
+}
+
+/*
+ * Compare GST entries by siod_id
+ */
+static int GSTnod_cmp(const void *a, const void *b){
+
+	return ((const struct GST_nod *)a)->siod_id - ((const struct GST_nod *)b)->siod_id;
+}
+
+/*
+ * Checksum of a single GST record
+ */
+static unsigned char GSTnod_sum(int siod_id, unsigned char gpios){
+
+	return gpios + (siod_id&0xff) + ((siod_id>>8)&0xff);
+}
+
+/*
+ * Returns the checksum of GST data, it is kept up to date on every GST change.
+ *
+ * GST checksum is the algebraic sum of all octets modulo 256 in the GST data,
+ * it does not depend on the order the records were added.
+ * If the checksum of the two GST is the same it is assumed that they are the same.
+*/
+unsigned char GSTchecksum(struct GST_tab *gst){
+
+	return(gst->sum);
 }
 
 /*
  * Add siod_id, gpios data pair in the GST
  * If siod_id already available only the gpios value is updated
  * If gpios are added 0 is returned, if it is updated 1 is returned, on issue -1 is returned
- * 
+ *
  */
-int GSTadd(struct GST_nod *gst, unsigned short siod_id, unsigned char gpios){
+int GSTadd(struct GST_tab *gst, unsigned short siod_id, unsigned char gpios){
 
-	int i;
-	i=0;
-    while((gst+i)->siod_id) {
-		if ((gst+i)->siod_id == siod_id) { //The siod_id found
-			(gst+i)->gpios = gpios;
-			return 1;
-		}
+	struct GST_nod *nod;
+	int added;
 
-		i++;
+	nod = SIODinsert(&gst->tab, siod_id, &added);
+	if(nod == NULL){
+		fprintf(stderr,"Can not add SIOD=%d in the GST\n", siod_id);
+		return -1;
+	}
 
-		if(i>=SIODS_MAX) {
-			fprintf(stderr,"Can not add, too much GST items already!\n");
-			return -1;
-		}
+	if(!added){
+		gst->sum += gpios - nod->gpios;
+		PLCchanged(siod_id, nod->gpios ^ gpios);
+		nod->gpios = gpios;
+		return 1;
 	}
 
-	(gst+i)->siod_id = siod_id;
-	(gst+i)->gpios = gpios;
+	nod->gpios = gpios;
+	gst->sum += GSTnod_sum(siod_id, gpios);
+	PLCchanged(siod_id, 0xff);	//All its IOs are new to the rules
 
 	return 0;
 }
@@ -2248,92 +2771,94 @@ int GSTadd(struct GST_nod *gst, unsigned short siod_id, unsigned char gpios){
 
 /*
  * Remove item from GST. If siod_id is not found the GST is unchanged
- * 
+ *
  */
-void GSTdel(struct GST_nod *gst, unsigned short siod_id){
+void GSTdel(struct GST_tab *gst, unsigned short siod_id){
 
-    int i, j;
+	struct GST_nod *nod;
 
-    i=0; j=-1;
-	while((gst+i)->siod_id){
-		if ((gst+i)->siod_id == siod_id) {
-			j=i;
-		}	
-		i++;
-	} 
+	nod = SIODfind(&gst->tab, siod_id);
+	if(nod == NULL) return;
 
-	if(j != -1) { //If siod_id is found
-		if(j==(i-1)){ //siod_id is last item in GST
-			(gst+j)->siod_id = 0;	//make it zero
-			(gst+j)->gpios = 0;		
-		} else {
-			(gst+j)->siod_id =  (gst+i-1)->siod_id;   //Copy last item on top of the one we delete
-			(gst+j)->gpios = (gst+i-1)->gpios; 		
-			
-			(gst+i-1)->siod_id = 0;					  // and delete the last item 	
-			(gst+i-1)->gpios = 0; 		
-		}
-	}
-	
+	gst->sum -= GSTnod_sum(siod_id, nod->gpios);
+	SIODremove(&gst->tab, siod_id);
 }
 
 /*
  * Retreive a gpios for a given siod_id from the GST
- * 0 if siod_id found in the GST, -1 otherwise 
+ * 0 if siod_id found in the GST, -1 otherwise
  */
-int GSTget(struct GST_nod *gst, unsigned short siod_id, unsigned char *gpios){
+int GSTget(struct GST_tab *gst, unsigned short siod_id, unsigned char *gpios){
 
-    int i;
-    i=0;
+	struct GST_nod *nod;
 
-    while((gst+i)->siod_id){
-        if ((gst+i)->siod_id == siod_id) {
-            *gpios = (gst+i)->gpios;
-            return 0;
-        }
-        i++;
-    }
+	nod = SIODfind(&gst->tab, siod_id);
+	if(nod == NULL) return -1;
+
+	*gpios = nod->gpios;
 
-    return -1;
+	return 0;
 }
 
 /*
  * Set gpios for a given siod_id to the GST
- * 0 if siod_id found in the GST, -1 otherwise 
+ * 0 if siod_id found in the GST, -1 otherwise
  */
-int GSTset(struct GST_nod *gst, unsigned short siod_id, unsigned char gpios){
+int GSTset(struct GST_tab *gst, unsigned short siod_id, unsigned char gpios){
 
-    int i;
-    i=0;
+	struct GST_nod *nod;
 
-    while((gst+i)->siod_id){
-        if ((gst+i)->siod_id == siod_id) {
-            (gst+i)->gpios = gpios;
-            return 0;
-        }
-        i++;
-    }
+	nod = SIODfind(&gst->tab, siod_id);
+	if(nod == NULL) return -1;
+
+	gst->sum += gpios - nod->gpios;
+	PLCchanged(siod_id, nod->gpios ^ gpios);
+	nod->gpios = gpios;
 
-    return -1;
+	return 0;
 }
 
 
 /*
- * Print GST in a string. 
+ * Print GST in a string, the records sorted by siod_id so the data are
+ * the same in all SIODs holding the same states. The records are printed
+ * from the first one on, as many as fit in max_len bytes.
  * Note that caller should allocate the str memory
+ * Returns the index of the first record left out, the number of records
+ * if none are
  */
-void GSTprint(struct GST_nod *gst, char *str){
+int GSTprint(struct GST_tab *gst, char *str, int max_len, int first){
 
-    int i;
-	char gpios[9], item[STR_MAX];	
+	struct GST_nod *sorted;
+	char gpios[9];
+	int i, n, len, item_len;
 
-	str[0]='\0';i=0;
-    while((gst+i)->siod_id){
-        byte2binarystr((gst+i)->gpios, gpios);
-		sprintf(item, "%d,%s;", (gst+i)->siod_id, gpios);
-		strcat(str, item);
-		i++;
+	str[0]='\0';
+	sorted = malloc(gst->tab.n*sizeof(struct GST_nod) + 1);
+	if(sorted == NULL){
+		fprintf(stderr,"GSTprint: Can not allocate memory\n");
+		return first;
+	}
+
+	for(i=n=0;i<gst->tab.size;i++){
+		if(SIODkey(&gst->tab, i)) sorted[n++] = *(struct GST_nod *)SIODnod(&gst->tab, i);
+	}
+	qsort(sorted, n, sizeof(struct GST_nod), GSTnod_cmp);
+
+	len=0;
+	for(i=first;i<n;i++){
+        byte2binarystr(sorted[i].gpios, gpios);
+		item_len = snprintf(str+len, max_len-len, "%d,%s;", sorted[i].siod_id, gpios);
+		if(item_len >= max_len-len){
+			str[len]='\0';		//Only whole records
+			break;
+		}
+		len += item_len;
     }
+
+	free(sorted);
+
+	return i;
 }
 
 /*
@@ -2379,43 +2904,36 @@ unsigned char binarystr2byte(char *str){
  * Retreive an IP address for a given siod_id from the IPT
  * 0 if siod_id found in the IPT, -1 otherwise 
  */
-int IPTget(struct IPT_nod *ipt, unsigned short siod_id, unsigned long *IPaddress){
+int IPTget(struct SIOD_tab *ipt, unsigned short siod_id, unsigned long *IPaddress){
 
-    int i;
-    i=0;
+	struct IPT_nod *nod;
 
-    while((ipt+i)->siod_id){
-        if ((ipt+i)->siod_id == siod_id) {
-            *IPaddress = (ipt+i)->IPaddress;
-            return 0;
-        }
-        i++;
-    }
+	nod = SIODfind(ipt, siod_id);
+	if(nod == NULL) return -1;
 
-    return -1;
+	*IPaddress = nod->IPaddress;
+
+	return 0;
 }
 
 /*
  * Set IP address for a given siod_id to the IPT
- * If siod_id item not available in the IPT we add it at the end 
+ * If siod_id item not available in the IPT we add it
  */
-void IPTset(struct IPT_nod *ipt, unsigned short siod_id, unsigned long IPaddress){
+void IPTset(struct SIOD_tab *ipt, unsigned short siod_id, unsigned long IPaddress){
 
-    int i;
-    i=0;
+	struct IPT_nod *nod;
+	int added;
 
-    while((ipt+i)->siod_id){
-        if ((ipt+i)->siod_id == siod_id) {
-            (ipt+i)->IPaddress = IPaddress;
-            return;
-        }
-        i++;
-    }
+	nod = SIODinsert(ipt, siod_id, &added);
+	if(nod == NULL){
+		fprintf(stderr,"Can not add SIOD=%d in the IPT\n", siod_id);
+		return;
+	}
 
-	(ipt+i)->siod_id = siod_id;
-	(ipt+i)->IPaddress = IPaddress;	
+	nod->IPaddress = IPaddress;
 
-	if(verbose>=2) {
+	if(added && verbose>=2) {
 		char IPaddress_str[STR_MAX];
         IPaddress_num2str(IPaddress, IPaddress_str);
 		fprintf(stderr,"IPTset: SIOD=%d added in our IPT with address %s\n", siod_id, IPaddress_str);
@@ -2631,26 +3149,135 @@ int CheckTimeRange(void){
 }
 
 /*
- * The tripel (AAAA1, X1, Y1) defines a rule in PLC table
- * If that rule found it will be deleted from PLC table
+ * Compare two PLC dependencies by siod_id, then by rule
+ */
+static int PLCdep_cmp(const void *a, const void *b){
+
+	const struct PLC_dep *da = a, *db = b;
+
+	if(da->siod_id != db->siod_id) return (da->siod_id < db->siod_id)?-1:1;
+	return da->rule - db->rule;
+}
+
+/*
+ * Rebuild the dependency index from the rules. Called once the rules
+ * changed, when the index is needed
+ */
+static void PLCindex(void){
+
+	struct PLC_rule *r;
+	int i;
+
+	PLCT.n_deps=0;
+	for(i=0;i<PLCT.n;i++){
+		r=&PLCT.rules[i];
+		PLCT.deps[PLCT.n_deps].siod_id=r->siod2;
+		PLCT.deps[PLCT.n_deps].mask=1<<r->x2;
+		PLCT.deps[PLCT.n_deps].rule=i;
+		if(r->siod3 == r->siod2){
+			PLCT.deps[PLCT.n_deps].mask |= 1<<r->x3;
+		} else {
+			PLCT.n_deps++;
+			PLCT.deps[PLCT.n_deps].siod_id=r->siod3;
+			PLCT.deps[PLCT.n_deps].mask=1<<r->x3;
+			PLCT.deps[PLCT.n_deps].rule=i;
+		}
+		PLCT.n_deps++;
+	}
+	qsort(PLCT.deps, PLCT.n_deps, sizeof(struct PLC_dep), PLCdep_cmp);
+
+	PLCT.stale=0;
+}
+
+/*
+ * Queue rule i for evaluation by the next PLCexec, once
+ */
+static void PLCqueue(int i){
+
+	if(PLCT.rules[i].queued) return;
+
+	PLCT.rules[i].queued=1;
+	PLCT.queue[PLCT.n_queue++]=i;
+}
+
+/*
+ * Notify the PLC that the IOs in mask changed for siod_id in the GST.
+ * The rules checking one of these IOs are queued for evaluation
+ */
+void PLCchanged(unsigned short siod_id, unsigned char mask){
+
+	int low, high, mid;
+
+	if(PLCT.n == 0 || mask == 0) return;
+	if(PLCT.stale) PLCindex();
+
+	/* first dependency on siod_id */
+	low=0; high=PLCT.n_deps;
+	while(low < high){
+		mid=(low+high)/2;
+		if(PLCT.deps[mid].siod_id < siod_id) low=mid+1;
+		else high=mid;
+	}
+
+	for(;low<PLCT.n_deps && PLCT.deps[low].siod_id == siod_id;low++){
+		if(PLCT.deps[low].mask & mask) PLCqueue(PLCT.deps[low].rule);
+	}
+}
+
+/*
+ * Make room for one more rule, the table doubles when it is full
+ * Function returns 0 on success, -1 otherwise
+ */
+static int PLCgrow(void){
+
+	struct PLC_rule *rules;
+	struct PLC_dep *deps;
+	int *queue, max;
+
+	if(PLCT.n < PLCT.max) return 0;
+
+	max=PLCT.max?2*PLCT.max:16;
+	rules=realloc(PLCT.rules, max*sizeof(struct PLC_rule));
+	if(rules == NULL) return -1;
+	PLCT.rules=rules;
+	deps=realloc(PLCT.deps, 2*max*sizeof(struct PLC_dep));	//two IOs checked per rule
+	if(deps == NULL) return -1;
+	PLCT.deps=deps;
+	queue=realloc(PLCT.queue, 2*max*sizeof(int));	//rules queued again while the queue is evaluated
+	if(queue == NULL) return -1;
+	PLCT.queue=queue;
+
+	PLCT.max=max;
+
+	return 0;
+}
+
+/*
+ * Add a rule AAAA1/X1/Y1/AAAA2/X2/Y2/and_or/AAAA3/X3/Y3 in PLC table.
+ * The rule is compiled once here, a rule with the same tripel (AAAA1, X1, Y1)
+ * is replaced.
  *
  * Function return 0 if a rule has been added, -1 otherwise
  */
-int PLCadd(char *rule){
+int PLCadd(const char *rule){
 
 	char rule_[STR_MAX],*AAAA1,*X1,*Y1,*AAAA2,*X2,*Y2,*and_or,*AAAA3,*X3,*Y3;
-	char *PLC_args[10];
+	char *PLC_args[UDP_ARGS_MAX];
     int PLC_n_args;
+	struct PLC_rule *r;
 
-	if(PLCT.n>=RULES_MAX){
-
-		fprintf(stderr,"Can not add PLC rule, We already have %d rules\n", RULES_MAX);
+	if(strlen(rule) >= STR_MAX){
+		fprintf(stderr,"PLCadd: rule too long\n");
 		return -1;
 	}
 
 	strcpy(rule_, rule);
 	RemoveSpaces(rule_);
-	extract_args(rule_, PLC_args, &PLC_n_args);	
+	extract_args(rule_, PLC_args, &PLC_n_args);
+	if(PLC_n_args != 10){
+		fprintf(stderr,"PLCadd: a rule must have 10 fields\n");
+		return -1;
+	}
 	AAAA1=PLC_args[0],X1=PLC_args[1],Y1=PLC_args[2],AAAA2=PLC_args[3],X2=PLC_args[4],Y2=PLC_args[5],and_or=PLC_args[6],AAAA3=PLC_args[7],X3=PLC_args[8],Y3=PLC_args[9];
 
 
@@ -2658,7 +3285,7 @@ int PLCadd(char *rule){
 	if(atoi(AAAA1)<1000 || atoi(AAAA1)>9999){
 		fprintf(stderr,"PLCadd: AAAA1 must represent 4 digit number\n");
         return -1;
-	} 
+	}
     if(atoi(AAAA2)<1000 || atoi(AAAA2)>9999){
         fprintf(stderr,"PLCadd: AAAA2 must represent 4 digit number\n");
         return -1;
@@ -2698,20 +3325,31 @@ int PLCadd(char *rule){
 
 
 	/* Check for rule duplications */
-	if(PLC_n_args>=3)
-		PLCdel(AAAA1, X1, Y1); //So we are sure no rules duplications 
+	PLCdel(AAAA1, X1, Y1); //So we are sure no rules duplications
 
-	PLCT.rules[PLCT.n]=malloc(strlen(rule));
-	if(PLCT.rules[PLCT.n] == NULL){
+	if(PLCgrow()){
 		fprintf(stderr,"PLCadd: Can not allocate memory\n");
 		return -1;
 	}
 
-	strcpy(PLCT.rules[PLCT.n], rule);
+	r=&PLCT.rules[PLCT.n];
+	r->text=strdup(rule);
+	if(r->text == NULL){
+		fprintf(stderr,"PLCadd: Can not allocate memory\n");
+		return -1;
+	}
 
-	PLCT.triggered[PLCT.n]=0;
+	r->siod1=atoi(AAAA1); r->x1=atoi(X1); r->y1=Y1[0]-'0';
+	r->siod2=atoi(AAAA2); r->x2=atoi(X2); r->y2=Y2[0]-'0';
+	r->siod3=atoi(AAAA3); r->x3=atoi(X3); r->y3=Y3[0]-'0';
+	r->and=!strcmp(and_or, "and");
+	r->triggered=0;
+	r->queued=0;
 
 	PLCT.n++;
+	PLCT.stale=1;
+
+	PLCqueue(PLCT.n-1);	//A new rule is checked against the current GST
 
 	return 0;
 }
@@ -2724,90 +3362,69 @@ int PLCadd(char *rule){
  * Function return 0 if a rule has been deleted, -1 otherwise
  */
 int PLCdel(char *AAAA1, char *X1, char *Y1){
-	int i, j, PLC_n_nargs;
-	char *PLC_args[10];
-	int PLC_n_args;
-	char rule_[STR_MAX];
-                   
+	int i, j, k, q;
+	unsigned short siod1;
+	unsigned char x1, y1;
+
+	siod1=atoi(AAAA1); x1=atoi(X1); y1=Y1[0]-'0';
+
 	for(i=0;i<PLCT.n;i++){
 
-		strcpy(rule_, PLCT.rules[i]);
-		extract_args(rule_, PLC_args, &PLC_n_args);
+		if(PLCT.rules[i].siod1 == siod1 && PLCT.rules[i].x1 == x1 && PLCT.rules[i].y1 == y1){
 
-		if(PLC_n_args >=3 && !strcmp(PLC_args[0], AAAA1) && !strcmp(PLC_args[1], X1) && !strcmp(PLC_args[2], Y1)){
+			free(PLCT.rules[i].text);     	//delete the rule memory;
 
-			free(PLCT.rules[i]);     	//delete the rule memory;
-		
-			for(j=i;j<PLCT.n-1;j++){	//Move the pointers so no holes in PLCT.rules array
-			                       
+			for(j=i;j<PLCT.n-1;j++)			//Move the rules so no holes in PLCT.rules array
 				PLCT.rules[j] = PLCT.rules[j+1];
 
-				PLCT.triggered[j] = PLCT.triggered[j+1];
-			}
-				
 			PLCT.n--;           	//Reduce rules count
-			
+			PLCT.stale=1;
+
+			//Drop it from the evaluation queue, the rules after it moved down
+			for(k=j=0;k<PLCT.n_queue;k++){
+				q=PLCT.queue[k];
+				if(q == i) continue;
+				PLCT.queue[j++] = (q > i)?q-1:q;
+			}
+			PLCT.n_queue=j;
+
 			return 0;
 		}
 	}
 
-	return -1;	
+	return -1;
 }
 
 
 
 /*
- * The tripel (AAAA1, X1, Y1) defines a rule in PLC table
- * If that rule found it will be deleted from the config
+ * Write the rules of the PLC table in the config, in place of the ones there
  *
  * Function returns 0
  */
-int PLCdel_config(char *AAAA1, char *X1, char *Y1){
-	char list[STR_MAX], rule[STR_MAX], del_rule[STR_MAX], *plist;
-	int len, len_list;
+int PLCwrite_config(void){
+	int i;
 
-	uciget("siod.plcrules.rule", list);
 	ucidelete("siod.plcrules.rule");
+	for(i=0;i<PLCT.n;i++)
+		uciadd_list("siod.plcrules.rule", PLCT.rules[i].text);
 
-	len=sprintf(del_rule,"%s/%s/%s",AAAA1,X1,Y1);
-	len_list=strlen(list);
-	plist=list;
-	do{
-		sscanf(plist, "%s", rule);
-		plist+=(strlen(rule)+1);
-		if(!strncmp(rule, del_rule, len)) continue;
-		uciadd_list("siod.plcrules.rule", rule);
-
-	} while((rule != '\0') && (plist-list < len_list));
-	
 	ucicommit();
 
-	if(verbose>=2)  fprintf(stderr,"PLC rule have been deleted from the config file\n");
+	if(verbose>=2)  fprintf(stderr,"PLC rules have been written in the config file\n");
 
 	return 0;
 
 }
 
 /*
- * The tripel (AAAA1, X1, Y1) defines a rule in PLC table
- * If that rule found it will be deleted from PLC table
+ * Add the rules from the config in the PLC table
  *
  * Function returns 0
  */
 int PLCread_config(void){
-    char list[STR_MAX], rule[STR_MAX], *plist;
-    int len_list;
 
-    uciget("siod.plcrules.rule", list);
-
-    len_list=strlen(list);
-    plist=list;
-    do{
-        sscanf(plist, "%s", rule);
-        plist+=(strlen(rule)+1);
-		PLCadd(rule);
-
-    } while((rule != '\0') && (plist-list < len_list));
+    uciforeach("siod.plcrules.rule", PLCadd);
 
     if(verbose>=2) fprintf(stderr,"PLC rules have been read from the config file\n");
 
@@ -2816,72 +3433,77 @@ int PLCread_config(void){
 }
 
 /*
- * Prints the rules in our PLC table
- * PLC should be allocated by the caller with a memory big enought
+ * Prints the rules in our PLC table, as many as fit in max_len bytes
+ * PLC should be allocated by the caller
  */
-void PLCprint(char *PLCstr){
+void PLCprint(char *PLCstr, int max_len){
 
-	int i;
+	int i, len, n;
+
+	len=0;
 	PLCstr[0]='\0';
 	for(i=0;i<PLCT.n;i++) {
-		strcat(PLCstr, PLCT.rules[i]);
-		strcat(PLCstr, "/");
+		n=strlen(PLCT.rules[i].text);
+		if(len+n+1 >= max_len) break;
+
+		sprintf(PLCstr+len, "%s%s", len?"/":"", PLCT.rules[i].text);
+		len+=n+(len?1:0);
 	}
-	PLCstr[strlen(PLCstr)-1]='\0';//Remove the final '/'
 
 }
 
 /*
- * Check the PLC rules and triggers those whos conditions met
- * Ment to be executed periodically (for example once each 100ms) 
- * The function reads the local inputs and update the GST
+ * Evaluate the PLC rules queued since the last call and trigger those whos conditions met
+ * Ment to be executed periodically (for example once each 100ms) and after GST updates
  */
 void PLCexec(void){
 
-    int i;
-    char rule_[STR_MAX], Y[STR_MAX];
-    char *args[10];
-    int n_args;
-	char *AAAA1, *X1, *Y1, *AAAA2, *X2, *Y2, *and_or, *AAAA3, *X3, *Y3;
+    int i, k, n;
+	char X1[2], Y1[2];
 	unsigned char gpios1, gpios2;
+	int cond2, cond3;
 	char msg[MSG_MAX];
 	unsigned long ipaddress;
+	struct PLC_rule *r;
 
-	getgpio("", Y);//Use to update GST, result in GPIOs
-
-    for(i=0;i<PLCT.n;i++) {
+	n=PLCT.n_queue;	//the rules queued by this evaluation wait for the next one
+    for(k=0;k<n;k++) {
 
-        strcpy(rule_, PLCT.rules[i]);
-        extract_args(rule_, args, &n_args);
+		i=PLCT.queue[k];
+		r=&PLCT.rules[i];
+		r->queued=0;
 
-		AAAA1=args[0]; X1=args[1]; Y1=args[2]; AAAA2=args[3], X2=args[4]; Y2=args[5]; and_or=args[6]; AAAA3=args[7]; X3=args[8]; Y3=args[9];	
+		if(verbose==3) fprintf(stderr,"rule[%d]: %s\n", i, r->text);
 
-		if(verbose==3) fprintf(stderr,"rule[%d]: %s/%s/%s/%s/%s/%s/%s/%s/%s/%s\n", i, AAAA1,X1,Y1,AAAA2,X2,Y2,and_or,AAAA3,X3,Y3);
-
-		if(GSTget(GST, atoi(AAAA2), &gpios1)) continue;
-		if(GSTget(GST, atoi(AAAA3), &gpios2)) continue;
+		if(GSTget(&GST, r->siod2, &gpios1)) continue;
+		if(GSTget(&GST, r->siod3, &gpios2)) continue;
 
 		if(verbose==3) fprintf(stderr,"gpios1=0x%x, gpios2=0x%x\n", gpios1, gpios2);
 
-		if((!strcmp(and_or, "or"))?((((gpios1>>(X2[0]-'0'))&1) == (Y2[0]-'0')) || (((gpios2>>(X3[0]-'0'))&1) == (Y3[0]-'0'))): \
-								   ((((gpios1>>(X2[0]-'0'))&1) == (Y2[0]-'0')) && (((gpios2>>(X3[0]-'0'))&1) == (Y3[0]-'0')))){
+		cond2 = ((gpios1>>r->x2)&1) == r->y2;
+		cond3 = ((gpios2>>r->x3)&1) == r->y3;
+
+		if(r->and?(cond2 && cond3):(cond2 || cond3)){
 			//Trigger rule i if it is not already trigered
-			if(PLCT.triggered[i]==0){
-				if(!strcmp(AAAA1, SIOD_ID)){//Have to set a local output
-  
+			if(r->triggered==0){
+				X1[0]='0'+r->x1; X1[1]='\0';
+				Y1[0]='0'+r->y1; Y1[1]='\0';
+
+				if(r->siod1 == atoi(SIOD_ID)){//Have to set a local output
+
 					setgpio(X1, Y1);
 
 					//broadcast Put message
 					sprintf(msg, "JNTCIT/Put/%s/%s/%s", SIOD_ID, X1, Y1);
 					if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
-					broadcast(msg);				
-	
-				} else {					//remote output need to be set				
+					broadcast(msg);
 
-					fprintf(stderr,"AAAA1=%s\n", AAAA1);
+				} else {					//remote output need to be set
+
+					fprintf(stderr,"AAAA1=%d\n", r->siod1);
 
 					/* AAAA1 -> IPaddress from IPT */
-					if(!IPTget(IPT, atoi(AAAA1), &ipaddress)){
+					if(!IPTget(&IPT, r->siod1, &ipaddress)){
                     						//Unicast Set to AAAA1
 
 						sprintf(msg, "JNTCIT/Set/%s/%s", X1, Y1);
@@ -2889,26 +3511,29 @@ void PLCexec(void){
                     	if(verbose>=2) fprintf(stderr,"Sent: %s\n", msg);
 
 						cliaddr.sin_addr.s_addr=ipaddress;
-						unicast(msg);	
-				
+						unicast(msg);
+
 					} else{
 
-						fprintf(stderr,"PLCexec: the IPaddress of rule SIOD=%s not available in our IPT\n", AAAA1);
+						fprintf(stderr,"PLCexec: the IPaddress of rule SIOD=%d not available in our IPT\n", r->siod1);
 
 					}
-					
+
 				}
-				
-				PLCT.triggered[i]=1;
-				 
+
+				r->triggered=1;
+
 			}
 
 		} else{
 			//rearm rule i
-			PLCT.triggered[i]=0;
+			r->triggered=0;
     	}
 
 	}
+
+	PLCT.n_queue-=n;
+	memmove(PLCT.queue, PLCT.queue+n, PLCT.n_queue*sizeof(int));
 }
 
 /*
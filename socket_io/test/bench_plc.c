@@ -0,0 +1,106 @@
+/*
+ * bench_plc.c
+ *
+ * PLC rules with thousands of rules, compiled rules against the former
+ * string rules of plc_old.c: adding them, a tick when nothing changed and
+ * a tick after a Put changed one IO of the GST.
+ */
+
+/* the PLC lives in the socket_io program, built here without its main */
+#define main socket_io_main
+#include "socket_io.c"
+#undef main
+
+#include "plc_old.h"
+#include "test.h"
+
+#define NB_SIODS	100		/* SIODs in the GST */
+#define NB_TICKS	200
+
+static int gst_get(unsigned short siod_id, unsigned char *gpios){
+
+	return GSTget(&GST, siod_id, gpios);
+}
+
+/* rule i: a remote output set from two IOs of two SIODs, 'and' or 'or' */
+static void make_rule(int i, char *rule){
+
+	sprintf(rule, "%d/%d/%d/%d/%d/%d/%s/%d/%d/%d", 1001+(i/8)%8999, (i/2)%4, i%2,
+		1000+(i*7)%NB_SIODS, i%8, (i/3)%2, (i%3)?"and":"or", 1000+(i*13)%NB_SIODS, (i+3)%8, (i/5)%2);
+}
+
+static void clear_rules(void){
+
+	int i;
+
+	for(i=0;i<PLCT.n;i++) free(PLCT.rules[i].text);
+	PLCT.n=0;
+	PLCT.n_queue=0;
+	PLCT.stale=1;
+	for(i=0;i<old_PLCT.n;i++) free(old_PLCT.rules[i]);
+	old_PLCT.n=0;
+}
+
+static void bench(int nb_rules){
+
+	char rule[STR_MAX];
+	double t0;
+	int i;
+
+	printf("bench_plc: %d rules, %d SIODs in the GST\n", nb_rules, NB_SIODS);
+
+	test_quiet(1);
+	t0=bench_now();
+	for(i=0;i<nb_rules;i++){ make_rule(i, rule); old_PLCadd(rule); }
+	test_quiet(0);
+	bench_report("add a rule, old", t0, nb_rules);
+
+	test_quiet(1);
+	t0=bench_now();
+	for(i=0;i<nb_rules;i++){ make_rule(i, rule); PLCadd(rule); }
+	PLCexec();
+	test_quiet(0);
+	bench_report("add a rule, new", t0, nb_rules);
+
+	test_quiet(1);
+	t0=bench_now();
+	for(i=0;i<NB_TICKS;i++) old_PLCexec(gst_get);
+	test_quiet(0);
+	bench_report("tick, nothing changed, old", t0, NB_TICKS);
+
+	test_quiet(1);
+	t0=bench_now();
+	for(i=0;i<NB_TICKS;i++) PLCexec();
+	test_quiet(0);
+	bench_report("tick, nothing changed, new", t0, NB_TICKS);
+
+	test_quiet(1);
+	t0=bench_now();
+	for(i=0;i<NB_TICKS;i++){ GSTset(&GST, 1000+i%NB_SIODS, 1<<(i%8)); old_PLCexec(gst_get); }
+	test_quiet(0);
+	bench_report("tick after one Put, old", t0, NB_TICKS);
+
+	test_quiet(1);
+	t0=bench_now();
+	for(i=0;i<NB_TICKS;i++){ GSTset(&GST, 1000+i%NB_SIODS, 1<<(i%8)); PLCexec(); }
+	test_quiet(0);
+	bench_report("tick after one Put, new", t0, NB_TICKS);
+
+	clear_rules();
+}
+
+int main(void){
+
+	int i;
+
+	strcpy(SIOD_ID, "1000");
+	udpfd=bcast_sockfd=-1;
+	for(i=0;i<NB_SIODS;i++) GSTadd(&GST, 1000+i, 0);
+
+	bench(1000);
+	bench(5000);
+
+	return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
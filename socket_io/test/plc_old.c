@@ -0,0 +1,173 @@
+/*
+ * plc_old.c
+ *
+ * PLCadd(), PLCdel() and PLCexec() of socket_io.c before the rules were
+ * compiled, reference of test_plc and bench_plc. The rules are kept as
+ * strings and all of them are parsed again on every PLCexec().
+ *
+ * Changes from the original: the table is bigger, the rule copy gets room
+ * for its '\0', PLCexec() no longer reads the local IOs (done by the main
+ * loop now) and only records the triggering, the Set or Put it sent then
+ * is left out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plc_old.h"
+
+#define STR_MAX		100		/* Maximum string length */
+
+/* parsing of socket_io.c, unchanged */
+void RemoveSpaces(char* source);
+int extract_args(char *datagram, char *args[], int *n_args);
+
+struct old_PLCT_s old_PLCT;
+
+int old_PLCadd(const char *rule){
+
+	char rule_[STR_MAX],*AAAA1,*X1,*Y1,*AAAA2,*X2,*Y2,*and_or,*AAAA3,*X3,*Y3;
+	char *PLC_args[10];
+    int PLC_n_args;
+
+	if(old_PLCT.n>=OLD_RULES_MAX){
+
+		fprintf(stderr,"Can not add PLC rule, We already have %d rules\n", OLD_RULES_MAX);
+		return -1;
+	}
+
+	strcpy(rule_, rule);
+	RemoveSpaces(rule_);
+	extract_args(rule_, PLC_args, &PLC_n_args);
+	AAAA1=PLC_args[0],X1=PLC_args[1],Y1=PLC_args[2],AAAA2=PLC_args[3],X2=PLC_args[4],Y2=PLC_args[5],and_or=PLC_args[6],AAAA3=PLC_args[7],X3=PLC_args[8],Y3=PLC_args[9];
+
+
+	/* Check if rule is valid */
+	if(atoi(AAAA1)<1000 || atoi(AAAA1)>9999){
+		fprintf(stderr,"PLCadd: AAAA1 must represent 4 digit number\n");
+        return -1;
+	}
+    if(atoi(AAAA2)<1000 || atoi(AAAA2)>9999){
+        fprintf(stderr,"PLCadd: AAAA2 must represent 4 digit number\n");
+        return -1;
+    }
+    if(atoi(AAAA3)<1000 || atoi(AAAA3)>9999){
+        fprintf(stderr,"PLCadd: AAAA3 must represent 4 digit number\n");
+        return -1;
+    }
+    if(atoi(X1)<0 || atoi(X1)>3){
+        fprintf(stderr,"PLCadd: X1 should be 0,1,2 or 3\n");
+        return -1;
+    }
+    if(atoi(X2)<0 || atoi(X2)>7){
+        fprintf(stderr,"PLCadd: X2 should be in the range [0,1, ... 7]\n");
+        return -1;
+    }
+    if(atoi(X3)<0 || atoi(X3)>7){
+        fprintf(stderr,"PLCadd: X3 should be in the range [0,1, ... 7]\n");
+        return -1;
+    }
+    if(strlen(Y1)!=1 || (Y1[0]!='0' && Y1[0]!='1')){
+        fprintf(stderr,"PLCadd: Y1 should be 0 or 1\n");
+        return -1;
+    }
+    if(strlen(Y2)!=1 || (Y2[0]!='0' && Y2[0]!='1')){
+        fprintf(stderr,"PLCadd: Y2 should be 0 or 1\n");
+        return -1;
+    }
+    if(strlen(Y3)!=1 || (Y3[0]!='0' && Y3[0]!='1')){
+        fprintf(stderr,"PLCadd: Y3 should be 0 or 1\n");
+        return -1;
+    }
+    if(strcmp(and_or, "and") && strcmp(and_or, "or")){
+        fprintf(stderr,"PLCadd: and_or parameter should be 'and' or 'or' \n");
+        return -1;
+    }
+
+
+	/* Check for rule duplications */
+	if(PLC_n_args>=3)
+		old_PLCdel(AAAA1, X1, Y1); //So we are sure no rules duplications
+
+	old_PLCT.rules[old_PLCT.n]=malloc(strlen(rule)+1);
+	if(old_PLCT.rules[old_PLCT.n] == NULL){
+		fprintf(stderr,"PLCadd: Can not allocate memory\n");
+		return -1;
+	}
+
+	strcpy(old_PLCT.rules[old_PLCT.n], rule);
+
+	old_PLCT.triggered[old_PLCT.n]=0;
+
+	old_PLCT.n++;
+
+	return 0;
+}
+
+int old_PLCdel(char *AAAA1, char *X1, char *Y1){
+	int i, j;
+	char *PLC_args[10];
+	int PLC_n_args;
+	char rule_[STR_MAX];
+
+	for(i=0;i<old_PLCT.n;i++){
+
+		strcpy(rule_, old_PLCT.rules[i]);
+		extract_args(rule_, PLC_args, &PLC_n_args);
+
+		if(PLC_n_args >=3 && !strcmp(PLC_args[0], AAAA1) && !strcmp(PLC_args[1], X1) && !strcmp(PLC_args[2], Y1)){
+
+			free(old_PLCT.rules[i]);     	//delete the rule memory;
+
+			for(j=i;j<old_PLCT.n-1;j++){	//Move the pointers so no holes in PLCT.rules array
+
+				old_PLCT.rules[j] = old_PLCT.rules[j+1];
+
+				old_PLCT.triggered[j] = old_PLCT.triggered[j+1];
+			}
+
+			old_PLCT.n--;           	//Reduce rules count
+
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void old_PLCexec(int (*gst_get)(unsigned short siod_id, unsigned char *gpios)){
+
+    int i;
+    char rule_[STR_MAX];
+    char *args[10];
+    int n_args;
+	char *AAAA2, *X2, *Y2, *and_or, *AAAA3, *X3, *Y3;
+	unsigned char gpios1, gpios2;
+
+    for(i=0;i<old_PLCT.n;i++) {
+
+        strcpy(rule_, old_PLCT.rules[i]);
+        extract_args(rule_, args, &n_args);
+
+		AAAA2=args[3], X2=args[4]; Y2=args[5]; and_or=args[6]; AAAA3=args[7]; X3=args[8]; Y3=args[9];
+
+		if(gst_get(atoi(AAAA2), &gpios1)) continue;
+		if(gst_get(atoi(AAAA3), &gpios2)) continue;
+
+		if((!strcmp(and_or, "or"))?((((gpios1>>(X2[0]-'0'))&1) == (Y2[0]-'0')) || (((gpios2>>(X3[0]-'0'))&1) == (Y3[0]-'0'))): \
+								   ((((gpios1>>(X2[0]-'0'))&1) == (Y2[0]-'0')) && (((gpios2>>(X3[0]-'0'))&1) == (Y3[0]-'0')))){
+			//Trigger rule i if it is not already trigered
+			if(old_PLCT.triggered[i]==0){
+				old_PLCT.triggered[i]=1;
+			}
+
+		} else{
+			//rearm rule i
+			old_PLCT.triggered[i]=0;
+    	}
+
+	}
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,28 @@
+/*
+ * plc_old.h
+ *
+ * The former PLC rule table of socket_io, see plc_old.c.
+ */
+
+#ifndef _PLC_OLD_H
+#define _PLC_OLD_H
+
+#define OLD_RULES_MAX	10000	/* 10 in socket_io, raised to compare with thousands of rules */
+
+struct old_PLCT_s {
+	int	n;								/* amount of active rules */
+	char *rules[OLD_RULES_MAX];			/* Keep the rules in string form */
+	int triggered[OLD_RULES_MAX];		/* Notifies if rule has triggered */
+};
+
+extern struct old_PLCT_s old_PLCT;
+
+int old_PLCadd(const char *rule);
+int old_PLCdel(char *AAAA1, char *X1, char *Y1);
+
+/* gst_get reads the GST as GSTget does, 0 if siod_id is found */
+void old_PLCexec(int (*gst_get)(unsigned short siod_id, unsigned char *gpios));
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,67 @@
+/*
+ * test.h
+ *
+ * Checks and timing shared by the host tests and benchmarks of socket_io,
+ * see Makefile.
+ */
+
+#ifndef _TEST_H
+#define _TEST_H
+
+#include <stdio.h>		/* printf, fprintf */
+#include <time.h>		/* clock_gettime */
+#include <fcntl.h>		/* open */
+#include <unistd.h>		/* dup, dup2 */
+
+static int test_fail __attribute__((unused)) = 0;
+
+/* report a failed condition and go on with the other checks */
+#define CHECK(cond) do { \
+		if (!(cond)) { \
+			fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			test_fail++; \
+		} \
+	} while (0)
+
+/* exit status of a test program */
+#define TEST_END(name) ( \
+		printf("%s: %s\n", (name), test_fail ? "FAILED" : "passed"), \
+		test_fail ? 1 : 0)
+
+/* socket_io reports to stderr as it goes, test_quiet(1) sends that to
+   /dev/null until test_quiet(0) */
+static inline void test_quiet(int on){
+
+	static int saved = -1;
+	int fd;
+
+	fflush(stderr);
+	if(on && saved < 0){
+		saved = dup(2);
+		fd = open("/dev/null", O_WRONLY);
+		dup2(fd, 2);
+		close(fd);
+	} else if(!on && saved >= 0){
+		dup2(saved, 2);
+		close(saved);
+		saved = -1;
+	}
+}
+
+static inline double bench_now(void){
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* print the cost of one of n iterations started at t0 */
+static inline void bench_report(const char *what, double t0, long n){
+
+	printf("  %-40s %10.2f us\n", what, (bench_now() - t0) * 1e6 / n);
+}
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
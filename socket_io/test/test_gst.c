@@ -0,0 +1,95 @@
+/*
+ * test_gst.c
+ *
+ * GSTReq answered with the whole GST: the GSTdata pages sent back must
+ * each fit in a message and, put together, give the records of GSTprint
+ * in one piece.
+ */
+
+/* the GST lives in the socket_io program, built here without its main */
+#define main socket_io_main
+#include "socket_io.c"
+#undef main
+
+#include "test.h"
+
+#define NB_SIODS	300		/* about 9 pages */
+
+/* answer a GSTReq, the GSTdata pages go to sock; returns the number of pages */
+static int request(int sock, char pages[][MSG_MAX+1], int max_pages){
+
+	char datagram[SOCKET_BUFLEN];
+	int n, len;
+
+	strcpy(datagram, "JNTCIT/GSTReq");
+	process_udp(datagram);
+
+	for(n=0;n<max_pages;n++){
+		len=recv(sock, pages[n], MSG_MAX+1, MSG_DONTWAIT);
+		if(len < 0) break;
+		pages[n][len]='\0';
+	}
+	return n;
+}
+
+int main(void){
+
+	static char pages[64][MSG_MAX+1];
+	static char all[NB_SIODS*16], got[NB_SIODS*16];
+	struct sockaddr_in addr;
+	char *data, *first, *total;
+	int sock, n, i, records, bad=0;
+
+	/* the answer is unicast to cliaddr on PORT, received here */
+	sock=socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family=AF_INET;
+	addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+	addr.sin_port=htons(PORT);
+	if(bind(sock, (struct sockaddr *)&addr, sizeof(addr))){
+		perror("test_gst: bind");
+		return 1;
+	}
+	udpfd=socket(AF_INET, SOCK_DGRAM, 0);
+	cliaddr=addr;
+	strcpy(SIOD_ID, "1000");
+
+	/* an empty GST, a single empty page */
+	test_quiet(1);
+	n=request(sock, pages, 64);
+	test_quiet(0);
+	CHECK(n == 1);
+	CHECK(!strcmp(pages[0], "JNTCIT/GSTdata//0/0"));
+
+	for(i=0;i<NB_SIODS;i++) GSTadd(&GST, 1000+(i*37)%NB_SIODS, (i*73)&0xff);
+	CHECK(GSTprint(&GST, all, sizeof(all), 0) == NB_SIODS);
+
+	test_quiet(1);
+	n=request(sock, pages, 64);
+	test_quiet(0);
+	CHECK(n > 1);
+
+	got[0]='\0';
+	records=0;
+	for(i=0;i<n;i++){
+		CHECK(strlen(pages[i]) < MSG_MAX);
+		CHECK(!strncmp(pages[i], "JNTCIT/GSTdata/", 15));
+		data=pages[i]+15;
+		total=strrchr(data, '/'); *total++='\0';
+		first=strrchr(data, '/'); *first++='\0';
+		if(atoi(first) != records || atoi(total) != NB_SIODS) bad++;
+		strcat(got, data);
+		while(*data) records+=(*data++ == ';');
+	}
+	CHECK(bad == 0);
+	CHECK(records == NB_SIODS);
+	CHECK(!strcmp(got, all));
+	printf("test_gst: %d records in %d GSTdata messages\n", records, n);
+
+	close(sock);
+	close(udpfd);
+
+	return TEST_END("test_gst");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
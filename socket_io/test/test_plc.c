@@ -0,0 +1,115 @@
+/*
+ * test_plc.c
+ *
+ * The compiled PLC rules against the former string rules of plc_old.c:
+ * 2000 rules, 3000 random GST changes, the same rules must be triggered
+ * after each of them. Rules replaced and deleted on the way.
+ */
+
+/* the PLC lives in the socket_io program, built here without its main */
+#define main socket_io_main
+#include "socket_io.c"
+#undef main
+
+#include "plc_old.h"
+#include "test.h"
+
+#define NB_RULES	2000
+#define NB_CHANGES	3000
+#define NB_SIODS	60		/* SIODs checked by the rules, the last 10 join the GST late */
+
+static int gst_get(unsigned short siod_id, unsigned char *gpios){
+
+	return GSTget(&GST, siod_id, gpios);
+}
+
+/* rule i: a remote output set from two IOs of two SIODs, 'and' or 'or' */
+static void make_rule(int i, int variant, char *rule){
+
+	sprintf(rule, "%d/%d/%d/%d/%d/%d/%s/%d/%d/%d", 2001+(i/8)%7000, (i/2)%4, i%2,
+		1001+(i*7+variant)%NB_SIODS, (i+variant)%8, (i/3)%2, ((i+variant)%3)?"and":"or",
+		1001+(i*13)%NB_SIODS, (i+3)%8, (i/5)%2);
+}
+
+/* number of rules whose triggered state differs */
+static int compare(void){
+
+	int i, n=0;
+
+	if(PLCT.n != old_PLCT.n) return -1;
+	for(i=0;i<PLCT.n;i++){
+		if(strcmp(PLCT.rules[i].text, old_PLCT.rules[i])) n++;
+		else if(PLCT.rules[i].triggered != old_PLCT.triggered[i]) n++;
+	}
+	return n;
+}
+
+int main(void){
+
+	unsigned char gpios[NB_SIODS]={0};
+	unsigned seed=1;
+	char rule[STR_MAX], AAAA1[8], X1[2], Y1[2];
+	int i, k, r, s, bad=0, fired=0, on;
+
+	test_quiet(1);
+	strcpy(SIOD_ID, "1000");
+	udpfd=bcast_sockfd=-1;
+
+	GSTadd(&GST, 1000, 0);
+	for(i=0;i<NB_SIODS-10;i++) GSTadd(&GST, 1001+i, 0);
+
+	for(i=0;i<NB_RULES;i++){
+		make_rule(i, 0, rule);
+		CHECK(PLCadd(rule) == 0);
+		CHECK(old_PLCadd(rule) == 0);
+	}
+	CHECK(PLCT.n == NB_RULES);		/* far past the former 10 rules */
+
+	PLCexec();
+	old_PLCexec(gst_get);
+	CHECK(compare() == 0);
+
+	/* nothing changed, nothing to evaluate */
+	PLCexec();
+	CHECK(PLCT.n_queue == 0);
+
+	for(k=0;k<NB_CHANGES;k++){
+		seed=seed*1103515245+12345;
+		s=(seed>>16)%NB_SIODS;
+		gpios[s]^=1<<((seed>>8)%8);
+		GSTadd(&GST, 1001+s, gpios[s]);	//updates it once it is in the GST
+
+		/* half way, rules replaced with other conditions and rules deleted */
+		if(k == NB_CHANGES/2){
+			for(r=0;r<NB_RULES;r+=17){
+				make_rule(r, 1, rule);
+				CHECK(PLCadd(rule) == 0);
+				CHECK(old_PLCadd(rule) == 0);
+			}
+			for(r=5;r<NB_RULES;r+=23){
+				sprintf(AAAA1, "%d", 2001+(r/8)%7000);
+				sprintf(X1, "%d", (r/2)%4);
+				sprintf(Y1, "%d", r%2);
+				CHECK(PLCdel(AAAA1, X1, Y1) == old_PLCdel(AAAA1, X1, Y1));
+			}
+		}
+
+		on=0;
+		for(i=0;i<old_PLCT.n;i++) on+=old_PLCT.triggered[i];
+		PLCexec();
+		old_PLCexec(gst_get);
+		for(i=0;i<old_PLCT.n;i++) on-=old_PLCT.triggered[i];
+		if(on < 0) fired-=on;
+
+		if(compare() != 0) bad++;
+	}
+
+	test_quiet(0);
+	CHECK(bad == 0);
+	CHECK(fired > 0);
+	printf("test_plc: %d rules, %d GST changes, %d differences, at least %d rules triggered\n", PLCT.n, NB_CHANGES, bad, fired);
+
+	return TEST_END("test_plc");
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,61 @@
+/*
+ * uci.h
+ *
+ * The part of the libuci API socket_io.c uses, for the host tests: same
+ * names and same layout of the elements. There is no configuration behind
+ * it, every call fails, see uci_stub.c.
+ */
+
+#ifndef _UCI_STUB_H
+#define _UCI_STUB_H
+
+#include <stdbool.h>
+#include <stddef.h>		/* offsetof */
+
+enum { UCI_OK = 0, UCI_ERR_MEM, UCI_ERR_INVAL, UCI_ERR_NOTFOUND };
+
+enum uci_type { UCI_TYPE_UNSPEC = 0, UCI_TYPE_DELTA, UCI_TYPE_PACKAGE, UCI_TYPE_SECTION, UCI_TYPE_OPTION, UCI_TYPE_PATH, UCI_TYPE_BACKEND, UCI_TYPE_ITEM, UCI_TYPE_HOOK };
+enum uci_option_type { UCI_TYPE_STRING = 0, UCI_TYPE_LIST = 1 };
+
+struct uci_list { struct uci_list *next, *prev; };
+struct uci_element { struct uci_list list; enum uci_type type; char *name; };
+struct uci_context { struct uci_list root; char *confdir; char *savedir; int flags; };
+struct uci_package { struct uci_element e; struct uci_list sections; struct uci_context *ctx; bool has_delta; char *path; };
+struct uci_section { struct uci_element e; struct uci_list options; struct uci_package *package; bool anonymous; char *type; };
+struct uci_option {
+	struct uci_element e;
+	struct uci_section *section;
+	enum uci_option_type type;
+	union { struct uci_list list; char *string; } v;
+};
+struct uci_ptr {
+	enum uci_type target;
+	enum { UCI_LOOKUP_DONE = (1 << 0), UCI_LOOKUP_COMPLETE = (1 << 1), UCI_LOOKUP_EXTENDED = (1 << 2) } flags;
+	struct uci_package *p;
+	struct uci_section *s;
+	struct uci_option *o;
+	struct uci_element *last;
+	const char *package, *section, *option, *value;
+};
+
+#define uci_list_to_element(ptr)	((struct uci_element *)((char *)(ptr) - offsetof(struct uci_element, list)))
+#define uci_foreach_element(_list, _ptr) \
+	for (_ptr = uci_list_to_element((_list)->next); &_ptr->list != (_list); _ptr = uci_list_to_element(_ptr->list.next))
+#define uci_to_package(ptr)	((struct uci_package *)(ptr))
+#define uci_to_section(ptr)	((struct uci_section *)(ptr))
+#define uci_to_option(ptr)	((struct uci_option *)(ptr))
+
+struct uci_context * uci_alloc_context(void);
+void uci_free_context(struct uci_context *ctx);
+void uci_perror(struct uci_context *ctx, const char *str);
+int uci_load(struct uci_context *ctx, const char *name, struct uci_package **package);
+int uci_unload(struct uci_context *ctx, struct uci_package *p);
+int uci_lookup_ptr(struct uci_context *ctx, struct uci_ptr *ptr, char *str, bool extended);
+int uci_set(struct uci_context *ctx, struct uci_ptr *ptr);
+int uci_add_list(struct uci_context *ctx, struct uci_ptr *ptr);
+int uci_delete(struct uci_context *ctx, struct uci_ptr *ptr);
+int uci_commit(struct uci_context *ctx, struct uci_package **p, bool overwrite);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
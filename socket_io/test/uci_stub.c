@@ -0,0 +1,23 @@
+/*
+ * uci_stub.c
+ *
+ * libuci without configuration for the host tests, see uci/uci.h: no
+ * context can be allocated, socket_io.c then gives up on every uci call.
+ */
+
+#include <stddef.h>
+
+#include "uci.h"
+
+struct uci_context * uci_alloc_context(void){ return NULL; }
+void uci_free_context(struct uci_context *ctx){ (void)ctx; }
+void uci_perror(struct uci_context *ctx, const char *str){ (void)ctx; (void)str; }
+int uci_load(struct uci_context *ctx, const char *name, struct uci_package **package){ (void)ctx; (void)name; (void)package; return UCI_ERR_NOTFOUND; }
+int uci_unload(struct uci_context *ctx, struct uci_package *p){ (void)ctx; (void)p; return UCI_ERR_INVAL; }
+int uci_lookup_ptr(struct uci_context *ctx, struct uci_ptr *ptr, char *str, bool extended){ (void)ctx; (void)ptr; (void)str; (void)extended; return UCI_ERR_NOTFOUND; }
+int uci_set(struct uci_context *ctx, struct uci_ptr *ptr){ (void)ctx; (void)ptr; return UCI_ERR_INVAL; }
+int uci_add_list(struct uci_context *ctx, struct uci_ptr *ptr){ (void)ctx; (void)ptr; return UCI_ERR_INVAL; }
+int uci_delete(struct uci_context *ctx, struct uci_ptr *ptr){ (void)ctx; (void)ptr; return UCI_ERR_INVAL; }
+int uci_commit(struct uci_context *ctx, struct uci_package **p, bool overwrite){ (void)ctx; (void)p; (void)overwrite; return UCI_ERR_INVAL; }
+
+/* --- EOF ------------------------------------------------------------------ */